@@ -0,0 +1,141 @@
+/*********************************************************/
+/*                                                       */
+/* Choice of the render path of a stimulus by timing     */
+/* each candidate on the screen at startup               */
+/*                                                       */
+/* GPL, of course                                        */
+/*                                                       */
+/*********************************************************/
+
+/* Which path is fastest depends on the size and format of the screen
+   and on whether SDL gave a surface in video memory, where reading
+   back is slow and blits may be done by the card. Rather than guess,
+   every candidate draws real frames of the stimulus into the screen
+   before the main loop starts. The flip is left out, it waits for the
+   display whichever path is taken. */
+
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "SDL.h"
+#include "refresh.h"
+#include "kernels.h"
+#include "autotune.h"
+
+/* most frames timed of each path */
+#define MAX_SAMPLES 64
+
+
+static int CompareDouble(const void *a, const void *b)
+{
+	double d = *(const double *)a - *(const double *)b;
+
+	return( d < 0 ? -1 : d > 0 );
+}
+
+
+/* draw frames for about ms after a warm up frame, at least one, and
+   return the median time of a frame */
+static double TimePath(const RenderPath *p, double ms)
+{
+	double t[MAX_SAMPLES], start, now;
+	int n;
+
+	start = GetTimeMs();
+	p->draw(0);
+	n = 0;
+	now = GetTimeMs();
+	while ( n < MAX_SAMPLES && (n == 0 || now - start < ms) ) {
+		p->draw(n+1);
+		t[n] = GetTimeMs() - now;
+		now += t[n];
+		n++;
+	}
+	qsort(t, n, sizeof(double), CompareDouble);
+	return(t[n/2]);
+}
+
+
+int TunePaths(RenderPath *path, int npaths, SDL_Surface *screen, double frame_ms,
+	      const char *name)
+{
+	const char *kernels;
+	double budget;
+	int i, n, pick, forced;
+
+	forced = -1;
+	if ( name != NULL && strcmp(name, "auto") != 0 ) {
+		for ( i=0; i<npaths && strcmp(path[i].name, name) != 0; i++ );
+		if ( i == npaths ) {
+			fprintf(stderr, "Unknown render path %s, use auto", name);
+			for ( i=0; i<npaths; i++ ) {
+				fprintf(stderr, ", %s", path[i].name);
+			}
+			fprintf(stderr, "\n");
+			return(-1);
+		}
+		if ( path[i].unusable != NULL ) {
+			fprintf(stderr, "The %s path cannot be used: %s\n", name, path[i].unusable);
+			return(-1);
+		}
+		forced = i;
+	}
+
+	n = 0;
+	for ( i=0; i<npaths; i++ ) {
+		path[i].ms = 0;
+		if ( path[i].unusable == NULL && (forced < 0 || i == forced) ) {
+			n++;
+		}
+	}
+	if ( n == 0 ) {
+		fprintf(stderr, "No render path can show this stimulus\n");
+		return(-1);
+	}
+
+	/* the kernels announce themselves when first used, not inside the table */
+	budget = TUNE_HEADROOM*frame_ms;
+	kernels = KernelName();
+	fprintf(stderr, "Render paths on a %dx%d %d bit %s surface with the %s kernels, budget %.2f of %.2f ms:\n",
+		screen->w, screen->h, screen->format->BitsPerPixel,
+		(screen->flags & SDL_HWSURFACE) ? "hardware" : "software", kernels, budget, frame_ms);
+	for ( i=0; i<npaths; i++ ) {
+		if ( forced >= 0 && i != forced ) {
+			continue;
+		}
+		if ( path[i].unusable != NULL ) {
+			fprintf(stderr, "  %-8s %s\n", path[i].name, path[i].unusable);
+		} else {
+			path[i].ms = TimePath(&path[i], (double)TUNE_MS/n);
+			fprintf(stderr, "  %-8s %.3f ms%s\n", path[i].name, path[i].ms,
+				path[i].ms > budget ? ", over budget" : "");
+		}
+	}
+
+	if ( forced >= 0 ) {
+		fprintf(stderr, "Using the %s path given on the command line\n", path[forced].name);
+		if ( path[forced].ms > budget ) {
+			fprintf(stderr, "Warning: the %s path may drop frames\n", path[forced].name);
+		}
+		return(forced);
+	}
+
+	/* the first within the budget, the list is ordered by cost */
+	for ( i=0; i<npaths; i++ ) {
+		if ( path[i].unusable == NULL && path[i].ms <= budget ) {
+			fprintf(stderr, "Using the %s path, the cheapest within the budget\n", path[i].name);
+			return(i);
+		}
+	}
+	pick = -1;
+	for ( i=0; i<npaths; i++ ) {
+		if ( path[i].unusable == NULL && (pick < 0 || path[i].ms < path[pick].ms) ) {
+			pick = i;
+		}
+	}
+	fprintf(stderr, "Warning: no path is within the budget, using the fastest, %s, which may drop frames\n",
+		path[pick].name);
+	return(pick);
+}
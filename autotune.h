@@ -0,0 +1,41 @@
+/*********************************************************/
+/*                                                       */
+/* Choice of the render path of a stimulus by timing     */
+/* each candidate on the screen at startup               */
+/*                                                       */
+/* GPL, of course                                        */
+/*                                                       */
+/*********************************************************/
+
+#ifndef AUTOTUNE_H
+#define AUTOTUNE_H
+
+#include "SDL.h"
+
+/* startup time spent timing all paths together */
+#define TUNE_MS 400
+
+/* fraction of the frame period a path may take, the rest is left to
+   the blit of the sync patch, the flip and the rest of the system */
+#define TUNE_HEADROOM 0.5
+
+/* a way of drawing the frames of one stimulus */
+typedef struct {
+	const char *name;
+	const char *unusable;		/* why the path cannot show the stimulus,
+					   NULL if it can */
+	void (*draw)(int frame);	/* draw frame up to the flip */
+	double ms;			/* median time of a frame, set by
+					   TunePaths, 0 if not timed */
+} RenderPath;
+
+/* The paths are listed by the resources they take, the cheapest first.
+   Times the usable paths on screen for TUNE_MS and picks the first one
+   within TUNE_HEADROOM of frame_ms, or the fastest if none is. A name
+   other than NULL or "auto" forces that path and only times it. Prints
+   the times and the reason for the choice, returns the index of the
+   path or -1 with a message if the forced path is unknown or unusable. */
+int TunePaths(RenderPath *path, int npaths, SDL_Surface *screen, double frame_ms,
+	      const char *name);
+
+#endif
@@ -0,0 +1,330 @@
+/*********************************************************/
+/*                                                       */
+/* Trains of moving bars with anti-aliased edges, drawn  */
+/* only where they were or are now                       */
+/*                                                       */
+/* GPL, of course                                        */
+/*                                                       */
+/*********************************************************/
+
+/* A pixel is treated as a unit square and its coverage by a bar as
+   the area of the square inside it. Across a straight edge that area
+   only depends on the distance of the pixel centre to the edge, and
+   for a given angle it is the integral of a trapezoid, so it is
+   tabulated once at COVERAGE_STEPS entries per pixel of distance.
+   Drawing a pixel is then four table lookups, two for the sides of
+   the bar and two for its ends, and the inside of a bar is filled
+   without any. Each bar covers one span per row, the spans drawn on
+   each page are kept so that the next frame erases only what the bar
+   no longer covers. The cost of a frame is the rows times the width
+   of the bars, however oblique they are. */
+
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+
+#include "SDL.h"
+#include "pixels.h"
+#include "kernels.h"
+#include "bars.h"
+
+
+/* the part of a unit square on the inner side of an edge t pixels
+   outside its centre, for an edge normal with components p >= q */
+static double EdgeCoverage(double t, double p, double q)
+{
+	double a = (p - q)/2, r = (p + q)/2;
+
+	if ( t <= -r ) {
+		return(0);
+	}
+	if ( t >= r ) {
+		return(1);
+	}
+	if ( t < -a ) {
+		return((t + r)*(t + r)/(2*p*q));
+	}
+	if ( t > a ) {
+		return(1 - (r - t)*(r - t)/(2*p*q));
+	}
+	return(0.5 + t/p);
+}
+
+
+/* coverage 0..255 of a pixel t pixels inside an edge */
+static int Cover(const BarTrain *b, double t)
+{
+	if ( t <= -b->reach ) {
+		return(0);
+	}
+	if ( t >= b->reach ) {
+		return(255);
+	}
+	return(b->coverage[(int)((t + b->reach)*COVERAGE_STEPS)]);
+}
+
+
+/* the pixels x of a row with |a + slope*x| < lim, clipped to 0..w */
+static void Interval(double a, double slope, double lim, int w, int *x0, int *x1)
+{
+	double lo, hi, t;
+
+	if ( lim <= 0 || fabs(slope) < 1e-9 ) {
+		*x0 = 0;
+		*x1 = fabs(a) < lim ? w : 0;
+		return;
+	}
+	lo = (-lim - a)/slope;
+	hi = (lim - a)/slope;
+	if ( lo > hi ) {
+		t = lo;
+		lo = hi;
+		hi = t;
+	}
+	lo = ceil(lo);
+	hi = floor(hi) + 1;
+	*x0 = lo < 0 ? 0 : lo > w ? w : (int)lo;
+	*x1 = hi < *x0 ? *x0 : hi > w ? w : (int)hi;
+}
+
+
+/* the pixels of a row within margin of a bar, s and u are where the
+   pixel x = 0 is across and along the bar */
+static void Span(const BarTrain *b, double s, double u, double margin, int *x0, int *x1)
+{
+	int a0, a1;
+
+	Interval(s, b->cosa, b->width/2 + margin, b->w, x0, x1);
+	Interval(u, -b->sina, b->length + margin, b->w, &a0, &a1);
+	if ( a0 > *x0 ) {
+		*x0 = a0;
+	}
+	if ( a1 < *x1 ) {
+		*x1 = a1;
+	}
+	if ( *x1 < *x0 ) {
+		*x1 = *x0;
+	}
+}
+
+
+int InitBars(BarTrain *b, const PixelWriter *pw, int n, double width, double length,
+	     double spacing, double angle, int w, int h, int fore, int back)
+{
+	double p, q;
+	int i;
+
+	memset(b, 0, sizeof(*b));
+	b->cosa = cos(angle);
+	b->sina = sin(angle);
+	p = fabs(b->cosa) > fabs(b->sina) ? fabs(b->cosa) : fabs(b->sina);
+	q = fabs(b->cosa) > fabs(b->sina) ? fabs(b->sina) : fabs(b->cosa);
+	b->reach = (p + q)/2;
+	if ( n < 1 || n > MAX_BARS || width <= 0 || length <= 0 ) {
+		fprintf(stderr, "Bars need a width and length above 0 and a count of 1..%d\n", MAX_BARS);
+		return(0);
+	}
+	/* neighbours never share a pixel, so each is drawn on its own */
+	if ( n > 1 && spacing < width + 2*b->reach ) {
+		fprintf(stderr, "The spacing of the bars must exceed their width by %.1f pixels\n",
+			2*b->reach);
+		return(0);
+	}
+	b->n = n;
+	b->width = width;
+	b->length = length;
+	b->spacing = spacing;
+	b->w = w;
+	b->h = h;
+
+	/* bin i covers the distances (i..i+1)/COVERAGE_STEPS - reach */
+	b->ncov = (int)(2*b->reach*COVERAGE_STEPS) + 2;
+	b->coverage = (Uint8 *)malloc(b->ncov);
+	for ( i=0; i<b->ncov; i++ ) {
+		b->coverage[i] = floor(255*EdgeCoverage((i + 0.5)/COVERAGE_STEPS - b->reach, p, q) + 0.5);
+	}
+	for ( i=0; i<256; i++ ) {
+		b->blend[i] = pw->map[back + ((fore - back)*i + (fore > back ? 127 : -127))/255];
+	}
+
+	for ( i=0; i<2; i++ ) {
+		b->x0[i] = (int *)calloc(n*h, sizeof(int));
+		b->x1[i] = (int *)calloc(n*h, sizeof(int));
+	}
+	b->nx0 = (int *)malloc(n*h*sizeof(int));
+	b->nx1 = (int *)malloc(n*h*sizeof(int));
+	b->nbands = (h + BAR_BAND - 1)/BAR_BAND;
+	/* one more for a sync patch */
+	b->rect = (SDL_Rect *)malloc((n*b->nbands + 1)*sizeof(SDL_Rect));
+	return(1);
+}
+
+
+/* draw the span x0..x1 of a bar on row y, s and u as for Span */
+static void DrawSpan(Uint8 *pixels, int pitch, const PixelWriter *pw, const BarTrain *b,
+		     int y, int x0, int x1, double s, double u)
+{
+	int x, i0, i1, ca, cb;
+	double sx, ux;
+
+	/* the inside needs no coverage */
+	Span(b, s, u, -b->reach, &i0, &i1);
+	if ( i0 < x0 ) {
+		i0 = x0;
+	}
+	if ( i1 > x1 ) {
+		i1 = x1;
+	}
+	if ( i1 <= i0 ) {
+		i0 = i1 = x1;
+	}
+
+	for ( x=x0; x<x1; x++ ) {
+		if ( x == i0 ) {
+			pw->fill(pixels + y*pitch + i0*pw->bpp, b->blend[255], i1 - i0);
+			x = i1;
+			if ( x == x1 ) {
+				break;
+			}
+		}
+		sx = s + x*b->cosa;
+		ux = u - x*b->sina;
+		ca = Cover(b, b->width/2 - sx) - Cover(b, -b->width/2 - sx);
+		cb = Cover(b, b->length - ux) - Cover(b, -b->length - ux);
+		pw->put(pixels, pitch, x, y, b->blend[(ca*cb + 127)/255]);
+	}
+}
+
+
+static void EraseSpan(Uint8 *pixels, int pitch, const PixelWriter *pw, BarTrain *b,
+		      int y, int x0, int x1)
+{
+	if ( x1 > x0 ) {
+		pw->fill(pixels + y*pitch + x0*pw->bpp, b->blend[0], x1 - x0);
+		b->touched += x1 - x0;
+	}
+}
+
+
+/* grow r to hold x0..x1 on row y */
+static void GrowRect(SDL_Rect *r, int *used, int y, int x0, int x1)
+{
+	int rx1;
+
+	if ( x1 <= x0 ) {
+		return;
+	}
+	if ( !*used ) {
+		r->x = x0;
+		r->y = y;
+		r->w = x1 - x0;
+		r->h = 1;
+		*used = 1;
+		return;
+	}
+	rx1 = r->x + r->w;
+	if ( x0 < r->x ) {
+		r->x = x0;
+	}
+	if ( x1 > rx1 ) {
+		rx1 = x1;
+	}
+	r->w = rx1 - r->x;
+	r->h = y + 1 - r->y;
+}
+
+
+void DrawBars(SDL_Surface *surface, const PixelWriter *pw, BarTrain *b, double offset, int page)
+{
+	Uint8 *pixels = (Uint8 *)surface->pixels;
+	int pitch = surface->pitch;
+	int *o0, *o1, *n0, *n1, *t;
+	int k, y, j, used, cleared;
+	double d, cx, cy;
+
+	b->touched = 0;
+	b->nrects = 0;
+	cleared = !b->drawn[page];
+	if ( cleared ) {
+		FillSolid(pixels, pitch, b->w*pw->bpp, b->h, b->blend[0], pw->bpp);
+		memset(b->x0[page], 0, b->n*b->h*sizeof(int));
+		memset(b->x1[page], 0, b->n*b->h*sizeof(int));
+		b->touched = (long)b->w*b->h;
+	}
+
+	/* the new spans, erasing what each bar leaves behind. Bars do
+	   not share pixels, so all are erased before any is drawn. */
+	cx = b->w/2;
+	cy = b->h/2;
+	for ( k=0; k<b->n; k++ ) {
+		d = offset + (k - (b->n - 1)/2.0)*b->spacing;
+		o0 = b->x0[page] + k*b->h;
+		o1 = b->x1[page] + k*b->h;
+		n0 = b->nx0 + k*b->h;
+		n1 = b->nx1 + k*b->h;
+		for ( j=0; j<b->nbands; j++ ) {
+			used = 0;
+			for ( y=j*BAR_BAND; y<b->h && y<(j+1)*BAR_BAND; y++ ) {
+				Span(b, -cx*b->cosa + (y - cy)*b->sina - d, cx*b->sina + (y - cy)*b->cosa,
+				     b->reach, &n0[y], &n1[y]);
+				if ( n1[y] == n0[y] ) {
+					EraseSpan(pixels, pitch, pw, b, y, o0[y], o1[y]);
+				} else {
+					EraseSpan(pixels, pitch, pw, b, y, o0[y], o1[y] < n0[y] ? o1[y] : n0[y]);
+					EraseSpan(pixels, pitch, pw, b, y, o0[y] > n1[y] ? o0[y] : n1[y], o1[y]);
+				}
+				GrowRect(&b->rect[b->nrects], &used, y, o0[y], o1[y]);
+				GrowRect(&b->rect[b->nrects], &used, y, n0[y], n1[y]);
+			}
+			if ( used ) {
+				b->nrects++;
+			}
+		}
+	}
+
+	for ( k=0; k<b->n; k++ ) {
+		d = offset + (k - (b->n - 1)/2.0)*b->spacing;
+		n0 = b->nx0 + k*b->h;
+		n1 = b->nx1 + k*b->h;
+		for ( y=0; y<b->h; y++ ) {
+			if ( n1[y] > n0[y] ) {
+				DrawSpan(pixels, pitch, pw, b, y, n0[y], n1[y],
+					 -cx*b->cosa + (y - cy)*b->sina - d, cx*b->sina + (y - cy)*b->cosa);
+				b->touched += n1[y] - n0[y];
+			}
+		}
+	}
+
+	/* this page now shows the new spans */
+	t = b->x0[page];
+	b->x0[page] = b->nx0;
+	b->nx0 = t;
+	t = b->x1[page];
+	b->x1[page] = b->nx1;
+	b->nx1 = t;
+	b->drawn[page] = 1;
+	if ( cleared ) {
+		b->rect[0].x = 0;
+		b->rect[0].y = 0;
+		b->rect[0].w = b->w;
+		b->rect[0].h = b->h;
+		b->nrects = 1;
+	}
+}
+
+
+void FreeBars(BarTrain *b)
+{
+	int i;
+
+	for ( i=0; i<2; i++ ) {
+		free(b->x0[i]);
+		free(b->x1[i]);
+	}
+	free(b->nx0);
+	free(b->nx1);
+	free(b->rect);
+	free(b->coverage);
+}
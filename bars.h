@@ -0,0 +1,56 @@
+/*********************************************************/
+/*                                                       */
+/* Trains of moving bars with anti-aliased edges, drawn  */
+/* only where they were or are now                       */
+/*                                                       */
+/* GPL, of course                                        */
+/*                                                       */
+/*********************************************************/
+
+#ifndef BARS_H
+#define BARS_H
+
+#include "SDL.h"
+#include "pixels.h"
+
+#define MAX_BARS 64
+
+/* entries of the coverage table per pixel of distance to an edge */
+#define COVERAGE_STEPS 64
+
+/* rows per rectangle of the changed parts */
+#define BAR_BAND 16
+
+typedef struct {
+	int n;			/* bars in the train */
+	double width;		/* of a bar in pixels */
+	double length;		/* half length of a bar */
+	double spacing;		/* between the centres of neighbours */
+	double cosa, sina;	/* direction of motion, across the bars */
+	int w, h;
+	double reach;		/* how far a pixel reaches across an edge */
+	int ncov;
+	Uint8 *coverage;	/* of a pixel by an edge at sub-pixel distances, 0..255 */
+	Uint32 blend[256];	/* pixel of each coverage, back to fore */
+	int *x0[2], *x1[2];	/* span of each bar on each row of a page */
+	int *nx0, *nx1;		/* the spans of the frame being drawn */
+	int drawn[2];		/* whether a page holds bars to erase */
+	int nbands, nrects;
+	SDL_Rect *rect;		/* changed by the last DrawBars, room for one more */
+	long touched;		/* pixels written by the last DrawBars */
+} BarTrain;
+
+/* n bars of width pixels and 2*length long, spacing pixels apart and
+   moving in direction angle (radians) over a w x h screen, in the gray
+   levels fore on back. Returns 0 with a message on error. */
+int InitBars(BarTrain *b, const PixelWriter *pw, int n, double width, double length,
+	     double spacing, double angle, int w, int h, int fore, int back);
+
+/* erase the bars drawn on this page of a locked surface and draw the
+   train with its centre offset pixels from the screen centre. The
+   first call for a page clears all of it. */
+void DrawBars(SDL_Surface *surface, const PixelWriter *pw, BarTrain *b, double offset, int page);
+
+void FreeBars(BarTrain *b);
+
+#endif
@@ -0,0 +1,214 @@
+/*********************************************************/
+/*                                                       */
+/* Luminance calibration of the display, turns wanted    */
+/* luminances into gray levels when tables are built     */
+/*                                                       */
+/* GPL, of course                                        */
+/*                                                       */
+/*********************************************************/
+
+/* A calibration file is either a gamma law
+
+     gamma 2.2 [min max]
+
+   or photometer readings, one "level luminance" pair per line
+   in ascending order of the level, for example
+
+     0 0.4
+     64 9.1
+     128 35.2
+     255 110.3
+
+   The luminance between readings is interpolated linearly, its
+   units do not matter. Lines starting with # are comments. */
+
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+
+#include "SDL.h"
+#include "calibration.h"
+
+/* contrast lost to the black level that is clipped silently */
+#define CONTRAST_TOLERANCE 0.01
+
+/* luminance of each gray level */
+static double lum[NUM_DAC];
+static int have_lum = 0;
+
+
+static void Linear(void)
+{
+	int i;
+
+	for ( i=0; i<NUM_DAC; i++ ) {
+		lum[i] = (double)i/(NUM_DAC-1);
+	}
+	have_lum = 1;
+}
+
+
+int LoadCalibration(const char *file)
+{
+	FILE *f;
+	char line[256], word[32];
+	double level[NUM_DAC], value[NUM_DAC];
+	double gamma, lo, hi, t;
+	int n, k, i, lineno;
+
+	f = fopen(file, "r");
+	if ( f == NULL ) {
+		fprintf(stderr, "Couldn't open calibration file %s\n", file);
+		return(0);
+	}
+	n = 0;
+	gamma = 0;
+	lineno = 0;
+	while ( fgets(line, sizeof(line), f) ) {
+		lineno++;
+		if ( sscanf(line, " %31s", word) != 1 || word[0] == '#' ) {
+			continue;
+		}
+		if ( strcmp(word, "gamma") == 0 ) {
+			lo = 0;
+			hi = 1;
+			if ( sscanf(line, " gamma %lf %lf %lf", &gamma, &lo, &hi) < 1 ||
+			     gamma <= 0 || hi <= lo ) {
+				fprintf(stderr, "%s:%d: expected gamma [min max]\n", file, lineno);
+				fclose(f);
+				return(0);
+			}
+			continue;
+		}
+		if ( n == NUM_DAC || sscanf(line, "%lf %lf", &level[n], &value[n]) != 2 ) {
+			fprintf(stderr, "%s:%d: expected a level and a luminance\n", file, lineno);
+			fclose(f);
+			return(0);
+		}
+		if ( level[n] < 0 || level[n] > NUM_DAC-1 ||
+		     (n > 0 && (level[n] <= level[n-1] || value[n] < value[n-1])) ) {
+			fprintf(stderr, "%s:%d: levels and luminances must increase\n", file, lineno);
+			fclose(f);
+			return(0);
+		}
+		n++;
+	}
+	fclose(f);
+
+	if ( gamma > 0 ) {
+		for ( i=0; i<NUM_DAC; i++ ) {
+			lum[i] = lo + (hi - lo)*pow((double)i/(NUM_DAC-1), gamma);
+		}
+	} else if ( n >= 2 ) {
+		/* flat beyond the first and last reading */
+		k = 0;
+		for ( i=0; i<NUM_DAC; i++ ) {
+			while ( k < n-2 && i > level[k+1] ) {
+				k++;
+			}
+			t = (i - level[k])/(level[k+1] - level[k]);
+			if ( t < 0 ) {
+				t = 0;
+			} else if ( t > 1 ) {
+				t = 1;
+			}
+			lum[i] = value[k] + t*(value[k+1] - value[k]);
+		}
+	} else {
+		fprintf(stderr, "%s: needs a gamma or at least two readings\n", file);
+		return(0);
+	}
+	if ( lum[NUM_DAC-1] <= lum[0] ) {
+		fprintf(stderr, "%s: the luminance does not change with the level\n", file);
+		return(0);
+	}
+	have_lum = 1;
+	fprintf(stderr, "Calibration %s: luminance %g to %g\n", file, lum[0], lum[NUM_DAC-1]);
+	return(1);
+}
+
+
+/* absolute luminance of a fraction of the range */
+static double MeanLuminance(double mean)
+{
+	if ( !have_lum ) {
+		Linear();
+	}
+	return(lum[0] + mean*(lum[NUM_DAC-1] - lum[0]));
+}
+
+
+double CheckContrast(double mean, double contrast)
+{
+	double l, max;
+
+	l = MeanLuminance(mean);
+	if ( mean < 0 || mean > 1 || l <= 0 ) {
+		fprintf(stderr, "The mean must lie above the darkest level and at most 1\n");
+		exit(1);
+	}
+	max = (l - lum[0])/l;
+	if ( (lum[NUM_DAC-1] - l)/l < max ) {
+		max = (lum[NUM_DAC-1] - l)/l;
+	}
+	if ( contrast < 0 ) {
+		contrast = 0;
+	}
+	if ( contrast > max + CONTRAST_TOLERANCE ) {
+		fprintf(stderr, "Warning: contrast %g is out of range at mean %g, using %g\n",
+			contrast, mean, max);
+	}
+	if ( contrast > max ) {
+		contrast = max;
+	}
+	return(contrast);
+}
+
+
+/* first level not darker than l */
+static int LevelAbove(double l)
+{
+	int lo, hi, mid;
+
+	lo = 0;
+	hi = NUM_DAC-1;
+	while ( lo < hi ) {
+		mid = (lo + hi)/2;
+		if ( lum[mid] < l ) {
+			lo = mid + 1;
+		} else {
+			hi = mid;
+		}
+	}
+	return(lo);
+}
+
+
+Uint8 ModulatedLevel(double mean, double contrast, double m)
+{
+	double l;
+	int k;
+
+	l = MeanLuminance(mean)*(1 + contrast*m);
+	k = LevelAbove(l);
+	if ( k > 0 && l - lum[k-1] < lum[k] - l ) {
+		k--;
+	}
+	return((Uint8)k);
+}
+
+
+double ModulatedValue(double mean, double contrast, double m)
+{
+	double l;
+	int k;
+
+	l = MeanLuminance(mean)*(1 + contrast*m);
+	k = LevelAbove(l);
+	if ( k == 0 || l >= lum[k] ) {
+		return(k);
+	}
+	return(k - (lum[k] - l)/(lum[k] - lum[k-1]));
+}
@@ -0,0 +1,33 @@
+/*********************************************************/
+/*                                                       */
+/* Luminance calibration of the display, turns wanted    */
+/* luminances into gray levels when tables are built     */
+/*                                                       */
+/* GPL, of course                                        */
+/*                                                       */
+/*********************************************************/
+
+#ifndef CALIBRATION_H
+#define CALIBRATION_H
+
+#include "SDL.h"
+
+/* number of gray levels of the display */
+#define NUM_DAC 256
+
+/* read a calibration file, returns 0 on error. Without one the
+   luminance is taken to be proportional to the gray level. */
+int LoadCalibration(const char *file);
+
+/* clip the Michelson contrast to what the display can show around
+   a mean given as a fraction 0..1 of its luminance range, warns */
+double CheckContrast(double mean, double contrast);
+
+/* gray level showing mean*(1+contrast*m) for m in -1..1 */
+Uint8 ModulatedLevel(double mean, double contrast, double m);
+
+/* the same as a fractional level 0..255 interpolated between the
+   levels around it, for dithering */
+double ModulatedValue(double mean, double contrast, double m);
+
+#endif
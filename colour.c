@@ -0,0 +1,126 @@
+/*********************************************************/
+/*                                                       */
+/* Modulation directions in colour space, as contrasts   */
+/* of the red, green and blue guns or of the cones       */
+/*                                                       */
+/* GPL, of course                                        */
+/*                                                       */
+/*********************************************************/
+
+/* A cone matrix file has three lines, for example for a CRT
+
+     # red green blue
+     0.1355 0.1786 0.0254   # L
+     0.0386 0.2002 0.0408   # M
+     0.0026 0.0183 0.2480   # S
+
+   with the excitation of each cone by each gun at full output. The
+   gun intensities of a gray background are all the same fraction of
+   their maximum, so the contrast each gun needs for given cone
+   contrasts does not depend on the mean. */
+
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+
+#include "calibration.h"
+#include "colour.h"
+
+/* determinant below which the guns do not span the cone space */
+#define SINGULAR 1e-12
+
+
+int ParseDirection(const char *s, double *v)
+{
+	char extra;
+
+	return(sscanf(s, "%lf,%lf,%lf%c", &v[0], &v[1], &v[2], &extra) == 3);
+}
+
+
+int LoadConeMatrix(const char *file, double cones[3][3])
+{
+	FILE *f;
+	char line[256], word[32];
+	int n, lineno;
+
+	f = fopen(file, "r");
+	if ( f == NULL ) {
+		fprintf(stderr, "Couldn't open cone matrix %s\n", file);
+		return(0);
+	}
+	n = 0;
+	lineno = 0;
+	while ( fgets(line, sizeof(line), f) ) {
+		lineno++;
+		if ( sscanf(line, " %31s", word) != 1 || word[0] == '#' ) {
+			continue;
+		}
+		if ( n == 3 || sscanf(line, "%lf %lf %lf", &cones[n][0], &cones[n][1], &cones[n][2]) != 3 ) {
+			fprintf(stderr, "%s:%d: expected the excitations of one cone by red, green and blue\n",
+				file, lineno);
+			fclose(f);
+			return(0);
+		}
+		n++;
+	}
+	fclose(f);
+	if ( n != 3 ) {
+		fprintf(stderr, "%s: needs a line for each of the L, M and S cones\n", file);
+		return(0);
+	}
+	return(1);
+}
+
+
+int ConeDirection(double cones[3][3], const double *lms, double *rgb)
+{
+	double inv[3][3], d[3], det;
+	int i, j;
+
+	/* the inverse from the cofactors */
+	for ( i=0; i<3; i++ ) {
+		for ( j=0; j<3; j++ ) {
+			inv[j][i] = cones[(i+1)%3][(j+1)%3]*cones[(i+2)%3][(j+2)%3]
+				- cones[(i+1)%3][(j+2)%3]*cones[(i+2)%3][(j+1)%3];
+		}
+	}
+	det = cones[0][0]*inv[0][0] + cones[0][1]*inv[1][0] + cones[0][2]*inv[2][0];
+	if ( fabs(det) < SINGULAR ) {
+		fprintf(stderr, "The cone matrix cannot be inverted\n");
+		return(0);
+	}
+
+	/* the change of the cones on a background of all guns at one */
+	for ( i=0; i<3; i++ ) {
+		d[i] = (cones[i][0] + cones[i][1] + cones[i][2])*lms[i];
+	}
+	for ( i=0; i<3; i++ ) {
+		rgb[i] = (inv[i][0]*d[0] + inv[i][1]*d[1] + inv[i][2]*d[2])/det;
+	}
+	fprintf(stderr, "Cone contrasts %g,%g,%g need gun contrasts %.4f,%.4f,%.4f\n",
+		lms[0], lms[1], lms[2], rgb[0], rgb[1], rgb[2]);
+	return(1);
+}
+
+
+double CheckColourContrast(double mean, double contrast, const double *rgb)
+{
+	double a;
+	int i;
+
+	a = 0;
+	for ( i=0; i<3; i++ ) {
+		if ( fabs(rgb[i]) > a ) {
+			a = fabs(rgb[i]);
+		}
+	}
+	if ( a == 0 ) {
+		fprintf(stderr, "The colour direction must not be zero\n");
+		exit(1);
+	}
+	/* the gun with the largest contrast reaches the limit first */
+	return(CheckContrast(mean, contrast*a)/a);
+}
@@ -0,0 +1,34 @@
+/*********************************************************/
+/*                                                       */
+/* Modulation directions in colour space, as contrasts   */
+/* of the red, green and blue guns or of the cones       */
+/*                                                       */
+/* GPL, of course                                        */
+/*                                                       */
+/*********************************************************/
+
+#ifndef COLOUR_H
+#define COLOUR_H
+
+/* A direction gives the contrast of each gun per unit of contrast of
+   the stimulus: 1,1,1 is a gray modulation, 1,-1,0 drives red and
+   green in antiphase. The guns are taken to share the luminance
+   calibration of calibration.h, scaled to their own maximum. */
+
+/* parse "r,g,b" or "l,m,s" into v, returns 0 on error */
+int ParseDirection(const char *s, double *v);
+
+/* read the cone excitations of each gun at full output, one line per
+   cone L, M and S with the values for red, green and blue. Lines
+   starting with # are comments. Returns 0 on error. */
+int LoadConeMatrix(const char *file, double cones[3][3]);
+
+/* the gun direction giving the cone contrasts lms on a gray
+   background, returns 0 if the matrix cannot be inverted */
+int ConeDirection(double cones[3][3], const double *lms, double *rgb);
+
+/* clip the contrast so that no gun leaves the range of the display,
+   as CheckContrast does for gray */
+double CheckColourContrast(double mean, double contrast, const double *rgb);
+
+#endif
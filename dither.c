@@ -0,0 +1,74 @@
+/*********************************************************/
+/*                                                       */
+/* Spatio-temporal ordered dithering of fractional gray  */
+/* levels for contrasts finer than one level             */
+/*                                                       */
+/* GPL, of course                                        */
+/*                                                       */
+/*********************************************************/
+
+/* The thresholds come from an 8x8 Bayer matrix, which spreads 64
+   steps between two gray levels over each 8x8 block. Every frame all
+   thresholds are advanced by the golden ratio modulo 1. The sequence
+   never repeats and fills the gaps between the 64 steps evenly, so
+   averaged over a block and a few dozen frames the resolution is
+   well beyond 10 bits. */
+
+
+#include <math.h>
+
+#include "SDL.h"
+#include "dither.h"
+
+#define DITHER_STEPS (DITHER_SIZE*DITHER_SIZE)
+
+/* advance of the thresholds per frame */
+#define GOLDEN 0.61803398874989485
+
+static int bayer[DITHER_SIZE][DITHER_SIZE];
+static int have_bayer = 0;
+
+
+static void InitBayer(void)
+{
+	static const int base[2][2] = { { 0, 2 }, { 3, 1 } };
+	int old[DITHER_SIZE][DITHER_SIZE];
+	int x, y, n;
+
+	/* each doubling puts four copies of the matrix side by side */
+	bayer[0][0] = 0;
+	for ( n=1; n<DITHER_SIZE; n*=2 ) {
+		for ( y=0; y<n; y++ ) {
+			for ( x=0; x<n; x++ ) {
+				old[y][x] = bayer[y][x];
+			}
+		}
+		for ( y=0; y<2*n; y++ ) {
+			for ( x=0; x<2*n; x++ ) {
+				bayer[y][x] = 4*old[y%n][x%n] + base[y/n][x/n];
+			}
+		}
+	}
+	have_bayer = 1;
+}
+
+
+void DitherLevels(Uint8 *levels, const float *value, int n, int y, int frame)
+{
+	float threshold[DITHER_SIZE];
+	double shift, t;
+	int x, l;
+
+	if ( !have_bayer ) {
+		InitBayer();
+	}
+	shift = fmod(frame*GOLDEN, 1.0);
+	for ( x=0; x<DITHER_SIZE; x++ ) {
+		t = (bayer[y%DITHER_SIZE][x] + 0.5)/DITHER_STEPS + shift;
+		threshold[x] = (float)(t < 1 ? t : t - 1);
+	}
+	for ( x=0; x<n; x++ ) {
+		l = (int)(value[x] + threshold[x%DITHER_SIZE]);
+		levels[x] = l > 255 ? 255 : l;
+	}
+}
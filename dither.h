@@ -0,0 +1,23 @@
+/*********************************************************/
+/*                                                       */
+/* Spatio-temporal ordered dithering of fractional gray  */
+/* levels for contrasts finer than one level             */
+/*                                                       */
+/* GPL, of course                                        */
+/*                                                       */
+/*********************************************************/
+
+#ifndef DITHER_H
+#define DITHER_H
+
+#include "SDL.h"
+
+/* side of the threshold matrix, rows repeat with this period */
+#define DITHER_SIZE 8
+
+/* round n fractional gray levels 0..255 of screen row y in the
+   given frame. The result only depends on x, y and the frame, so
+   every run shows the same sequence of images. */
+void DitherLevels(Uint8 *levels, const float *value, int n, int y, int frame);
+
+#endif
@@ -0,0 +1,292 @@
+/*********************************************************/
+/*                                                       */
+/* Random dot fields for motion coherence stimuli, kept  */
+/* as arrays of coordinates for SIMD updates             */
+/*                                                       */
+/* GPL, of course                                        */
+/*                                                       */
+/*********************************************************/
+
+/* The coordinates of all dots are kept in separate arrays, so a move
+   is one pass over x and one over y which the AVX2 kernel does eight
+   dots at a time. Dot i ends its life on the frames f with
+   (f + i) % life == 0, so the lifetimes are staggered without
+   keeping an age per dot and a frame only visits the dots which die.
+   Only the squares of the dots are erased and drawn, the rest of the
+   screen is never touched after the first frame. The dots are drawn
+   in bands of rows, sorted by a counting sort each frame, so that
+   erasing and drawing 100k dots walks down the screen instead of
+   jumping across it. */
+
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+
+#include "SDL.h"
+#include "pixels.h"
+#include "kernels.h"
+#include "dots.h"
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__)) && defined(__SSE2__)
+#define HAVE_X86_KERNELS
+#include <immintrin.h>
+#endif
+
+/* move n coordinates by k velocities, wrap them into 0..f and
+   store their pixel positions, at most max */
+typedef void (*MoveFunc)(float *p, const float *v, Sint32 *ip, int n,
+			 float k, float f, Sint32 max);
+
+static MoveFunc move_kernel;
+
+
+static void MoveGeneric(float *p, const float *v, Sint32 *ip, int n,
+			float k, float f, Sint32 max)
+{
+	float q;
+	Sint32 t;
+	int i;
+
+	for ( i=0; i<n; i++ ) {
+		q = p[i] + k*v[i];
+		q -= f*floorf(q/f);
+		p[i] = q;
+		t = (Sint32)q;
+		ip[i] = t > max ? max : t;
+	}
+}
+
+#ifdef HAVE_X86_KERNELS
+
+__attribute__((target("avx2")))
+static void MoveAVX2(float *p, const float *v, Sint32 *ip, int n,
+		     float k, float f, Sint32 max)
+{
+	__m256 q, vk, vf;
+	__m256i vmax;
+	int i;
+
+	vk = _mm256_set1_ps(k);
+	vf = _mm256_set1_ps(f);
+	vmax = _mm256_set1_epi32(max);
+	for ( i=0; i+8<=n; i+=8 ) {
+		q = _mm256_add_ps(_mm256_loadu_ps(p+i), _mm256_mul_ps(vk, _mm256_loadu_ps(v+i)));
+		q = _mm256_sub_ps(q, _mm256_mul_ps(vf, _mm256_floor_ps(_mm256_div_ps(q, vf))));
+		_mm256_storeu_ps(p+i, q);
+		_mm256_storeu_si256((__m256i *)(ip+i),
+				    _mm256_min_epi32(_mm256_cvttps_epi32(q), vmax));
+	}
+	_mm256_zeroupper();
+	MoveGeneric(p+i, v+i, ip+i, n-i, k, f, max);
+}
+
+#endif
+
+
+/* uniform in 0..1 from a xorshift generator */
+static float Uniform(DotField *d)
+{
+	d->random ^= d->random << 13;
+	d->random ^= d->random >> 17;
+	d->random ^= d->random << 5;
+	return((d->random >> 8)*(1.0f/16777216.0f));
+}
+
+
+/* a new dot at a random place, noise dots get a new direction */
+static void Respawn(DotField *d, int i)
+{
+	double a;
+
+	d->x[i] = Uniform(d)*d->fw;
+	d->y[i] = Uniform(d)*d->fh;
+	d->ix[i] = (Sint32)d->x[i] < (Sint32)d->fw - 1 ? (Sint32)d->x[i] : (Sint32)d->fw - 1;
+	d->iy[i] = (Sint32)d->y[i] < (Sint32)d->fh - 1 ? (Sint32)d->y[i] : (Sint32)d->fh - 1;
+	if ( i >= d->nsignal ) {
+		a = 2*M_PI*Uniform(d);
+		d->vx[i] = d->speed*cos(a);
+		d->vy[i] = d->speed*sin(a);
+	}
+}
+
+
+int InitDots(DotField *d, int n, int size, int w, int h, double angle,
+	     double speed, double coherence, int life, Uint32 seed)
+{
+	double a;
+	int i;
+
+	if ( n < 1 || size < 1 || size > w || size > h || life < 0 ||
+	     coherence < 0 || coherence > 1 ) {
+		fprintf(stderr, "Dots need a size within the screen, a lifetime of at least 0 and a coherence of 0..1\n");
+		return(0);
+	}
+	d->n = n;
+	d->nsignal = (int)floor(coherence*n + 0.5);
+	d->size = size;
+	d->life = life;
+	d->speed = speed;
+	/* the whole dot stays on the screen */
+	d->fw = w - size + 1;
+	d->fh = h - size + 1;
+	d->x = (float *)malloc(n*sizeof(float));
+	d->y = (float *)malloc(n*sizeof(float));
+	d->vx = (float *)malloc(n*sizeof(float));
+	d->vy = (float *)malloc(n*sizeof(float));
+	for ( i=0; i<2; i++ ) {
+		d->ox[i] = (Sint32 *)malloc(n*sizeof(Sint32));
+		d->oy[i] = (Sint32 *)malloc(n*sizeof(Sint32));
+		d->drawn[i] = 0;
+	}
+	d->ix = (Sint32 *)malloc(n*sizeof(Sint32));
+	d->iy = (Sint32 *)malloc(n*sizeof(Sint32));
+	d->sx = (Sint32 *)malloc(n*sizeof(Sint32));
+	d->sy = (Sint32 *)malloc(n*sizeof(Sint32));
+	/* bands of at least 16 rows and at least one dot high */
+	for ( d->bandshift=4; (1 << d->bandshift) < size; d->bandshift++ );
+	d->nbands = (h >> d->bandshift) + 1;
+	for ( i=0; i<2; i++ ) {
+		d->band[i] = (int *)malloc((d->nbands+1)*sizeof(int));
+	}
+	d->sband = (int *)malloc((d->nbands+1)*sizeof(int));
+	d->random = seed ? seed : 1;
+
+	a = angle*M_PI/180;
+	for ( i=0; i<n; i++ ) {
+		d->vx[i] = speed*cos(a);
+		d->vy[i] = speed*sin(a);
+		Respawn(d, i);
+	}
+
+	move_kernel = MoveGeneric;
+#ifdef HAVE_X86_KERNELS
+	if ( strcmp(KernelName(), "avx2") == 0 ) {
+		move_kernel = MoveAVX2;
+	}
+#endif
+	MoveDots(d, 0, 0);
+	return(1);
+}
+
+
+void MoveDots(DotField *d, int frames, int frame)
+{
+	int f, i;
+
+	move_kernel(d->x, d->vx, d->ix, d->n, frames, d->fw, (Sint32)d->fw - 1);
+	move_kernel(d->y, d->vy, d->iy, d->n, frames, d->fh, (Sint32)d->fh - 1);
+	if ( d->life == 0 ) {
+		return;
+	}
+	/* after a whole lifetime every dot has been replaced once */
+	if ( frames > d->life ) {
+		frames = d->life;
+	}
+	for ( f=frame-frames+1; f<=frame; f++ ) {
+		for ( i=(d->life - f%d->life)%d->life; i<d->n; i+=d->life ) {
+			Respawn(d, i);
+		}
+	}
+}
+
+
+/* fill the squares of dots from..to-1 with one pixel value */
+static void Squares(SDL_Surface *surface, const PixelWriter *pw, const Sint32 *x,
+		    const Sint32 *y, int from, int to, int size, Uint32 pixel)
+{
+	Uint8 *p;
+	int i, r, c;
+
+	if ( pw->bpp == 4 ) {
+		for ( i=from; i<to; i++ ) {
+			p = (Uint8 *)surface->pixels + y[i]*surface->pitch + 4*x[i];
+			for ( r=0; r<size; r++, p += surface->pitch ) {
+				for ( c=0; c<size; c++ ) {
+					((Uint32 *)p)[c] = pixel;
+				}
+			}
+		}
+		return;
+	}
+	for ( i=from; i<to; i++ ) {
+		p = (Uint8 *)surface->pixels + y[i]*surface->pitch + pw->bpp*x[i];
+		for ( r=0; r<size; r++, p += surface->pitch ) {
+			pw->fill(p, pixel, size);
+		}
+	}
+}
+
+
+void DrawDots(SDL_Surface *surface, const PixelWriter *pw, DotField *d, int page,
+	      Uint32 fore, Uint32 back)
+{
+	Sint32 *t, *old, *oldy;
+	int *band, *oldband;
+	int b, i, j;
+
+	/* counting sort of the new positions into bands of rows */
+	band = d->sband;
+	memset(band, 0, (d->nbands+1)*sizeof(int));
+	for ( i=0; i<d->n; i++ ) {
+		band[(d->iy[i] >> d->bandshift) + 1]++;
+	}
+	for ( b=0; b<d->nbands; b++ ) {
+		band[b+1] += band[b];
+	}
+	for ( i=0; i<d->n; i++ ) {
+		j = band[d->iy[i] >> d->bandshift]++;
+		d->sx[j] = d->ix[i];
+		d->sy[j] = d->iy[i];
+	}
+	memmove(band+1, band, d->nbands*sizeof(int));
+	band[0] = 0;
+
+	/* a new dot in band b can only overlap old ones starting in
+	   bands b-1..b+1, so erasing runs one band ahead of drawing */
+	old = d->ox[page];
+	oldy = d->oy[page];
+	oldband = d->band[page];
+	if ( d->drawn[page] ) {
+		Squares(surface, pw, old, oldy, oldband[0], oldband[1], d->size, back);
+	}
+	for ( b=0; b<d->nbands; b++ ) {
+		if ( d->drawn[page] && b+1 < d->nbands ) {
+			Squares(surface, pw, old, oldy, oldband[b+1], oldband[b+2], d->size, back);
+		}
+		Squares(surface, pw, d->sx, d->sy, band[b], band[b+1], d->size, fore);
+	}
+
+	/* this page now shows the new positions */
+	t = d->ox[page];
+	d->ox[page] = d->sx;
+	d->sx = t;
+	t = d->oy[page];
+	d->oy[page] = d->sy;
+	d->sy = t;
+	d->band[page] = band;
+	d->sband = oldband;
+	d->drawn[page] = 1;
+}
+
+
+void FreeDots(DotField *d)
+{
+	int i;
+
+	for ( i=0; i<2; i++ ) {
+		free(d->ox[i]);
+		free(d->oy[i]);
+		free(d->band[i]);
+	}
+	free(d->x);
+	free(d->y);
+	free(d->vx);
+	free(d->vy);
+	free(d->ix);
+	free(d->iy);
+	free(d->sx);
+	free(d->sy);
+	free(d->sband);
+}
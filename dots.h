@@ -0,0 +1,53 @@
+/*********************************************************/
+/*                                                       */
+/* Random dot fields for motion coherence stimuli, kept  */
+/* as arrays of coordinates for SIMD updates             */
+/*                                                       */
+/* GPL, of course                                        */
+/*                                                       */
+/*********************************************************/
+
+#ifndef DOTS_H
+#define DOTS_H
+
+#include "SDL.h"
+#include "pixels.h"
+
+typedef struct {
+	int n;			/* number of dots */
+	int nsignal;		/* dots 0..nsignal-1 move coherently */
+	int size;		/* side of a dot in pixels */
+	int life;		/* frames a dot lives, 0 forever */
+	float speed;		/* pixels per frame */
+	float fw, fh;		/* the field, dots wrap around at its edges */
+	float *x, *y;		/* positions in pixels */
+	float *vx, *vy;		/* velocities in pixels per frame */
+	Sint32 *ix, *iy;	/* pixel positions after the last move */
+	Sint32 *sx, *sy;	/* the same sorted by bands of rows */
+	int bandshift, nbands;	/* bands of 1 << bandshift rows */
+	int *sband;		/* start of each band in sx, sy */
+	Sint32 *ox[2], *oy[2];	/* sorted pixel positions drawn on each page */
+	int *band[2];		/* and the start of each band */
+	int drawn[2];		/* whether a page holds dots to erase */
+	Uint32 random;		/* state of the respawn generator */
+} DotField;
+
+/* n dots of size pixels on a w x h screen, a fraction coherence of
+   them moving at speed pixels per frame in direction angle (degrees,
+   0 is to the right), the others in random directions. Returns 0 on
+   error. */
+int InitDots(DotField *d, int n, int size, int w, int h, double angle,
+	     double speed, double coherence, int life, Uint32 seed);
+
+/* advance the dots by frames frames, the last being frame, moving
+   dots which end their life to a random place */
+void MoveDots(DotField *d, int frames, int frame);
+
+/* erase the dots drawn on this page of a locked surface and draw them
+   at their new positions, page is 0 without page flipping */
+void DrawDots(SDL_Surface *surface, const PixelWriter *pw, DotField *d, int page,
+	      Uint32 fore, Uint32 back);
+
+void FreeDots(DotField *d);
+
+#endif
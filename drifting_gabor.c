@@ -0,0 +1,336 @@
+/*********************************************************/
+/*                                                       */
+/* Display a drifting grating in a Gaussian or raised    */
+/* cosine window, moved around with the mouse            */
+/* to be used as stimulus in conjunction with the physio */
+/* recording software                                    */
+/*                                                       */
+/* GPL, of course                                        */
+/*                                                       */
+/*********************************************************/
+
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+
+#include "SDL.h"
+#include "refresh.h"
+#include "pixels.h"
+#include "kernels.h"
+#include "calibration.h"
+#include "gabor.h"
+#include "trace.h"
+#include "perfcount.h"
+#include "syncpatch.h"
+
+/* default parameters */
+#define SIZE 200
+#define PERIOD 40
+#define FREQUENCY 1
+#define MEAN 0.5
+#define CONTRAST 1
+
+/* 8 Bit Graphics */
+#define NUM_COLORS	256
+
+SDL_Surface *screen;
+PixelWriter pw;
+PerfCounters perf;
+SyncPatch syncpatch;
+
+/* centre of the patch, follows the mouse */
+int px, py;
+
+SDL_Event redrawEvent, moveEvent;
+
+SDL_Surface *CreateScreen(Uint16 w, Uint16 h, Uint8 bpp, Uint32 flags)
+{
+	SDL_Surface *screen;
+	int i;
+	SDL_Color palette[NUM_COLORS];
+
+	/* Set the video mode */
+	screen = SDL_SetVideoMode(w, h, bpp, flags);
+	if ( screen == NULL ) {
+	  fprintf(stderr, "Couldn't set display mode: %s\n", SDL_GetError());
+	  return(NULL);
+	}
+	fprintf(stderr, "Screen is in %s mode\n", (screen->flags & SDL_FULLSCREEN) ? "fullscreen" : "windowed");
+
+	/* Set a gray colormap */
+	for ( i=0; i<NUM_COLORS; ++i ) {
+		palette[i].r = (NUM_COLORS-1)-i * (256 / NUM_COLORS);
+		palette[i].g = (NUM_COLORS-1)-i * (256 / NUM_COLORS);
+		palette[i].b = (NUM_COLORS-1)-i * (256 / NUM_COLORS);
+	}
+	SDL_SetColors(screen, palette, 0, NUM_COLORS);
+
+	if ( !InitPixelWriter(&pw, screen->format) ) {
+	  return(NULL);
+	}
+	return(screen);
+}
+
+
+int FilterEvents(const SDL_Event *event) {
+
+    if ( event->type == SDL_MOUSEMOTION ) {
+      /* only remember the position, the patch moves on the next frame */
+      px = event->motion.x;
+      py = event->motion.y;
+      SDL_PushEvent(&moveEvent);
+      return(0);
+    }
+    return(1);
+}
+
+Uint32 refreshTimer(Uint32 interval, void *params)
+{
+	TRACE_INSTANT("timer");
+        SDL_PushEvent(&redrawEvent);
+	return interval;
+}
+
+
+
+int main(int argc, char *argv[])
+{
+	Uint32 videoflags;
+	SDL_TimerID refreshTimerID;
+	SDL_Event event;
+	int width, height, bpp;
+	int done;
+	double rate, frame_ms, start_ms, mean;
+	GaborPatch patch;
+	SDL_Rect drawn[2], rects[3];	/* old and new box, sync patch */
+	Uint32 back;
+	int frame, lastframe, moved, page, pages, x, y;
+
+	/* Initialize SDL */
+	if ( SDL_Init(SDL_INIT_VIDEO|SDL_INIT_TIMER) < 0 ) {
+	  fprintf(stderr, "Couldn't initialize SDL: %s\n",SDL_GetError());
+	  exit(1);
+	}
+
+	width = 640;
+	height = 480;
+	bpp = 32;
+	rate = 0;
+	mean = MEAN;
+	patch.angle = 0;
+	patch.period = PERIOD;
+	patch.frequency = FREQUENCY;
+	patch.contrast = CONTRAST;
+	patch.window = GABOR_GAUSS;
+	patch.size = SIZE;
+	patch.sigma = 0;
+	patch.ramp = 0;
+	px = -1;
+	py = -1;
+
+	videoflags =  SDL_DOUBLEBUF|SDL_FULLSCREEN;
+
+	redrawEvent.type = SDL_USEREVENT;
+	redrawEvent.user.code = 1;
+	redrawEvent.user.data1 = NULL;
+	redrawEvent.user.data2 = NULL;
+	moveEvent = redrawEvent;
+	moveEvent.user.code = 2;
+
+	while ( argc > 1 ) {
+	  --argc;
+	  if ( argv[argc-1] && (strcmp(argv[argc-1], "-w") == 0) ) {
+	    width = atoi(argv[argc]);
+	    --argc;
+	  } else if ( argv[argc-1] && (strcmp(argv[argc-1], "-h") == 0) ) {
+	    height = atoi(argv[argc]);
+	    --argc;
+	  } else if ( argv[argc-1] && (strcmp(argv[argc-1], "-x") == 0) ) {
+	    px = atoi(argv[argc]);
+	    --argc;
+	  } else if ( argv[argc-1] && (strcmp(argv[argc-1], "-y") == 0) ) {
+	    py = atoi(argv[argc]);
+	    --argc;
+	  } else if ( argv[argc-1] && (strcmp(argv[argc-1], "-size") == 0) ) {
+	    patch.size = atoi(argv[argc]);
+	    --argc;
+	  } else if ( argv[argc-1] && (strcmp(argv[argc-1], "-sigma") == 0) ) {
+	    patch.sigma = atof(argv[argc]);
+	    --argc;
+	  } else if ( argv[argc-1] && (strcmp(argv[argc-1], "-ramp") == 0) ) {
+	    patch.ramp = atof(argv[argc]);
+	    patch.window = GABOR_COSINE;
+	    --argc;
+	  } else if ( argv[argc-1] && (strcmp(argv[argc-1], "-period") == 0) ) {
+	    patch.period = atof(argv[argc]);
+	    --argc;
+	  } else if ( argv[argc-1] && (strcmp(argv[argc-1], "-angle") == 0) ) {
+	    patch.angle = atof(argv[argc]);
+	    --argc;
+	  } else if ( argv[argc-1] && (strcmp(argv[argc-1], "-freq") == 0) ) {
+	    patch.frequency = atof(argv[argc]);
+	    --argc;
+	  } else if ( argv[argc-1] && (strcmp(argv[argc-1], "-bpp") == 0) ) {
+	    bpp = atoi(argv[argc]);
+	    --argc;
+	  } else if ( argv[argc-1] && (strcmp(argv[argc-1], "-refresh") == 0) ) {
+	    rate = atof(argv[argc]);
+	    --argc;
+	  } else if ( argv[argc-1] && (strcmp(argv[argc-1], "-mean") == 0) ) {
+	    mean = atof(argv[argc]);
+	    --argc;
+	  } else if ( argv[argc-1] && (strcmp(argv[argc-1], "-contrast") == 0) ) {
+	    patch.contrast = atof(argv[argc]);
+	    --argc;
+	  } else if ( argv[argc-1] && (strcmp(argv[argc-1], "-calib") == 0) ) {
+	    if ( !LoadCalibration(argv[argc]) ) {
+	      exit(1);
+	    }
+	    --argc;
+	  } else if ( argv[argc-1] && (strcmp(argv[argc-1], "-sync") == 0) ) {
+	    OpenSyncPatch(&syncpatch, argv[argc]);
+	    --argc;
+	  } else if ( argv[argc] && (strcmp(argv[argc], "-cosine") == 0) ) {
+	    patch.window = GABOR_COSINE;
+	  } else if ( argv[argc] && (strcmp(argv[argc], "-sw") == 0) ) {
+	    videoflags |= SDL_SWSURFACE;
+	  } else if ( argv[argc] && (strcmp(argv[argc], "-hw") == 0) ) {
+	    videoflags |= SDL_HWSURFACE;
+	  } else if ( argv[argc] && (strcmp(argv[argc], "-hwpalette") == 0) ) {
+	    videoflags |= SDL_HWPALETTE;
+	  } else if ( argv[argc] && (strcmp(argv[argc], "-window") == 0) ) {
+	    videoflags ^= SDL_FULLSCREEN;
+	  } else if ( argv[argc] && (strcmp(argv[argc], "-perf") == 0) ) {
+	    PerfOpen(&perf);
+	  } else
+	    {
+	      fprintf(stderr, "Usage: %s [-window] [-bpp #] [-w #] [-h #] [-x #] [-y #] [-size #] [-sigma #] [-cosine] [-ramp #] [-period #] [-angle #] [-freq #] [-mean #] [-contrast #] [-calib file] [-refresh #] [-perf] [-sync luminance|binary]\n", argv[0]);
+	      exit(1);
+	    }
+	}
+
+	/* by default the Gaussian fades out inside the box and the
+	   cosine edge takes the outer quarter on each side */
+	if ( patch.sigma <= 0 ) {
+	  patch.sigma = patch.size/8.0;
+	}
+	if ( patch.ramp <= 0 ) {
+	  patch.ramp = patch.size/4.0;
+	}
+	if ( !InitGabor(&patch, mean) ) {
+	  exit(1);
+	}
+
+	/* Set video mode */
+	screen = CreateScreen(width, height, bpp, videoflags);
+	if ( screen == NULL ) {
+		exit(2);
+	}
+	if ( px < 0 || py < 0 ) {
+	  px = screen->w/2;
+	  py = screen->h/2;
+	}
+
+	/* with page flipping each page keeps the box drawn on it,
+	   otherwise only the changed rectangles are updated */
+	pages = ((screen->flags & SDL_DOUBLEBUF) && (screen->flags & SDL_HWSURFACE)) ? 2 : 1;
+	back = GaborBackground(&pw);
+	for ( page=0; page<pages; page++ ) {
+	  SDL_FillRect(screen, NULL, back);
+	  drawn[page].w = 0;
+	  if ( pages == 2 ) {
+	    SDL_Flip(screen);
+	  }
+	}
+	SDL_UpdateRect(screen, 0, 0, 0, 0);
+	page = 0;
+
+	frame_ms = FramePeriod(screen, rate);
+	SDL_SetEventFilter(FilterEvents);
+	SDL_ShowCursor(SDL_DISABLE);
+
+	refreshTimerID = SDL_AddTimer(FrameTimerInterval(frame_ms), refreshTimer, (void *)screen);
+	start_ms = GetTimeMs();
+	lastframe = -1;
+	moved = 1;
+
+	done = 0;
+	TRACE_BEGIN("wait");
+	while ( !done && SDL_WaitEvent(&event) ) {
+	  TRACE_END("wait");
+	  switch (event.type) {
+	  case SDL_KEYDOWN:
+	    /* Ignore ALT-TAB */
+	    if ( (event.key.keysym.sym == SDLK_LALT) || (event.key.keysym.sym == SDLK_TAB) ) {
+	      break;
+	    }
+	    /* Any key quits */
+	  case SDL_QUIT:
+	    done = 1;
+	    break;
+	  case SDL_USEREVENT:
+	    /* moves are collected and drawn with the next frame */
+	    if ( event.user.code == 2 ) {
+	      moved = 1;
+	      break;
+	    }
+	    frame = FrameIndex(start_ms, frame_ms);
+	    if ( frame == lastframe && !moved ) {
+	      break;
+	    }
+	    if ( patch.frequency == 0 && !moved ) {
+	      break;
+	    }
+	    lastframe = frame;
+	    moved = 0;
+	    x = px;
+	    y = py;
+	    TRACE_BEGIN("lock");
+	    SDL_LockSurface(screen);
+	    TRACE_END("lock");
+	    TRACE_BEGIN("draw");
+	    PerfBegin(&perf);
+	    /* clear the old box on this page, then draw the new one */
+	    rects[0] = drawn[page];
+	    if ( rects[0].w > 0 ) {
+	      FillSolid((Uint8 *)screen->pixels + rects[0].y*screen->pitch + rects[0].x*pw.bpp,
+			screen->pitch, rects[0].w*pw.bpp, rects[0].h, back, pw.bpp);
+	    }
+	    RenderGabor(screen, &pw, x, y, frame*frame_ms/1000);
+	    GaborBox(screen, x, y, &rects[1]);
+	    drawn[page] = rects[1];
+	    SDL_UnlockSurface(screen);
+	    PerfEnd(&perf);
+	    TRACE_END("draw");
+	    ShowSyncPatch(&syncpatch, screen, &pw);
+	    if ( pages == 2 ) {
+	      TRACE_BEGIN("flip");
+	      SDL_Flip(screen);
+	      TRACE_END("flip");
+	      page = 1 - page;
+	    } else if ( rects[0].w > 0 ) {
+	      TRACE_BEGIN("update");
+	      SDL_UpdateRects(screen, SyncRects(&syncpatch, rects, 2), rects);
+	      TRACE_END("update");
+	    } else {
+	      TRACE_BEGIN("update");
+	      SDL_UpdateRects(screen, SyncRects(&syncpatch, &rects[1], 1), &rects[1]);
+	      TRACE_END("update");
+	    }
+	    SyncPresented(&syncpatch, frame);
+	    break;
+	  default:
+	    break;
+	  }
+	  TRACE_BEGIN("wait");
+	}
+	TRACE_END("wait");
+	SDL_RemoveTimer(refreshTimerID);
+	SDL_ShowCursor(SDL_ENABLE);
+	CloseSyncPatch(&syncpatch);
+	PerfReport(&perf);
+	SDL_Quit();
+	return(0);
+}
@@ -16,27 +16,49 @@
 #include <math.h>
 
 #include "SDL.h"
+#include "refresh.h"
+#include "gl_backend.h"
+#include "pixels.h"
+#include "kernels.h"
+#include "calibration.h"
+#include "waveform.h"
+#include "stimuli.h"
+#include "trace.h"
+#include "perfcount.h"
+#include "syncpatch.h"
+#include "frameclock.h"
 
 /* default parameters */
 #define DIAMETER 20
 #define REFRESHINT 80
 #define FREQUENCY 1
+#define MEAN 0.5
+#define CONTRAST 1
 
 /* 8 Bit Graphics */
 #define NUM_COLORS	256
 
 /* wifth and height of the spot */
-int sqsize;
+double sqsize;
+
+/* shift of the board in pixels */
+double xoff, yoff;
 
 /* the blinking frequency */
 double frequency;
 
-/* the spot */
-SDL_Rect grid;
-
 /* back/fore color */
 int back, fore;
 
+/* mean luminance as a fraction of the range and Michelson contrast */
+double mean, contrast;
+
+/* pixel values of the gray levels */
+PixelWriter pw;
+PerfCounters perf;
+SyncPatch syncpatch;
+FrameClock fclock;
+
 SDL_Event redrawEvent;
 
 SDL_Surface *CreateScreen(Uint16 w, Uint16 h, Uint8 bpp, Uint32 flags)
@@ -59,8 +81,65 @@ SDL_Surface *CreateScreen(Uint16 w, Uint16 h, Uint8 bpp, Uint32 flags)
 
 
 
+/* a buffer in the screen format for fast blits */
+SDL_Surface *CreateBuffer(SDL_Surface *screen)
+{
+	SDL_Surface *tmp, *buffer;
+
+	tmp = SDL_CreateRGBSurface(SDL_HWSURFACE|SDL_HWACCEL, screen->w, screen->h, screen->format->BitsPerPixel, 0,0,0,0);
+	if ( tmp == NULL ) {
+	  fprintf(stderr, "Couldn't create buffer: %s\n", SDL_GetError());
+	  return(NULL);
+	}
+	buffer = SDL_DisplayFormat(tmp);
+	SDL_FreeSurface(tmp);
+	if ( buffer == NULL ) {
+	  fprintf(stderr, "Couldn't convert buffer: %s\n", SDL_GetError());
+	}
+	return(buffer);
+}
+
+
+
+/* In palette mode the squares are drawn with the colour indices 0
+   and 1, so reversing the board or changing its contrast only sets
+   two palette entries. c runs from 1 (fore at index 0) to -1. */
+void ContrastLevels(double c, Uint8 *l)
+{
+	int i;
+
+	if ( fore < back ) {
+	  c = -c;
+	}
+	for ( i=0; i<2; i++ ) {
+	  l[i] = ModulatedLevel(mean, contrast, i ? -c : c);
+	}
+}
+
+void SetLevels(SDL_Surface *screen, const Uint8 *l)
+{
+	SDL_Color colors[2];
+	int i;
+
+	for ( i=0; i<2; i++ ) {
+	  colors[i].r = colors[i].g = colors[i].b = l[i];
+	}
+	SDL_SetPalette(screen, SDL_LOGPAL|SDL_PHYSPAL, colors, 0, 2);
+}
+
+void SetContrast(SDL_Surface *screen, double c)
+{
+	Uint8 l[2];
+
+	ContrastLevels(c, l);
+	SetLevels(screen, l);
+}
+
+
+
 Uint32 refreshTimer(Uint32 interval, void *params)
 {
+	TRACE_INSTANT("timer");
         SDL_PushEvent(&redrawEvent);
 	return interval;
 }
@@ -69,16 +148,23 @@ Uint32 refreshTimer(Uint32 interval, void *params)
 
 int main(int argc, char *argv[])
 {
-	SDL_Surface *screen, *buffer1, *buffer2;
-	SDL_PixelFormat *fmt;
+	SDL_Surface *screen, *buffer1 = NULL, *buffer2 = NULL;
 	Uint32 videoflags;
 	SDL_TimerID refreshTimerID;
 	int width, height, bpp, refresh;
 	int done;
-	Uint8 *buffp;
-	Uint32 startTimer, runTimer;
-	int i, j;
 	SDL_Event event;
+	double rate, frame_ms, start_ms, build_ms;
+	int polarity;
+	int usepalette, modulate, frame;
+	Waveform wave;
+	double *m;
+	Uint8 *wavelevel = NULL;
+	int nwave, i;
+	Uint32 pixel[2];
+	int half, step, laststep;
+	int usegl;
+	GLStimParams glparams;
 
 	/* Initialize SDL */
 	if ( SDL_Init(SDL_INIT_VIDEO|SDL_INIT_TIMER) < 0 ) {
@@ -92,13 +178,25 @@ int main(int argc, char *argv[])
 	redrawEvent.user.data2 = NULL;
 
 	sqsize = DIAMETER;
+	xoff = 0;
+	yoff = 0;
 	width = 640;
 	height = 480;
 	bpp = 32;
 	back = 0;
 	fore = 255;
+	mean = MEAN;
+	contrast = CONTRAST;
 	refresh = REFRESHINT;
 	frequency = FREQUENCY;
+	rate = 0;
+	usegl = 0;
+	usepalette = 0;
+	modulate = 0;
+	wave.type = WAVE_SQUARE;
+	wave.duration = WAVE_DURATION;
+	wave.f1 = 0;
+	wave.seed = 1;
 
 	videoflags =  SDL_DOUBLEBUF|SDL_FULLSCREEN;
 
@@ -111,14 +209,57 @@ int main(int argc, char *argv[])
 	    height = atoi(argv[argc]);
 	    --argc;
 	  } else if ( argv[argc-1] && (strcmp(argv[argc-1], "-sqsize") == 0) ) {
-	    sqsize = atoi(argv[argc]);
+	    sqsize = atof(argv[argc]);
+	    --argc;
+	  } else if ( argv[argc-1] && (strcmp(argv[argc-1], "-xoff") == 0) ) {
+	    xoff = atof(argv[argc]);
+	    --argc;
+	  } else if ( argv[argc-1] && (strcmp(argv[argc-1], "-yoff") == 0) ) {
+	    yoff = atof(argv[argc]);
 	    --argc;
 	  } else if ( argv[argc-1] && (strcmp(argv[argc-1], "-freq") == 0) ) {
 	    frequency = atof(argv[argc]);
 	    --argc;
+	  } else if ( argv[argc-1] && (strcmp(argv[argc-1], "-wave") == 0) ) {
+	    wave.type = ParseWaveform(argv[argc]);
+	    usepalette = 1;
+	    modulate = 1;
+	    --argc;
+	  } else if ( argv[argc-1] && (strcmp(argv[argc-1], "-duration") == 0) ) {
+	    wave.duration = atof(argv[argc]);
+	    --argc;
+	  } else if ( argv[argc-1] && (strcmp(argv[argc-1], "-f1") == 0) ) {
+	    wave.f1 = atof(argv[argc]);
+	    --argc;
+	  } else if ( argv[argc-1] && (strcmp(argv[argc-1], "-seed") == 0) ) {
+	    wave.seed = (Uint32)strtoul(argv[argc], NULL, 0);
+	    --argc;
 	  } else if ( argv[argc-1] && (strcmp(argv[argc-1], "-bpp") == 0) ) {
 	    bpp = atoi(argv[argc]);
 	    --argc;
+	  } else if ( argv[argc-1] && (strcmp(argv[argc-1], "-refresh") == 0) ) {
+	    rate = atof(argv[argc]);
+	    --argc;
+	  } else if ( argv[argc-1] && (strcmp(argv[argc-1], "-mean") == 0) ) {
+	    mean = atof(argv[argc]);
+	    --argc;
+	  } else if ( argv[argc-1] && (strcmp(argv[argc-1], "-contrast") == 0) ) {
+	    contrast = atof(argv[argc]);
+	    --argc;
+	  } else if ( argv[argc-1] && (strcmp(argv[argc-1], "-calib") == 0) ) {
+	    if ( !LoadCalibration(argv[argc]) ) {
+	      exit(1);
+	    }
+	    --argc;
+	  } else if ( argv[argc-1] && (strcmp(argv[argc-1], "-leader") == 0) ) {
+	    OpenFrameClock(&fclock, argv[argc], CLOCK_LEADER);
+	    --argc;
+	  } else if ( argv[argc-1] && (strcmp(argv[argc-1], "-follow") == 0) ) {
+	    OpenFrameClock(&fclock, argv[argc], CLOCK_FOLLOWER);
+	    --argc;
+	  } else if ( argv[argc-1] && (strcmp(argv[argc-1], "-sync") == 0) ) {
+	    OpenSyncPatch(&syncpatch, argv[argc]);
+	    --argc;
 	  } else if ( argv[argc] && (strcmp(argv[argc], "-sw") == 0) ) {
 	    videoflags |= SDL_SWSURFACE;
 	  } else if ( argv[argc] && (strcmp(argv[argc], "-i") == 0) ) {
@@ -130,70 +271,135 @@ int main(int argc, char *argv[])
 	    videoflags |= SDL_HWPALETTE;
 	  } else if ( argv[argc] && (strcmp(argv[argc], "-window") == 0) ) {
 	    videoflags ^= SDL_FULLSCREEN;
+	  } else if ( argv[argc] && (strcmp(argv[argc], "-perf") == 0) ) {
+	    PerfOpen(&perf);
+	  } else if ( argv[argc] && (strcmp(argv[argc], "-gl") == 0) ) {
+	    usegl = 1;
+	  } else if ( argv[argc] && (strcmp(argv[argc], "-palette") == 0) ) {
+	    usepalette = 1;
+	  } else if ( argv[argc] && (strcmp(argv[argc], "-sine") == 0) ) {
+	    wave.type = WAVE_SINE;
+	    usepalette = 1;
+	    modulate = 1;
 	  } else 
 	    {
-	      fprintf(stderr, "Usage: %s [-window] [-bpp #] [-w #] [-h #] [-sqsize #] [-i] [-freq #] [-sw] [-hw] [-hwpalette]\n", argv[0]);
+	      fprintf(stderr, "Usage: %s [-window] [-bpp #] [-w #] [-h #] [-sqsize #] [-xoff #] [-yoff #] [-i] [-freq #] [-refresh #] [-mean #] [-contrast #] [-calib file] [-sw] [-hw] [-hwpalette] [-gl] [-palette] [-sine] [-wave square|sine|sawtooth|chirp|noise] [-duration #] [-f1 #] [-seed #] [-perf] [-sync luminance|binary] [-leader name] [-follow name]\n"
+		      "-freq and -f1 are reversals per second, two per cycle of any -wave\n", argv[0]);
 	      exit(1);
 	    }
 	}
+	if ( sqsize < 1 ) {
+	  fprintf(stderr, "The square size must be at least one pixel\n");
+	  exit(1);
+	}
+	if ( usegl && usepalette ) {
+	  fprintf(stderr, "-gl cannot be combined with -palette, -sine or -wave\n");
+	  exit(1);
+	}
+	if ( syncpatch.code != SYNC_NONE && usepalette ) {
+	  fprintf(stderr, "-sync cannot be combined with -palette, -sine or -wave\n");
+	  exit(1);
+	}
+
+	/* fore and back are the calibrated extremes, -i swaps them */
+	contrast = CheckContrast(mean, contrast);
+	polarity = fore > back ? 1 : -1;
+	fore = ModulatedLevel(mean, contrast, polarity);
+	back = ModulatedLevel(mean, contrast, -polarity);
 
 	/* Set video mode */
-	screen = CreateScreen(width, height, bpp, videoflags);
+	if ( usegl ) {
+		screen = CreateGLScreen(width, height, videoflags);
+		if ( screen == NULL || !GLStimInit(GLSTIM_CHECKER) ) {
+			exit(2);
+		}
+		glparams.period = sqsize;
+		glparams.xoff = xoff;
+		glparams.yoff = yoff;
+		glparams.fore = fore/255.0;
+		glparams.back = back/255.0;
+	} else if ( usepalette ) {
+		screen = CreateScreen(width, height, 8, videoflags|SDL_HWPALETTE);
+		if ( screen != NULL && screen->format->palette == NULL ) {
+			fprintf(stderr, "Couldn't get an 8 bit palette mode\n");
+			exit(2);
+		}
+	} else {
+		screen = CreateScreen(width, height, bpp, videoflags);
+	}
 	if ( screen == NULL ) {
 		exit(2);
 	}
 
+	/* reversals happen on whole frames, the sine is sampled on each */
+	frame_ms = ClockPeriod(&fclock, FramePeriod(screen, rate));
+	half = 1;
+	if ( !modulate ) {
+		half = FramesFor(1000/frequency, frame_ms, "reversal period");
+	}
 
-	/* prepare stimulus */
-	fmt = screen->format;
-	bpp = screen->format->BytesPerPixel;
-	buffer1 = SDL_CreateRGBSurface(SDL_HWSURFACE|SDL_HWACCEL, width, height, bpp, 0,0,0,0);
-	buffer1 = SDL_DisplayFormat(buffer1);
-	SDL_LockSurface(buffer1);
-	buffp = (Uint8 *)buffer1->pixels;
-	for ( i=0; i<screen->h/sqsize; i++ ) {
-		for ( j=i%2; j<screen->w/sqsize; j=j+2 ) {
-			grid.x = j*sqsize;
-			grid.y = i*sqsize;
-			grid.w = sqsize;
-			grid.h = sqsize;
-			SDL_FillRect(buffer1, &grid,  SDL_MapRGB(fmt, fore, fore, fore));
-			grid.x = j*sqsize+sqsize;
-			grid.y = i*sqsize+sqsize;
-			grid.w = sqsize;
-			grid.h = sqsize;
-			SDL_FillRect(buffer1, &grid,  SDL_MapRGB(fmt, back, back, back));
+	/* the two palette levels of every frame of the trial. -freq and
+	   -f1 count reversals, two per cycle, for every shape, so -sine
+	   crosses zero where the square wave would reverse */
+	if ( modulate ) {
+		wave.frequency = frequency/2;
+		wave.f1 /= 2;
+		m = SampleWaveform(&wave, frame_ms, &nwave);
+		if ( m == NULL ) {
+			exit(1);
 		}
+		wavelevel = (Uint8 *)malloc(2*nwave);
+		for ( i=0; i<nwave; i++ ) {
+			ContrastLevels(m[i], wavelevel + 2*i);
+		}
+		free(m);
 	}
-	SDL_UnlockSurface(buffer1);
-
-	buffer2 = SDL_CreateRGBSurface(SDL_HWSURFACE|SDL_HWACCEL, width, height, bpp, 0,0,0,0);
-	buffer2 = SDL_DisplayFormat(buffer2);
-	SDL_LockSurface(buffer2);
-	buffp = (Uint8 *)buffer2->pixels;
-	for ( i=0; i<screen->h/sqsize; i++ ) {
-		for ( j=(i+1)%2; j<screen->w/sqsize; j=j+2 ) {
-			grid.x = j*sqsize;
-			grid.y = i*sqsize;
-			grid.w = sqsize;
-			grid.h = sqsize;
-			SDL_FillRect(buffer2, &grid,  SDL_MapRGB(fmt, fore, fore, fore));
-			grid.x = j*sqsize+sqsize;
-			grid.y = i*sqsize+sqsize;
-			grid.w = sqsize;
-			grid.h = sqsize;
-			SDL_FillRect(buffer2, &grid,  SDL_MapRGB(fmt, back, back, back));
+
+	/* prepare stimulus, the shaders need no buffers and the
+	   palette mode draws once into both pages of the screen */
+	if ( usepalette ) {
+		if ( !InitPixelWriter(&pw, screen->format) ) {
+			exit(2);
 		}
+		pixel[0] = 0;
+		pixel[1] = 1;
+		SetContrast(screen, 1);
+		build_ms = GetTimeMs();
+		DrawChecker(screen, &pw, sqsize, xoff, yoff, pixel);
+		if ( screen->flags & SDL_DOUBLEBUF ) {
+			SDL_Flip(screen);
+			DrawChecker(screen, &pw, sqsize, xoff, yoff, pixel);
+		}
+		fprintf(stderr, "Checker board drawn in %.1f ms\n", GetTimeMs() - build_ms);
+	} else if ( !usegl ) {
+		if ( !InitPixelWriter(&pw, screen->format) ) {
+			exit(2);
+		}
+		buffer1 = CreateBuffer(screen);
+		buffer2 = CreateBuffer(screen);
+		if ( buffer1 == NULL || buffer2 == NULL ) {
+			exit(2);
+		}
+		build_ms = GetTimeMs();
+		pixel[0] = pw.map[fore];
+		pixel[1] = pw.map[back];
+		DrawChecker(buffer1, &pw, sqsize, xoff, yoff, pixel);
+		pixel[0] = pw.map[back];
+		pixel[1] = pw.map[fore];
+		DrawChecker(buffer2, &pw, sqsize, xoff, yoff, pixel);
+		fprintf(stderr, "Checker board drawn in %.1f ms\n", GetTimeMs() - build_ms);
 	}
-	SDL_UnlockSurface(buffer2);
 
 	SDL_ShowCursor(SDL_DISABLE);
 
-	refreshTimerID = SDL_AddTimer((int)(1000/frequency), refreshTimer, (void *)screen);
-	runTimer = SDL_GetTicks();
+	refreshTimerID = SDL_AddTimer(FrameTimerInterval(frame_ms), refreshTimer, (void *)screen);
+	start_ms = ClockEpoch(&fclock, GetTimeMs());
+	laststep = -1;
 
 	done = 0;
+	TRACE_BEGIN("wait");
 	while ( !done && SDL_WaitEvent(&event) ) {
+	  TRACE_END("wait");
 	  switch (event.type) {
 	  case SDL_KEYDOWN:
 	    /* Ignore ALT-TAB */
@@ -205,19 +411,81 @@ int main(int argc, char *argv[])
 	    done = 1;
 	    break;
 	  case SDL_USEREVENT:
-	    runTimer = SDL_GetTicks();
-	    if((int)(runTimer/(1000/frequency))%2 == 0) 
+	    if ( ClockStopped(&fclock) ) {
+	      done = 1;
+	      break;
+	    }
+	    frame = FrameIndex(start_ms, frame_ms);
+	    step = frame/half;
+	    if ( step == laststep ) {
+	      break;
+	    }
+	    laststep = step;
+	    if ( usegl ) {
+	      glparams.phase = step%2;
+	      TRACE_BEGIN("draw");
+	      PerfBegin(&perf);
+	      GLStimDraw(&glparams);
+	      PerfEnd(&perf);
+	      TRACE_END("draw");
+	      GLSyncPatch(&syncpatch);
+	      TRACE_BEGIN("swap");
+	      SDL_GL_SwapBuffers();
+	      TRACE_END("swap");
+	      SyncPresented(&syncpatch, frame);
+	      ClockPresented(&fclock, frame, step);
+	      break;
+	    }
+	    if ( modulate ) {
+	      TRACE_BEGIN("palette");
+	      PerfBegin(&perf);
+	      SetLevels(screen, wavelevel + 2*(frame%nwave));
+	      PerfEnd(&perf);
+	      TRACE_END("palette");
+	      TRACE_BEGIN("flip");
+	      SDL_Flip(screen);
+	      TRACE_END("flip");
+	      ClockPresented(&fclock, frame, step);
+	      break;
+	    }
+	    if ( usepalette ) {
+	      TRACE_BEGIN("palette");
+	      PerfBegin(&perf);
+	      SetContrast(screen, step%2 ? -1 : 1);
+	      PerfEnd(&perf);
+	      TRACE_END("palette");
+	      TRACE_BEGIN("flip");
+	      SDL_Flip(screen);
+	      TRACE_END("flip");
+	      ClockPresented(&fclock, frame, step);
+	      break;
+	    }
+	    TRACE_BEGIN("blit");
+	    PerfBegin(&perf);
+	    if(step%2 == 0) 
 	      SDL_BlitSurface(buffer1, NULL, screen, NULL);
 	    else {
 	      SDL_BlitSurface(buffer2, NULL, screen, NULL);
 	    }
+	    PerfEnd(&perf);
+	    TRACE_END("blit");
+	    ShowSyncPatch(&syncpatch, screen, &pw);
+	    TRACE_BEGIN("flip");
 	    SDL_Flip(screen);
+	    TRACE_END("flip");
+	    SyncPresented(&syncpatch, frame);
+	    ClockPresented(&fclock, frame, step);
 	    break;
 	  default:
 	    break;
 	  }
+	  TRACE_BEGIN("wait");
 	}
+	TRACE_END("wait");
 	SDL_ShowCursor(SDL_ENABLE);
+	CloseFrameClock(&fclock);
+	CloseSyncPatch(&syncpatch);
+	PerfReport(&perf);
 	SDL_Quit();
 	return(0);	
 }
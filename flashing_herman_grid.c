@@ -16,28 +16,48 @@
 #include <math.h>
 
 #include "SDL.h"
+#include "refresh.h"
+#include "gl_backend.h"
+#include "pixels.h"
+#include "kernels.h"
+#include "calibration.h"
+#include "waveform.h"
+#include "stimuli.h"
+#include "trace.h"
+#include "perfcount.h"
+#include "syncpatch.h"
 
 /* default parameters */
 #define SQSIZE  30
 #define GAPSIZE 10
 #define REFRESHRATE 30
 #define FREQUENCY 1
+#define MEAN 0.5
+#define CONTRAST 1
 
 /* 8 Bit Graphics */
 #define NUM_COLORS	256
 
 /* wifth and height of the spot */
-int gapsize, sqsize;
+double gapsize, sqsize;
+
+/* shift of the grid in pixels */
+double xoff, yoff;
 
 /* the blinking frequency */
 double frequency;
 
-/* the spot */
-SDL_Rect grid;
-
 /* back/fore color */
 int back, fore;
 
+/* mean luminance as a fraction of the range and Michelson contrast */
+double mean, contrast;
+
+/* pixel values of the gray levels */
+PixelWriter pw;
+PerfCounters perf;
+SyncPatch syncpatch;
+
 SDL_Event redrawEvent;
 
 SDL_Surface *CreateScreen(Uint16 w, Uint16 h, Uint8 bpp, Uint32 flags)
@@ -72,8 +92,43 @@ SDL_Surface *CreateScreen(Uint16 w, Uint16 h, Uint8 bpp, Uint32 flags)
 
 
 
+/* a buffer in the screen format for fast blits */
+SDL_Surface *CreateBuffer(SDL_Surface *screen)
+{
+	SDL_Surface *tmp, *buffer;
+
+	tmp = SDL_CreateRGBSurface(SDL_HWSURFACE|SDL_HWACCEL, screen->w, screen->h, screen->format->BitsPerPixel, 0,0,0,0);
+	if ( tmp == NULL ) {
+	  fprintf(stderr, "Couldn't create buffer: %s\n", SDL_GetError());
+	  return(NULL);
+	}
+	buffer = SDL_DisplayFormat(tmp);
+	SDL_FreeSurface(tmp);
+	if ( buffer == NULL ) {
+	  fprintf(stderr, "Couldn't convert buffer: %s\n", SDL_GetError());
+	}
+	return(buffer);
+}
+
+
+
+/* With a waveform the grid is drawn once with the colour indices 0
+   for the gaps and 1 for the squares, and each frame only sets the
+   palette entry of the squares. */
+void SetSquareLevel(SDL_Surface *screen, Uint8 l)
+{
+	SDL_Color colors[2];
+
+	colors[0].r = colors[0].g = colors[0].b = back;
+	colors[1].r = colors[1].g = colors[1].b = l;
+	SDL_SetPalette(screen, SDL_LOGPAL|SDL_PHYSPAL, colors, 0, 2);
+}
+
+
+
 Uint32 refreshTimer(Uint32 interval, void *params)
 {
+	TRACE_INSTANT("timer");
         SDL_PushEvent(&redrawEvent);
 	return interval;
 }
@@ -82,16 +137,23 @@ Uint32 refreshTimer(Uint32 interval, void *params)
 
 int main(int argc, char *argv[])
 {
-	SDL_Surface *screen, *buffer;
+	SDL_Surface *screen, *buffer = NULL;
 	SDL_PixelFormat *fmt;
 	Uint32 videoflags;
 	SDL_TimerID refreshTimerID;
 	int width, height, bpp, refresh;
 	int done;
-	Uint8 *buffp;
-	Uint32 startTimer, runTimer;
-	int i, j;
 	SDL_Event event;
+	double rate, frame_ms, start_ms, build_ms;
+	int polarity;
+	int half, step, laststep;
+	int usegl;
+	GLStimParams glparams;
+	Uint32 pixel[2];
+	Waveform wave;
+	double *m;
+	Uint8 *wavelevel = NULL;
+	int usewave, nwave, frame, i;
 
 	/* Initialize SDL */
 	if ( SDL_Init(SDL_INIT_VIDEO|SDL_INIT_TIMER) < 0 ) {
@@ -106,13 +168,23 @@ int main(int argc, char *argv[])
 
 	sqsize = SQSIZE;
         gapsize = GAPSIZE;
+	xoff = 0;
+	yoff = 0;
 	width = 640;
 	height = 480;
 	bpp = 32;
 	back = 0;
 	fore = 255;
+	mean = MEAN;
+	contrast = CONTRAST;
 	refresh = REFRESHRATE;
 	frequency = FREQUENCY;
+	rate = 0;
+	usegl = 0;
+	usewave = 0;
+	wave.duration = WAVE_DURATION;
+	wave.f1 = 0;
+	wave.seed = 1;
 
 	videoflags =  SDL_DOUBLEBUF|SDL_FULLSCREEN;
 
@@ -125,17 +197,53 @@ int main(int argc, char *argv[])
 	    height = atoi(argv[argc]);
 	    --argc;
 	  } else if ( argv[argc-1] && (strcmp(argv[argc-1], "-gapsize") == 0) ) {
-	    gapsize = atoi(argv[argc]);
+	    gapsize = atof(argv[argc]);
 	    --argc;
 	  } else if ( argv[argc-1] && (strcmp(argv[argc-1], "-sqsize") == 0) ) {
-	    sqsize = atoi(argv[argc]);
+	    sqsize = atof(argv[argc]);
+	    --argc;
+	  } else if ( argv[argc-1] && (strcmp(argv[argc-1], "-xoff") == 0) ) {
+	    xoff = atof(argv[argc]);
+	    --argc;
+	  } else if ( argv[argc-1] && (strcmp(argv[argc-1], "-yoff") == 0) ) {
+	    yoff = atof(argv[argc]);
 	    --argc;
 	  } else if ( argv[argc-1] && (strcmp(argv[argc-1], "-freq") == 0) ) {
 	    frequency = atof(argv[argc]);
 	    --argc;
+	  } else if ( argv[argc-1] && (strcmp(argv[argc-1], "-wave") == 0) ) {
+	    wave.type = ParseWaveform(argv[argc]);
+	    usewave = 1;
+	    --argc;
+	  } else if ( argv[argc-1] && (strcmp(argv[argc-1], "-duration") == 0) ) {
+	    wave.duration = atof(argv[argc]);
+	    --argc;
+	  } else if ( argv[argc-1] && (strcmp(argv[argc-1], "-f1") == 0) ) {
+	    wave.f1 = atof(argv[argc]);
+	    --argc;
+	  } else if ( argv[argc-1] && (strcmp(argv[argc-1], "-seed") == 0) ) {
+	    wave.seed = (Uint32)strtoul(argv[argc], NULL, 0);
+	    --argc;
 	  } else if ( argv[argc-1] && (strcmp(argv[argc-1], "-bpp") == 0) ) {
 	    bpp = atoi(argv[argc]);
 	    --argc;
+	  } else if ( argv[argc-1] && (strcmp(argv[argc-1], "-refresh") == 0) ) {
+	    rate = atof(argv[argc]);
+	    --argc;
+	  } else if ( argv[argc-1] && (strcmp(argv[argc-1], "-mean") == 0) ) {
+	    mean = atof(argv[argc]);
+	    --argc;
+	  } else if ( argv[argc-1] && (strcmp(argv[argc-1], "-contrast") == 0) ) {
+	    contrast = atof(argv[argc]);
+	    --argc;
+	  } else if ( argv[argc-1] && (strcmp(argv[argc-1], "-calib") == 0) ) {
+	    if ( !LoadCalibration(argv[argc]) ) {
+	      exit(1);
+	    }
+	    --argc;
+	  } else if ( argv[argc-1] && (strcmp(argv[argc-1], "-sync") == 0) ) {
+	    OpenSyncPatch(&syncpatch, argv[argc]);
+	    --argc;
 	  } else if ( argv[argc] && (strcmp(argv[argc], "-sw") == 0) ) {
 	    videoflags |= SDL_SWSURFACE;
 	  } else if ( argv[argc] && (strcmp(argv[argc], "-i") == 0) ) {
@@ -147,45 +255,127 @@ int main(int argc, char *argv[])
 	    videoflags |= SDL_HWPALETTE;
 	  } else if ( argv[argc] && (strcmp(argv[argc], "-window") == 0) ) {
 	    videoflags ^= SDL_FULLSCREEN;
+	  } else if ( argv[argc] && (strcmp(argv[argc], "-perf") == 0) ) {
+	    PerfOpen(&perf);
+	  } else if ( argv[argc] && (strcmp(argv[argc], "-gl") == 0) ) {
+	    usegl = 1;
 	  } else 
 	    {
-	      fprintf(stderr, "Usage: %s [-window] [-bpp #] [-w #] [-h #] [-gapsize #] [-sqsize #] [-i] [-freq #] [-sw] [-hw] [-hwpalette]\n", argv[0]);
+	      fprintf(stderr, "Usage: %s [-window] [-bpp #] [-w #] [-h #] [-gapsize #] [-sqsize #] [-xoff #] [-yoff #] [-i] [-freq #] [-refresh #] [-mean #] [-contrast #] [-calib file] [-sw] [-hw] [-hwpalette] [-gl] [-wave square|sine|sawtooth|chirp|noise] [-duration #] [-f1 #] [-seed #] [-perf] [-sync luminance|binary]\n"
+		      "-freq and -f1 are reversals per second, two per cycle of any -wave\n", argv[0]);
 	      exit(1);
 	    }
 	}
+	if ( sqsize < 1 || gapsize < 0 ) {
+	  fprintf(stderr, "The square size must be at least one pixel and the gap positive\n");
+	  exit(1);
+	}
+	if ( usegl && usewave ) {
+	  fprintf(stderr, "-gl cannot be combined with -wave\n");
+	  exit(1);
+	}
+	if ( syncpatch.code != SYNC_NONE && usewave ) {
+	  fprintf(stderr, "-sync cannot be combined with -wave\n");
+	  exit(1);
+	}
+
+	/* fore and back are the calibrated extremes, -i swaps them */
+	contrast = CheckContrast(mean, contrast);
+	polarity = fore > back ? 1 : -1;
+	fore = ModulatedLevel(mean, contrast, polarity);
+	back = ModulatedLevel(mean, contrast, -polarity);
 
 	/* Set video mode */
-	screen = CreateScreen(width, height, bpp, videoflags);
+	if ( usegl ) {
+		screen = CreateGLScreen(width, height, videoflags);
+		if ( screen == NULL || !GLStimInit(GLSTIM_HERMAN) ) {
+			exit(2);
+		}
+		glparams.period = sqsize;
+		glparams.gap = gapsize;
+		glparams.xoff = xoff;
+		glparams.yoff = yoff;
+		glparams.fore = fore/255.0;
+		glparams.back = back/255.0;
+	} else if ( usewave ) {
+		screen = CreateScreen(width, height, 8, videoflags|SDL_HWPALETTE);
+		if ( screen != NULL && screen->format->palette == NULL ) {
+			fprintf(stderr, "Couldn't get an 8 bit palette mode\n");
+			exit(2);
+		}
+	} else {
+		screen = CreateScreen(width, height, bpp, videoflags);
+	}
 	if ( screen == NULL ) {
 		exit(2);
 	}
-
-	/* prepare stimulus */
 	fmt = screen->format;
-	bpp = screen->format->BytesPerPixel;
-	buffer = SDL_CreateRGBSurface(SDL_HWSURFACE|SDL_HWACCEL, width, height, bpp, 0,0,0,0);
-	buffer = SDL_DisplayFormat(buffer);
-	SDL_LockSurface(buffer);
-	buffp = (Uint8 *)buffer->pixels;
-	SDL_FillRect(buffer, NULL,  SDL_MapRGB(fmt, back, back, back));
-	for ( i=0; i<screen->h/(gapsize+sqsize); i++ ) {
-	  for ( j=0; j<screen->w/(gapsize+sqsize); j++ ) {
-	    grid.x = j*(gapsize+sqsize) + gapsize/2;
-	    grid.y = i*(gapsize+sqsize) + gapsize/2;
-	    grid.w = sqsize;
-	    grid.h = sqsize;
-	    SDL_FillRect(buffer, &grid,  SDL_MapRGB(fmt, fore, fore, fore));
-	  }
+
+	/* reversals happen on whole frames */
+	frame_ms = FramePeriod(screen, rate);
+	half = 1;
+	if ( !usewave ) {
+		half = FramesFor(1000/frequency, frame_ms, "reversal period");
+	}
+
+	/* the level of the squares on every frame of the trial, at -1
+	   they vanish into the gaps like the blank half of the flashing */
+	if ( usewave ) {
+		/* -freq and -f1 count reversals, two per cycle */
+		wave.frequency = frequency/2;
+		wave.f1 /= 2;
+		m = SampleWaveform(&wave, frame_ms, &nwave);
+		if ( m == NULL ) {
+			exit(1);
+		}
+		wavelevel = (Uint8 *)malloc(nwave);
+		for ( i=0; i<nwave; i++ ) {
+			wavelevel[i] = ModulatedLevel(mean, contrast, polarity*m[i]);
+		}
+		free(m);
+	}
+
+	/* prepare stimulus, the shaders need no buffers and the
+	   waveforms draw once into both pages of the screen */
+	if ( usewave ) {
+		if ( !InitPixelWriter(&pw, screen->format) ) {
+			exit(2);
+		}
+		pixel[0] = 0;
+		pixel[1] = 1;
+		SetSquareLevel(screen, fore);
+		build_ms = GetTimeMs();
+		DrawHermanGrid(screen, &pw, sqsize, gapsize, xoff, yoff, pixel);
+		if ( screen->flags & SDL_DOUBLEBUF ) {
+			SDL_Flip(screen);
+			DrawHermanGrid(screen, &pw, sqsize, gapsize, xoff, yoff, pixel);
+		}
+		fprintf(stderr, "Herman grid drawn in %.1f ms\n", GetTimeMs() - build_ms);
+	} else if ( !usegl ) {
+		if ( !InitPixelWriter(&pw, fmt) ) {
+			exit(2);
+		}
+		buffer = CreateBuffer(screen);
+		if ( buffer == NULL ) {
+			exit(2);
+		}
+		build_ms = GetTimeMs();
+		pixel[0] = pw.map[back];
+		pixel[1] = pw.map[fore];
+		DrawHermanGrid(buffer, &pw, sqsize, gapsize, xoff, yoff, pixel);
+		fprintf(stderr, "Herman grid drawn in %.1f ms\n", GetTimeMs() - build_ms);
 	}
-	SDL_UnlockSurface(buffer);
 
 	SDL_ShowCursor(SDL_DISABLE);
 
-	refreshTimerID = SDL_AddTimer((int)(1000/frequency), refreshTimer, (void *)screen);
-	runTimer = SDL_GetTicks();
+	refreshTimerID = SDL_AddTimer(FrameTimerInterval(frame_ms), refreshTimer, (void *)screen);
+	start_ms = GetTimeMs();
+	laststep = -1;
 
 	done = 0;
+	TRACE_BEGIN("wait");
 	while ( !done && SDL_WaitEvent(&event) ) {
+	  TRACE_END("wait");
 	  switch (event.type) {
 	  case SDL_KEYDOWN:
 	    /* Ignore ALT-TAB */
@@ -197,22 +387,63 @@ int main(int argc, char *argv[])
 	    done = 1;
 	    break;
 	  case SDL_USEREVENT:
-	    runTimer = SDL_GetTicks();
-	    if((int)(runTimer/(1000/frequency))%2 == 0) 
+	    frame = FrameIndex(start_ms, frame_ms);
+	    step = frame/half;
+	    if ( step == laststep ) {
+	      break;
+	    }
+	    laststep = step;
+	    if ( usegl ) {
+	      glparams.phase = step%2;
+	      TRACE_BEGIN("draw");
+	      PerfBegin(&perf);
+	      GLStimDraw(&glparams);
+	      PerfEnd(&perf);
+	      TRACE_END("draw");
+	      GLSyncPatch(&syncpatch);
+	      TRACE_BEGIN("swap");
+	      SDL_GL_SwapBuffers();
+	      TRACE_END("swap");
+	      SyncPresented(&syncpatch, frame);
+	      break;
+	    }
+	    if ( usewave ) {
+	      TRACE_BEGIN("palette");
+	      PerfBegin(&perf);
+	      SetSquareLevel(screen, wavelevel[frame%nwave]);
+	      PerfEnd(&perf);
+	      TRACE_END("palette");
+	      TRACE_BEGIN("flip");
+	      SDL_Flip(screen);
+	      TRACE_END("flip");
+	      break;
+	    }
+	    TRACE_BEGIN("blit");
+	    PerfBegin(&perf);
+	    if(step%2 == 0) 
 	      SDL_BlitSurface(buffer, NULL, screen, NULL);
 	    else {
-	      printf(".");
 	      /*	      SDL_LockSurface(screen);*/
 	      SDL_FillRect(screen, NULL, SDL_MapRGB(fmt, back,back,back));
 	      /*SDL_UnlockSurface(screen);*/
 	    }
+	    PerfEnd(&perf);
+	    TRACE_END("blit");
+	    ShowSyncPatch(&syncpatch, screen, &pw);
+	    TRACE_BEGIN("flip");
 	    SDL_Flip(screen);
+	    TRACE_END("flip");
+	    SyncPresented(&syncpatch, frame);
 	    break;
 	  default:
 	    break;
 	  }
+	  TRACE_BEGIN("wait");
 	}
+	TRACE_END("wait");
 	SDL_ShowCursor(SDL_ENABLE);
+	CloseSyncPatch(&syncpatch);
+	PerfReport(&perf);
 	SDL_Quit();
 	return(0);	
 }
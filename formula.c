@@ -0,0 +1,688 @@
+/*********************************************************/
+/*                                                       */
+/* Stimuli given as a formula of the pixel position and  */
+/* time, compiled once and evaluated a block at a time   */
+/*                                                       */
+/* GPL, of course                                        */
+/*                                                       */
+/*********************************************************/
+
+/* The formula is parsed into a tree, folding what is constant. Each
+   node records whether it depends on x, y and t. Only the nodes
+   which vary with x are evaluated per pixel: they are listed with
+   their operands first and each runs one tight loop over a block of
+   FORMULA_BLOCK pixels, so the interpretation costs one switch per
+   node and block. Their operands which do not vary along a row, like
+   a phase of t or a term of y, are evaluated once per row in double
+   precision. A formula without y is rendered as one row replicated
+   down the screen, which is what moving_grating does by hand. */
+
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <ctype.h>
+#include <math.h>
+
+#include "SDL.h"
+#include "pixels.h"
+#include "kernels.h"
+#include "calibration.h"
+#include "formula.h"
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__)) && defined(__SSE2__)
+#define HAVE_X86_KERNELS
+#include <immintrin.h>
+#endif
+
+enum {
+	OP_NUM, OP_X, OP_Y, OP_T,
+	OP_ADD, OP_SUB, OP_MUL, OP_DIV, OP_POW, OP_LT, OP_GT,
+	OP_NEG, OP_SIN, OP_COS, OP_EXP, OP_SQRT, OP_ABS, OP_FLOOR,
+	OP_MIN, OP_MAX, OP_ATAN2, OP_MOD,
+	OP_RAMP		/* a[0], a[0] + 1, ... for the x of a block */
+};
+
+static const struct {
+	const char *name;
+	int op, args;
+} functions[] = {
+	{ "sin", OP_SIN, 1 }, { "cos", OP_COS, 1 }, { "exp", OP_EXP, 1 },
+	{ "sqrt", OP_SQRT, 1 }, { "abs", OP_ABS, 1 }, { "floor", OP_FLOOR, 1 },
+	{ "min", OP_MIN, 2 }, { "max", OP_MAX, 2 }, { "atan2", OP_ATAN2, 2 },
+	{ "pow", OP_POW, 2 }, { "mod", OP_MOD, 2 }
+};
+
+
+/* Cody-Waite reduction by pi to -pi/2..pi/2 and the Taylor series
+   to r^11, the error is below float rounding */
+#define PI_HI 3.140625f
+#define PI_LO 9.67653589793e-4f
+#define S3 -1.66666667e-1f
+#define S5 8.33333333e-3f
+#define S7 -1.98412698e-4f
+#define S9 2.75573192e-6f
+#define S11 -2.50521084e-8f
+
+static float Sin(float x)
+{
+	float k, r, r2, s;
+
+	k = floorf(x*(float)(1/M_PI) + 0.5f);
+	r = x - k*PI_HI;
+	r -= k*PI_LO;
+	r2 = r*r;
+	s = r + r*r2*(S3 + r2*(S5 + r2*(S7 + r2*(S9 + r2*S11))));
+	return( ((int)k & 1) ? -s : s );
+}
+
+
+/* the operation op on n values of a and b into d */
+typedef void (*OpFunc)(int op, float *d, const float *a, const float *b, int n);
+
+/* gray levels of n values */
+typedef void (*QuantizeFunc)(Uint8 *levels, const float *v, int n, const Uint8 *table);
+
+static OpFunc op_kernel;
+static QuantizeFunc quantize_kernel;
+
+
+static void OpGeneric(int op, float *d, const float *a, const float *b, int n)
+{
+	int i;
+
+	switch ( op ) {
+	case OP_ADD:
+		for ( i=0; i<n; i++ ) d[i] = a[i] + b[i];
+		break;
+	case OP_SUB:
+		for ( i=0; i<n; i++ ) d[i] = a[i] - b[i];
+		break;
+	case OP_MUL:
+		for ( i=0; i<n; i++ ) d[i] = a[i] * b[i];
+		break;
+	case OP_DIV:
+		for ( i=0; i<n; i++ ) d[i] = a[i] / b[i];
+		break;
+	case OP_POW:
+		for ( i=0; i<n; i++ ) d[i] = powf(a[i], b[i]);
+		break;
+	case OP_LT:
+		for ( i=0; i<n; i++ ) d[i] = a[i] < b[i] ? 1 : 0;
+		break;
+	case OP_GT:
+		for ( i=0; i<n; i++ ) d[i] = a[i] > b[i] ? 1 : 0;
+		break;
+	case OP_NEG:
+		for ( i=0; i<n; i++ ) d[i] = -a[i];
+		break;
+	case OP_SIN:
+		for ( i=0; i<n; i++ ) d[i] = Sin(a[i]);
+		break;
+	case OP_COS:
+		for ( i=0; i<n; i++ ) d[i] = Sin(a[i] + (float)(M_PI/2));
+		break;
+	case OP_EXP:
+		for ( i=0; i<n; i++ ) d[i] = expf(a[i]);
+		break;
+	case OP_SQRT:
+		for ( i=0; i<n; i++ ) d[i] = sqrtf(a[i]);
+		break;
+	case OP_ABS:
+		for ( i=0; i<n; i++ ) d[i] = fabsf(a[i]);
+		break;
+	case OP_FLOOR:
+		for ( i=0; i<n; i++ ) d[i] = floorf(a[i]);
+		break;
+	case OP_MIN:
+		for ( i=0; i<n; i++ ) d[i] = a[i] < b[i] ? a[i] : b[i];
+		break;
+	case OP_MAX:
+		for ( i=0; i<n; i++ ) d[i] = a[i] > b[i] ? a[i] : b[i];
+		break;
+	case OP_ATAN2:
+		for ( i=0; i<n; i++ ) d[i] = atan2f(a[i], b[i]);
+		break;
+	case OP_MOD:
+		for ( i=0; i<n; i++ ) d[i] = a[i] - b[i]*floorf(a[i]/b[i]);
+		break;
+	case OP_RAMP:
+		for ( i=0; i<n; i++ ) d[i] = a[0] + i;
+		break;
+	}
+}
+
+
+static void QuantizeGeneric(Uint8 *levels, const float *v, int n, const Uint8 *table)
+{
+	float m;
+	int i;
+
+	for ( i=0; i<n; i++ ) {
+		/* NaN, from sqrt(-1) say, goes to -1 as in _mm256_max_ps */
+		m = v[i];
+		if ( !(m >= -1) ) {
+			m = -1;
+		} else if ( m > 1 ) {
+			m = 1;
+		}
+		levels[i] = table[(int)((m + 1)*(FORMULA_STEPS/2) + 0.5f)];
+	}
+}
+
+#ifdef HAVE_X86_KERNELS
+
+__attribute__((target("avx2")))
+static __m256 SinAVX2(__m256 x)
+{
+	__m256 k, r, r2, s;
+	__m256i sign;
+
+	k = _mm256_round_ps(_mm256_mul_ps(x, _mm256_set1_ps((float)(1/M_PI))),
+			    _MM_FROUND_TO_NEAREST_INT|_MM_FROUND_NO_EXC);
+	r = _mm256_sub_ps(x, _mm256_mul_ps(k, _mm256_set1_ps(PI_HI)));
+	r = _mm256_sub_ps(r, _mm256_mul_ps(k, _mm256_set1_ps(PI_LO)));
+	r2 = _mm256_mul_ps(r, r);
+	s = _mm256_add_ps(_mm256_set1_ps(S9), _mm256_mul_ps(r2, _mm256_set1_ps(S11)));
+	s = _mm256_add_ps(_mm256_set1_ps(S7), _mm256_mul_ps(r2, s));
+	s = _mm256_add_ps(_mm256_set1_ps(S5), _mm256_mul_ps(r2, s));
+	s = _mm256_add_ps(_mm256_set1_ps(S3), _mm256_mul_ps(r2, s));
+	s = _mm256_add_ps(r, _mm256_mul_ps(_mm256_mul_ps(r, r2), s));
+	/* odd multiples of pi flip the sign */
+	sign = _mm256_slli_epi32(_mm256_cvtps_epi32(k), 31);
+	return(_mm256_xor_ps(s, _mm256_castsi256_ps(sign)));
+}
+
+/* one loop per operation, the switch is outside of them */
+#define LOOP1(expr) \
+	for ( i=0; i+8<=n; i+=8 ) { \
+		va = _mm256_loadu_ps(a+i); \
+		_mm256_storeu_ps(d+i, expr); \
+	} \
+	break
+#define LOOP2(expr) \
+	for ( i=0; i+8<=n; i+=8 ) { \
+		va = _mm256_loadu_ps(a+i); \
+		vb = _mm256_loadu_ps(b+i); \
+		_mm256_storeu_ps(d+i, expr); \
+	} \
+	break
+
+__attribute__((target("avx2")))
+static void OpAVX2(int op, float *d, const float *a, const float *b, int n)
+{
+	__m256 va, vb, one, signbit, half_pi, step;
+	int i;
+
+	one = _mm256_set1_ps(1);
+	signbit = _mm256_set1_ps(-0.0f);
+	half_pi = _mm256_set1_ps((float)(M_PI/2));
+	i = 0;
+	switch ( op ) {
+	case OP_ADD: LOOP2(_mm256_add_ps(va, vb));
+	case OP_SUB: LOOP2(_mm256_sub_ps(va, vb));
+	case OP_MUL: LOOP2(_mm256_mul_ps(va, vb));
+	case OP_DIV: LOOP2(_mm256_div_ps(va, vb));
+	case OP_LT: LOOP2(_mm256_and_ps(_mm256_cmp_ps(va, vb, _CMP_LT_OQ), one));
+	case OP_GT: LOOP2(_mm256_and_ps(_mm256_cmp_ps(va, vb, _CMP_GT_OQ), one));
+	case OP_NEG: LOOP1(_mm256_xor_ps(va, signbit));
+	case OP_SIN: LOOP1(SinAVX2(va));
+	case OP_COS: LOOP1(SinAVX2(_mm256_add_ps(va, half_pi)));
+	case OP_SQRT: LOOP1(_mm256_sqrt_ps(va));
+	case OP_ABS: LOOP1(_mm256_andnot_ps(signbit, va));
+	case OP_FLOOR: LOOP1(_mm256_floor_ps(va));
+	case OP_MIN: LOOP2(_mm256_min_ps(va, vb));
+	case OP_MAX: LOOP2(_mm256_max_ps(va, vb));
+	case OP_MOD: LOOP2(_mm256_sub_ps(va, _mm256_mul_ps(vb, _mm256_floor_ps(_mm256_div_ps(va, vb)))));
+	case OP_RAMP:
+		va = _mm256_add_ps(_mm256_set1_ps(a[0]), _mm256_setr_ps(0, 1, 2, 3, 4, 5, 6, 7));
+		step = _mm256_set1_ps(8);
+		for ( i=0; i+8<=n; i+=8 ) {
+			_mm256_storeu_ps(d+i, va);
+			va = _mm256_add_ps(va, step);
+		}
+		_mm256_zeroupper();
+		for ( ; i<n; i++ ) {
+			d[i] = a[0] + i;
+		}
+		return;
+	}
+	_mm256_zeroupper();
+	/* the rest, and pow, exp and atan2 left to the C library */
+	OpGeneric(op, d+i, a+i, b ? b+i : NULL, n-i);
+}
+
+__attribute__((target("avx2")))
+static void QuantizeAVX2(Uint8 *levels, const float *v, int n, const Uint8 *table)
+{
+	__m256 m, lo, hi, scale;
+	__m256i l;
+	Sint32 four;
+	int i;
+
+	lo = _mm256_set1_ps(-1);
+	hi = _mm256_set1_ps(1);
+	scale = _mm256_set1_ps(FORMULA_STEPS/2);
+	for ( i=0; i+8<=n; i+=8 ) {
+		m = _mm256_min_ps(_mm256_max_ps(_mm256_loadu_ps(v+i), lo), hi);
+		m = _mm256_mul_ps(_mm256_add_ps(m, hi), scale);
+		/* gather four bytes from each index, the table is padded,
+		   and pack the first of each down to bytes */
+		l = _mm256_i32gather_epi32((const int *)table, _mm256_cvtps_epi32(m), 1);
+		l = _mm256_and_si256(l, _mm256_set1_epi32(0xff));
+		l = _mm256_packus_epi32(l, l);
+		l = _mm256_packus_epi16(l, l);
+		four = _mm_cvtsi128_si32(_mm256_castsi256_si128(l));
+		memcpy(levels+i, &four, 4);
+		four = _mm_cvtsi128_si32(_mm256_extracti128_si256(l, 1));
+		memcpy(levels+i+4, &four, 4);
+	}
+	_mm256_zeroupper();
+	QuantizeGeneric(levels+i, v+i, n-i, table);
+}
+
+#endif
+
+
+
+/* value of node n at x, y, t in double precision */
+static double Eval(const Formula *f, int n, double x, double y, double t)
+{
+	const FormulaNode *p = &f->node[n];
+	double a, b;
+
+	switch ( p->op ) {
+	case OP_NUM: return(p->value);
+	case OP_X: return(x);
+	case OP_Y: return(y);
+	case OP_T: return(t);
+	}
+	a = Eval(f, p->a, x, y, t);
+	b = p->b >= 0 ? Eval(f, p->b, x, y, t) : 0;
+	switch ( p->op ) {
+	case OP_ADD: return(a + b);
+	case OP_SUB: return(a - b);
+	case OP_MUL: return(a * b);
+	case OP_DIV: return(a / b);
+	case OP_POW: return(pow(a, b));
+	case OP_LT: return(a < b ? 1 : 0);
+	case OP_GT: return(a > b ? 1 : 0);
+	case OP_NEG: return(-a);
+	case OP_SIN: return(sin(a));
+	case OP_COS: return(cos(a));
+	case OP_EXP: return(exp(a));
+	case OP_SQRT: return(sqrt(a));
+	case OP_ABS: return(fabs(a));
+	case OP_FLOOR: return(floor(a));
+	case OP_MIN: return(a < b ? a : b);
+	case OP_MAX: return(a > b ? a : b);
+	case OP_ATAN2: return(atan2(a, b));
+	case OP_MOD: return(a - b*floor(a/b));
+	}
+	return(0);
+}
+
+
+
+/* the recursive descent parser */
+typedef struct {
+	Formula *f;
+	const char *text, *p;
+	char *const *names;
+	const double *values;
+	int nparams;
+	int error;
+} Parser;
+
+static int Compare(Parser *ps);
+
+static void Error(Parser *ps, const char *what)
+{
+	if ( !ps->error ) {
+		fprintf(stderr, "Formula error at column %d: %s\n",
+			(int)(ps->p - ps->text) + 1, what);
+	}
+	ps->error = 1;
+}
+
+/* skip blanks, then is the next character c */
+static int Next(Parser *ps, char c)
+{
+	while ( isspace((unsigned char)*ps->p) ) {
+		ps->p++;
+	}
+	return( *ps->p == c );
+}
+
+/* a new node, constant if its operands are */
+static int Node(Parser *ps, int op, int a, int b, double value)
+{
+	static const int deps[] = { 0, FORMULA_X, FORMULA_Y, FORMULA_T };
+	Formula *f = ps->f;
+	FormulaNode *n;
+
+	if ( ps->error ) {
+		return(0);
+	}
+	if ( f->nnodes == MAX_FORMULA_NODES ) {
+		Error(ps, "too long");
+		return(0);
+	}
+	n = &f->node[f->nnodes];
+	n->op = op;
+	n->a = a;
+	n->b = b;
+	n->value = value;
+	n->slot = NULL;
+	n->dep = op <= OP_T ? deps[op] : f->node[a].dep | (b >= 0 ? f->node[b].dep : 0);
+	/* dividing by a constant is multiplying by its inverse */
+	if ( op == OP_DIV && f->node[b].op == OP_NUM ) {
+		n->op = OP_MUL;
+		f->node[b].value = 1/f->node[b].value;
+	}
+	if ( op > OP_T && n->dep == 0 ) {
+		n->value = Eval(f, f->nnodes, 0, 0, 0);
+		n->op = OP_NUM;
+		n->a = n->b = -1;
+	}
+	return(f->nnodes++);
+}
+
+static int Atom(Parser *ps)
+{
+	char name[32];
+	const char *start;
+	char *end;
+	double v;
+	int i, a, b, len;
+
+	if ( Next(ps, '(') ) {
+		ps->p++;
+		a = Compare(ps);
+		if ( !Next(ps, ')') ) {
+			Error(ps, "missing )");
+			return(0);
+		}
+		ps->p++;
+		return(a);
+	}
+	start = ps->p;
+	if ( isdigit((unsigned char)*start) || *start == '.' ) {
+		v = strtod(start, &end);
+		ps->p = end;
+		return(Node(ps, OP_NUM, -1, -1, v));
+	}
+	if ( !isalpha((unsigned char)*start) ) {
+		Error(ps, "expected a number, name or (");
+		return(0);
+	}
+	while ( isalnum((unsigned char)*ps->p) || *ps->p == '_' ) {
+		ps->p++;
+	}
+	len = ps->p - start;
+	if ( len >= (int)sizeof(name) ) {
+		Error(ps, "name too long");
+		return(0);
+	}
+	memcpy(name, start, len);
+	name[len] = '\0';
+	for ( i=0; i<(int)(sizeof(functions)/sizeof(functions[0])); i++ ) {
+		if ( strcmp(name, functions[i].name) != 0 ) {
+			continue;
+		}
+		if ( !Next(ps, '(') ) {
+			Error(ps, "missing ( after function");
+			return(0);
+		}
+		ps->p++;
+		a = Compare(ps);
+		b = -1;
+		if ( functions[i].args == 2 ) {
+			if ( !Next(ps, ',') ) {
+				Error(ps, "missing second argument");
+				return(0);
+			}
+			ps->p++;
+			b = Compare(ps);
+		}
+		if ( !Next(ps, ')') ) {
+			Error(ps, "missing )");
+			return(0);
+		}
+		ps->p++;
+		return(Node(ps, functions[i].op, a, b, 0));
+	}
+	/* parameters hide the variables */
+	for ( i=0; i<ps->nparams; i++ ) {
+		if ( strcmp(name, ps->names[i]) == 0 ) {
+			return(Node(ps, OP_NUM, -1, -1, ps->values[i]));
+		}
+	}
+	if ( strcmp(name, "x") == 0 ) {
+		return(Node(ps, OP_X, -1, -1, 0));
+	} else if ( strcmp(name, "y") == 0 ) {
+		return(Node(ps, OP_Y, -1, -1, 0));
+	} else if ( strcmp(name, "t") == 0 ) {
+		return(Node(ps, OP_T, -1, -1, 0));
+	} else if ( strcmp(name, "pi") == 0 ) {
+		return(Node(ps, OP_NUM, -1, -1, M_PI));
+	}
+	ps->p = start;
+	Error(ps, "unknown name");
+	return(0);
+}
+
+static int Unary(Parser *ps);
+
+static int Power(Parser *ps)
+{
+	int a;
+
+	a = Atom(ps);
+	if ( Next(ps, '^') ) {
+		ps->p++;
+		a = Node(ps, OP_POW, a, Unary(ps), 0);
+	}
+	return(a);
+}
+
+static int Unary(Parser *ps)
+{
+	if ( Next(ps, '-') ) {
+		ps->p++;
+		return(Node(ps, OP_NEG, Unary(ps), -1, 0));
+	}
+	return(Power(ps));
+}
+
+static int Product(Parser *ps)
+{
+	int a, op;
+
+	a = Unary(ps);
+	while ( !ps->error && (Next(ps, '*') || Next(ps, '/')) ) {
+		op = *ps->p++ == '*' ? OP_MUL : OP_DIV;
+		a = Node(ps, op, a, Unary(ps), 0);
+	}
+	return(a);
+}
+
+static int Sum(Parser *ps)
+{
+	int a, op;
+
+	a = Product(ps);
+	while ( !ps->error && (Next(ps, '+') || Next(ps, '-')) ) {
+		op = *ps->p++ == '+' ? OP_ADD : OP_SUB;
+		a = Node(ps, op, a, Product(ps), 0);
+	}
+	return(a);
+}
+
+static int Compare(Parser *ps)
+{
+	int a, op;
+
+	a = Sum(ps);
+	if ( !ps->error && (Next(ps, '<') || Next(ps, '>')) ) {
+		op = *ps->p++ == '<' ? OP_LT : OP_GT;
+		a = Node(ps, op, a, Sum(ps), 0);
+	}
+	return(a);
+}
+
+
+
+/* list the nodes varying with x, operands first, and their operands
+   which are constant along a row */
+static void Schedule(Formula *f, int n)
+{
+	FormulaNode *p = &f->node[n];
+	int i, k, operand[2];
+
+	if ( p->slot != NULL ) {
+		return;
+	}
+	operand[0] = p->a;
+	operand[1] = p->b;
+	for ( i=0; i<2; i++ ) {
+		k = operand[i];
+		if ( k < 0 ) {
+			continue;
+		}
+		if ( f->node[k].dep & FORMULA_X ) {
+			Schedule(f, k);
+		} else if ( f->node[k].slot == NULL ) {
+			f->node[k].slot = f->slots + (f->ncode + f->nuniform)*FORMULA_BLOCK;
+			f->uniform[f->nuniform++] = k;
+		}
+	}
+	p->slot = f->slots + (f->ncode + f->nuniform)*FORMULA_BLOCK;
+	f->code[f->ncode++] = n;
+}
+
+
+int CompileFormula(Formula *f, const char *text, int w, char *const *names,
+		   const double *values, int nparams)
+{
+	Parser ps;
+
+	ps.f = f;
+	ps.text = ps.p = text;
+	ps.names = names;
+	ps.values = values;
+	ps.nparams = nparams;
+	ps.error = 0;
+	f->nnodes = 0;
+	f->root = Compare(&ps);
+	if ( !ps.error && !Next(&ps, '\0') ) {
+		Error(&ps, "unexpected text");
+	}
+	if ( ps.error ) {
+		return(0);
+	}
+	f->dep = f->node[f->root].dep;
+
+	/* at most one slot per node */
+	f->slots = (float *)malloc(f->nnodes*FORMULA_BLOCK*sizeof(float));
+	f->ncode = 0;
+	f->nuniform = 0;
+	if ( f->dep & FORMULA_X ) {
+		Schedule(f, f->root);
+	}
+	f->w = w;
+	f->levels = (Uint8 *)malloc(w);
+	f->row = (Uint8 *)malloc(w*4);
+
+	op_kernel = OpGeneric;
+	quantize_kernel = QuantizeGeneric;
+#ifdef HAVE_X86_KERNELS
+	if ( strcmp(KernelName(), "avx2") == 0 ) {
+		op_kernel = OpAVX2;
+		quantize_kernel = QuantizeAVX2;
+	}
+#endif
+	return(1);
+}
+
+
+void FreeFormula(Formula *f)
+{
+	free(f->slots);
+	free(f->levels);
+	free(f->row);
+	f->slots = NULL;
+	f->levels = f->row = NULL;
+}
+
+
+void FormulaLevels(Formula *f, double mean, double contrast)
+{
+	int i;
+
+	for ( i=0; i<=FORMULA_STEPS; i++ ) {
+		f->table[i] = ModulatedLevel(mean, contrast, 2.0*i/FORMULA_STEPS - 1);
+	}
+}
+
+
+void FormulaRow(Formula *f, Uint8 *levels, int x0, int w, int y, double t)
+{
+	FormulaNode *p;
+	float v, start;
+	int i, j, x, n;
+
+	if ( !(f->dep & FORMULA_X) ) {
+		v = Eval(f, f->root, 0, y, t);
+		QuantizeGeneric(levels, &v, 1, f->table);
+		memset(levels+1, levels[0], w-1);
+		return;
+	}
+	for ( i=0; i<f->nuniform; i++ ) {
+		p = &f->node[f->uniform[i]];
+		v = Eval(f, f->uniform[i], 0, y, t);
+		for ( j=0; j<FORMULA_BLOCK; j++ ) {
+			p->slot[j] = v;
+		}
+	}
+	for ( x=0; x<w; x+=FORMULA_BLOCK ) {
+		n = w - x < FORMULA_BLOCK ? w - x : FORMULA_BLOCK;
+		for ( i=0; i<f->ncode; i++ ) {
+			p = &f->node[f->code[i]];
+			if ( p->op == OP_X ) {
+				start = x0 + x;
+				op_kernel(OP_RAMP, p->slot, &start, NULL, n);
+			} else {
+				op_kernel(p->op, p->slot, f->node[p->a].slot,
+					  p->b >= 0 ? f->node[p->b].slot : NULL, n);
+			}
+		}
+		quantize_kernel(levels + x, f->node[f->root].slot, n, f->table);
+	}
+}
+
+
+void RenderFormula(Formula *f, SDL_Surface *surface, const PixelWriter *pw, double t)
+{
+	Uint8 *p;
+	int y, x0, y0;
+
+	x0 = -surface->w/2;
+	y0 = -surface->h/2;
+	p = (Uint8 *)surface->pixels;
+	if ( !(f->dep & FORMULA_Y) ) {
+		FormulaRow(f, f->levels, x0, surface->w, 0, t);
+		pw->row(f->row, f->levels, surface->w, pw->map);
+		ReplicateRow(p, surface->pitch, f->row, surface->w*pw->bpp, surface->h);
+		return;
+	}
+	for ( y=0; y<surface->h; y++ ) {
+		FormulaRow(f, f->levels, x0, surface->w, y0 + y, t);
+		if ( f->dep & FORMULA_X ) {
+			pw->row(p, f->levels, surface->w, pw->map);
+		} else {
+			FillSolid(p, 0, surface->w*pw->bpp, 1, pw->map[f->levels[0]], pw->bpp);
+		}
+		p += surface->pitch;
+	}
+}
@@ -0,0 +1,76 @@
+/*********************************************************/
+/*                                                       */
+/* Stimuli given as a formula of the pixel position and  */
+/* time, compiled once and evaluated a block at a time   */
+/*                                                       */
+/* GPL, of course                                        */
+/*                                                       */
+/*********************************************************/
+
+#ifndef FORMULA_H
+#define FORMULA_H
+
+#include "SDL.h"
+#include "pixels.h"
+
+/* what a formula or a part of it depends on */
+#define FORMULA_X 1
+#define FORMULA_Y 2
+#define FORMULA_T 4
+
+/* most nodes of a parsed formula */
+#define MAX_FORMULA_NODES 128
+
+/* most -p parameters */
+#define MAX_FORMULA_PARAMS 16
+
+/* pixels evaluated together */
+#define FORMULA_BLOCK 256
+
+/* steps of the modulation -1..1 looked up as gray levels */
+#define FORMULA_STEPS 1024
+
+typedef struct {
+	int op;
+	int a, b;		/* operands, node numbers */
+	double value;		/* of constants */
+	int dep;		/* FORMULA_* of the node and its operands */
+	float *slot;		/* its values on a block, if needed */
+} FormulaNode;
+
+typedef struct {
+	int nnodes, root;
+	FormulaNode node[MAX_FORMULA_NODES];
+	int dep;			/* of the whole formula */
+	int ncode;
+	int code[MAX_FORMULA_NODES];	/* nodes varying with x, operands first */
+	int nuniform;
+	int uniform[MAX_FORMULA_NODES];	/* their operands constant along a row */
+	float *slots;
+	Uint8 table[FORMULA_STEPS+4];	/* gray levels of the modulation,
+					   padded for 4 byte gathers */
+	int w;				/* longest row */
+	Uint8 *levels, *row;
+} Formula;
+
+/* parse text, a formula of x and y in pixels from the screen centre
+   (y downwards), t in s and the parameters names[i] = values[i], for
+   rows of up to w pixels. Returns 0 with a message on error. */
+int CompileFormula(Formula *f, const char *text, int w, char *const *names,
+		   const double *values, int nparams);
+
+/* release the tables of a compiled formula, before compiling another */
+void FreeFormula(Formula *f);
+
+/* turn the values of the formula, clipped to -1..1, into the gray
+   levels of mean*(1+contrast*value) */
+void FormulaLevels(Formula *f, double mean, double contrast);
+
+/* the gray levels of a row of w pixels from x0, y at time t */
+void FormulaRow(Formula *f, Uint8 *levels, int x0, int w, int y, double t);
+
+/* draw the formula at time t into a locked surface, formulas which
+   do not depend on x or y are drawn as one row or column */
+void RenderFormula(Formula *f, SDL_Surface *surface, const PixelWriter *pw, double t);
+
+#endif
@@ -0,0 +1,270 @@
+/*********************************************************/
+/*                                                       */
+/* Display a stimulus given as a formula of the pixel    */
+/* position and time, such as                            */
+/* -f "sin(2*pi*(x/period - freq*t))" -p period=50       */
+/*                                                       */
+/* GPL, of course                                        */
+/*                                                       */
+/*********************************************************/
+
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+
+#include "SDL.h"
+#include "refresh.h"
+#include "pixels.h"
+#include "kernels.h"
+#include "calibration.h"
+#include "formula.h"
+#include "trace.h"
+#include "perfcount.h"
+#include "syncpatch.h"
+
+/* default parameters */
+#define MEAN 0.5
+#define CONTRAST 1
+
+/* 8 Bit Graphics */
+#define NUM_COLORS	256
+
+SDL_Event redrawEvent;
+
+PixelWriter pw;
+PerfCounters perf;
+SyncPatch syncpatch;
+
+SDL_Surface *CreateScreen(Uint16 w, Uint16 h, Uint8 bpp, Uint32 flags)
+{
+	SDL_Surface *screen;
+	int i;
+	SDL_Color palette[NUM_COLORS];
+
+	/* Set the video mode */
+	screen = SDL_SetVideoMode(w, h, bpp, flags);
+	if ( screen == NULL ) {
+	  fprintf(stderr, "Couldn't set display mode: %s\n",
+		  SDL_GetError());
+	  return(NULL);
+	}
+	fprintf(stderr, "Screen is in %s mode\n",
+		(screen->flags & SDL_FULLSCREEN) ? "fullscreen" : "windowed");
+
+	/* Set a gray colormap */
+	for ( i=0; i<NUM_COLORS; ++i ) {
+		palette[i].r = (NUM_COLORS-1)-i * (256 / NUM_COLORS);
+		palette[i].g = (NUM_COLORS-1)-i * (256 / NUM_COLORS);
+		palette[i].b = (NUM_COLORS-1)-i * (256 / NUM_COLORS);
+	}
+	SDL_SetColors(screen, palette, 0, NUM_COLORS);
+
+	if ( !InitPixelWriter(&pw, screen->format) ) {
+	  return(NULL);
+	}
+	return(screen);
+}
+
+Uint32 refreshTimer(Uint32 interval, void *params)
+{
+	TRACE_INSTANT("timer");
+        SDL_PushEvent(&redrawEvent);
+	return interval;
+}
+
+
+int main(int argc, char *argv[])
+{
+	SDL_Surface *screen;
+	Uint32 videoflags;
+	SDL_TimerID refreshTimerID;
+	SDL_Event event;
+	int width, height, bpp;
+	int done;
+	double rate, frame_ms, start_ms, draw_ms, t0;
+	double mean, contrast;
+	char *text, *eq;
+	char *names[MAX_FORMULA_PARAMS];
+	double values[MAX_FORMULA_PARAMS];
+	int nparams;
+	int frame, lastframe, nframes, still;
+	Formula formula;
+
+	redrawEvent.type = SDL_USEREVENT;
+	redrawEvent.user.code = 1;
+	redrawEvent.user.data1 = NULL;
+	redrawEvent.user.data2 = NULL;
+
+	/* Initialize SDL */
+	if ( SDL_Init(SDL_INIT_VIDEO|SDL_INIT_TIMER) < 0 ) {
+		fprintf(stderr, "Couldn't initialize SDL: %s\n",SDL_GetError());
+		exit(1);
+	}
+
+	width = 640;
+	height = 480;
+	bpp = 32;
+	rate = 0;
+	mean = MEAN;
+	contrast = CONTRAST;
+	text = NULL;
+	nparams = 0;
+
+	videoflags =  SDL_DOUBLEBUF|SDL_FULLSCREEN;
+
+	while ( argc > 1 ) {
+	  --argc;
+	  if ( argv[argc-1] && (strcmp(argv[argc-1], "-f") == 0) ) {
+	    text = argv[argc];
+	    --argc;
+	  } else if ( argv[argc-1] && (strcmp(argv[argc-1], "-p") == 0) ) {
+	    eq = strchr(argv[argc], '=');
+	    if ( eq == NULL || nparams == MAX_FORMULA_PARAMS ) {
+	      fprintf(stderr, "-p takes name=value, at most %d times\n", MAX_FORMULA_PARAMS);
+	      exit(1);
+	    }
+	    *eq = '\0';
+	    names[nparams] = argv[argc];
+	    values[nparams] = atof(eq + 1);
+	    nparams++;
+	    --argc;
+	  } else if ( argv[argc-1] && (strcmp(argv[argc-1], "-w") == 0) ) {
+	    width = atoi(argv[argc]);
+	    --argc;
+	  } else if ( argv[argc-1] && (strcmp(argv[argc-1], "-h") == 0) ) {
+	    height = atoi(argv[argc]);
+	    --argc;
+	  } else if ( argv[argc-1] && (strcmp(argv[argc-1], "-bpp") == 0) ) {
+	    bpp = atoi(argv[argc]);
+	    --argc;
+	  } else if ( argv[argc-1] && (strcmp(argv[argc-1], "-refresh") == 0) ) {
+	    rate = atof(argv[argc]);
+	    --argc;
+	  } else if ( argv[argc-1] && (strcmp(argv[argc-1], "-mean") == 0) ) {
+	    mean = atof(argv[argc]);
+	    --argc;
+	  } else if ( argv[argc-1] && (strcmp(argv[argc-1], "-contrast") == 0) ) {
+	    contrast = atof(argv[argc]);
+	    --argc;
+	  } else if ( argv[argc-1] && (strcmp(argv[argc-1], "-calib") == 0) ) {
+	    if ( !LoadCalibration(argv[argc]) ) {
+	      exit(1);
+	    }
+	    --argc;
+	  } else if ( argv[argc-1] && (strcmp(argv[argc-1], "-sync") == 0) ) {
+	    OpenSyncPatch(&syncpatch, argv[argc]);
+	    --argc;
+	  } else if ( argv[argc] && (strcmp(argv[argc], "-sw") == 0) ) {
+	    videoflags |= SDL_SWSURFACE;
+	  } else if ( argv[argc] && (strcmp(argv[argc], "-hw") == 0) ) {
+	    videoflags |= SDL_HWSURFACE;
+	  } else if ( argv[argc] && (strcmp(argv[argc], "-hwpalette") == 0) ) {
+	    videoflags |= SDL_HWPALETTE;
+	  } else if ( argv[argc] && (strcmp(argv[argc], "-window") == 0) ) {
+	    videoflags ^= SDL_FULLSCREEN;
+	  } else if ( argv[argc] && (strcmp(argv[argc], "-perf") == 0) ) {
+	    PerfOpen(&perf);
+	  } else
+	    {
+	      fprintf(stderr, "Usage: %s -f formula [-p name=value]... [-window] [-bpp #] [-w #] [-h #] [-mean #] [-contrast #] [-calib file] [-refresh #] [-perf] [-sync luminance|binary]\n"
+		      "The formula of x, y (pixels from the centre), t (s) and the parameters\n"
+		      "uses + - * / ^ < >, sin cos exp sqrt abs floor min max atan2 pow mod and pi,\n"
+		      "its value -1..1 modulates the luminance around the mean\n", argv[0]);
+	      exit(1);
+	    }
+	}
+	if ( text == NULL ) {
+	  fprintf(stderr, "No formula given with -f\n");
+	  exit(1);
+	}
+	contrast = CheckContrast(mean, contrast);
+
+	/* Set video mode */
+	screen = CreateScreen(width, height, bpp, videoflags);
+	if ( screen == NULL ) {
+		exit(2);
+	}
+	if ( !CompileFormula(&formula, text, screen->w, names, values, nparams) ) {
+		exit(1);
+	}
+	FormulaLevels(&formula, mean, contrast);
+	fprintf(stderr, "Formula depends on%s%s%s%s\n",
+		formula.dep & FORMULA_X ? " x" : "", formula.dep & FORMULA_Y ? " y" : "",
+		formula.dep & FORMULA_T ? " t" : "", formula.dep ? "" : " nothing");
+
+	/* t is taken from whole frames */
+	frame_ms = FramePeriod(screen, rate);
+
+	SDL_ShowCursor(SDL_DISABLE);
+	refreshTimerID = SDL_AddTimer(FrameTimerInterval(frame_ms), refreshTimer, (void *)screen);
+	start_ms = GetTimeMs();
+	lastframe = -1;
+	draw_ms = 0;
+	nframes = 0;
+
+	/* MAIN LOOP, do screen refresh and wait for keys */
+	done = 0;
+	TRACE_BEGIN("wait");
+	while ( !done && SDL_WaitEvent(&event) ) {
+	  TRACE_END("wait");
+	  switch (event.type) {
+	  case SDL_KEYDOWN:
+	    /* Ignore ALT-TAB for windows */
+	    if ( (event.key.keysym.sym == SDLK_LALT) ||
+		 (event.key.keysym.sym == SDLK_TAB) ) {
+	      break;
+	    }
+	    /* Any key quits the application... */
+	  case SDL_QUIT:
+	    done = 1;
+	    break;
+	  case SDL_USEREVENT:
+	    frame = FrameIndex(start_ms, frame_ms);
+	    if ( frame == lastframe ) {
+	      break;
+	    }
+	    /* a formula without t is drawn into both pages and left,
+	       with -sync the patch still changes on every frame */
+	    still = !(formula.dep & FORMULA_T) && nframes >= 2;
+	    if ( still && syncpatch.code == SYNC_NONE ) {
+	      break;
+	    }
+	    lastframe = frame;
+	    if ( !still ) {
+	      t0 = GetTimeMs();
+	      TRACE_BEGIN("lock");
+	      SDL_LockSurface(screen);
+	      TRACE_END("lock");
+	      TRACE_BEGIN("draw");
+	      PerfBegin(&perf);
+	      RenderFormula(&formula, screen, &pw, frame*frame_ms/1000);
+	      SDL_UnlockSurface(screen);
+	      PerfEnd(&perf);
+	      TRACE_END("draw");
+	      draw_ms += GetTimeMs() - t0;
+	      nframes++;
+	    }
+	    ShowSyncPatch(&syncpatch, screen, &pw);
+	    TRACE_BEGIN("flip");
+	    SDL_Flip(screen);
+	    TRACE_END("flip");
+	    SyncPresented(&syncpatch, frame);
+	    break;
+	  default:
+	    break;
+	  }
+	  TRACE_BEGIN("wait");
+	}
+	TRACE_END("wait");
+	SDL_RemoveTimer(refreshTimerID);
+	SDL_ShowCursor(SDL_ENABLE);
+	if ( nframes > 0 ) {
+	  printf("mean time to draw the formula: %.3f ms\n", draw_ms/nframes);
+	}
+	CloseSyncPatch(&syncpatch);
+	PerfReport(&perf);
+	SDL_Quit();
+	return(0);
+}
@@ -0,0 +1,277 @@
+/*********************************************************/
+/*                                                       */
+/* A frame clock in shared memory which locks the frames */
+/* of stimulus processes on separate displays to a       */
+/* leader                                                */
+/*                                                       */
+/* GPL, of course                                        */
+/*                                                       */
+/*********************************************************/
+
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <math.h>
+
+#ifndef _WIN32
+#include <unistd.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#endif
+
+#include "SDL.h"
+#include "refresh.h"
+#include "frameclock.h"
+
+#define CLOCK_MAGIC 0x46434c4b
+
+
+#ifndef _WIN32
+static SharedClock *CreateShared(const char *name)
+{
+	SharedClock *sc;
+	int fd;
+
+	fd = shm_open(name, O_RDWR|O_CREAT, 0644);
+	if ( fd < 0 || ftruncate(fd, sizeof(SharedClock)) < 0 ) {
+		fprintf(stderr, "Couldn't create the frame clock %s: %s\n", name, strerror(errno));
+		return(NULL);
+	}
+	sc = (SharedClock *)mmap(NULL, sizeof(SharedClock), PROT_READ|PROT_WRITE, MAP_SHARED, fd, 0);
+	close(fd);
+	if ( sc == MAP_FAILED ) {
+		fprintf(stderr, "Couldn't map the frame clock %s: %s\n", name, strerror(errno));
+		return(NULL);
+	}
+	/* a clock left behind by a crashed leader starts over */
+	memset(sc, 0, sizeof(SharedClock));
+	sc->last = -1;
+	__sync_synchronize();
+	sc->magic = CLOCK_MAGIC;
+	return(sc);
+}
+
+
+/* wait until the leader has created and sized the clock */
+static SharedClock *AttachShared(const char *name)
+{
+	SharedClock *sc;
+	struct stat st;
+	double start_ms;
+	int fd;
+
+	start_ms = GetTimeMs();
+	for ( ;; ) {
+		fd = shm_open(name, O_RDWR, 0);
+		if ( fd >= 0 ) {
+			if ( fstat(fd, &st) == 0 && st.st_size >= (off_t)sizeof(SharedClock) ) {
+				break;
+			}
+			close(fd);
+		} else if ( errno != ENOENT ) {
+			fprintf(stderr, "Couldn't open the frame clock %s: %s\n", name, strerror(errno));
+			return(NULL);
+		}
+		if ( GetTimeMs() - start_ms > CLOCK_WAIT_MS ) {
+			fprintf(stderr, "No leader created the frame clock %s\n", name);
+			return(NULL);
+		}
+		SDL_Delay(10);
+	}
+	sc = (SharedClock *)mmap(NULL, sizeof(SharedClock), PROT_READ|PROT_WRITE, MAP_SHARED, fd, 0);
+	close(fd);
+	if ( sc == MAP_FAILED ) {
+		fprintf(stderr, "Couldn't map the frame clock %s: %s\n", name, strerror(errno));
+		return(NULL);
+	}
+	return(sc);
+}
+#endif
+
+
+void OpenFrameClock(FrameClock *fc, const char *name, int role)
+{
+	memset(fc, 0, sizeof(*fc));
+	if ( strlen(name) == 0 || strlen(name) > sizeof(fc->name) - 2 || strchr(name, '/') ) {
+		fprintf(stderr, "The frame clock needs a short name without a /\n");
+		exit(1);
+	}
+#ifdef _WIN32
+	fprintf(stderr, "Frame clocks need POSIX shared memory\n");
+	exit(1);
+#else
+	sprintf(fc->name, "/%s", name);
+	fc->shared = role == CLOCK_LEADER ? CreateShared(fc->name) : AttachShared(fc->name);
+	if ( fc->shared == NULL ) {
+		exit(2);
+	}
+	if ( role == CLOCK_FOLLOWER ) {
+		__sync_fetch_and_add(&fc->shared->followers, 1);
+	}
+	fc->role = role;
+#endif
+}
+
+
+double ClockPeriod(FrameClock *fc, double frame_ms)
+{
+	SharedClock *sc = fc->shared;
+	double start_ms;
+
+	if ( fc->role == CLOCK_LEADER ) {
+		sc->frame_ms = frame_ms;
+	} else if ( fc->role == CLOCK_FOLLOWER ) {
+		start_ms = GetTimeMs();
+		while ( sc->magic != CLOCK_MAGIC || !sc->ready ) {
+			if ( sc->quit || GetTimeMs() - start_ms > CLOCK_WAIT_MS ) {
+				fprintf(stderr, "The leader of the frame clock %s did not start\n", fc->name);
+				exit(2);
+			}
+			SDL_Delay(1);
+		}
+		__sync_synchronize();
+		if ( fabs(sc->frame_ms - frame_ms) > CLOCK_PERIOD_TOLERANCE*sc->frame_ms ) {
+			fprintf(stderr, "Warning: the frame period is %.3f ms here but %.3f ms at the leader, "
+				"the skew will drift\n", frame_ms, sc->frame_ms);
+		}
+		frame_ms = sc->frame_ms;
+	}
+	return(frame_ms);
+}
+
+
+double ClockEpoch(FrameClock *fc, double start_ms)
+{
+	SharedClock *sc = fc->shared;
+
+	if ( fc->role == CLOCK_LEADER ) {
+		sc->epoch_ms = start_ms;
+		__sync_synchronize();
+		sc->ready = 1;
+	} else if ( fc->role == CLOCK_FOLLOWER ) {
+		/* joins the leader in phase even if it started long ago */
+		start_ms = sc->epoch_ms;
+		fprintf(stderr, "Following %s from its frame %d\n", fc->name,
+			FrameIndex(start_ms, sc->frame_ms));
+	}
+	return(start_ms);
+}
+
+
+/* a consistent copy of a frame of the ring */
+static void ReadFrame(volatile ClockFrame *f, ClockFrame *copy)
+{
+	Uint32 seq;
+
+	do {
+		seq = f->seq;
+		__sync_synchronize();
+		copy->frame = f->frame;
+		copy->step = f->step;
+		copy->present_ms = f->present_ms;
+		__sync_synchronize();
+	} while ( (seq & 1) || f->seq != seq );
+}
+
+
+/* compare the waiting frames with the leader's, keeps those the
+   leader has not shown yet */
+static void MatchPending(FrameClock *fc)
+{
+	SharedClock *sc = fc->shared;
+	ClockFrame *p, lead;
+	double skew;
+	int i, n;
+
+	n = 0;
+	for ( i=0; i<fc->npending; i++ ) {
+		p = &fc->pending[i];
+		ReadFrame(&sc->ring[p->frame%CLOCK_RING], &lead);
+		if ( lead.frame == p->frame ) {
+			skew = p->present_ms - lead.present_ms;
+			printf("%d %d %.3f\n", p->frame, p->step, skew);
+			fc->matched++;
+			fc->sum += skew;
+			fc->sum2 += skew*skew;
+			if ( fabs(skew) > fabs(fc->worst) ) {
+				fc->worst = skew;
+			}
+			if ( lead.step != p->step ) {
+				fc->misphased++;
+			}
+		} else if ( sc->last > p->frame || sc->quit ) {
+			/* the leader has gone past without showing it */
+			fc->unmatched++;
+		} else {
+			fc->pending[n++] = *p;
+		}
+	}
+	fc->npending = n;
+}
+
+
+void ClockPresented(FrameClock *fc, int frame, int step)
+{
+	SharedClock *sc = fc->shared;
+	ClockFrame *f;
+
+	if ( fc->role == CLOCK_LEADER ) {
+		f = &sc->ring[frame%CLOCK_RING];
+		f->seq++;
+		__sync_synchronize();
+		f->frame = frame;
+		f->step = step;
+		f->present_ms = GetTimeMs();
+		__sync_synchronize();
+		f->seq++;
+		sc->last = frame;
+	} else if ( fc->role == CLOCK_FOLLOWER ) {
+		if ( fc->npending == CLOCK_RING ) {
+			/* the leader stalled, forget the oldest */
+			memmove(fc->pending, fc->pending + 1, (CLOCK_RING - 1)*sizeof(ClockFrame));
+			fc->npending--;
+			fc->unmatched++;
+		}
+		f = &fc->pending[fc->npending++];
+		f->frame = frame;
+		f->step = step;
+		f->present_ms = GetTimeMs();
+		MatchPending(fc);
+	}
+}
+
+
+int ClockStopped(FrameClock *fc)
+{
+	return(fc->role == CLOCK_FOLLOWER && fc->shared->quit);
+}
+
+
+void CloseFrameClock(FrameClock *fc)
+{
+	SharedClock *sc = fc->shared;
+	double mean, var;
+
+	if ( fc->role == CLOCK_LEADER ) {
+		sc->quit = 1;
+#ifndef _WIN32
+		shm_unlink(fc->name);
+#endif
+		fprintf(stderr, "%d followers joined the frame clock %s\n", sc->followers, fc->name);
+	} else if ( fc->role == CLOCK_FOLLOWER ) {
+		MatchPending(fc);
+		fc->unmatched += fc->npending;
+		printf("frame clock %s: %ld frames matched, %ld unmatched, %ld at another step\n",
+		       fc->name, fc->matched, fc->unmatched, fc->misphased);
+		if ( fc->matched > 0 ) {
+			mean = fc->sum/fc->matched;
+			var = fc->sum2/fc->matched - mean*mean;
+			printf("skew to the leader: mean %.3f ms, sd %.3f ms, worst %.3f ms\n", mean,
+			       var > 0 ? sqrt(var) : 0, fc->worst);
+		}
+	}
+	fc->role = CLOCK_NONE;
+}
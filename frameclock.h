@@ -0,0 +1,79 @@
+/*********************************************************/
+/*                                                       */
+/* A frame clock in shared memory which locks the frames */
+/* of stimulus processes on separate displays to a       */
+/* leader                                                */
+/*                                                       */
+/* GPL, of course                                        */
+/*                                                       */
+/*********************************************************/
+
+#ifndef FRAMECLOCK_H
+#define FRAMECLOCK_H
+
+#include "SDL.h"
+
+#define CLOCK_NONE     0
+#define CLOCK_LEADER   1
+#define CLOCK_FOLLOWER 2
+
+/* frames the leader keeps for the followers to compare with */
+#define CLOCK_RING 256
+
+/* how long a follower waits for its leader */
+#define CLOCK_WAIT_MS 10000
+
+/* a follower warns if its own frame period differs by more */
+#define CLOCK_PERIOD_TOLERANCE 0.005
+
+/* a frame presented by the leader, seq is odd while it is written */
+typedef struct {
+	volatile Uint32 seq;
+	Sint32 frame, step;
+	double present_ms;
+} ClockFrame;
+
+/* the shared memory, times are CLOCK_MONOTONIC and hence the same in
+   all processes of the machine */
+typedef struct {
+	Uint32 magic;
+	volatile Sint32 ready, quit, followers;
+	double frame_ms, epoch_ms;
+	volatile Sint32 last;		/* last frame presented */
+	ClockFrame ring[CLOCK_RING];
+} SharedClock;
+
+typedef struct {
+	int role;			/* CLOCK_NONE unless opened */
+	char name[64];
+	SharedClock *shared;
+	/* own frames of a follower waiting for the leader's */
+	ClockFrame pending[CLOCK_RING];
+	int npending;
+	long matched, unmatched, misphased;
+	double sum, sum2, worst;
+} FrameClock;
+
+/* create the clock name as leader or attach to it as follower, exits
+   with a message on failure */
+void OpenFrameClock(FrameClock *fc, const char *name, int role);
+
+/* the leader publishes its frame period, a follower waits for the
+   leader and returns its period instead of the own */
+double ClockPeriod(FrameClock *fc, double frame_ms);
+
+/* the leader publishes the start of frame 0, a follower returns the
+   leader's so that both count the same frames and steps */
+double ClockEpoch(FrameClock *fc, double start_ms);
+
+/* after a frame has been presented. A follower prints the skew to the
+   same frame of the leader on stdout as soon as it is known. */
+void ClockPresented(FrameClock *fc, int frame, int step);
+
+/* true once the leader of a follower has quit */
+int ClockStopped(FrameClock *fc);
+
+/* the leader stops its followers, a follower prints its summary */
+void CloseFrameClock(FrameClock *fc);
+
+#endif
@@ -0,0 +1,297 @@
+/*********************************************************/
+/*                                                       */
+/* Drifting gratings in a Gaussian or raised cosine      */
+/* window, drawn only inside their bounding box          */
+/*                                                       */
+/* GPL, of course                                        */
+/*                                                       */
+/*********************************************************/
+
+/* The window is the product of a row and a column profile, computed
+   once as a fixed point table with ENV_ONE = 1. The box is square,
+   so one table serves both directions. Per frame a row costs one
+   multiplication for the window, a sine table lookup for the
+   carrier and a second multiplication, as in plaid.c the result is
+   kept in units of MOD_ONE = contrast 1 and turned into a calibrated
+   gray level by a last table. */
+
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+
+#include "SDL.h"
+#include "pixels.h"
+#include "kernels.h"
+#include "calibration.h"
+#include "gabor.h"
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__)) && defined(__SSE2__)
+#define HAVE_X86_KERNELS
+#include <immintrin.h>
+#endif
+
+/* entries of the sine table */
+#define SINE_BITS 12
+#define SINE_SIZE (1<<SINE_BITS)
+
+/* the modulation of contrast 1 */
+#define MOD_ONE 2048
+
+/* the window at its peak */
+#define ENV_BITS 15
+#define ENV_ONE (1<<ENV_BITS)
+
+/* window times carrier for one row, as indices MOD_ONE +- modulation */
+typedef void (*ModulateFunc)(Sint32 *acc, const Sint32 *env, Sint32 ey,
+			     const Sint32 *sine, Uint32 ph, Uint32 dx, int n);
+/* look up 32 bit pixels */
+typedef void (*LookupFunc)(Uint32 *dst, const Sint32 *acc, const Uint32 *pixel, int n);
+
+static int size;
+static double centre;
+static double cosa, sina, period, frequency;
+static Uint32 dx;
+static Sint32 *env, *acc;
+static Uint8 *levels;
+static Sint32 sine[SINE_SIZE];
+static Uint8 level[2*MOD_ONE+1];
+static Uint32 pixel[2*MOD_ONE+1];
+static const PixelWriter *pixel_pw;
+static ModulateFunc modulate_kernel;
+static LookupFunc lookup_kernel;
+
+
+/* a fraction of a cycle as a fixed point phase */
+static Uint32 Turns(double turns)
+{
+	turns -= floor(turns);
+	if ( turns >= 1 ) {
+		turns = 0;
+	}
+	return((Uint32)(turns*4294967296.0));
+}
+
+
+static void ModulateGeneric(Sint32 *acc, const Sint32 *env, Sint32 ey,
+			    const Sint32 *sine, Uint32 ph, Uint32 dx, int n)
+{
+	int x;
+
+	for ( x=0; x<n; x++ ) {
+		acc[x] = MOD_ONE + ((((env[x]*ey) >> ENV_BITS)*sine[ph >> (32-SINE_BITS)]) >> ENV_BITS);
+		ph += dx;
+	}
+}
+
+
+static void LookupGeneric(Uint32 *dst, const Sint32 *acc, const Uint32 *pixel, int n)
+{
+	int x;
+
+	for ( x=0; x<n; x++ ) {
+		dst[x] = pixel[acc[x]];
+	}
+}
+
+#ifdef HAVE_X86_KERNELS
+
+__attribute__((target("avx2")))
+static void ModulateAVX2(Sint32 *acc, const Sint32 *env, Sint32 ey,
+			 const Sint32 *sine, Uint32 ph, Uint32 dx, int n)
+{
+	__m256i p, step, e, s, m;
+	int x;
+
+	p = _mm256_add_epi32(_mm256_set1_epi32(ph),
+			     _mm256_mullo_epi32(_mm256_setr_epi32(0, 1, 2, 3, 4, 5, 6, 7),
+						_mm256_set1_epi32(dx)));
+	step = _mm256_set1_epi32(8*dx);
+	for ( x=0; x+8<=n; x+=8 ) {
+		e = _mm256_loadu_si256((const __m256i *)(env+x));
+		e = _mm256_srai_epi32(_mm256_mullo_epi32(e, _mm256_set1_epi32(ey)), ENV_BITS);
+		s = _mm256_i32gather_epi32((const int *)sine,
+					   _mm256_srli_epi32(p, 32-SINE_BITS), 4);
+		m = _mm256_srai_epi32(_mm256_mullo_epi32(e, s), ENV_BITS);
+		_mm256_storeu_si256((__m256i *)(acc+x),
+				    _mm256_add_epi32(m, _mm256_set1_epi32(MOD_ONE)));
+		p = _mm256_add_epi32(p, step);
+	}
+	_mm256_zeroupper();
+	ModulateGeneric(acc+x, env+x, ey, sine, ph + (Uint32)x*dx, dx, n-x);
+}
+
+
+__attribute__((target("avx2")))
+static void LookupAVX2(Uint32 *dst, const Sint32 *acc, const Uint32 *pixel, int n)
+{
+	int x;
+
+	for ( x=0; x+8<=n; x+=8 ) {
+		_mm256_storeu_si256((__m256i *)(dst+x),
+				    _mm256_i32gather_epi32((const int *)pixel,
+							   _mm256_loadu_si256((const __m256i *)(acc+x)), 4));
+	}
+	_mm256_zeroupper();
+	LookupGeneric(dst+x, acc+x, pixel, n-x);
+}
+
+#endif
+
+
+/* the window at distance r from the centre, 1 at the peak */
+static double Window(const GaborPatch *patch, double r)
+{
+	double flat;
+
+	if ( patch->window == GABOR_GAUSS ) {
+		return(exp(-r*r/(2*patch->sigma*patch->sigma)));
+	}
+	r = fabs(r);
+	flat = patch->size/2.0 - patch->ramp;
+	if ( r <= flat ) {
+		return(1);
+	}
+	if ( r >= patch->size/2.0 ) {
+		return(0);
+	}
+	return(0.5*(1 + cos(M_PI*(r - flat)/patch->ramp)));
+}
+
+
+int InitGabor(const GaborPatch *patch, double mean)
+{
+	double a, c;
+	int i;
+
+	if ( patch->size < 1 || patch->period < 2 ) {
+		fprintf(stderr, "A Gabor patch needs a size of at least 1 and a period of at least 2 pixels\n");
+		return(0);
+	}
+	if ( (patch->window == GABOR_GAUSS && patch->sigma <= 0) ||
+	     (patch->window == GABOR_COSINE && (patch->ramp <= 0 || patch->ramp > patch->size/2.0)) ) {
+		fprintf(stderr, "The window needs a positive width within the box\n");
+		return(0);
+	}
+	c = CheckContrast(mean, patch->contrast);
+	/* a Gaussian cut off by the box leaves a visible edge */
+	if ( patch->window == GABOR_GAUSS &&
+	     fabs(c)*Window(patch, patch->size/2.0) > 0.5/NUM_DAC ) {
+		fprintf(stderr, "Warning: the Gaussian is cut off at the edge of the box, make it larger than %.0f pixels\n",
+			2*patch->sigma*sqrt(2*log(fabs(c)*2*NUM_DAC)));
+	}
+
+	free(env);
+	free(acc);
+	free(levels);
+	env = (Sint32 *)malloc(patch->size*sizeof(Sint32));
+	acc = (Sint32 *)malloc(patch->size*sizeof(Sint32));
+	levels = (Uint8 *)malloc(patch->size);
+	size = patch->size;
+	centre = (size-1)/2.0;
+	for ( i=0; i<size; i++ ) {
+		env[i] = (Sint32)floor(ENV_ONE*Window(patch, i - centre) + 0.5);
+	}
+
+	a = patch->angle*M_PI/180;
+	cosa = cos(a);
+	sina = sin(a);
+	period = patch->period;
+	frequency = patch->frequency;
+	dx = Turns(cosa/period);
+	for ( i=0; i<SINE_SIZE; i++ ) {
+		sine[i] = (Sint32)floor(c*MOD_ONE*sin(2*M_PI*(i+0.5)/SINE_SIZE) + 0.5);
+	}
+	for ( i=0; i<=2*MOD_ONE; i++ ) {
+		level[i] = ModulatedLevel(mean, 1, (double)(i-MOD_ONE)/MOD_ONE);
+	}
+
+	pixel_pw = NULL;
+
+	modulate_kernel = ModulateGeneric;
+	lookup_kernel = LookupGeneric;
+#ifdef HAVE_X86_KERNELS
+	if ( strcmp(KernelName(), "avx2") == 0 ) {
+		modulate_kernel = ModulateAVX2;
+		lookup_kernel = LookupAVX2;
+	}
+#endif
+	return(1);
+}
+
+
+Uint32 GaborBackground(const PixelWriter *pw)
+{
+	return(pw->map[level[MOD_ONE]]);
+}
+
+
+void GaborBox(SDL_Surface *surface, int x, int y, SDL_Rect *box)
+{
+	int x0, y0, x1, y1;
+
+	x0 = x - size/2;
+	y0 = y - size/2;
+	x1 = x0 + size;
+	y1 = y0 + size;
+	if ( x0 < 0 ) x0 = 0;
+	if ( y0 < 0 ) y0 = 0;
+	if ( x1 > surface->w ) x1 = surface->w;
+	if ( y1 > surface->h ) y1 = surface->h;
+	if ( x1 <= x0 || y1 <= y0 ) {
+		box->x = box->y = 0;
+		box->w = box->h = 0;
+		return;
+	}
+	box->x = x0;
+	box->y = y0;
+	box->w = x1 - x0;
+	box->h = y1 - y0;
+}
+
+
+void RenderGabor(SDL_Surface *surface, const PixelWriter *pw, int x, int y, double t)
+{
+	SDL_Rect box;
+	Uint8 *dst;
+	Uint32 back;
+	int i, j, i0, j0, n;
+
+	GaborBox(surface, x, y, &box);
+	if ( box.w == 0 ) {
+		return;
+	}
+	/* 32 bit pixels are looked up directly */
+	if ( pw != pixel_pw ) {
+		for ( i=0; i<=2*MOD_ONE; i++ ) {
+			pixel[i] = pw->map[level[i]];
+		}
+		pixel_pw = pw;
+	}
+	back = pw->map[level[MOD_ONE]];
+
+	/* first visible row and column of the tables */
+	i0 = box.x - (x - size/2);
+	j0 = box.y - (y - size/2);
+	n = box.w;
+	dst = (Uint8 *)surface->pixels + box.y*surface->pitch + box.x*pw->bpp;
+	for ( j=j0; j<j0+box.h; j++, dst += surface->pitch ) {
+		if ( env[j] == 0 ) {
+			pw->fill(dst, back, n);
+			continue;
+		}
+		/* the carrier is in phase with the window wherever it is */
+		modulate_kernel(acc, env+i0, env[j], sine,
+				Turns(((i0 - centre)*cosa + (j - centre)*sina)/period - frequency*t),
+				dx, n);
+		if ( pw->bpp == 4 ) {
+			lookup_kernel((Uint32 *)dst, acc, pixel, n);
+			continue;
+		}
+		for ( i=0; i<n; i++ ) {
+			levels[i] = level[acc[i]];
+		}
+		pw->row(dst, levels, n, pw->map);
+	}
+}
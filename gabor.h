@@ -0,0 +1,47 @@
+/*********************************************************/
+/*                                                       */
+/* Drifting gratings in a Gaussian or raised cosine      */
+/* window, drawn only inside their bounding box          */
+/*                                                       */
+/* GPL, of course                                        */
+/*                                                       */
+/*********************************************************/
+
+#ifndef GABOR_H
+#define GABOR_H
+
+#include "SDL.h"
+#include "pixels.h"
+
+/* shapes of the window */
+#define GABOR_GAUSS 0
+#define GABOR_COSINE 1
+
+typedef struct {
+	double angle;		/* direction of drift in degrees, 0 is to the right */
+	double period;		/* wavelength in pixels */
+	double frequency;	/* temporal frequency in Hz */
+	double contrast;	/* contrast in the centre of the window */
+	int window;		/* GABOR_GAUSS or GABOR_COSINE */
+	int size;		/* side of the bounding box in pixels */
+	double sigma;		/* standard deviation of the Gaussian */
+	double ramp;		/* width of the cosine edge of the other window */
+} GaborPatch;
+
+/* prepare the window tables and gray levels around the mean
+   luminance (a fraction of the range as in calibration.h),
+   returns 0 on error */
+int InitGabor(const GaborPatch *patch, double mean);
+
+/* pixel value of the mean luminance */
+Uint32 GaborBackground(const PixelWriter *pw);
+
+/* bounding box of the patch centred on x, y, clipped to the surface,
+   w is 0 if nothing is visible */
+void GaborBox(SDL_Surface *surface, int x, int y, SDL_Rect *box);
+
+/* draw the patch centred on x, y at time t in seconds into a locked
+   surface, touching only its bounding box */
+void RenderGabor(SDL_Surface *surface, const PixelWriter *pw, int x, int y, double t);
+
+#endif
@@ -0,0 +1,313 @@
+/*********************************************************/
+/*                                                       */
+/* OpenGL rendering of the stimuli by fragment shaders   */
+/* so that the CPU cost does not grow with screen size   */
+/*                                                       */
+/* GPL, of course                                        */
+/*                                                       */
+/*********************************************************/
+
+
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "SDL.h"
+#include "gl_backend.h"
+#include "syncpatch.h"
+
+#ifdef HAVE_OPENGL
+
+#include "SDL_opengl.h"
+
+/* all entry points come from SDL_GL_GetProcAddress so that we
+   do not have to link against libGL */
+typedef void (APIENTRY *ViewportFunc)(GLint, GLint, GLsizei, GLsizei);
+typedef void (APIENTRY *RectfFunc)(GLfloat, GLfloat, GLfloat, GLfloat);
+typedef GLuint (APIENTRY *CreateShaderFunc)(GLenum);
+typedef void (APIENTRY *ShaderSourceFunc)(GLuint, GLsizei, const GLchar **, const GLint *);
+typedef void (APIENTRY *CompileShaderFunc)(GLuint);
+typedef void (APIENTRY *GetShaderivFunc)(GLuint, GLenum, GLint *);
+typedef void (APIENTRY *GetInfoLogFunc)(GLuint, GLsizei, GLsizei *, GLchar *);
+typedef GLuint (APIENTRY *CreateProgramFunc)(void);
+typedef void (APIENTRY *AttachShaderFunc)(GLuint, GLuint);
+typedef void (APIENTRY *LinkProgramFunc)(GLuint);
+typedef void (APIENTRY *GetProgramivFunc)(GLuint, GLenum, GLint *);
+typedef void (APIENTRY *UseProgramFunc)(GLuint);
+typedef GLint (APIENTRY *GetUniformLocationFunc)(GLuint, const GLchar *);
+typedef void (APIENTRY *Uniform1fFunc)(GLint, GLfloat);
+typedef void (APIENTRY *Uniform2fFunc)(GLint, GLfloat, GLfloat);
+typedef void (APIENTRY *CapFunc)(GLenum);
+typedef void (APIENTRY *ScissorFunc)(GLint, GLint, GLsizei, GLsizei);
+typedef void (APIENTRY *ClearColorFunc)(GLclampf, GLclampf, GLclampf, GLclampf);
+typedef void (APIENTRY *ClearFunc)(GLbitfield);
+
+static ViewportFunc pglViewport;
+static RectfFunc pglRectf;
+static CreateShaderFunc pglCreateShader;
+static ShaderSourceFunc pglShaderSource;
+static CompileShaderFunc pglCompileShader;
+static GetShaderivFunc pglGetShaderiv;
+static GetInfoLogFunc pglGetShaderInfoLog;
+static CreateProgramFunc pglCreateProgram;
+static AttachShaderFunc pglAttachShader;
+static LinkProgramFunc pglLinkProgram;
+static GetProgramivFunc pglGetProgramiv;
+static GetInfoLogFunc pglGetProgramInfoLog;
+static UseProgramFunc pglUseProgram;
+static GetUniformLocationFunc pglGetUniformLocation;
+static Uniform1fFunc pglUniform1f;
+static Uniform2fFunc pglUniform2f;
+static CapFunc pglEnable, pglDisable;
+static ScissorFunc pglScissor;
+static ClearColorFunc pglClearColor;
+static ClearFunc pglClear;
+
+/* size of the screen */
+static float glw, glh;
+
+/* uniform locations of the current program */
+static GLint u_size, u_period, u_phase, u_angle, u_offset;
+static GLint u_length, u_gap, u_fore, u_back, u_bar, u_shift;
+
+/* the fragment shaders work in SDL pixel coordinates, y downwards */
+#define SHADER_HEADER \
+	"uniform vec2 u_size, u_shift;\n" \
+	"uniform float u_period, u_phase, u_angle, u_offset;\n" \
+	"uniform float u_length, u_gap, u_fore, u_back, u_bar;\n" \
+	"vec2 pixel() {\n" \
+	"  return vec2(floor(gl_FragCoord.x), u_size.y-1.0-floor(gl_FragCoord.y));\n" \
+	"}\n"
+
+static const char *shaders[] = {
+	/* GLSTIM_GRATING, u_phase is the shift in pixels */
+	SHADER_HEADER
+	"void main() {\n"
+	"  float x = mod(pixel().x + u_phase, u_period);\n"
+	"  float l;\n"
+	"  if ( u_bar > 0.5 )\n"
+	"    l = x < 1.0 ? u_fore : u_back;\n"
+	"  else\n"
+	"    l = mix(u_back, u_fore, (sin(x/u_period*6.2831853)+1.0)/2.0);\n"
+	"  gl_FragColor = vec4(l, l, l, 1.0);\n"
+	"}\n",
+
+	/* GLSTIM_BAR, a one pixel wide line across the direction of motion,
+	   pixels are centred on whole coordinates as in bars.c and the
+	   half open test lights one pixel per row at any offset */
+	SHADER_HEADER
+	"void main() {\n"
+	"  vec2 dir = vec2(cos(u_angle), sin(u_angle));\n"
+	"  vec2 q = pixel() - floor(u_size/2.0) - dir*u_offset;\n"
+	"  float across = dot(q, dir);\n"
+	"  float along = dot(q, vec2(-dir.y, dir.x));\n"
+	"  float l = u_back;\n"
+	"  if ( across >= -0.5 && across < 0.5 && abs(along) <= u_length+0.5 )\n"
+	"    l = u_fore;\n"
+	"  gl_FragColor = vec4(l, l, l, 1.0);\n"
+	"}\n",
+
+	/* GLSTIM_CHECKER, u_phase 1 swaps the squares */
+	SHADER_HEADER
+	"void main() {\n"
+	"  vec2 cell = floor((pixel()+u_shift)/u_period);\n"
+	"  float l = u_back;\n"
+	"  if ( mod(cell.x+cell.y+u_phase, 2.0) < 0.5 )\n"
+	"    l = u_fore;\n"
+	"  gl_FragColor = vec4(l, l, l, 1.0);\n"
+	"}\n",
+
+	/* GLSTIM_HERMAN, u_phase 1 is the blank frame */
+	SHADER_HEADER
+	"void main() {\n"
+	"  float cellsize = u_period + u_gap;\n"
+	"  vec2 p = pixel()+u_shift;\n"
+	"  vec2 q = p - floor(p/cellsize)*cellsize - floor(u_gap/2.0);\n"
+	"  float l = u_back;\n"
+	"  if ( u_phase < 0.5 &&\n"
+	"       q.x >= 0.0 && q.y >= 0.0 && q.x < u_period && q.y < u_period )\n"
+	"    l = u_fore;\n"
+	"  gl_FragColor = vec4(l, l, l, 1.0);\n"
+	"}\n"
+};
+
+
+static void *GetGLProc(const char *name, int *ok)
+{
+	void *proc;
+
+	proc = SDL_GL_GetProcAddress(name);
+	if ( proc == NULL ) {
+		fprintf(stderr, "OpenGL function %s is missing\n", name);
+		*ok = 0;
+	}
+	return(proc);
+}
+
+
+static int LoadGL(void)
+{
+	int ok = 1;
+
+	pglViewport = (ViewportFunc)GetGLProc("glViewport", &ok);
+	pglRectf = (RectfFunc)GetGLProc("glRectf", &ok);
+	pglCreateShader = (CreateShaderFunc)GetGLProc("glCreateShader", &ok);
+	pglShaderSource = (ShaderSourceFunc)GetGLProc("glShaderSource", &ok);
+	pglCompileShader = (CompileShaderFunc)GetGLProc("glCompileShader", &ok);
+	pglGetShaderiv = (GetShaderivFunc)GetGLProc("glGetShaderiv", &ok);
+	pglGetShaderInfoLog = (GetInfoLogFunc)GetGLProc("glGetShaderInfoLog", &ok);
+	pglCreateProgram = (CreateProgramFunc)GetGLProc("glCreateProgram", &ok);
+	pglAttachShader = (AttachShaderFunc)GetGLProc("glAttachShader", &ok);
+	pglLinkProgram = (LinkProgramFunc)GetGLProc("glLinkProgram", &ok);
+	pglGetProgramiv = (GetProgramivFunc)GetGLProc("glGetProgramiv", &ok);
+	pglGetProgramInfoLog = (GetInfoLogFunc)GetGLProc("glGetProgramInfoLog", &ok);
+	pglUseProgram = (UseProgramFunc)GetGLProc("glUseProgram", &ok);
+	pglGetUniformLocation = (GetUniformLocationFunc)GetGLProc("glGetUniformLocation", &ok);
+	pglUniform1f = (Uniform1fFunc)GetGLProc("glUniform1f", &ok);
+	pglUniform2f = (Uniform2fFunc)GetGLProc("glUniform2f", &ok);
+	pglEnable = (CapFunc)GetGLProc("glEnable", &ok);
+	pglDisable = (CapFunc)GetGLProc("glDisable", &ok);
+	pglScissor = (ScissorFunc)GetGLProc("glScissor", &ok);
+	pglClearColor = (ClearColorFunc)GetGLProc("glClearColor", &ok);
+	pglClear = (ClearFunc)GetGLProc("glClear", &ok);
+	return(ok);
+}
+
+
+SDL_Surface *CreateGLScreen(Uint16 w, Uint16 h, Uint32 flags)
+{
+	SDL_Surface *screen;
+	int swap;
+
+	SDL_GL_SetAttribute(SDL_GL_DOUBLEBUFFER, 1);
+	/* swap on the vertical retrace, needs SDL 1.2.10 */
+	SDL_GL_SetAttribute(SDL_GL_SWAP_CONTROL, 1);
+
+	screen = SDL_SetVideoMode(w, h, 0, SDL_OPENGL|(flags & SDL_FULLSCREEN));
+	if ( screen == NULL ) {
+	  fprintf(stderr, "Couldn't set OpenGL mode: %s\n", SDL_GetError());
+	  return(NULL);
+	}
+	fprintf(stderr, "Screen is in %s OpenGL mode\n",
+		(screen->flags & SDL_FULLSCREEN) ? "fullscreen" : "windowed");
+	if ( SDL_GL_GetAttribute(SDL_GL_SWAP_CONTROL, &swap) < 0 || swap != 1 ) {
+	  fprintf(stderr, "Warning: buffer swaps are not synced to the retrace\n");
+	}
+
+	if ( !LoadGL() ) {
+	  return(NULL);
+	}
+	glw = screen->w;
+	glh = screen->h;
+	pglViewport(0, 0, screen->w, screen->h);
+
+	return(screen);
+}
+
+
+int GLStimInit(int type)
+{
+	GLuint shader, program;
+	GLint status;
+	char log[1024];
+
+	if ( type < 0 || type >= (int)(sizeof(shaders)/sizeof(shaders[0])) ) {
+		return(0);
+	}
+
+	shader = pglCreateShader(GL_FRAGMENT_SHADER);
+	pglShaderSource(shader, 1, (const GLchar **)&shaders[type], NULL);
+	pglCompileShader(shader);
+	pglGetShaderiv(shader, GL_COMPILE_STATUS, &status);
+	if ( !status ) {
+		pglGetShaderInfoLog(shader, sizeof(log), NULL, log);
+		fprintf(stderr, "Couldn't compile shader: %s\n", log);
+		return(0);
+	}
+
+	program = pglCreateProgram();
+	pglAttachShader(program, shader);
+	pglLinkProgram(program);
+	pglGetProgramiv(program, GL_LINK_STATUS, &status);
+	if ( !status ) {
+		pglGetProgramInfoLog(program, sizeof(log), NULL, log);
+		fprintf(stderr, "Couldn't link shader: %s\n", log);
+		return(0);
+	}
+	pglUseProgram(program);
+
+	u_size = pglGetUniformLocation(program, "u_size");
+	u_period = pglGetUniformLocation(program, "u_period");
+	u_phase = pglGetUniformLocation(program, "u_phase");
+	u_angle = pglGetUniformLocation(program, "u_angle");
+	u_offset = pglGetUniformLocation(program, "u_offset");
+	u_length = pglGetUniformLocation(program, "u_length");
+	u_gap = pglGetUniformLocation(program, "u_gap");
+	u_fore = pglGetUniformLocation(program, "u_fore");
+	u_back = pglGetUniformLocation(program, "u_back");
+	u_bar = pglGetUniformLocation(program, "u_bar");
+	u_shift = pglGetUniformLocation(program, "u_shift");
+	pglUniform2f(u_size, glw, glh);
+
+	return(1);
+}
+
+
+void GLStimDraw(const GLStimParams *p)
+{
+	/* unused uniforms have location -1 and are ignored */
+	pglUniform1f(u_period, p->period);
+	pglUniform1f(u_phase, p->phase);
+	pglUniform1f(u_angle, p->angle);
+	pglUniform1f(u_offset, p->offset);
+	pglUniform1f(u_length, p->length);
+	pglUniform1f(u_gap, p->gap);
+	pglUniform1f(u_fore, p->fore);
+	pglUniform1f(u_back, p->back);
+	pglUniform1f(u_bar, (float)p->bar);
+	pglUniform2f(u_shift, p->xoff, p->yoff);
+	pglRectf(-1, -1, 1, 1);
+}
+
+
+void GLSyncPatch(const SyncPatch *sp)
+{
+	float l;
+	int i, symbol;
+
+	if ( sp->code == SYNC_NONE ) {
+		return;
+	}
+	/* clearing a scissor box fills it without touching the shader */
+	symbol = SyncSymbol(sp->code, sp->presented);
+	pglEnable(GL_SCISSOR_TEST);
+	for ( i=0; i<sp->npatches; i++ ) {
+		l = SyncLevel(sp->code, symbol, i)/255.0;
+		pglScissor(i*SYNC_SIZE, glh - SYNC_SIZE, SYNC_SIZE, SYNC_SIZE);
+		pglClearColor(l, l, l, 1);
+		pglClear(GL_COLOR_BUFFER_BIT);
+	}
+	pglDisable(GL_SCISSOR_TEST);
+}
+
+#else
+
+SDL_Surface *CreateGLScreen(Uint16 w, Uint16 h, Uint32 flags)
+{
+	fprintf(stderr, "Compiled without OpenGL support\n");
+	return(NULL);
+}
+
+int GLStimInit(int type)
+{
+	return(0);
+}
+
+void GLStimDraw(const GLStimParams *p)
+{
+}
+
+void GLSyncPatch(const SyncPatch *sp)
+{
+}
+
+#endif
@@ -0,0 +1,47 @@
+/*********************************************************/
+/*                                                       */
+/* OpenGL rendering of the stimuli by fragment shaders   */
+/* so that the CPU cost does not grow with screen size   */
+/*                                                       */
+/* GPL, of course                                        */
+/*                                                       */
+/*********************************************************/
+
+#ifndef GL_BACKEND_H
+#define GL_BACKEND_H
+
+#include "SDL.h"
+#include "syncpatch.h"
+
+/* the stimuli drawn by the shaders */
+#define GLSTIM_GRATING 0
+#define GLSTIM_BAR     1
+#define GLSTIM_CHECKER 2
+#define GLSTIM_HERMAN  3
+
+/* shader parameters, lengths in pixels and gray levels 0..1 */
+typedef struct {
+	float period;	/* grating wavelength or square size */
+	float phase;	/* grating shift, 1 for the reversed or blank frame */
+	float angle;	/* bar orientation in radians */
+	float offset;	/* bar distance from the screen centre */
+	float length;	/* half length of the bar */
+	float gap;	/* gap between herman grid squares */
+	float xoff, yoff;	/* shift of the checker and herman grid */
+	float fore, back;
+	int bar;	/* one pixel lines instead of a sine grating */
+} GLStimParams;
+
+/* OpenGL video mode, swaps are synced to the retrace if possible */
+SDL_Surface *CreateGLScreen(Uint16 w, Uint16 h, Uint32 flags);
+
+/* compile the shader of a stimulus, returns 0 on failure */
+int GLStimInit(int type);
+
+/* draw the stimulus into the back buffer, swap with SDL_GL_SwapBuffers */
+void GLStimDraw(const GLStimParams *p);
+
+/* draw the sync patches over it */
+void GLSyncPatch(const SyncPatch *sp);
+
+#endif
@@ -0,0 +1,332 @@
+/*********************************************************/
+/*                                                       */
+/* Check of the OpenGL shaders against the CPU drawing   */
+/* of the same stimuli, pixel by pixel, meant for Mesa   */
+/* llvmpipe so that it runs without a graphics card      */
+/*                                                       */
+/* GPL, of course                                        */
+/*                                                       */
+/*********************************************************/
+
+/* Each shader draws a few frames into the back buffer, which is read
+   back and compared with what the CPU path of the program draws for
+   the same parameters. Run it by make glcheck, which asks Mesa for
+   its software renderer. It needs a display, xvfb-run will do. */
+
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+
+#include "SDL.h"
+#include "pixels.h"
+#include "calibration.h"
+#include "stimuli.h"
+#include "bars.h"
+#include "gl_backend.h"
+
+#ifdef HAVE_OPENGL
+
+#include "SDL_opengl.h"
+
+/* period of the gratings and squares, not a power of two */
+#define PERIOD 37
+
+/* gap of the herman grid */
+#define GAPSIZE 7
+
+/* half length of the bar */
+#define LENGTH 30
+
+typedef const GLubyte *(APIENTRY *GetStringFunc)(GLenum);
+typedef void (APIENTRY *ReadPixelsFunc)(GLint, GLint, GLsizei, GLsizei, GLenum, GLenum, GLvoid *);
+
+static GetStringFunc pglGetString;
+static ReadPixelsFunc pglReadPixels;
+
+/* the OpenGL screen and the CPU drawing it is compared with */
+static SDL_Surface *screen, *ref;
+static PixelWriter pw;
+static Uint8 *readback;
+static int failures;
+
+
+/* gray level of the frame read back, in SDL coordinates */
+static int GLLevel(int x, int y)
+{
+	return(readback[((screen->h - 1 - y)*screen->w + x)*4]);
+}
+
+
+static int RefLevel(int x, int y)
+{
+	Uint8 r, g, b;
+
+	SDL_GetRGB(*(Uint32 *)((Uint8 *)ref->pixels + y*ref->pitch + x*4), ref->format, &r, &g, &b);
+	return(r);
+}
+
+
+static void ReadBack(void)
+{
+	pglReadPixels(0, 0, screen->w, screen->h, GL_RGBA, GL_UNSIGNED_BYTE, readback);
+}
+
+
+/* the frame drawn by GLStimDraw against ref, tolerance levels apart
+   at most */
+static void Compare(const char *what, int tolerance)
+{
+	int x, y, d, worst, bad, bx, by;
+
+	ReadBack();
+	worst = 0;
+	bad = 0;
+	bx = by = 0;
+	for ( y=0; y<screen->h; y++ ) {
+	  for ( x=0; x<screen->w; x++ ) {
+	    d = abs(GLLevel(x, y) - RefLevel(x, y));
+	    if ( d > tolerance && bad++ == 0 ) {
+	      bx = x;
+	      by = y;
+	    }
+	    if ( d > worst ) {
+	      worst = d;
+	    }
+	  }
+	}
+	if ( bad ) {
+	  printf("%-32s FAILED, %d pixels differ, first at %d,%d: %d on OpenGL, %d on the CPU\n",
+		 what, bad, bx, by, GLLevel(bx, by), RefLevel(bx, by));
+	  failures++;
+	} else {
+	  printf("%-32s ok, largest difference %d\n", what, worst);
+	}
+}
+
+
+/* as moving_grating, a shift of phase pixels is an offset into the row table */
+static void CheckGrating(int bar, int phase)
+{
+	GLStimParams p;
+	Uint8 *c;
+	char what[64];
+	int y;
+
+	memset(&p, 0, sizeof(p));
+	p.period = PERIOD;
+	p.phase = phase;
+	p.bar = bar;
+	p.fore = ModulatedLevel(0.5, 0.8, 1)/255.0;
+	p.back = ModulatedLevel(0.5, 0.8, -1)/255.0;
+	GLStimInit(GLSTIM_GRATING);
+	GLStimDraw(&p);
+
+	c = (Uint8 *)malloc(2*ref->w*pw.bpp);
+	GratingTable(c, &pw, 2*ref->w, PERIOD, bar, 0.5, 0.8, NULL);
+	SDL_LockSurface(ref);
+	for ( y=0; y<ref->h; y++ ) {
+		memcpy((Uint8 *)ref->pixels + y*ref->pitch, c + phase*pw.bpp, ref->w*pw.bpp);
+	}
+	SDL_UnlockSurface(ref);
+	free(c);
+
+	/* the shader interpolates between the extreme levels, the table
+	   rounds each one */
+	sprintf(what, "%s phase %d", bar ? "bars" : "grating", phase);
+	Compare(what, 1);
+}
+
+
+static void CheckChecker(int phase, double xoff, double yoff)
+{
+	GLStimParams p;
+	Uint32 pixel[2];
+	char what[64];
+
+	memset(&p, 0, sizeof(p));
+	p.period = PERIOD;
+	p.phase = phase;
+	p.xoff = xoff;
+	p.yoff = yoff;
+	p.fore = 200/255.0;
+	p.back = 40/255.0;
+	GLStimInit(GLSTIM_CHECKER);
+	GLStimDraw(&p);
+
+	/* as flashing_checker, the reversed frame swaps the pixels */
+	pixel[phase] = pw.map[200];
+	pixel[1-phase] = pw.map[40];
+	DrawChecker(ref, &pw, PERIOD, xoff, yoff, pixel);
+
+	sprintf(what, "checker phase %d shift %g,%g", phase, xoff, yoff);
+	Compare(what, 0);
+}
+
+
+static void CheckHerman(int phase, double xoff, double yoff)
+{
+	GLStimParams p;
+	Uint32 pixel[2];
+	char what[64];
+
+	memset(&p, 0, sizeof(p));
+	p.period = PERIOD;
+	p.gap = GAPSIZE;
+	p.phase = phase;
+	p.xoff = xoff;
+	p.yoff = yoff;
+	p.fore = 200/255.0;
+	p.back = 40/255.0;
+	GLStimInit(GLSTIM_HERMAN);
+	GLStimDraw(&p);
+
+	/* the second frame is blank */
+	pixel[0] = pw.map[40];
+	pixel[1] = phase ? pw.map[40] : pw.map[200];
+	DrawHermanGrid(ref, &pw, PERIOD, GAPSIZE, xoff, yoff, pixel);
+
+	sprintf(what, "herman phase %d shift %g,%g", phase, xoff, yoff);
+	Compare(what, 0);
+}
+
+
+/* The CPU bar is anti-aliased and the shader's is not, so the pixels
+   cannot match. Every pixel the shader lights has to be covered by the
+   CPU bar, and there have to be about as many as the bar is long. */
+static void CheckBar(double angle, double offset)
+{
+	GLStimParams p;
+	BarTrain bars;
+	char what[64];
+	int x, y, lit, outside;
+
+	memset(&p, 0, sizeof(p));
+	p.angle = angle;
+	p.offset = offset;
+	p.length = LENGTH;
+	p.fore = 1;
+	p.back = 0;
+	GLStimInit(GLSTIM_BAR);
+	GLStimDraw(&p);
+	ReadBack();
+
+	if ( !InitBars(&bars, &pw, 1, 1, LENGTH, 1, angle, ref->w, ref->h, NUM_LEVELS-1, 0) ) {
+		exit(2);
+	}
+	SDL_LockSurface(ref);
+	DrawBars(ref, &pw, &bars, offset, 0);
+	SDL_UnlockSurface(ref);
+	FreeBars(&bars);
+
+	lit = 0;
+	outside = 0;
+	for ( y=0; y<screen->h; y++ ) {
+	  for ( x=0; x<screen->w; x++ ) {
+	    if ( GLLevel(x, y) > 127 ) {
+	      lit++;
+	      if ( RefLevel(x, y) == 0 ) {
+		outside++;
+	      }
+	    }
+	  }
+	}
+
+	sprintf(what, "bar angle %g offset %g", angle, offset);
+	if ( outside || lit < 2*LENGTH ) {
+	  printf("%-32s FAILED, %d pixels lit, %d of them outside the CPU bar\n", what, lit, outside);
+	  failures++;
+	} else {
+	  printf("%-32s ok, %d pixels lit\n", what, lit);
+	}
+}
+
+
+int main(int argc, char *argv[])
+{
+	const char *renderer;
+	int width, height;
+
+	width = 320;
+	height = 240;
+	while ( argc > 1 ) {
+	  --argc;
+	  if ( argv[argc-1] && (strcmp(argv[argc-1], "-w") == 0) ) {
+	    width = atoi(argv[argc]);
+	    --argc;
+	  } else if ( argv[argc-1] && (strcmp(argv[argc-1], "-h") == 0) ) {
+	    height = atoi(argv[argc]);
+	    --argc;
+	  } else {
+	    fprintf(stderr, "Usage: %s [-w #] [-h #]\n"
+		    "Draws each shader of gl_backend in a window and compares it pixel by pixel\n"
+		    "with the CPU drawing of the stimulus, exits with 1 if any differ\n", argv[0]);
+	    exit(1);
+	  }
+	}
+
+	if ( SDL_Init(SDL_INIT_VIDEO) < 0 ) {
+		fprintf(stderr, "Couldn't initialize SDL: %s\n", SDL_GetError());
+		exit(1);
+	}
+	atexit(SDL_Quit);
+
+	screen = CreateGLScreen(width, height, 0);
+	if ( screen == NULL ) {
+		exit(2);
+	}
+	pglGetString = (GetStringFunc)SDL_GL_GetProcAddress("glGetString");
+	pglReadPixels = (ReadPixelsFunc)SDL_GL_GetProcAddress("glReadPixels");
+	if ( pglGetString == NULL || pglReadPixels == NULL ) {
+		fprintf(stderr, "Couldn't find glGetString and glReadPixels\n");
+		exit(2);
+	}
+	renderer = (const char *)pglGetString(GL_RENDERER);
+	printf("Renderer: %s\n", renderer);
+	if ( strstr(renderer, "llvmpipe") == NULL ) {
+		fprintf(stderr, "Warning: not Mesa llvmpipe, try LIBGL_ALWAYS_SOFTWARE=1\n");
+	}
+
+	ref = SDL_CreateRGBSurface(SDL_SWSURFACE, screen->w, screen->h, 32,
+				   0xff0000, 0x00ff00, 0x0000ff, 0);
+	readback = (Uint8 *)malloc(screen->w*screen->h*4);
+	if ( ref == NULL || readback == NULL || !InitPixelWriter(&pw, ref->format) ) {
+		fprintf(stderr, "Couldn't create the reference surface\n");
+		exit(2);
+	}
+
+	CheckGrating(0, 0);
+	CheckGrating(0, 13);
+	CheckGrating(0, PERIOD-1);
+	CheckGrating(1, 0);
+	CheckGrating(1, 13);
+	CheckChecker(0, 0, 0);
+	CheckChecker(1, 0, 0);
+	CheckChecker(0, 5, -3);
+	CheckHerman(0, 0, 0);
+	CheckHerman(1, 0, 0);
+	CheckHerman(0, 5, -3);
+	CheckBar(0, 0);
+	CheckBar(0.6, -20);
+	CheckBar(M_PI/2, 17.5);
+
+	SDL_FreeSurface(ref);
+	free(readback);
+	if ( failures ) {
+		printf("%d checks failed\n", failures);
+		exit(1);
+	}
+	printf("All checks passed\n");
+	exit(0);
+}
+
+#else
+
+int main(int argc, char *argv[])
+{
+	fprintf(stderr, "Compiled without OpenGL support\n");
+	exit(1);
+}
+
+#endif
@@ -0,0 +1,602 @@
+/*********************************************************/
+/*                                                       */
+/* Microbenchmarks of the drawing steps of the stimuli   */
+/* and of the fill kernels against the plain memcpy and  */
+/* SDL_FillRect paths, in every pixel format             */
+/*                                                       */
+/* GPL, of course                                        */
+/*                                                       */
+/*********************************************************/
+
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+
+#include "SDL.h"
+#include "refresh.h"
+#include "kernels.h"
+#include "pixels.h"
+#include "plaid.h"
+#include "dots.h"
+#include "calibration.h"
+#include "formula.h"
+#include "stimuli.h"
+#include "bars.h"
+
+#if defined(__GNUC__) && (defined(__i386__) || defined(__x86_64__))
+#include <x86intrin.h>
+#define HAVE_TSC
+#endif
+
+/* repetitions of each measurement, the median is reported */
+#define REPS 5
+
+/* minimum time spent on each repetition */
+#define REP_MS 40
+
+/* slowdown against the baseline which is flagged, at least */
+#define TOLERANCE 0.10
+
+/* most results kept from a baseline file */
+#define MAX_RESULTS 1024
+
+/* most formula to grating ratios kept for the summary */
+#define MAX_RATIOS 64
+
+/* square size of the checkerboard case */
+#define SQSIZE 20
+
+/* gap of the herman grid case */
+#define GAPSIZE 6
+
+/* period of the grating cases */
+#define PERIOD 64
+
+/* steps of the mach band case */
+#define MACHNUM 8
+
+typedef struct {
+	char key[64];		/* name|kernel|bpp|wxh */
+	double ns;
+} Result;
+
+typedef struct {
+	const char *name;
+	const char *kernel;
+	int bpp;
+	double ratio;
+} Ratio;
+
+static SDL_Surface *surface;
+static Uint8 *row;
+static Uint32 white;
+static Uint32 pixel[2];
+static PixelWriter pw;
+static double plaid_t;
+static DotField dots;
+static int dot_frame;
+static Uint8 *grating;
+static int grating_step;
+static Formula formula;
+static double formula_t;
+static BarTrain bar_train;
+static double bar_offset;
+static Uint8 *levels[3];
+static const double red_green[3] = { 1, -1, 0 };
+
+/* cycles and spread of the last measurement */
+static double cycles, spread;
+
+static Result baseline[MAX_RESULTS];
+static int nbaseline;
+static Ratio ratios[MAX_RATIOS];
+static int nratios;
+static FILE *save;
+static int ncompared, nslower;
+
+
+/* the memcpy loop of moving_grating and moving_mach_bands */
+static void RowsMemcpy(void)
+{
+	Uint8 *p = (Uint8 *)surface->pixels;
+	int i;
+
+	for ( i=0; i<surface->h; i++ ) {
+		memcpy(p, row, surface->w*surface->format->BytesPerPixel);
+		p += surface->pitch;
+	}
+}
+
+
+static void RowsKernel(void)
+{
+	ReplicateRow((Uint8 *)surface->pixels, surface->pitch, row,
+		     surface->w*surface->format->BytesPerPixel, surface->h);
+}
+
+
+static void FillSDL(void)
+{
+	SDL_FillRect(surface, NULL, white);
+}
+
+
+static void FillKernel(void)
+{
+	FillSolid((Uint8 *)surface->pixels, surface->pitch,
+		  surface->w*surface->format->BytesPerPixel, surface->h,
+		  white, surface->format->BytesPerPixel);
+}
+
+
+/* the square by square construction flashing_checker used to have */
+static void CheckerSDL(void)
+{
+	SDL_Rect grid;
+	int i, j;
+
+	for ( i=0; i<surface->h/SQSIZE; i++ ) {
+		for ( j=i%2; j<surface->w/SQSIZE; j=j+2 ) {
+			grid.x = j*SQSIZE;
+			grid.y = i*SQSIZE;
+			grid.w = SQSIZE;
+			grid.h = SQSIZE;
+			SDL_FillRect(surface, &grid, white);
+		}
+	}
+}
+
+
+/* two rows of squares tiled and replicated */
+static void CheckerTile(void)
+{
+	int bpp = surface->format->BytesPerPixel;
+	int rowbytes = surface->w*bpp;
+	Uint8 *pattern, *p;
+	int i;
+
+	pattern = (Uint8 *)malloc(4*SQSIZE*bpp);
+	FillSolid(pattern, 0, SQSIZE*bpp, 1, white, bpp);
+	memset(pattern+SQSIZE*bpp, 0, SQSIZE*bpp);
+	memcpy(pattern+2*SQSIZE*bpp, pattern+SQSIZE*bpp, SQSIZE*bpp);
+	memcpy(pattern+3*SQSIZE*bpp, pattern, SQSIZE*bpp);
+	p = (Uint8 *)surface->pixels;
+	TilePattern(row, rowbytes, pattern, 2*SQSIZE*bpp);
+	TilePattern(row+rowbytes, rowbytes, pattern+2*SQSIZE*bpp, 2*SQSIZE*bpp);
+	for ( i=0; i<surface->h; i+=SQSIZE ) {
+		ReplicateRow(p + i*surface->pitch, surface->pitch,
+			     row + ((i/SQSIZE)%2)*rowbytes, rowbytes,
+			     surface->h-i < SQSIZE ? surface->h-i : SQSIZE);
+	}
+	free(pattern);
+}
+
+
+/* the board of flashing_checker */
+static void Checker(void)
+{
+	DrawChecker(surface, &pw, SQSIZE, 0, 0, pixel);
+}
+
+
+/* the grid of flashing_herman_grid */
+static void HermanGrid(void)
+{
+	DrawHermanGrid(surface, &pw, SQSIZE, GAPSIZE, 0, 0, pixel);
+}
+
+
+/* the row table moving_grating builds for two screen widths */
+static void GratingBuild(void)
+{
+	GratingTable(row, &pw, 2*surface->w, PERIOD, 0, 0.5, 1, NULL);
+}
+
+
+/* the same in colour, red and green in antiphase */
+static void ColourGratingBuild(void)
+{
+	ColourGratingTable(row, &pw, 2*surface->w, PERIOD, 0, 0.5, 1, red_green, NULL);
+}
+
+
+/* the rows of a dithered grating made from levels on every frame,
+   gray and in colour */
+static void LevelRow(void)
+{
+	pw.row(row, levels[RED], surface->w, pw.map);
+}
+
+
+static void ColourRow(void)
+{
+	pw.colour(&pw, row, levels, surface->w);
+}
+
+
+/* the row table of moving_mach_bands */
+static void MachBandBuild(void)
+{
+	MachBandTable(row, &pw, surface->w, MACHNUM, 0.5, 1);
+}
+
+
+/* a frame of moving_bar, a train of oblique bars across the screen
+   moving by a fraction of a pixel */
+static void BarFrame(void)
+{
+	DrawBars(surface, &pw, &bar_train, bar_offset, 0);
+	bar_offset += 1.37;
+	if ( bar_offset > surface->w/2 ) {
+		bar_offset -= surface->w;
+	}
+}
+
+
+/* a new plaid frame at 60 Hz */
+static void Plaid(void)
+{
+	RenderPlaid(surface, &pw, plaid_t);
+	plaid_t += 1/60.0;
+}
+
+
+/* one frame of a random dot kinematogram */
+static void Dots(void)
+{
+	MoveDots(&dots, 1, ++dot_frame);
+	DrawDots(surface, &pw, &dots, 0, white, 0);
+}
+
+
+/* a frame of moving_grating, the row starts at the phase in the table */
+static void GratingFrame(void)
+{
+	ReplicateRow((Uint8 *)surface->pixels, surface->pitch,
+		     grating + (grating_step++%PERIOD)*pw.bpp,
+		     surface->w*pw.bpp, surface->h);
+}
+
+
+/* a frame of a formula at 60 Hz */
+static void FormulaFrame(void)
+{
+	RenderFormula(&formula, surface, &pw, formula_t);
+	formula_t += 1/60.0;
+}
+
+
+/* the time stamp counter, reference cycles rather than core cycles
+   where the clock is scaled, 0 where there is none */
+static double Ticks(void)
+{
+#ifdef HAVE_TSC
+	return((double)__rdtsc());
+#else
+	return(0);
+#endif
+}
+
+
+static int CompareDouble(const void *a, const void *b)
+{
+	double d = *(const double *)a - *(const double *)b;
+
+	return( d < 0 ? -1 : d > 0 );
+}
+
+
+/* run f REPS times for at least REP_MS each after a warm up call,
+   returns the median ns per call and sets cycles and spread */
+static double Measure(void (*f)(void))
+{
+	double ns[REPS], ticks[REPS];
+	double start, now, t0;
+	int n, r;
+
+	f();
+	for ( r=0; r<REPS; r++ ) {
+		n = 0;
+		start = GetTimeMs();
+		t0 = Ticks();
+		do {
+			f();
+			n++;
+			now = GetTimeMs();
+		} while ( now - start < REP_MS );
+		ticks[r] = (Ticks() - t0)/n;
+		ns[r] = (now - start)*1.0e6/n;
+	}
+	qsort(ns, REPS, sizeof(double), CompareDouble);
+	qsort(ticks, REPS, sizeof(double), CompareDouble);
+	cycles = ticks[REPS/2];
+	spread = (ns[REPS-1] - ns[0])/ns[REPS/2];
+	return(ns[REPS/2]);
+}
+
+
+/* replace spaces in names so that keys are single words */
+static const char *Name(const char *what)
+{
+	static char name[64];
+	int i;
+
+	for ( i=0; what[i] && i<(int)sizeof(name)-1; i++ ) {
+		name[i] = (what[i] == ' ') ? '_' : what[i];
+	}
+	name[i] = '\0';
+	return(name);
+}
+
+
+static void MakeKey(char *key, const char *what)
+{
+	sprintf(key, "%.32s|%s|%d|%dx%d", Name(what), KernelName(),
+		surface->format->BitsPerPixel, surface->w, surface->h);
+}
+
+
+/* print a measurement of a step writing npixels, save it and compare
+   it with the baseline */
+static void Report(const char *what, double ns, double npixels)
+{
+	double bytes = npixels*surface->format->BytesPerPixel;
+	char key[64];
+	int i;
+
+	printf("%-24s %-8s %3d %5dx%-5d %12.0f ns %8.2f GB/s", what, KernelName(),
+	       surface->format->BitsPerPixel, surface->w, surface->h, ns, bytes/ns);
+	if ( cycles > 0 ) {
+		printf(" %7.3f cyc/px", cycles/npixels);
+	} else {
+		printf(" %7s cyc/px", "-");
+	}
+	printf(" %6.1f%%", 100*spread);
+
+	MakeKey(key, what);
+	if ( save != NULL ) {
+		fprintf(save, "%s %.1f\n", key, ns);
+	}
+	for ( i=0; i<nbaseline; i++ ) {
+		if ( strcmp(baseline[i].key, key) == 0 ) {
+			printf(" %+6.1f%%", 100*(ns/baseline[i].ns - 1));
+			ncompared++;
+			/* runs which scatter more than the tolerance are
+			   only flagged outside their own spread */
+			if ( ns > baseline[i].ns*(1 + (spread > TOLERANCE ? spread : TOLERANCE)) ) {
+				printf(" SLOWER");
+				nslower++;
+			}
+			break;
+		}
+	}
+	printf("\n");
+}
+
+
+static void ReportFrame(const char *what, double ns)
+{
+	Report(what, ns, (double)surface->w*surface->h);
+}
+
+
+/* read the results saved by -save, one "key ns" per line */
+static void LoadBaseline(const char *filename)
+{
+	FILE *fp;
+	char line[128];
+
+	fp = fopen(filename, "r");
+	if ( fp == NULL ) {
+		fprintf(stderr, "Couldn't open baseline %s\n", filename);
+		exit(1);
+	}
+	while ( nbaseline < MAX_RESULTS && fgets(line, sizeof(line), fp) != NULL ) {
+		if ( sscanf(line, "%63s %lf", baseline[nbaseline].key, &baseline[nbaseline].ns) == 2 ) {
+			nbaseline++;
+		}
+	}
+	fclose(fp);
+}
+
+
+static SDL_Surface *CreateSurface(int w, int h, int bpp)
+{
+	SDL_Surface *s;
+
+	s = SDL_CreateRGBSurface(SDL_SWSURFACE, w, h, bpp, 0,0,0,0);
+	if ( s == NULL || !InitPixelWriter(&pw, s->format) ) {
+		fprintf(stderr, "Couldn't create surface: %s\n", SDL_GetError());
+		exit(2);
+	}
+	white = pw.map[255];
+	pixel[0] = pw.map[0];
+	pixel[1] = pw.map[255];
+	return(s);
+}
+
+
+int main(int argc, char *argv[])
+{
+	static const int sizes[][2] = {
+		{ 640, 480 }, { 1920, 1080 }, { 3840, 2160 }
+	};
+	static const int formats[] = { 8, 16, 24, 32 };
+	static const char *kernels[] = { "generic", "sse2", "avx2" };
+	/* oblique components, and a horizontal plus vertical plaid */
+	static const GratingComponent oblique[] = {
+		{ 30, 64, 2, 0.2 }, { 120, 48, 3, 0.2 }, { 60, 80, 1, 0.2 }, { 150, 40, 4, 0.2 }
+	};
+	static const GratingComponent separable[] = {
+		{ 0, 64, 2, 0.4 }, { 90, 48, 3, 0.4 }
+	};
+	/* the moving_grating case, and a pattern which needs every pixel */
+	static const char *formulas[][2] = {
+		{ "formula grating", "sin(2*pi*(x/period - 2*t))" },
+		{ "formula rings", "sin(2*pi*(sqrt(x*x + y*y)/period - 2*t))" }
+	};
+	static char *names[] = { "period" };
+	static const double values[] = { PERIOD };
+	double table_ms, ns;
+	char what[32];
+	int bpp, f, s, k, n;
+	char *savefile;
+
+	bpp = 0;
+	savefile = NULL;
+	while ( argc > 1 ) {
+	  --argc;
+	  if ( argv[argc-1] && (strcmp(argv[argc-1], "-bpp") == 0) ) {
+	    bpp = atoi(argv[argc]);
+	    --argc;
+	  } else if ( argv[argc-1] && (strcmp(argv[argc-1], "-save") == 0) ) {
+	    savefile = argv[argc];
+	    --argc;
+	  } else if ( argv[argc-1] && (strcmp(argv[argc-1], "-compare") == 0) ) {
+	    LoadBaseline(argv[argc]);
+	    --argc;
+	  } else {
+	    fprintf(stderr, "Usage: %s [-bpp #] [-save file] [-compare file]\n"
+		    "Times every step in each pixel format, or only in -bpp, as the median\n"
+		    "of %d runs: ns per call, GB/s written, cycles per pixel and the spread\n"
+		    "of the runs. -save writes the results as a baseline, -compare flags\n"
+		    "those more than %.0f%% slower than the baseline\n",
+		    argv[0], REPS, 100*TOLERANCE);
+	    exit(1);
+	  }
+	}
+	if ( savefile != NULL ) {
+	  save = fopen(savefile, "w");
+	  if ( save == NULL ) {
+	    fprintf(stderr, "Couldn't write baseline %s\n", savefile);
+	    exit(1);
+	  }
+	}
+
+	InitKernels();
+	printf("%-24s %-8s %3s %-11s %15s %13s %14s %7s%s\n", "step", "kernel", "bpp", "size",
+	       "time", "bandwidth", "cycles", "spread", nbaseline ? " vs base" : "");
+	for ( f=0; f<(int)(sizeof(formats)/sizeof(formats[0])); f++ ) {
+	  if ( bpp != 0 && formats[f] != bpp ) {
+	    continue;
+	  }
+	  for ( s=0; s<(int)(sizeof(sizes)/sizeof(sizes[0])); s++ ) {
+		surface = CreateSurface(sizes[s][0], sizes[s][1], formats[f]);
+		row = (Uint8 *)malloc(2*surface->pitch);
+		memset(row, 0x80, 2*surface->pitch);
+		for ( k=RED; k<=BLUE; k++ ) {
+			levels[k] = (Uint8 *)malloc(surface->w);
+			for ( n=0; n<surface->w; n++ ) {
+				levels[k][n] = (Uint8)(n*(k + 1));
+			}
+		}
+		InitBars(&bar_train, &pw, 4, 8, surface->h, 100, M_PI/6, surface->w, surface->h, 255, 0);
+
+		SelectKernels("generic");
+		ReportFrame("rows memcpy", Measure(RowsMemcpy));
+		ReportFrame("fill SDL_FillRect", Measure(FillSDL));
+		ReportFrame("checker SDL_FillRect", Measure(CheckerSDL));
+		for ( k=0; k<(int)(sizeof(kernels)/sizeof(kernels[0])); k++ ) {
+			if ( !SelectKernels(kernels[k]) ) {
+				continue;
+			}
+			ReportFrame("rows ReplicateRow", Measure(RowsKernel));
+			ReportFrame("fill FillSolid", Measure(FillKernel));
+			ReportFrame("checker TilePattern", Measure(CheckerTile));
+			ReportFrame("checker DrawChecker", Measure(Checker));
+			ReportFrame("herman DrawHermanGrid", Measure(HermanGrid));
+			ReportFrame("bar DrawBars", Measure(BarFrame));
+			Report("grating GratingTable", Measure(GratingBuild), 2.0*surface->w);
+			Report("mach MachBandTable", Measure(MachBandBuild), 2.0*surface->w);
+			Report("row PixelWriter row", Measure(LevelRow), surface->w);
+			if ( pw.colour != NULL ) {
+				Report("grating ColourGratingTable", Measure(ColourGratingBuild), 2.0*surface->w);
+				Report("row PixelWriter colour", Measure(ColourRow), surface->w);
+			}
+		}
+		for ( k=RED; k<=BLUE; k++ ) {
+			free(levels[k]);
+		}
+		free(row);
+		FreeBars(&bar_train);
+		SDL_FreeSurface(surface);
+	  }
+
+	  /* the plaid compositor should scale linearly with the components */
+	  surface = CreateSurface(1920, 1080, formats[f]);
+	  for ( k=0; k<(int)(sizeof(kernels)/sizeof(kernels[0])); k++ ) {
+		if ( !SelectKernels(kernels[k]) ) {
+			continue;
+		}
+		for ( n=1; n<=4; n++ ) {
+			InitPlaid(oblique, n, surface->w, surface->h, 0.5);
+			sprintf(what, "plaid %d oblique", n);
+			ReportFrame(what, Measure(Plaid));
+		}
+		InitPlaid(separable, 2, surface->w, surface->h, 0.5);
+		ReportFrame("plaid separable", Measure(Plaid));
+	  }
+	  FreePlaid();
+
+	  /* the formulas should stay within 2x of the hand written grating */
+	  grating = (Uint8 *)malloc((surface->w + PERIOD)*pw.bpp);
+	  GratingTable(grating, &pw, surface->w + PERIOD, PERIOD, 0, 0.5, 1, NULL);
+	  for ( k=0; k<(int)(sizeof(kernels)/sizeof(kernels[0])); k++ ) {
+		if ( !SelectKernels(kernels[k]) ) {
+			continue;
+		}
+		table_ms = Measure(GratingFrame);
+		ReportFrame("grating frame", table_ms);
+		for ( n=0; n<(int)(sizeof(formulas)/sizeof(formulas[0])); n++ ) {
+			if ( !CompileFormula(&formula, formulas[n][1], surface->w, names, values, 1) ) {
+				exit(2);
+			}
+			FormulaLevels(&formula, 0.5, 1);
+			ns = Measure(FormulaFrame);
+			ReportFrame(formulas[n][0], ns);
+			/* kept out of the table, which -save and -compare read */
+			if ( nratios < MAX_RATIOS ) {
+				ratios[nratios].name = formulas[n][0];
+				ratios[nratios].kernel = KernelName();
+				ratios[nratios].bpp = formats[f];
+				ratios[nratios].ratio = ns/table_ms;
+				nratios++;
+			}
+			FreeFormula(&formula);
+		}
+	  }
+	  free(grating);
+
+	  /* random dots should hold the frame rate at 100k dots */
+	  for ( k=0; k<(int)(sizeof(kernels)/sizeof(kernels[0])); k++ ) {
+		if ( !SelectKernels(kernels[k]) ) {
+			continue;
+		}
+		for ( n=10000; n<=100000; n*=10 ) {
+			InitDots(&dots, n, 2, surface->w, surface->h, 30, 5, 0.5, 60, 1);
+			sprintf(what, "dots %dk", n/1000);
+			ReportFrame(what, Measure(Dots));
+			FreeDots(&dots);
+		}
+	  }
+	  SDL_FreeSurface(surface);
+	}
+
+	if ( save != NULL ) {
+	  fclose(save);
+	}
+	if ( nratios > 0 ) {
+	  printf("\nFormulas against the grating frame, 1920x1080:\n");
+	  for ( n=0; n<nratios; n++ ) {
+	    printf("%-24s %-8s %3d %.2fx\n", ratios[n].name, ratios[n].kernel, ratios[n].bpp,
+		   ratios[n].ratio);
+	  }
+	}
+	if ( nbaseline > 0 ) {
+	  printf("%d of %d steps more than %.0f%% slower than the baseline\n",
+		 nslower, ncompared, 100*TOLERANCE);
+	}
+	return(0);
+}
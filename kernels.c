@@ -0,0 +1,405 @@
+/*********************************************************/
+/*                                                       */
+/* Row replication, pattern tiling and solid fill with   */
+/* SIMD and streaming stores, picked at startup          */
+/*                                                       */
+/* GPL, of course                                        */
+/*                                                       */
+/*********************************************************/
+
+
+#include <stdio.h>
+#include <string.h>
+#ifndef _WIN32
+#include <unistd.h>
+#endif
+
+#include "SDL.h"
+#include "kernels.h"
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__)) && defined(__SSE2__)
+#define HAVE_X86_KERNELS
+#include <immintrin.h>
+#endif
+
+/* assumed last level cache if the system does not tell */
+#define DEFAULT_LLC_BYTES (8*1024*1024)
+
+/* the fill pattern covers whole pixels of 1..4 bytes and whole vectors */
+#define PATTERN_BYTES 96
+
+/* copy n bytes, stream bypasses the cache */
+typedef void (*CopyFunc)(Uint8 *dst, const Uint8 *src, size_t n, int stream);
+/* fill n bytes from a PATTERN_BYTES pattern which starts at dst */
+typedef void (*FillFunc)(Uint8 *dst, const Uint8 *pattern, size_t n, int stream);
+/* n pixels of 4 bytes from 4 planes, a NULL plane gives 0 */
+typedef void (*InterleaveFunc)(Uint8 *dst, const Uint8 *const *plane, int n);
+
+static const char *kernel_name = "generic";
+static CopyFunc copy_kernel;
+static FillFunc fill_kernel;
+static InterleaveFunc interleave_kernel;
+static size_t llc_bytes = DEFAULT_LLC_BYTES;
+
+
+static void CopyGeneric(Uint8 *dst, const Uint8 *src, size_t n, int stream)
+{
+	memcpy(dst, src, n);
+}
+
+
+static void FillGeneric(Uint8 *dst, const Uint8 *pattern, size_t n, int stream)
+{
+	while ( n >= PATTERN_BYTES ) {
+		memcpy(dst, pattern, PATTERN_BYTES);
+		dst += PATTERN_BYTES;
+		n -= PATTERN_BYTES;
+	}
+	memcpy(dst, pattern, n);
+}
+
+
+static void InterleaveGeneric(Uint8 *dst, const Uint8 *const *plane, int n)
+{
+	int i, j;
+
+	for ( j=0; j<4; j++ ) {
+		if ( plane[j] == NULL ) {
+			for ( i=0; i<n; i++ ) {
+				dst[4*i + j] = 0;
+			}
+		} else {
+			for ( i=0; i<n; i++ ) {
+				dst[4*i + j] = plane[j][i];
+			}
+		}
+	}
+}
+
+#ifdef HAVE_X86_KERNELS
+
+/* bytes up to the next multiple of align */
+#define HEAD(p, align) ((size_t)(-(size_t)(p)) & ((align)-1))
+
+static void CopySSE2(Uint8 *dst, const Uint8 *src, size_t n, int stream)
+{
+	size_t head, i;
+	__m128i a, b;
+
+	head = HEAD(dst, 16);
+	if ( head > n ) {
+		head = n;
+	}
+	memcpy(dst, src, head);
+	dst += head;
+	src += head;
+	n -= head;
+
+	/* dst is aligned now, src may not be */
+	if ( stream ) {
+		for ( i=0; i+32<=n; i+=32 ) {
+			a = _mm_loadu_si128((const __m128i *)(src+i));
+			b = _mm_loadu_si128((const __m128i *)(src+i+16));
+			_mm_stream_si128((__m128i *)(dst+i), a);
+			_mm_stream_si128((__m128i *)(dst+i+16), b);
+		}
+	} else {
+		for ( i=0; i+32<=n; i+=32 ) {
+			a = _mm_loadu_si128((const __m128i *)(src+i));
+			b = _mm_loadu_si128((const __m128i *)(src+i+16));
+			_mm_store_si128((__m128i *)(dst+i), a);
+			_mm_store_si128((__m128i *)(dst+i+16), b);
+		}
+	}
+	memcpy(dst+i, src+i, n-i);
+}
+
+
+static void FillSSE2(Uint8 *dst, const Uint8 *pattern, size_t n, int stream)
+{
+	size_t head, i;
+	__m128i v[PATTERN_BYTES/16];
+	int k;
+
+	head = HEAD(dst, 16);
+	if ( head > n ) {
+		head = n;
+	}
+	memcpy(dst, pattern, head);
+
+	/* the pattern continues at the aligned address with phase head */
+	for ( k=0; k<PATTERN_BYTES/16; k++ ) {
+		v[k] = _mm_loadu_si128((const __m128i *)(pattern + head + 16*k));
+	}
+	for ( i=head; i+PATTERN_BYTES<=n; i+=PATTERN_BYTES ) {
+		for ( k=0; k<PATTERN_BYTES/16; k++ ) {
+			if ( stream ) {
+				_mm_stream_si128((__m128i *)(dst+i+16*k), v[k]);
+			} else {
+				_mm_store_si128((__m128i *)(dst+i+16*k), v[k]);
+			}
+		}
+	}
+	memcpy(dst+i, pattern+head, n-i);
+}
+
+
+/* 16 pixels per step: bytes of planes 0 and 1 and of 2 and 3 are
+   paired, then the pairs are joined into pixels */
+static void InterleaveSSE2(Uint8 *dst, const Uint8 *const *plane, int n)
+{
+	__m128i v[4], lo01, hi01, lo23, hi23;
+	const Uint8 *tail[4];
+	int i, j;
+
+	for ( i=0; i+16<=n; i+=16 ) {
+		for ( j=0; j<4; j++ ) {
+			v[j] = plane[j] ? _mm_loadu_si128((const __m128i *)(plane[j] + i))
+					: _mm_setzero_si128();
+		}
+		lo01 = _mm_unpacklo_epi8(v[0], v[1]);
+		hi01 = _mm_unpackhi_epi8(v[0], v[1]);
+		lo23 = _mm_unpacklo_epi8(v[2], v[3]);
+		hi23 = _mm_unpackhi_epi8(v[2], v[3]);
+		_mm_storeu_si128((__m128i *)(dst + 4*i), _mm_unpacklo_epi16(lo01, lo23));
+		_mm_storeu_si128((__m128i *)(dst + 4*i + 16), _mm_unpackhi_epi16(lo01, lo23));
+		_mm_storeu_si128((__m128i *)(dst + 4*i + 32), _mm_unpacklo_epi16(hi01, hi23));
+		_mm_storeu_si128((__m128i *)(dst + 4*i + 48), _mm_unpackhi_epi16(hi01, hi23));
+	}
+	for ( j=0; j<4; j++ ) {
+		tail[j] = plane[j] ? plane[j] + i : NULL;
+	}
+	InterleaveGeneric(dst + 4*i, tail, n - i);
+}
+
+
+__attribute__((target("avx2")))
+static void CopyAVX2(Uint8 *dst, const Uint8 *src, size_t n, int stream)
+{
+	size_t head, i;
+	__m256i a, b;
+
+	head = HEAD(dst, 32);
+	if ( head > n ) {
+		head = n;
+	}
+	memcpy(dst, src, head);
+	dst += head;
+	src += head;
+	n -= head;
+
+	if ( stream ) {
+		for ( i=0; i+64<=n; i+=64 ) {
+			a = _mm256_loadu_si256((const __m256i *)(src+i));
+			b = _mm256_loadu_si256((const __m256i *)(src+i+32));
+			_mm256_stream_si256((__m256i *)(dst+i), a);
+			_mm256_stream_si256((__m256i *)(dst+i+32), b);
+		}
+	} else {
+		for ( i=0; i+64<=n; i+=64 ) {
+			a = _mm256_loadu_si256((const __m256i *)(src+i));
+			b = _mm256_loadu_si256((const __m256i *)(src+i+32));
+			_mm256_store_si256((__m256i *)(dst+i), a);
+			_mm256_store_si256((__m256i *)(dst+i+32), b);
+		}
+	}
+	memcpy(dst+i, src+i, n-i);
+	_mm256_zeroupper();
+}
+
+
+__attribute__((target("avx2")))
+static void FillAVX2(Uint8 *dst, const Uint8 *pattern, size_t n, int stream)
+{
+	size_t head, i;
+	__m256i v[PATTERN_BYTES/32];
+	int k;
+
+	head = HEAD(dst, 32);
+	if ( head > n ) {
+		head = n;
+	}
+	memcpy(dst, pattern, head);
+
+	for ( k=0; k<PATTERN_BYTES/32; k++ ) {
+		v[k] = _mm256_loadu_si256((const __m256i *)(pattern + head + 32*k));
+	}
+	for ( i=head; i+PATTERN_BYTES<=n; i+=PATTERN_BYTES ) {
+		for ( k=0; k<PATTERN_BYTES/32; k++ ) {
+			if ( stream ) {
+				_mm256_stream_si256((__m256i *)(dst+i+32*k), v[k]);
+			} else {
+				_mm256_store_si256((__m256i *)(dst+i+32*k), v[k]);
+			}
+		}
+	}
+	memcpy(dst+i, pattern+head, n-i);
+	_mm256_zeroupper();
+}
+
+#endif
+
+
+int SelectKernels(const char *name)
+{
+	if ( strcmp(name, "generic") == 0 ) {
+		copy_kernel = CopyGeneric;
+		fill_kernel = FillGeneric;
+		interleave_kernel = InterleaveGeneric;
+#ifdef HAVE_X86_KERNELS
+	} else if ( strcmp(name, "sse2") == 0 ) {
+		copy_kernel = CopySSE2;
+		fill_kernel = FillSSE2;
+		interleave_kernel = InterleaveSSE2;
+	} else if ( strcmp(name, "avx2") == 0 && __builtin_cpu_supports("avx2") ) {
+		copy_kernel = CopyAVX2;
+		fill_kernel = FillAVX2;
+		/* the byte unpacks of AVX2 stay within 128 bit lanes */
+		interleave_kernel = InterleaveSSE2;
+#endif
+	} else {
+		return(0);
+	}
+	kernel_name = name;
+	return(1);
+}
+
+
+void InitKernels(void)
+{
+#if !defined(_WIN32) && defined(_SC_LEVEL3_CACHE_SIZE)
+	long llc;
+
+	llc = sysconf(_SC_LEVEL3_CACHE_SIZE);
+	if ( llc <= 0 ) {
+		llc = sysconf(_SC_LEVEL2_CACHE_SIZE);
+	}
+	if ( llc > 0 ) {
+		llc_bytes = llc;
+	}
+#endif
+
+	if ( !SelectKernels("avx2") && !SelectKernels("sse2") ) {
+		SelectKernels("generic");
+	}
+	fprintf(stderr, "Fill kernels: %s, streaming above %lu kB\n",
+		kernel_name, (unsigned long)(llc_bytes/1024));
+}
+
+
+const char *KernelName(void)
+{
+	if ( copy_kernel == NULL ) {
+		InitKernels();
+	}
+	return(kernel_name);
+}
+
+
+/* frames that do not fit into the cache are written around it */
+static int UseStreaming(size_t bytes)
+{
+	return(bytes > llc_bytes);
+}
+
+
+static void Fence(int stream)
+{
+#ifdef HAVE_X86_KERNELS
+	if ( stream ) {
+		_mm_sfence();
+	}
+#endif
+}
+
+
+void ReplicateRow(Uint8 *dst, int pitch, const Uint8 *src, int rowbytes, int nrows)
+{
+	int i, stream;
+
+	if ( copy_kernel == NULL ) {
+		InitKernels();
+	}
+	stream = UseStreaming((size_t)pitch*nrows);
+	for ( i=0; i<nrows; i++ ) {
+		copy_kernel(dst, src, rowbytes, stream);
+		dst += pitch;
+	}
+	Fence(stream);
+}
+
+
+void ReplicateRows(Uint8 *dst, int pitch, Uint8 *const *rows, const Uint8 *type,
+		   int rowbytes, int nrows)
+{
+	int i, stream;
+
+	if ( copy_kernel == NULL ) {
+		InitKernels();
+	}
+	stream = UseStreaming((size_t)pitch*nrows);
+	for ( i=0; i<nrows; i++ ) {
+		copy_kernel(dst, rows[type[i]], rowbytes, stream);
+		dst += pitch;
+	}
+	Fence(stream);
+}
+
+
+void TilePattern(Uint8 *dst, size_t n, const Uint8 *pattern, int period)
+{
+	size_t done, k;
+
+	if ( n <= (size_t)period ) {
+		memcpy(dst, pattern, n);
+		return;
+	}
+	/* double the filled part until it covers n */
+	memcpy(dst, pattern, period);
+	done = period;
+	while ( done < n ) {
+		k = done;
+		if ( k > n-done ) {
+			k = n-done;
+		}
+		memcpy(dst+done, dst, k);
+		done += k;
+	}
+}
+
+
+void FillSolid(Uint8 *dst, int pitch, int rowbytes, int nrows, Uint32 pixel, int bpp)
+{
+	Uint8 pattern[2*PATTERN_BYTES];
+	Uint8 bytes[4];
+	int i, stream;
+
+	if ( fill_kernel == NULL ) {
+		InitKernels();
+	}
+	/* the pixel as it lies in memory, then enough of it for the
+	   kernels to start at any phase */
+	memcpy(bytes, &pixel, 4);
+#if SDL_BYTEORDER == SDL_BIG_ENDIAN
+	for ( i=0; i<bpp; i++ ) {
+		bytes[i] = (Uint8)(pixel >> (8*(bpp-1-i)));
+	}
+#endif
+	TilePattern(pattern, sizeof(pattern), bytes, bpp);
+
+	stream = UseStreaming((size_t)pitch*nrows);
+	for ( i=0; i<nrows; i++ ) {
+		fill_kernel(dst, pattern, rowbytes, stream);
+		dst += pitch;
+	}
+	Fence(stream);
+}
+
+
+void InterleavePlanes(Uint8 *dst, const Uint8 *const *plane, int n)
+{
+	if ( interleave_kernel == NULL ) {
+		InitKernels();
+	}
+	interleave_kernel(dst, plane, n);
+}
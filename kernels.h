@@ -0,0 +1,46 @@
+/*********************************************************/
+/*                                                       */
+/* Row replication, pattern tiling and solid fill with   */
+/* SIMD and streaming stores, picked at startup          */
+/*                                                       */
+/* GPL, of course                                        */
+/*                                                       */
+/*********************************************************/
+
+#ifndef KERNELS_H
+#define KERNELS_H
+
+#include <stddef.h>
+
+#include "SDL.h"
+
+/* detect the CPU features and cache size, prints the choice */
+void InitKernels(void);
+
+/* name of the kernel set in use */
+const char *KernelName(void);
+
+/* force a kernel set ("generic", "sse2", "avx2"), returns 0 if
+   the CPU cannot run it */
+int SelectKernels(const char *name);
+
+/* copy one row of rowbytes into nrows rows pitch bytes apart */
+void ReplicateRow(Uint8 *dst, int pitch, const Uint8 *src, int rowbytes, int nrows);
+
+/* copy rows[type[y]] into row y of nrows rows pitch bytes apart,
+   for patterns built from a few distinct rows */
+void ReplicateRows(Uint8 *dst, int pitch, Uint8 *const *rows, const Uint8 *type,
+		   int rowbytes, int nrows);
+
+/* fill n bytes by repeating a pattern of period bytes */
+void TilePattern(Uint8 *dst, size_t n, const Uint8 *pattern, int period);
+
+/* fill a rectangle of nrows rows with one pixel value of bpp bytes */
+void FillSolid(Uint8 *dst, int pitch, int rowbytes, int nrows, Uint32 pixel, int bpp);
+
+/* n pixels of 4 bytes whose byte j in memory is plane[j][i], a NULL
+   plane gives 0. Colour rows are kept as one plane of levels per
+   channel. */
+void InterleavePlanes(Uint8 *dst, const Uint8 *const *plane, int n);
+
+#endif
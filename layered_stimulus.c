@@ -0,0 +1,568 @@
+/*********************************************************/
+/*                                                       */
+/* Display several stimuli on top of each other, such as */
+/* a flashing spot over a drifting grating, redrawing    */
+/* only what changed                                     */
+/*                                                       */
+/* GPL, of course                                        */
+/*                                                       */
+/*********************************************************/
+
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+
+#include "SDL.h"
+#include "refresh.h"
+#include "pixels.h"
+#include "kernels.h"
+#include "calibration.h"
+#include "scene.h"
+#include "trace.h"
+#include "perfcount.h"
+#include "syncpatch.h"
+#include "options.h"
+
+/* default parameters */
+#define MEAN 0.5
+#define CONTRAST 1
+
+/* 8 Bit Graphics */
+#define NUM_COLORS	256
+
+/* kinds of layers */
+#define LAYER_GRATING 0
+#define LAYER_HERMAN 1
+#define LAYER_CHECKER 2
+#define LAYER_SPOT 3
+#define LAYER_BAR 4
+
+/* the parameters of all kinds of layers */
+typedef struct {
+	int kind;
+	int period;		/* grating, in pixels */
+	double shift;		/* grating and bar, pixels per frame */
+	int offset;		/* of the grating or bar after the last update */
+	int range;		/* of the bar's offsets */
+	Uint8 *table;		/* levels of one grating period */
+	double sqsize, gapsize;	/* herman grid and checker board */
+	int half;		/* frames of half a flash of the spot */
+	int state;		/* of the spot */
+	Uint8 *levels, *rows[2], *type;	/* work space for drawing */
+} LayerData;
+
+/* mean luminance as a fraction of the range and Michelson contrast */
+double mean, contrast;
+
+/* gray levels of the extremes and the background */
+int fore, back, meanlevel;
+
+PixelWriter pw;
+PerfCounters perf;
+SyncPatch syncpatch;
+
+SDL_Event redrawEvent;
+
+SDL_Surface *CreateScreen(Uint16 w, Uint16 h, Uint8 bpp, Uint32 flags)
+{
+	SDL_Surface *screen;
+	int i;
+	SDL_Color palette[NUM_COLORS];
+
+	/* Set the video mode */
+	screen = SDL_SetVideoMode(w, h, bpp, flags);
+	if ( screen == NULL ) {
+	  fprintf(stderr, "Couldn't set display mode: %s\n",
+		  SDL_GetError());
+	  return(NULL);
+	}
+	fprintf(stderr, "Screen is in %s mode\n",
+		(screen->flags & SDL_FULLSCREEN) ? "fullscreen" : "windowed");
+
+	/* Set a gray colormap */
+	for ( i=0; i<NUM_COLORS; ++i ) {
+		palette[i].r = (NUM_COLORS-1)-i * (256 / NUM_COLORS);
+		palette[i].g = (NUM_COLORS-1)-i * (256 / NUM_COLORS);
+		palette[i].b = (NUM_COLORS-1)-i * (256 / NUM_COLORS);
+	}
+	SDL_SetColors(screen, palette, 0, NUM_COLORS);
+
+	if ( !InitPixelWriter(&pw, screen->format) ) {
+	  return(NULL);
+	}
+	return(screen);
+}
+
+Uint32 refreshTimer(Uint32 interval, void *params)
+{
+	TRACE_INSTANT("timer");
+        SDL_PushEvent(&redrawEvent);
+	return interval;
+}
+
+
+
+/* layers in the reverse order of the command line */
+OptionSpec specs[MAX_LAYERS];
+int nspec;
+
+/* "1,2.5,3" after option into the next spec, it needs min or max
+   numbers, exits with form as the usage on error */
+void AddSpec(const char *option, const char *s, int kind, int min, int max,
+	     const char *form)
+{
+	AddOptionSpec(specs, &nspec, MAX_LAYERS - 1, "layers", option, s, kind, min, max, form);
+}
+
+
+
+/* the background, and the spot and bar, are single levels */
+void DrawSolid(Layer *l, Uint8 *dst, int pitch, const SDL_Rect *clip)
+{
+	LayerData *d;
+	Uint32 pixel;
+
+	d = (LayerData *)l->data;
+	pixel = pw.map[meanlevel];
+	if ( d != NULL ) {
+		pixel = pw.map[d->kind == LAYER_SPOT && d->state ? back : fore];
+	}
+	FillSolid(dst, pitch, clip->w*pw.bpp, clip->h, pixel, pw.bpp);
+}
+
+
+/* a vertical sine grating drifting to the right, one row of the clip
+   is rendered and copied to the others */
+void DrawGrating(Layer *l, Uint8 *dst, int pitch, const SDL_Rect *clip)
+{
+	LayerData *d;
+	int x, p;
+
+	d = (LayerData *)l->data;
+	p = (clip->x - d->offset)%d->period;
+	if ( p < 0 ) {
+		p += d->period;
+	}
+	for ( x=0; x<clip->w; x++ ) {
+		d->levels[x] = d->table[p];
+		if ( ++p == d->period ) {
+			p = 0;
+		}
+	}
+	pw.row(d->rows[0], d->levels, clip->w, pw.map);
+	ReplicateRow(dst, pitch, d->rows[0], clip->w*pw.bpp, clip->h);
+}
+
+
+/* is coordinate x inside a square of the herman grid */
+static int InSquare(int x, double sqsize, double gapsize)
+{
+	double cellsize, q;
+
+	cellsize = sqsize + gapsize;
+	q = x - floor(x/cellsize)*cellsize - floor(gapsize/2);
+	return( q >= 0 && q < sqsize );
+}
+
+/* the herman grid and the checker board are made of two kinds of
+   rows, drawn like in flashing_herman_grid and flashing_checker */
+void DrawPattern(Layer *l, Uint8 *dst, int pitch, const SDL_Rect *clip)
+{
+	LayerData *d;
+	int x, y, r;
+
+	d = (LayerData *)l->data;
+	for ( r=0; r<2; r++ ) {
+		for ( x=0; x<clip->w; x++ ) {
+			if ( d->kind == LAYER_HERMAN ) {
+				d->levels[x] = r && InSquare(clip->x + x, d->sqsize, d->gapsize) ? fore : back;
+			} else {
+				d->levels[x] = (((int)floor((clip->x + x)/d->sqsize) + r) & 1) ? back : fore;
+			}
+		}
+		pw.row(d->rows[r], d->levels, clip->w, pw.map);
+	}
+	for ( y=0; y<clip->h; y++ ) {
+		if ( d->kind == LAYER_HERMAN ) {
+			d->type[y] = InSquare(clip->y + y, d->sqsize, d->gapsize);
+		} else {
+			d->type[y] = (int)floor((clip->y + y)/d->sqsize) & 1;
+		}
+	}
+	ReplicateRows(dst, pitch, d->rows, d->type, clip->w*pw.bpp, clip->h);
+}
+
+
+
+int UpdateGrating(Layer *l, int frame)
+{
+	LayerData *d;
+	int offset;
+
+	d = (LayerData *)l->data;
+	offset = (int)floor(frame*d->shift);
+	if ( offset == d->offset ) {
+		return(0);
+	}
+	d->offset = offset;
+	return(1);
+}
+
+int UpdateSpot(Layer *l, int frame)
+{
+	LayerData *d;
+	int state;
+
+	d = (LayerData *)l->data;
+	state = (frame/d->half)%2;
+	if ( state == d->state ) {
+		return(0);
+	}
+	d->state = state;
+	return(1);
+}
+
+/* the bar enters on the left and leaves on the right */
+int UpdateBar(Layer *l, int frame)
+{
+	LayerData *d;
+	int offset;
+
+	d = (LayerData *)l->data;
+	offset = (int)floor(frame*d->shift)%d->range;
+	if ( offset == d->offset ) {
+		return(0);
+	}
+	d->offset = offset;
+	l->rect.x = offset - l->rect.w;
+	return(1);
+}
+
+
+
+/* a layer of a spec on screen, returns NULL on error */
+Layer *CreateLayer(const OptionSpec *spec, SDL_Surface *screen, double frame_ms)
+{
+	Layer *l;
+	LayerData *d;
+	const double *v;
+	int i, n;
+
+	l = (Layer *)calloc(1, sizeof(Layer));
+	d = (LayerData *)calloc(1, sizeof(LayerData));
+	l->data = d;
+	d->kind = spec->kind;
+	d->offset = -1;
+	d->state = -1;
+	v = spec->v;
+	n = spec->n;
+	/* a layer covers the screen unless given x,y,w,h after its parameters */
+	l->rect.x = l->rect.y = 0;
+	l->rect.w = screen->w;
+	l->rect.h = screen->h;
+
+	switch ( spec->kind ) {
+	case LAYER_GRATING:
+		d->period = (int)floor(v[0] + 0.5);
+		if ( d->period < 2 ) {
+			fprintf(stderr, "A grating period needs at least two pixels\n");
+			return(NULL);
+		}
+		d->shift = d->period*v[1]*frame_ms/1000;
+		d->table = (Uint8 *)malloc(d->period);
+		for ( i=0; i<d->period; i++ ) {
+			d->table[i] = ModulatedLevel(mean, contrast, sin(2*M_PI*i/d->period));
+		}
+		if ( n == 6 ) {
+			l->rect.x = v[2];
+			l->rect.y = v[3];
+			l->rect.w = v[4];
+			l->rect.h = v[5];
+		}
+		l->dynamic = 1;
+		l->update = UpdateGrating;
+		l->draw = DrawGrating;
+		break;
+	case LAYER_HERMAN:
+	case LAYER_CHECKER:
+		d->sqsize = v[0];
+		d->gapsize = spec->kind == LAYER_HERMAN ? v[1] : 0;
+		if ( d->sqsize < 1 || d->gapsize < 0 ) {
+			fprintf(stderr, "The square size must be at least one pixel and the gap positive\n");
+			return(NULL);
+		}
+		i = spec->kind == LAYER_HERMAN ? 2 : 1;
+		if ( n == i + 4 ) {
+			l->rect.x = v[i];
+			l->rect.y = v[i+1];
+			l->rect.w = v[i+2];
+			l->rect.h = v[i+3];
+		}
+		l->draw = DrawPattern;
+		break;
+	case LAYER_SPOT:
+		if ( v[2] < 1 || v[2] > screen->w || v[2] > screen->h ) {
+			fprintf(stderr, "A spot needs a diameter of one pixel up to the screen size\n");
+			return(NULL);
+		}
+		if ( !(v[3] > 0) ) {
+			fprintf(stderr, "A spot needs a flash frequency above zero\n");
+			return(NULL);
+		}
+		l->rect.w = l->rect.h = v[2];
+		l->rect.x = v[0] - v[2]/2;
+		l->rect.y = v[1] - v[2]/2;
+		d->half = FramesFor(500/v[3], frame_ms, "flash half period");
+		l->dynamic = 1;
+		l->update = UpdateSpot;
+		l->draw = DrawSolid;
+		break;
+	case LAYER_BAR:
+		if ( v[0] < 1 || v[0] > screen->w ) {
+			fprintf(stderr, "A bar needs a width of one pixel up to the screen width\n");
+			return(NULL);
+		}
+		l->rect.w = v[0];
+		d->shift = v[1]*frame_ms/1000;
+		d->range = screen->w + l->rect.w;
+		l->dynamic = 1;
+		l->update = UpdateBar;
+		l->draw = DrawSolid;
+		break;
+	}
+	if ( l->rect.w < 1 || l->rect.h < 1 ) {
+		fprintf(stderr, "A layer needs a size of at least one pixel\n");
+		return(NULL);
+	}
+	d->levels = (Uint8 *)malloc(l->rect.w);
+	d->rows[0] = (Uint8 *)malloc(2*l->rect.w*pw.bpp);
+	d->rows[1] = d->rows[0] + l->rect.w*pw.bpp;
+	d->type = (Uint8 *)malloc(l->rect.h);
+	return(l);
+}
+
+
+
+int main(int argc, char *argv[])
+{
+	SDL_Surface *screen;
+	Uint32 videoflags;
+	SDL_TimerID refreshTimerID;
+	SDL_Event event;
+	int width, height, bpp;
+	int done;
+	double rate, frame_ms, start_ms;
+	int i;
+	Layer background, *l;
+	Scene scene;
+	SDL_Rect rects[MAX_DAMAGE + 1];	/* and a sync patch */
+	int frame, lastframe, page, pages, nrects, nframes, log;
+	double touched;
+	long maxtouched;
+
+	redrawEvent.type = SDL_USEREVENT;
+	redrawEvent.user.code = 1;
+	redrawEvent.user.data1 = NULL;
+	redrawEvent.user.data2 = NULL;
+
+	/* Initialize SDL */
+	if ( SDL_Init(SDL_INIT_VIDEO|SDL_INIT_TIMER) < 0 ) {
+		fprintf(stderr, "Couldn't initialize SDL: %s\n",SDL_GetError());
+		exit(1);
+	}
+
+	width = 640;
+	height = 480;
+	bpp = 32;
+	rate = 0;
+	mean = MEAN;
+	contrast = CONTRAST;
+	nspec = 0;
+	log = 0;
+
+	videoflags =  SDL_DOUBLEBUF|SDL_FULLSCREEN;
+
+	while ( argc > 1 ) {
+	  --argc;
+	  if ( argv[argc-1] && (strcmp(argv[argc-1], "-grating") == 0) ) {
+	    AddSpec(argv[argc-1], argv[argc], LAYER_GRATING, 2, 6, "period,freq[,x,y,w,h]");
+	    --argc;
+	  } else if ( argv[argc-1] && (strcmp(argv[argc-1], "-herman") == 0) ) {
+	    AddSpec(argv[argc-1], argv[argc], LAYER_HERMAN, 2, 6, "sqsize,gapsize[,x,y,w,h]");
+	    --argc;
+	  } else if ( argv[argc-1] && (strcmp(argv[argc-1], "-checker") == 0) ) {
+	    AddSpec(argv[argc-1], argv[argc], LAYER_CHECKER, 1, 5, "sqsize[,x,y,w,h]");
+	    --argc;
+	  } else if ( argv[argc-1] && (strcmp(argv[argc-1], "-spot") == 0) ) {
+	    AddSpec(argv[argc-1], argv[argc], LAYER_SPOT, 4, 4, "x,y,diam,freq");
+	    --argc;
+	  } else if ( argv[argc-1] && (strcmp(argv[argc-1], "-bar") == 0) ) {
+	    AddSpec(argv[argc-1], argv[argc], LAYER_BAR, 2, 2, "width,speed");
+	    --argc;
+	  } else if ( argv[argc-1] && (strcmp(argv[argc-1], "-w") == 0) ) {
+	    width = atoi(argv[argc]);
+	    --argc;
+	  } else if ( argv[argc-1] && (strcmp(argv[argc-1], "-h") == 0) ) {
+	    height = atoi(argv[argc]);
+	    --argc;
+	  } else if ( argv[argc-1] && (strcmp(argv[argc-1], "-bpp") == 0) ) {
+	    bpp = atoi(argv[argc]);
+	    --argc;
+	  } else if ( argv[argc-1] && (strcmp(argv[argc-1], "-refresh") == 0) ) {
+	    rate = atof(argv[argc]);
+	    --argc;
+	  } else if ( argv[argc-1] && (strcmp(argv[argc-1], "-mean") == 0) ) {
+	    mean = atof(argv[argc]);
+	    --argc;
+	  } else if ( argv[argc-1] && (strcmp(argv[argc-1], "-contrast") == 0) ) {
+	    contrast = atof(argv[argc]);
+	    --argc;
+	  } else if ( argv[argc-1] && (strcmp(argv[argc-1], "-calib") == 0) ) {
+	    if ( !LoadCalibration(argv[argc]) ) {
+	      exit(1);
+	    }
+	    --argc;
+	  } else if ( argv[argc-1] && (strcmp(argv[argc-1], "-sync") == 0) ) {
+	    OpenSyncPatch(&syncpatch, argv[argc]);
+	    --argc;
+	  } else if ( argv[argc] && (strcmp(argv[argc], "-log") == 0) ) {
+	    log = 1;
+	  } else if ( argv[argc] && (strcmp(argv[argc], "-sw") == 0) ) {
+	    videoflags |= SDL_SWSURFACE;
+	  } else if ( argv[argc] && (strcmp(argv[argc], "-hw") == 0) ) {
+	    videoflags |= SDL_HWSURFACE;
+	  } else if ( argv[argc] && (strcmp(argv[argc], "-hwpalette") == 0) ) {
+	    videoflags |= SDL_HWPALETTE;
+	  } else if ( argv[argc] && (strcmp(argv[argc], "-window") == 0) ) {
+	    videoflags ^= SDL_FULLSCREEN;
+	  } else if ( argv[argc] && (strcmp(argv[argc], "-perf") == 0) ) {
+	    PerfOpen(&perf);
+	  } else
+	    {
+	      fprintf(stderr, "Usage: %s [-window] [-bpp #] [-w #] [-h #] [-grating period,freq[,x,y,w,h]] [-herman sqsize,gapsize[,x,y,w,h]] [-checker sqsize[,x,y,w,h]] [-spot x,y,diam,freq] [-bar width,speed]... [-mean #] [-contrast #] [-calib file] [-refresh #] [-log] [-perf] [-sync luminance|binary]\n", argv[0]);
+	      exit(1);
+	    }
+	}
+
+	contrast = CheckContrast(mean, contrast);
+	fore = ModulatedLevel(mean, contrast, 1);
+	back = ModulatedLevel(mean, contrast, -1);
+	meanlevel = ModulatedLevel(mean, contrast, 0);
+
+	/* Set video mode */
+	screen = CreateScreen(width, height, bpp, videoflags);
+	if ( screen == NULL ) {
+		exit(2);
+	}
+	frame_ms = FramePeriod(screen, rate);
+
+	/* with page flipping each page keeps its own damage */
+	pages = ((screen->flags & SDL_DOUBLEBUF) && (screen->flags & SDL_HWSURFACE)) ? 2 : 1;
+	InitScene(&scene, screen, pages);
+
+	/* a background at the mean luminance, then the layers in the order
+	   of the command line, which was parsed from its end */
+	memset(&background, 0, sizeof(background));
+	background.rect.w = screen->w;
+	background.rect.h = screen->h;
+	background.dynamic = 1;
+	background.draw = DrawSolid;
+	AddLayer(&scene, &background);
+	for ( i=nspec-1; i>=0; i-- ) {
+		l = CreateLayer(&specs[i], screen, frame_ms);
+		if ( l == NULL || !AddLayer(&scene, l) ) {
+			exit(1);
+		}
+	}
+	UpdateScene(&scene, 0);
+	if ( !CacheLayers(&scene, screen) ) {
+		exit(2);
+	}
+
+	SDL_ShowCursor(SDL_DISABLE);
+	refreshTimerID = SDL_AddTimer(FrameTimerInterval(frame_ms), refreshTimer, (void *)screen);
+	start_ms = GetTimeMs();
+	lastframe = -1;
+	page = 0;
+	nframes = 0;
+	touched = 0;
+	maxtouched = 0;
+
+	/* MAIN LOOP, do screen refresh and wait for keys */
+	done = 0;
+	TRACE_BEGIN("wait");
+	while ( !done && SDL_WaitEvent(&event) ) {
+	  TRACE_END("wait");
+	  switch (event.type) {
+	  case SDL_KEYDOWN:
+	    /* Ignore ALT-TAB for windows */
+	    if ( (event.key.keysym.sym == SDLK_LALT) ||
+		 (event.key.keysym.sym == SDLK_TAB) ) {
+	      break;
+	    }
+	    /* Any key quits the application... */
+	  case SDL_QUIT:
+	    done = 1;
+	    break;
+	  case SDL_USEREVENT:
+	    frame = FrameIndex(start_ms, frame_ms);
+	    if ( frame == lastframe ) {
+	      break;
+	    }
+	    lastframe = frame;
+	    TRACE_BEGIN("scene");
+	    UpdateScene(&scene, frame);
+	    TRACE_END("scene");
+	    TRACE_BEGIN("lock");
+	    SDL_LockSurface(screen);
+	    TRACE_END("lock");
+	    TRACE_BEGIN("draw");
+	    PerfBegin(&perf);
+	    nrects = DrawScene(&scene, screen, page, rects);
+	    SDL_UnlockSurface(screen);
+	    PerfEnd(&perf);
+	    TRACE_END("draw");
+	    ShowSyncPatch(&syncpatch, screen, &pw);
+	    if ( pages == 2 ) {
+	      TRACE_BEGIN("flip");
+	      SDL_Flip(screen);
+	      TRACE_END("flip");
+	    } else {
+	      TRACE_BEGIN("update");
+	      SDL_UpdateRects(screen, SyncRects(&syncpatch, rects, nrects), rects);
+	      TRACE_END("update");
+	    }
+	    SyncPresented(&syncpatch, frame);
+	    page = (page + 1)%pages;
+	    /* the first frame of each page draws everything */
+	    if ( nframes >= pages ) {
+	      touched += scene.touched;
+	      if ( scene.touched > maxtouched ) {
+		maxtouched = scene.touched;
+	      }
+	    }
+	    nframes++;
+	    if ( log ) {
+	      printf("touched %d %ld\n", frame, scene.touched);
+	    }
+	    break;
+	  default:
+	    break;
+	  }
+	  TRACE_BEGIN("wait");
+	}
+	TRACE_END("wait");
+	SDL_RemoveTimer(refreshTimerID);
+	SDL_ShowCursor(SDL_ENABLE);
+	if ( nframes > pages ) {
+	  touched /= nframes - pages;
+	  printf("pixels touched per frame: mean %.0f (%.1f%% of the screen), max %ld\n",
+		 touched, 100*touched/((double)screen->w*screen->h), maxtouched);
+	}
+	CloseSyncPatch(&syncpatch);
+	PerfReport(&perf);
+	SDL_Quit();
+	return(0);
+}
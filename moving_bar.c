@@ -17,12 +17,22 @@
 #include <math.h>
 
 #include "SDL.h"
+#include "refresh.h"
+#include "gl_backend.h"
+#include "pixels.h"
+#include "kernels.h"
+#include "bars.h"
+#include "trace.h"
+#include "perfcount.h"
+#include "syncpatch.h"
 
 /* default parameters */
 #define STIMLENGTH 20
 #define FREQUENCY 1
-#define REFRESHINT 50 // ms
 #define ANGLE 0
+#define BARWIDTH 1
+#define NBARS 1
+#define SPACING 50
 
 /* 8 Bit Graphics */
 #define NUM_COLORS	256
@@ -31,10 +41,17 @@
 float stimLength = STIMLENGTH;
 float frequency = FREQUENCY;
 float angle = ANGLE;
+float barWidth = BARWIDTH;
+float spacing = SPACING;
+int nbars = NBARS;
 
 SDL_Event redrawEvent;
 
 int cycle;
+PixelWriter pw;
+BarTrain bars;
+PerfCounters perf;
+SyncPatch syncpatch;
 
 SDL_Surface *CreateScreen(Uint16 w, Uint16 h, Uint8 bpp, Uint32 flags)
 {
@@ -75,6 +92,7 @@ SDL_Surface *CreateScreen(Uint16 w, Uint16 h, Uint8 bpp, Uint32 flags)
 
 Uint32 refreshTimer(Uint32 interval, void *params)
 {
+	TRACE_INSTANT("timer");
         SDL_PushEvent(&redrawEvent);
 	return interval;
 }
@@ -82,24 +100,22 @@ Uint32 refreshTimer(Uint32 interval, void *params)
 
 int main(int argc, char *argv[])
 {
-	SDL_Surface *screen, *buffer;
+	SDL_Surface *screen;
 	Uint32 videoflags;
 	SDL_TimerID refreshTimerID;
 	SDL_Event event;
-	int width, height, bpp, refresh;
+	int width, height, bpp;
 	int done;
-	int shift;
-	Uint8 *buffp;
-	int i, j;
+	int i;
 	int t, interval_stat;
 	Uint32 startTimer, runTimer;
-	float pos;
-	int x,y;
-	float xt,yt;
-	int d;
-	int nsteps;
-	SDL_PixelFormat *fmt;
-	SDL_Rect grid;
+	double sweep, d;
+	double rate, frame_ms, start_ms;
+	int frame, lastframe, page, pages, nframes;
+	double touched;
+	long maxtouched;
+	int usegl;
+	GLStimParams glparams;
 
 	redrawEvent.type = SDL_USEREVENT;
 	redrawEvent.user.code = 1;
@@ -117,7 +133,8 @@ int main(int argc, char *argv[])
 	cycle = 0;
 
 	frequency = FREQUENCY;
-	refresh = REFRESHINT;
+	rate = 0;
+	usegl = 0;
 
 	width = 200;
 	height = 200;
@@ -139,50 +156,101 @@ int main(int argc, char *argv[])
 	  } else if ( argv[argc-1] && (strcmp(argv[argc-1], "-length") == 0) ) {
 	    stimLength = atoi(argv[argc]);
 	    --argc;
+	  } else if ( argv[argc-1] && (strcmp(argv[argc-1], "-width") == 0) ) {
+	    barWidth = atof(argv[argc]);
+	    --argc;
+	  } else if ( argv[argc-1] && (strcmp(argv[argc-1], "-bars") == 0) ) {
+	    nbars = atoi(argv[argc]);
+	    --argc;
+	  } else if ( argv[argc-1] && (strcmp(argv[argc-1], "-spacing") == 0) ) {
+	    spacing = atof(argv[argc]);
+	    --argc;
 	  } else if ( argv[argc-1] && (strcmp(argv[argc-1], "-freq") == 0) ) {
 	    frequency = atof(argv[argc]);
 	    --argc;
 	  } else if ( argv[argc-1] && (strcmp(argv[argc-1], "-bpp") == 0) ) {
 	    bpp = atoi(argv[argc]);
 	    --argc;
+	  } else if ( argv[argc-1] && (strcmp(argv[argc-1], "-refresh") == 0) ) {
+	    rate = atof(argv[argc]);
+	    --argc;
+	  } else if ( argv[argc-1] && (strcmp(argv[argc-1], "-sync") == 0) ) {
+	    OpenSyncPatch(&syncpatch, argv[argc]);
+	    --argc;
 	  } else if ( argv[argc] && (strcmp(argv[argc], "-sw") == 0) ) {
 	    videoflags |= SDL_SWSURFACE;
+	  } else if ( argv[argc] && (strcmp(argv[argc], "-hw") == 0) ) {
+	    videoflags |= SDL_HWSURFACE;
 	  } else if ( argv[argc] && (strcmp(argv[argc], "-hwpalette") == 0) ) {
 	    videoflags |= SDL_HWPALETTE;
 	  } else if ( argv[argc] && (strcmp(argv[argc], "-window") == 0) ) {
 	    videoflags ^= SDL_FULLSCREEN;
+	  } else if ( argv[argc] && (strcmp(argv[argc], "-perf") == 0) ) {
+	    PerfOpen(&perf);
+	  } else if ( argv[argc] && (strcmp(argv[argc], "-gl") == 0) ) {
+	    usegl = 1;
 	  } else 
 	    {
-	      fprintf(stderr, "Usage: %s [-window] [-w #] [-h #] [-angle #] [-length #] [-freq #] [-bpp] [-sw] [-hwpalette]\n", argv[0]);
+	      fprintf(stderr, "Usage: %s [-window] [-w #] [-h #] [-angle #] [-length #] [-width #] [-bars #] [-spacing #] [-freq #] [-refresh #] [-bpp] [-sw] [-hw] [-hwpalette] [-gl] [-perf] [-sync luminance|binary]\n", argv[0]);
 	      exit(1);
 	    }
 	}
+	if ( usegl && (nbars != 1 || barWidth != 1) ) {
+	  fprintf(stderr, "-bars and -width cannot be combined with -gl\n");
+	  exit(1);
+	}
 	
+	angle=angle/180*M_PI;
+
 	/* Set video mode */
-	screen = CreateScreen(width, height, bpp, videoflags);
+	if ( usegl ) {
+		screen = CreateGLScreen(width, height, videoflags);
+		if ( screen == NULL || !GLStimInit(GLSTIM_BAR) ) {
+			exit(2);
+		}
+		glparams.angle = angle;
+		glparams.length = stimLength;
+		glparams.fore = 1;
+		glparams.back = 0;
+	} else {
+		screen = CreateScreen(width, height, bpp, videoflags);
+	}
 	if ( screen == NULL ) {
 		exit(2);
 	}
+	if ( !usegl ) {
+		if ( !InitPixelWriter(&pw, screen->format) ||
+		     !InitBars(&bars, &pw, nbars, barWidth, stimLength, spacing, angle,
+			       screen->w, screen->h, NUM_COLORS-1, 0) ) {
+			exit(2);
+		}
+	}
 
-	angle=angle/180*M_PI;
+	SDL_ShowCursor(SDL_DISABLE);
 
-	/* create a buffer where the stimulus is prepared */
-	buffer = SDL_CreateRGBSurface(SDL_HWSURFACE|SDL_HWACCEL, width, height, bpp, 0,0,0,0);
-	buffer = SDL_DisplayFormat(buffer);
+	/* the train crosses the screen frequency times a second and moves
+	   by fractions of a pixel, which the anti-aliased edges show */
+	frame_ms = FramePeriod(screen, rate);
+	sweep = screen->w + (nbars - 1)*spacing;
+	fprintf(stderr,"f=%f, %.2f pixels per frame\n",frequency,sweep*frequency*frame_ms/1000);
 
-	bpp = screen->format->BytesPerPixel;
-	SDL_ShowCursor(SDL_DISABLE);
-	refreshTimerID = SDL_AddTimer((int)(refresh), refreshTimer, (void *)screen);
-	runTimer = SDL_GetTicks();
+	/* with page flipping each page keeps the bars drawn on it */
+	pages = ((screen->flags & SDL_DOUBLEBUF) && (screen->flags & SDL_HWSURFACE)) ? 2 : 1;
+	page = 0;
 
-	/* calculate the amount of shift per ms */
-	nsteps=ceil(1000.0/(((float)refresh)*frequency));
-	shift=screen->w/nsteps;
-	fprintf(stderr,"f=%f, refresh=%d, shift=%d, nsteps=%d\n",frequency,refresh,shift,nsteps);
+	refreshTimerID = SDL_AddTimer(FrameTimerInterval(frame_ms), refreshTimer, (void *)screen);
+	runTimer = SDL_GetTicks();
+	start_ms = GetTimeMs();
+	lastframe = -1;
+	nframes = 0;
+	touched = 0;
+	maxtouched = 0;
 
 	/* MAIN LOOP, do screen refresh and wait for keys */
 	done = 0;
+	TRACE_BEGIN("wait");
 	while ( !done && SDL_WaitEvent(&event) ) {
+	  TRACE_END("wait");
 	  switch (event.type) {
 	  case SDL_KEYDOWN:
 	    /* Ignore ALT-TAB for windows */
@@ -195,45 +263,78 @@ int main(int argc, char *argv[])
 	    done = 1;
 	    break;
 	  case SDL_USEREVENT:
+	    frame = FrameIndex(start_ms, frame_ms);
+	    if ( frame == lastframe ) {
+	      break;
+	    }
+	    lastframe = frame;
 	    i = runTimer;
 	    runTimer = SDL_GetTicks();
 	    startTimer = i;
 	    interval_stat +=  runTimer - i;
 	    t++;
-	    SDL_LockSurface(buffer);
-	    buffp = (Uint8 *)buffer->pixels;
-	    grid.x = 0;
-	    grid.y = 0;
-	    grid.w = screen->w;
-	    grid.h = screen->h;
-	    fmt = screen->format;
-	    SDL_FillRect(buffer, &grid,  SDL_MapRGB(fmt, 0, 0, 0));
-	    //fprintf(stderr,"t=%d\n",t);
-	    d=(t%nsteps)*shift-shift*nsteps/2;
-	    buffp = (Uint8 *)buffer->pixels;
-	    xt=cos(angle)*d+screen->w/2;
-	    yt=sin(angle)*d+screen->h/2;
-	    for(pos=-stimLength;pos<=stimLength;pos=pos+1) {
-		    x=xt-sin(angle)*pos;
-		    y=yt+cos(angle)*pos;
-		    if ((x>0)&&(x<(screen->w-1))&&(y>0)&&(y<(screen->h-1))) {
-			    buffp[x*bpp+y*screen->w*bpp+0]=NUM_COLORS-1;
-			    buffp[x*bpp+y*screen->w*bpp+1]=NUM_COLORS-1;
-			    buffp[x*bpp+y*screen->w*bpp+2]=NUM_COLORS-1;
-		    }
+	    d = frame*frame_ms*frequency/1000;
+	    d = (d - floor(d) - 0.5)*sweep;
+	    if ( usegl ) {
+	      glparams.offset = d;
+	      TRACE_BEGIN("draw");
+	      PerfBegin(&perf);
+	      GLStimDraw(&glparams);
+	      PerfEnd(&perf);
+	      TRACE_END("draw");
+	      GLSyncPatch(&syncpatch);
+	      TRACE_BEGIN("swap");
+	      SDL_GL_SwapBuffers();
+	      TRACE_END("swap");
+	      SyncPresented(&syncpatch, frame);
+	      break;
+	    }
+	    TRACE_BEGIN("lock");
+	    SDL_LockSurface(screen);
+	    TRACE_END("lock");
+	    TRACE_BEGIN("draw");
+	    PerfBegin(&perf);
+	    DrawBars(screen, &pw, &bars, d, page);
+	    SDL_UnlockSurface(screen);
+	    PerfEnd(&perf);
+	    TRACE_END("draw");
+	    ShowSyncPatch(&syncpatch, screen, &pw);
+	    if ( pages == 2 ) {
+	      TRACE_BEGIN("flip");
+	      SDL_Flip(screen);
+	      TRACE_END("flip");
+	    } else {
+	      TRACE_BEGIN("update");
+	      SDL_UpdateRects(screen, SyncRects(&syncpatch, bars.rect, bars.nrects), bars.rect);
+	      TRACE_END("update");
 	    }
-	    SDL_UnlockSurface(buffer);
-	    SDL_BlitSurface(buffer, NULL, screen, NULL);
-	    SDL_Flip(screen);
-	    cycle += shift*bpp;
+	    SyncPresented(&syncpatch, frame);
+	    page = (page + 1)%pages;
+	    /* the first frame of each page clears it */
+	    if ( nframes >= pages ) {
+	      touched += bars.touched;
+	      if ( bars.touched > maxtouched ) {
+		maxtouched = bars.touched;
+	      }
+	    }
+	    nframes++;
 	    break;
 	  default:
 	    break;
 	  }
+	  TRACE_BEGIN("wait");
 	}
+	TRACE_END("wait");
 	SDL_RemoveTimer(refreshTimerID);
 	SDL_ShowCursor(SDL_ENABLE);
 	printf("mean display interval:%f\n", (float)interval_stat/(float)t);
+	if ( nframes > pages ) {
+	  touched /= nframes - pages;
+	  printf("pixels touched per frame: mean %.0f (%.1f%% of the screen), max %ld\n",
+		 touched, 100*touched/((double)screen->w*screen->h), maxtouched);
+	}
+	CloseSyncPatch(&syncpatch);
+	PerfReport(&perf);
 	SDL_Quit();
 	return(0);	
 }
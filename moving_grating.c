@@ -15,33 +15,84 @@
 #include <stdlib.h>
 #include <string.h>
 #include <math.h>
+#include <unistd.h>
 
 #include "SDL.h"
+#include "refresh.h"
+#include "gl_backend.h"
+#include "pixels.h"
+#include "kernels.h"
+#include "calibration.h"
+#include "colour.h"
+#include "dither.h"
+#include "plaid.h"
+#include "stimuli.h"
+#include "trace.h"
+#include "perfcount.h"
+#include "syncpatch.h"
+#include "frameclock.h"
+#include "pool.h"
+#include "autotune.h"
 
 /* default parameters */
 #define SINEWIDTH 50
 #define FREQUENCY 1
-#define REFRESHINT 100 //ms
+#define REFRESHINT 100 //ms, rounded to whole frames
+#define MEAN 0.5
+#define CONTRAST 1
 
 /* 8 Bit Graphics */
 #define NUM_COLORS	256
 
+/* most memory taken by the precomputed frames of the ring path */
+#define RING_MB 128
+
 /* some global variables */
 float sinewidth = SINEWIDTH;
 float frequency = FREQUENCY;
 int bar=0;
 
+/* mean luminance as a fraction of the range and Michelson contrast */
+double mean = MEAN;
+double contrast = CONTRAST;
+
+/* fractional gray levels for dithering */
+int dither = 0;
+float *value;
+
+/* a colour grating modulates each gun with contrast times rgb, the
+   fractional levels of each channel are kept for dithering */
+int colour = 0;
+double rgb[3];
+float *cvalue[3];
+
+/* the grating moves by shift pixels every update frames */
+int update, shift;
+
 SDL_Event redrawEvent;
 
-int cycle;
-Uint8 c[32768];
+SDL_Surface *screen, *buffer;
+SDL_Color gray[NUM_COLORS];
+Uint8 *c;
+Uint8 *drows[DITHER_SIZE], *dtype, *dlevels, *clevels[3];
+int ncomp;
+double frame_ms;
+
+/* the ring path blits one of nring frames drawn at the start, the
+   threads path splits the screen into bands drawn by a pool */
+SDL_Surface **ring;
+int nring;
+ThreadPool pool;
+
+PixelWriter pw;
+PerfCounters perf;
+SyncPatch syncpatch;
+FrameClock fclock;
 
 SDL_Surface *CreateScreen(Uint16 w, Uint16 h, Uint8 bpp, Uint32 flags)
 {
 	SDL_Surface *screen;
-	int i, j, k;
-	SDL_Color palette[NUM_COLORS];
-	SDL_PixelFormat *fmt;
+	int i;
 
 	/* Set the video mode */
 	screen = SDL_SetVideoMode(w, h, bpp, flags);
@@ -55,11 +106,11 @@ SDL_Surface *CreateScreen(Uint16 w, Uint16 h, Uint8 bpp, Uint32 flags)
 	
 	/* Set a gray colormap */
 	for ( i=0; i<NUM_COLORS; ++i ) {
-		palette[i].r = (NUM_COLORS-1)-i * (256 / NUM_COLORS);
-		palette[i].g = (NUM_COLORS-1)-i * (256 / NUM_COLORS);
-		palette[i].b = (NUM_COLORS-1)-i * (256 / NUM_COLORS);
+		gray[i].r = (NUM_COLORS-1)-i * (256 / NUM_COLORS);
+		gray[i].g = (NUM_COLORS-1)-i * (256 / NUM_COLORS);
+		gray[i].b = (NUM_COLORS-1)-i * (256 / NUM_COLORS);
 	}
-	SDL_SetColors(screen, palette, 0, NUM_COLORS);
+	SDL_SetColors(screen, gray, 0, NUM_COLORS);
 
 	if ( SDL_LockSurface(screen) < 0 ) {
 	  fprintf(stderr, "Couldn't lock display surface: %s\n",
@@ -67,20 +118,25 @@ SDL_Surface *CreateScreen(Uint16 w, Uint16 h, Uint8 bpp, Uint32 flags)
 	  return(NULL);
 	}
 	
-	/* prepare the stimulus */
-	k = 0;
-	for ( i=0; i<2*screen->w; i++ ) {
-	  for(j=0; j<screen->format->BytesPerPixel; j++)
-		  if (bar) {
-			  if ((i%((int)sinewidth))==0) {
-				  c[k+j]=NUM_COLORS-1;
-			  } else {
-				  c[k+j]=0;
-			  }
-		  } else {
-			  c[k+j] = (Uint8) ((NUM_COLORS-1) * (sin((float)i/sinewidth*(2*M_PI))+1)/2);
-		  }
-	  k = k+screen->format->BytesPerPixel;
+	/* prepare the stimulus, two screen widths of gray levels
+	   converted to pixels of the screen format */
+	if ( !InitPixelWriter(&pw, screen->format) ) {
+	  return(NULL);
+	}
+	c = (Uint8 *)malloc(2*screen->w*pw.bpp);
+	if ( colour ) {
+	  if ( pw.colour == NULL ) {
+	    fprintf(stderr, "A colour grating needs more than %d bits per pixel\n", 8*pw.bpp);
+	    return(NULL);
+	  }
+	  for ( i=RED; i<=BLUE; i++ ) {
+	    cvalue[i] = dither ? (float *)malloc(2*screen->w*sizeof(float)) : NULL;
+	  }
+	  ColourGratingTable(c, &pw, 2*screen->w, sinewidth, bar, mean, contrast, rgb,
+			     dither ? cvalue : NULL);
+	} else {
+	  value = dither ? (float *)malloc(2*screen->w*sizeof(float)) : NULL;
+	  GratingTable(c, &pw, 2*screen->w, sinewidth, bar, mean, contrast, value);
 	}
 
 	SDL_UnlockSurface(screen);
@@ -89,8 +145,208 @@ SDL_Surface *CreateScreen(Uint16 w, Uint16 h, Uint8 bpp, Uint32 flags)
 	return(screen);
 }
 
+/* pixels the grating has moved by in frame, within one period */
+int Offset(int frame)
+{
+	int period = (int)sinewidth;
+
+	return((((frame/update)%period)*shift%period + period)%period);
+}
+
+
+/* draw frame into a locked surface, for the direct and buffer paths */
+void DrawFrame(SDL_Surface *target, int frame)
+{
+	int i, j, x;
+
+	x = Offset(frame);
+	if ( ncomp > 0 ) {
+	  RenderPlaid(target, &pw, frame*frame_ms/1000);
+	} else if ( dither ) {
+	  for ( i=0; i<DITHER_SIZE; i++ ) {
+	    if ( colour ) {
+	      for ( j=RED; j<=BLUE; j++ ) {
+		DitherLevels(clevels[j], &cvalue[j][x], target->w, i, frame);
+	      }
+	      pw.colour(&pw, drows[i], clevels, target->w);
+	    } else {
+	      DitherLevels(dlevels, &value[x], target->w, i, frame);
+	      pw.row(drows[i], dlevels, target->w, pw.map);
+	    }
+	  }
+	  ReplicateRows((Uint8 *)target->pixels, target->pitch, drows, dtype,
+			target->w*pw.bpp, target->h);
+	} else {
+	  ReplicateRow((Uint8 *)target->pixels, target->pitch,
+		       &c[x*pw.bpp], target->w*pw.bpp, target->h);
+	}
+}
+
+
+/* the render paths, see the table in main */
+void DrawDirect(int frame)
+{
+	SDL_LockSurface(screen);
+	DrawFrame(screen, frame);
+	SDL_UnlockSurface(screen);
+}
+
+void DrawBuffer(int frame)
+{
+	SDL_LockSurface(buffer);
+	DrawFrame(buffer, frame);
+	SDL_UnlockSurface(buffer);
+	TRACE_BEGIN("blit");
+	SDL_BlitSurface(buffer, NULL, screen, NULL);
+	TRACE_END("blit");
+}
+
+/* The offsets repeat after nring updates, as shift times the update
+   returns to a multiple of the period */
+void DrawRing(int frame)
+{
+	SDL_BlitSurface(ring[(frame/update)%nring], NULL, screen, NULL);
+}
+
+void DrawBand(void *arg, int i)
+{
+	int y0, y1, x;
+
+	x = *(int *)arg;
+	y0 = i*screen->h/(pool.nthreads+1);
+	y1 = (i+1)*screen->h/(pool.nthreads+1);
+	ReplicateRow((Uint8 *)screen->pixels + y0*screen->pitch, screen->pitch,
+		     &c[x*pw.bpp], screen->w*pw.bpp, y1 - y0);
+}
+
+void DrawThreads(int frame)
+{
+	int x;
+
+	x = Offset(frame);
+	SDL_LockSurface(screen);
+	RunPool(&pool, DrawBand, &x, pool.nthreads+1);
+	SDL_UnlockSurface(screen);
+}
+
+/* In palette mode pixel x holds the colour index x modulo the period,
+   so moving the grating only rotates the first period entries. Only
+   the physical palette turns, blits keep mapping by the gray one. */
+void DrawPalette(int frame)
+{
+	SDL_Color colors[NUM_COLORS];
+	int period = (int)sinewidth;
+	int i, x;
+
+	x = Offset(frame);
+	for ( i=0; i<period; i++ ) {
+	  colors[i] = gray[c[(x+i)%period]];
+	}
+	SDL_SetPalette(screen, SDL_PHYSPAL, colors, 0, period);
+}
+
+void DrawIndices(SDL_Surface *screen)
+{
+	Uint8 *row;
+	int x;
+
+	row = (Uint8 *)malloc(screen->w);
+	for ( x=0; x<screen->w; x++ ) {
+	  row[x] = x%((int)sinewidth);
+	}
+	SDL_LockSurface(screen);
+	ReplicateRow((Uint8 *)screen->pixels, screen->pitch, row, screen->w, screen->h);
+	SDL_UnlockSurface(screen);
+	free(row);
+}
+
+
+/* an off screen surface in the format of the screen */
+SDL_Surface *CreateBuffer(SDL_Surface *screen)
+{
+	SDL_Surface *s, *f;
+
+	s = SDL_CreateRGBSurface(SDL_HWSURFACE|SDL_HWACCEL, screen->w, screen->h,
+				 screen->format->BitsPerPixel, 0,0,0,0);
+	if ( s == NULL ) {
+	  return(NULL);
+	}
+	f = SDL_DisplayFormat(s);
+	SDL_FreeSurface(s);
+	return(f);
+}
+
+void FreeRing(void)
+{
+	int i;
+
+	for ( i=0; i<nring; i++ ) {
+	  SDL_FreeSurface(ring[i]);
+	}
+	free(ring);
+	ring = NULL;
+	nring = 0;
+}
+
+
+/* draw the nring frames of the ring path, returns why not if they
+   take too much memory */
+const char *BuildRing(void)
+{
+	static char why[64];
+	int period = (int)sinewidth;
+	int a, b, t, i;
+	double mb;
+
+	/* the number of distinct offsets is period/gcd(shift, period) */
+	a = abs(shift);
+	b = period;
+	while ( a > 0 ) {
+	  t = b%a;
+	  b = a;
+	  a = t;
+	}
+	nring = period/b;
+	mb = (double)nring*screen->h*screen->w*pw.bpp/1048576.0;
+	if ( mb > RING_MB ) {
+	  sprintf(why, "%d frames would take %.0f MB", nring, mb);
+	  return(why);
+	}
+	ring = (SDL_Surface **)malloc(nring*sizeof(SDL_Surface *));
+	for ( i=0; i<nring; i++ ) {
+	  ring[i] = CreateBuffer(screen);
+	  if ( ring[i] == NULL ) {
+	    nring = i;
+	    FreeRing();
+	    return("couldn't allocate the frames");
+	  }
+	  SDL_LockSurface(ring[i]);
+	  DrawFrame(ring[i], i*update);
+	  SDL_UnlockSurface(ring[i]);
+	}
+	return(NULL);
+}
+
+
+/* the render paths, cheapest first: rotating the palette of an 8 bit
+   screen, drawing into the screen, drawing into a buffer blitted to
+   the screen, blitting precomputed frames and drawing bands of the
+   screen on several threads. The last three are only for the plain
+   grating, which is a replicated row. */
+enum { PATH_PALETTE, PATH_DIRECT, PATH_BUFFER, PATH_RING, PATH_THREADS, NPATHS };
+
+RenderPath path[NPATHS] = {
+	{ "palette", NULL, DrawPalette, 0 },
+	{ "direct", NULL, DrawDirect, 0 },
+	{ "buffer", NULL, DrawBuffer, 0 },
+	{ "ring", NULL, DrawRing, 0 },
+	{ "threads", NULL, DrawThreads, 0 }
+};
+
+
 Uint32 refreshTimer(Uint32 interval, void *params)
 {
+	TRACE_INSTANT("timer");
         SDL_PushEvent(&redrawEvent);
 	return interval;
 }
@@ -98,15 +354,22 @@ Uint32 refreshTimer(Uint32 interval, void *params)
 
 int main(int argc, char *argv[])
 {
-	SDL_Surface *screen, *buffer;
 	Uint32 videoflags;
 	SDL_TimerID refreshTimerID;
 	SDL_Event event;
 	int width, height, bpp, refresh;
 	int done;
-	int shift;
-	Uint8 *buffp;
-	int i, j;
+	double rate, start_ms;
+	int step, laststep, frame;
+	int usegl, calibrated, everyframe;
+	double lms[3], cones[3][3];
+	int uselms, usecones;
+	GratingComponent comp[MAX_COMPONENTS];
+	GLStimParams glparams;
+	char *pathname;
+	int usepath, tune;
+	long ncpu;
+	int i;
 	int t, interval_stat;
 	Uint32 startTimer, runTimer;
 
@@ -123,11 +386,18 @@ int main(int argc, char *argv[])
 
 	interval_stat = 0;
 	t = 0;
-	cycle = 0;
 
 	sinewidth = SINEWIDTH;
 	frequency = FREQUENCY;
 	refresh = REFRESHINT;
+	rate = 0;
+	usegl = 0;
+	ncomp = 0;
+	calibrated = 0;
+	uselms = 0;
+	usecones = 0;
+	pathname = NULL;
+	usepath = -1;
 
 	width = 200;
 	height = 200;
@@ -152,43 +422,233 @@ int main(int argc, char *argv[])
 	  } else if ( argv[argc-1] && (strcmp(argv[argc-1], "-bpp") == 0) ) {
 	    bpp = atoi(argv[argc]);
 	    --argc;
+	  } else if ( argv[argc-1] && (strcmp(argv[argc-1], "-refresh") == 0) ) {
+	    rate = atof(argv[argc]);
+	    --argc;
+	  } else if ( argv[argc-1] && (strcmp(argv[argc-1], "-mean") == 0) ) {
+	    mean = atof(argv[argc]);
+	    --argc;
+	  } else if ( argv[argc-1] && (strcmp(argv[argc-1], "-contrast") == 0) ) {
+	    contrast = atof(argv[argc]);
+	    --argc;
+	  } else if ( argv[argc-1] && (strcmp(argv[argc-1], "-comp") == 0) ) {
+	    if ( ncomp == MAX_COMPONENTS || !ParseComponent(argv[argc], &comp[ncomp]) ) {
+	      fprintf(stderr, "-comp takes angle,period,frequency,contrast, at most %d times\n", MAX_COMPONENTS);
+	      exit(1);
+	    }
+	    ncomp++;
+	    --argc;
+	  } else if ( argv[argc-1] && (strcmp(argv[argc-1], "-calib") == 0) ) {
+	    if ( !LoadCalibration(argv[argc]) ) {
+	      exit(1);
+	    }
+	    calibrated = 1;
+	    --argc;
+	  } else if ( argv[argc-1] && (strcmp(argv[argc-1], "-rgb") == 0) ) {
+	    if ( !ParseDirection(argv[argc], rgb) ) {
+	      fprintf(stderr, "-rgb takes the contrasts of the red, green and blue guns as r,g,b\n");
+	      exit(1);
+	    }
+	    colour = 1;
+	    --argc;
+	  } else if ( argv[argc-1] && (strcmp(argv[argc-1], "-lms") == 0) ) {
+	    if ( !ParseDirection(argv[argc], lms) ) {
+	      fprintf(stderr, "-lms takes the contrasts of the L, M and S cones as l,m,s\n");
+	      exit(1);
+	    }
+	    uselms = 1;
+	    --argc;
+	  } else if ( argv[argc-1] && (strcmp(argv[argc-1], "-cones") == 0) ) {
+	    if ( !LoadConeMatrix(argv[argc], cones) ) {
+	      exit(1);
+	    }
+	    usecones = 1;
+	    --argc;
+	  } else if ( argv[argc-1] && (strcmp(argv[argc-1], "-path") == 0) ) {
+	    pathname = argv[argc];
+	    --argc;
+	  } else if ( argv[argc-1] && (strcmp(argv[argc-1], "-leader") == 0) ) {
+	    OpenFrameClock(&fclock, argv[argc], CLOCK_LEADER);
+	    --argc;
+	  } else if ( argv[argc-1] && (strcmp(argv[argc-1], "-follow") == 0) ) {
+	    OpenFrameClock(&fclock, argv[argc], CLOCK_FOLLOWER);
+	    --argc;
+	  } else if ( argv[argc-1] && (strcmp(argv[argc-1], "-sync") == 0) ) {
+	    OpenSyncPatch(&syncpatch, argv[argc]);
+	    --argc;
 	  } else if ( argv[argc] && (strcmp(argv[argc], "-sw") == 0) ) {
 	    videoflags |= SDL_SWSURFACE;
 	  } else if ( argv[argc] && (strcmp(argv[argc], "-hwpalette") == 0) ) {
 	    videoflags |= SDL_HWPALETTE;
 	  } else if ( argv[argc] && (strcmp(argv[argc], "-window") == 0) ) {
 	    videoflags ^= SDL_FULLSCREEN;
+	  } else if ( argv[argc] && (strcmp(argv[argc], "-perf") == 0) ) {
+	    PerfOpen(&perf);
 	  } else if ( argv[argc] && (strcmp(argv[argc], "-bar") == 0) ) {
 		  bar=1;
+	  } else if ( argv[argc] && (strcmp(argv[argc], "-gl") == 0) ) {
+		  usegl=1;
+	  } else if ( argv[argc] && (strcmp(argv[argc], "-dither") == 0) ) {
+		  dither=1;
 	  } else 
 	    {
-	      fprintf(stderr, "Usage: %s [-bar] [-window] [-w #] [-h #] [-swidth #] [-freq #] [-bar]\n", argv[0]);
+	      fprintf(stderr, "Usage: %s [-bar] [-window] [-w #] [-h #] [-swidth #] [-freq #] [-refresh #] [-mean #] [-contrast #] [-calib file] [-rgb r,g,b] [-lms l,m,s -cones file] [-dither] [-comp a,p,f,c]... [-bar] [-gl] [-path auto|palette|direct|buffer|ring|threads] [-perf] [-sync luminance|binary] [-leader name] [-follow name]\n", argv[0]);
 	      exit(1);
 	    }
 	}
+	if ( uselms ) {
+	  if ( !usecones ) {
+	    fprintf(stderr, "-lms needs the cone matrix of the display, given with -cones\n");
+	    exit(1);
+	  }
+	  if ( !ConeDirection(cones, lms, rgb) ) {
+	    exit(1);
+	  }
+	  colour = 1;
+	}
+	if ( colour ) {
+	  contrast = CheckColourContrast(mean, contrast, rgb);
+	} else {
+	  contrast = CheckContrast(mean, contrast);
+	}
+	if ( ncomp > 0 && (usegl || dither) ) {
+	  fprintf(stderr, "-comp cannot be combined with -gl or -dither\n");
+	  exit(1);
+	}
+	if ( colour && (ncomp > 0 || usegl) ) {
+	  fprintf(stderr, "-rgb and -lms cannot be combined with -comp or -gl\n");
+	  exit(1);
+	}
+	if ( pathname != NULL && usegl ) {
+	  fprintf(stderr, "-path cannot be combined with -gl\n");
+	  exit(1);
+	}
+	/* these change on every frame, not only every update */
+	everyframe = dither || ncomp > 0;
 	
-	/* calculate the amount of shift per ms */
-	shift = ceil(sinewidth*frequency/(1000.0/refresh));
-	fprintf(stderr,"frequency=%f, refresh=%d, shift=%d\n",frequency,refresh,shift);
-
 	/* Set video mode */
-	screen = CreateScreen(width, height, bpp, videoflags);
+	if ( usegl ) {
+		screen = CreateGLScreen(width, height, videoflags);
+		if ( screen == NULL || !GLStimInit(GLSTIM_GRATING) ) {
+			exit(2);
+		}
+		glparams.period = (int)sinewidth;
+		glparams.bar = bar;
+		/* the shader interpolates linearly between the extremes */
+		glparams.fore = ModulatedLevel(mean, contrast, 1)/255.0;
+		glparams.back = ModulatedLevel(mean, contrast, -1)/255.0;
+		if ( dither ) {
+			fprintf(stderr, "Warning: the OpenGL grating is not dithered\n");
+			dither = 0;
+		}
+		if ( calibrated && !bar ) {
+			fprintf(stderr, "Warning: the OpenGL grating is not linearized between its extremes\n");
+		}
+	} else {
+		screen = CreateScreen(width, height, bpp, videoflags);
+	}
 	if ( screen == NULL ) {
 		exit(2);
 	}
 
+	/* update on whole frames and shift by whole pixels per update */
+	frame_ms = ClockPeriod(&fclock, FramePeriod(screen, rate));
+	update = FramesFor(refresh, frame_ms, NULL);
+	shift = floor(sinewidth*frequency*update*frame_ms/1000.0 + 0.5);
+	CheckFrequency("frequency", frequency, shift*1000.0/(sinewidth*update*frame_ms));
+	fprintf(stderr,"frequency=%f, refresh=%.2f, shift=%d\n",frequency,update*frame_ms,shift);
+
 	/* create a buffer where the stimulus is prepared */
-	buffer = SDL_CreateRGBSurface(SDL_HWSURFACE|SDL_HWACCEL, width, height, bpp, 0,0,0,0);
-	buffer = SDL_DisplayFormat(buffer);
+	if ( !usegl ) {
+		buffer = CreateBuffer(screen);
+		if ( buffer == NULL ) {
+			fprintf(stderr, "Couldn't create the buffer: %s\n", SDL_GetError());
+			exit(2);
+		}
+	}
 
 	bpp = screen->format->BytesPerPixel;
+
+	/* the plaid replaces the grating table */
+	if ( ncomp > 0 && !InitPlaid(comp, ncomp, screen->w, screen->h, mean) ) {
+		exit(2);
+	}
+
+	/* dithering renders DITHER_SIZE different rows each frame */
+	if ( dither ) {
+		dlevels = (Uint8 *)malloc(screen->w);
+		for ( i=RED; i<=BLUE; i++ ) {
+			clevels[i] = (Uint8 *)malloc(screen->w);
+		}
+		dtype = (Uint8 *)malloc(screen->h);
+		for ( i=0; i<DITHER_SIZE; i++ ) {
+			drows[i] = (Uint8 *)malloc(screen->w*bpp);
+		}
+		for ( i=0; i<screen->h; i++ ) {
+			dtype[i] = i%DITHER_SIZE;
+		}
+	}
+
+	/* time the paths which can show the stimulus on this screen, only
+	   those which may be chosen are set up */
+	if ( !usegl ) {
+		tune = pathname == NULL || strcmp(pathname, "auto") == 0;
+		if ( ncomp > 0 || dither ) {
+			path[PATH_PALETTE].unusable = "only for the plain grating";
+			path[PATH_RING].unusable = "only for the plain grating";
+			path[PATH_THREADS].unusable = "only for the plain grating";
+		} else if ( screen->format->palette == NULL ) {
+			path[PATH_PALETTE].unusable = "needs an 8 bit screen, -bpp 8";
+		} else if ( (int)sinewidth > NUM_COLORS ) {
+			path[PATH_PALETTE].unusable = "the period is longer than the palette";
+		} else if ( syncpatch.code != SYNC_NONE ) {
+			path[PATH_PALETTE].unusable = "the sync patch needs a fixed palette";
+		}
+		if ( path[PATH_RING].unusable == NULL && (tune || strcmp(pathname, "ring") == 0) ) {
+			path[PATH_RING].unusable = BuildRing();
+		}
+		ncpu = sysconf(_SC_NPROCESSORS_ONLN);
+		if ( path[PATH_THREADS].unusable == NULL && ncpu < 2 ) {
+			path[PATH_THREADS].unusable = "needs more than one processor";
+		}
+		if ( path[PATH_THREADS].unusable == NULL && (tune || strcmp(pathname, "threads") == 0)
+		     && !InitPool(&pool, ncpu - 1, &perf) ) {
+			exit(2);
+		}
+		usepath = TunePaths(path, NPATHS, screen, frame_ms, pathname);
+		if ( usepath < 0 ) {
+			exit(1);
+		}
+		if ( usepath != PATH_RING ) {
+			FreeRing();
+		}
+		if ( usepath != PATH_THREADS && pool.lock != NULL ) {
+			FreePool(&pool);
+			PerfDropThreads(&perf);
+			pool.lock = NULL;
+		}
+		if ( usepath == PATH_PALETTE ) {
+			DrawIndices(screen);
+			if ( screen->flags & SDL_DOUBLEBUF ) {
+				SDL_Flip(screen);
+				DrawIndices(screen);
+			}
+		} else if ( screen->format->palette != NULL ) {
+			SDL_SetPalette(screen, SDL_PHYSPAL, gray, 0, NUM_COLORS);
+		}
+	}
+
 	SDL_ShowCursor(SDL_DISABLE);
-	refreshTimerID = SDL_AddTimer((int)(refresh), refreshTimer, (void *)screen);
+	refreshTimerID = SDL_AddTimer(FrameTimerInterval(frame_ms), refreshTimer, (void *)screen);
 	runTimer = SDL_GetTicks();
+	start_ms = ClockEpoch(&fclock, GetTimeMs());
+	laststep = -1;
 
 	/* MAIN LOOP, do screen refresh and wait for keys */
 	done = 0;
+	TRACE_BEGIN("wait");
 	while ( !done && SDL_WaitEvent(&event) ) {
+	  TRACE_END("wait");
 	  switch (event.type) {
 	  case SDL_KEYDOWN:
 	    /* Ignore ALT-TAB for windows */
@@ -201,29 +661,65 @@ int main(int argc, char *argv[])
 	    done = 1;
 	    break;
 	  case SDL_USEREVENT:
+	    if ( ClockStopped(&fclock) ) {
+	      done = 1;
+	      break;
+	    }
+	    /* the phase follows the frame count, not the timer,
+	       dithered gratings and plaids are drawn on every frame */
+	    frame = FrameIndex(start_ms, frame_ms);
+	    step = frame/update;
+	    if ( (everyframe ? frame : step) == laststep ) {
+	      break;
+	    }
+	    laststep = everyframe ? frame : step;
 	    i = runTimer;
 	    runTimer = SDL_GetTicks();
 	    startTimer = i;
 	    interval_stat +=  runTimer - i;
 	    t++;
-	    SDL_LockSurface(buffer);
-	    buffp = (Uint8 *)buffer->pixels;
-	    for ( i=0; i<screen->h; ++i ) {
-		    memcpy(buffp, &c[cycle%(((int)sinewidth)*bpp)], screen->w*bpp);
-	      buffp += screen->pitch;
+	    if ( usegl ) {
+	      glparams.phase = (step%((int)sinewidth))*shift;
+	      TRACE_BEGIN("draw");
+	      PerfBegin(&perf);
+	      GLStimDraw(&glparams);
+	      PerfEnd(&perf);
+	      TRACE_END("draw");
+	      GLSyncPatch(&syncpatch);
+	      TRACE_BEGIN("swap");
+	      SDL_GL_SwapBuffers();
+	      TRACE_END("swap");
+	      SyncPresented(&syncpatch, frame);
+	      ClockPresented(&fclock, frame, step);
+	      break;
 	    }
-	    SDL_UnlockSurface(buffer);
-	    SDL_BlitSurface(buffer, NULL, screen, NULL);
+	    TRACE_BEGIN("draw");
+	    PerfBegin(&perf);
+	    path[usepath].draw(frame);
+	    PerfEnd(&perf);
+	    TRACE_END("draw");
+	    ShowSyncPatch(&syncpatch, screen, &pw);
+	    TRACE_BEGIN("flip");
 	    SDL_Flip(screen);
-	    cycle += shift*bpp;
+	    TRACE_END("flip");
+	    SyncPresented(&syncpatch, frame);
+	    ClockPresented(&fclock, frame, step);
 	    break;
 	  default:
 	    break;
 	  }
+	  TRACE_BEGIN("wait");
 	}
+	TRACE_END("wait");
 	SDL_RemoveTimer(refreshTimerID);
 	SDL_ShowCursor(SDL_ENABLE);
 	printf("mean display interval:%f\n", ((float)interval_stat/(float)t));
+	if ( pool.lock != NULL ) {
+		FreePool(&pool);
+	}
+	CloseFrameClock(&fclock);
+	CloseSyncPatch(&syncpatch);
+	PerfReport(&perf);
 	SDL_Quit();
 	return(0);	
 }
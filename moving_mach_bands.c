@@ -16,11 +16,21 @@
 #include <math.h>
 
 #include <SDL.h>
+#include "refresh.h"
+#include "pixels.h"
+#include "kernels.h"
+#include "calibration.h"
+#include "stimuli.h"
+#include "trace.h"
+#include "perfcount.h"
+#include "syncpatch.h"
 
 /* default parameters */
 #define MACHNUM 3
 #define FREQUENCY 0.5
-#define REFRESHRATE 50
+#define REFRESHRATE 50 // ms, rounded to whole frames
+#define MEAN 0.5
+#define CONTRAST 1
 
 /* 8 Bit Graphics */
 #define NUM_COLORS	256
@@ -29,18 +39,23 @@
 int machnum = MACHNUM;
 float frequency = FREQUENCY;
 
+/* mean luminance as a fraction of the range and Michelson contrast */
+double mean = MEAN;
+double contrast = CONTRAST;
+
 SDL_Event redrawEvent;
 
 int cycle;
-Uint8 c[10000];
+Uint8 *c;
+PixelWriter pw;
+PerfCounters perf;
+SyncPatch syncpatch;
 
 SDL_Surface *CreateScreen(Uint16 w, Uint16 h, Uint8 bpp, Uint32 flags)
 {
 	SDL_Surface *screen;
-	SDL_PixelFormat *fmt;
-	int i, j, k;
+	int i;
 	SDL_Color palette[NUM_COLORS];
-	Uint8 *buffer;
 
 	/* Set the video mode */
 	screen = SDL_SetVideoMode(w, h, bpp, flags);
@@ -63,19 +78,13 @@ SDL_Surface *CreateScreen(Uint16 w, Uint16 h, Uint8 bpp, Uint32 flags)
 	  return(NULL);
 	}
 
-	fmt = screen->format;
-	buffer = (Uint8 *)screen->pixels;
-      
-	k = 0;
-	for ( i=0; i<screen->w; i++ ) {
-	  for(j=0; j<screen->format->BytesPerPixel; j++)
-	    {
-	      c[k+j] = (Uint8) ceil(i/((screen->w/machnum))) * (NUM_COLORS-1)/(machnum-1);
-	      c[screen->w*screen->format->BytesPerPixel+k+j] = \
-		(Uint8) ceil(i/((screen->w/machnum))) * (NUM_COLORS-1)/(machnum-1);
-	    }
-	  k += screen->format->BytesPerPixel;
+	/* one period of gray levels, written twice in the screen format,
+	   the steps are equal in luminance from dark to bright */
+	if ( !InitPixelWriter(&pw, screen->format) ) {
+	  return(NULL);
 	}
+	c = (Uint8 *)malloc(2*screen->w*pw.bpp);
+	MachBandTable(c, &pw, screen->w, machnum, mean, contrast);
 
 	SDL_UnlockSurface(screen);
 	SDL_UpdateRect(screen, 0, 0, 0, 0);
@@ -85,6 +94,7 @@ SDL_Surface *CreateScreen(Uint16 w, Uint16 h, Uint8 bpp, Uint32 flags)
 
 Uint32 refreshTimer(Uint32 interval, void *params)
 {
+	TRACE_INSTANT("timer");
         SDL_PushEvent(&redrawEvent);
 	return interval;
 }
@@ -99,7 +109,8 @@ int main(int argc, char *argv[])
 	SDL_Event event;
 	int width, height, bpp, refresh, shift;
 	int done;
-	Uint8 *buffp;
+	double rate, frame_ms, start_ms;
+	int update, frame, step, laststep;
 	int i;
 	int t, interval_stat;
 	Uint32 startTimer, runTimer;
@@ -123,6 +134,7 @@ int main(int argc, char *argv[])
 	machnum = MACHNUM;
 	frequency = FREQUENCY;
 	refresh = REFRESHRATE;
+	rate = 0;
 
 	width = 300;
 	height = 200;
@@ -148,6 +160,23 @@ int main(int argc, char *argv[])
 	  } else if ( argv[argc-1] && (strcmp(argv[argc-1], "-bpp") == 0) ) {
 	    bpp = atoi(argv[argc]);
 	    --argc;
+	  } else if ( argv[argc-1] && (strcmp(argv[argc-1], "-refresh") == 0) ) {
+	    rate = atof(argv[argc]);
+	    --argc;
+	  } else if ( argv[argc-1] && (strcmp(argv[argc-1], "-mean") == 0) ) {
+	    mean = atof(argv[argc]);
+	    --argc;
+	  } else if ( argv[argc-1] && (strcmp(argv[argc-1], "-contrast") == 0) ) {
+	    contrast = atof(argv[argc]);
+	    --argc;
+	  } else if ( argv[argc-1] && (strcmp(argv[argc-1], "-calib") == 0) ) {
+	    if ( !LoadCalibration(argv[argc]) ) {
+	      exit(1);
+	    }
+	    --argc;
+	  } else if ( argv[argc-1] && (strcmp(argv[argc-1], "-sync") == 0) ) {
+	    OpenSyncPatch(&syncpatch, argv[argc]);
+	    --argc;
 	  } else if ( argv[argc] && (strcmp(argv[argc], "-sw") == 0) ) {
 	    videoflags |= SDL_SWSURFACE;
 	  } else if ( argv[argc] && (strcmp(argv[argc], "-hw") == 0) ) {
@@ -156,11 +185,18 @@ int main(int argc, char *argv[])
 	    videoflags |= SDL_HWPALETTE;
 	  } else if ( argv[argc] && (strcmp(argv[argc], "-window") == 0) ) {
 	    videoflags ^= SDL_FULLSCREEN;
+	  } else if ( argv[argc] && (strcmp(argv[argc], "-perf") == 0) ) {
+	    PerfOpen(&perf);
 	  } else {
-	    fprintf(stderr, "Usage: %s [-window] [-sw] [-hwpalette] [-w] [-h] [-swidth] [-sfreq] [-num]\n", argv[0]);
+	    fprintf(stderr, "Usage: %s [-window] [-sw] [-hwpalette] [-w] [-h] [-swidth] [-sfreq] [-num] [-refresh] [-mean] [-contrast] [-calib] [-perf] [-sync luminance|binary]\n", argv[0]);
 	    exit(1);
 	  }
 	}
+	if ( machnum < 2 ) {
+	  fprintf(stderr, "At least two bands are needed\n");
+	  exit(1);
+	}
+	contrast = CheckContrast(mean, contrast);
 	
 	/* create the screen */
 	screen = CreateScreen(width, height, bpp, videoflags);
@@ -173,18 +209,25 @@ int main(int argc, char *argv[])
 	buffer = SDL_DisplayFormat(buffer);
 
 	bpp = screen->format->BytesPerPixel;
-	shift = (int)(frequency*refresh*screen->w/1000.0);
+	frame_ms = FramePeriod(screen, rate);
+	update = FramesFor(refresh, frame_ms, NULL);
+	shift = (int)floor(frequency*update*frame_ms*screen->w/1000.0 + 0.5);
+	CheckFrequency("sweep frequency", frequency, shift*1000.0/(update*frame_ms*screen->w));
 	printf("Setup:\nscreen size: %d %d\n",screen->w,screen->h);
 	printf("bytes per pixel:%d\n",bpp);
 	printf("shift:%d\n",shift);
 
 	SDL_ShowCursor(SDL_DISABLE);
-	refreshTimerID = SDL_AddTimer((int)(refresh), refreshTimer, (void *)screen);
+	refreshTimerID = SDL_AddTimer(FrameTimerInterval(frame_ms), refreshTimer, (void *)screen);
 	runTimer = SDL_GetTicks();
+	start_ms = GetTimeMs();
+	laststep = -1;
 
 	/* MAIN LOOP, do screen refresh and wait for keys */
 	done = 0;
+	TRACE_BEGIN("wait");
 	while ( !done && SDL_WaitEvent(&event) ) {
+	  TRACE_END("wait");
 	  switch (event.type) {
 	  case SDL_KEYDOWN:
 	    if ( (event.key.keysym.sym == SDLK_LALT) ||
@@ -195,29 +238,48 @@ int main(int argc, char *argv[])
 	    done = 1;
 	    break;
 	  case SDL_USEREVENT:
+	    frame = FrameIndex(start_ms, frame_ms);
+	    step = frame/update;
+	    if ( step == laststep ) {
+	      break;
+	    }
+	    laststep = step;
+	    cycle = (step%screen->w)*shift*bpp;
 	    i = runTimer;
 	    runTimer = SDL_GetTicks();
 	    startTimer = i;
 	    interval_stat +=  runTimer - i;
 	    t++;
+	    TRACE_BEGIN("lock");
 	    SDL_LockSurface(buffer);
-	    buffp = (Uint8 *)buffer->pixels;
-	    for ( i=0; i<screen->h; ++i ) {
-	      memcpy(buffp, &c[cycle%(buffer->w*bpp)], buffer->w*bpp);
-	      buffp += buffer->pitch;
-	    }
+	    TRACE_END("lock");
+	    TRACE_BEGIN("draw");
+	    PerfBegin(&perf);
+	    ReplicateRow((Uint8 *)buffer->pixels, buffer->pitch,
+			 &c[cycle%(buffer->w*bpp)], buffer->w*bpp, screen->h);
 	    SDL_UnlockSurface(buffer);
+	    PerfEnd(&perf);
+	    TRACE_END("draw");
+	    TRACE_BEGIN("blit");
 	    SDL_BlitSurface(buffer, NULL, screen, NULL);
+	    TRACE_END("blit");
+	    ShowSyncPatch(&syncpatch, screen, &pw);
+	    TRACE_BEGIN("flip");
 	    SDL_Flip(screen);
-	    cycle += shift*bpp;
+	    TRACE_END("flip");
+	    SyncPresented(&syncpatch, frame);
 	    break;
 	  default:
 	    break;
 	  }
+	  TRACE_BEGIN("wait");
 	}
+	TRACE_END("wait");
 	SDL_RemoveTimer(refreshTimerID);
 	SDL_ShowCursor(SDL_ENABLE);
 	printf("mean display interval:%d\n", interval_stat/t);
+	CloseSyncPatch(&syncpatch);
+	PerfReport(&perf);
 	SDL_Quit();
 	return(0);	
 
@@ -0,0 +1,530 @@
+/*********************************************************/
+/*                                                       */
+/* Several independent stimuli in regions of one screen, */
+/* such as a drifting grating and a flashing checker on  */
+/* two displays of one desktop, from one process         */
+/*                                                       */
+/* GPL, of course                                        */
+/*                                                       */
+/*********************************************************/
+
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+
+#include "SDL.h"
+#include "refresh.h"
+#include "pixels.h"
+#include "kernels.h"
+#include "calibration.h"
+#include "stimuli.h"
+#include "pool.h"
+#include "trace.h"
+#include "perfcount.h"
+#include "syncpatch.h"
+#include "options.h"
+
+/* default parameters */
+#define MEAN 0.5
+#define CONTRAST 1
+
+/* 8 Bit Graphics */
+#define NUM_COLORS	256
+
+/* kinds of instances */
+#define INST_GRATING 0
+#define INST_CHECKER 1
+
+#define MAX_INSTANCES 8
+
+/* what instances with the same parameters share: the row table of a
+   grating, or the two frames of a checker board */
+typedef struct {
+	int kind;
+	double size, contrast;		/* period or square size */
+	int w, h;			/* of the checker frames */
+	Uint8 *row;
+	SDL_Surface *frame[2];
+	int users;
+} SharedTable;
+
+typedef struct {
+	int kind;
+	SDL_Rect rect;
+	double size, freq, contrast;
+	SharedTable *table;
+	int update;		/* frames per step, 0 for a still stimulus */
+	double shift;		/* grating, pixels per frame */
+	int step, state;	/* current step and what it shows */
+	int drawn[2];		/* the state shown on each page */
+	int changed;		/* a new step this frame */
+	/* timing log of the steps */
+	int nsteps, nlate, nskipped;
+	double last_ms, interval;
+} Instance;
+
+/* mean luminance as a fraction of the range */
+double mean;
+
+PixelWriter pw;
+PerfCounters perf;
+SyncPatch syncpatch;
+
+SDL_Event redrawEvent;
+SDL_Surface *screen;
+
+/* instances in the reverse order of the command line */
+OptionSpec specs[MAX_INSTANCES];
+int nspec;
+Instance instance[MAX_INSTANCES];
+int ninstances;
+SharedTable shared[MAX_INSTANCES];
+int nshared;
+
+SDL_Surface *CreateScreen(Uint16 w, Uint16 h, Uint8 bpp, Uint32 flags)
+{
+	SDL_Surface *screen;
+	int i;
+	SDL_Color palette[NUM_COLORS];
+
+	/* Set the video mode */
+	screen = SDL_SetVideoMode(w, h, bpp, flags);
+	if ( screen == NULL ) {
+	  fprintf(stderr, "Couldn't set display mode: %s\n",
+		  SDL_GetError());
+	  return(NULL);
+	}
+	fprintf(stderr, "Screen is in %s mode\n",
+		(screen->flags & SDL_FULLSCREEN) ? "fullscreen" : "windowed");
+
+	/* Set a gray colormap */
+	for ( i=0; i<NUM_COLORS; ++i ) {
+		palette[i].r = (NUM_COLORS-1)-i * (256 / NUM_COLORS);
+		palette[i].g = (NUM_COLORS-1)-i * (256 / NUM_COLORS);
+		palette[i].b = (NUM_COLORS-1)-i * (256 / NUM_COLORS);
+	}
+	SDL_SetColors(screen, palette, 0, NUM_COLORS);
+
+	if ( !InitPixelWriter(&pw, screen->format) ) {
+	  return(NULL);
+	}
+	return(screen);
+}
+
+Uint32 refreshTimer(Uint32 interval, void *params)
+{
+	TRACE_INSTANT("timer");
+        SDL_PushEvent(&redrawEvent);
+	return interval;
+}
+
+
+
+/* "1,2.5,3" after option into the next spec, it needs min or max
+   numbers, exits with form as the usage on error */
+void AddSpec(const char *option, const char *s, int kind, int min, int max,
+	     const char *form)
+{
+	AddOptionSpec(specs, &nspec, MAX_INSTANCES, "instances", option, s, kind, min, max, form);
+}
+
+
+
+/* the table of an instance, made by the first instance which needs it */
+SharedTable *FindTable(const Instance *in)
+{
+	SharedTable *t;
+	Uint32 pixel[2];
+	int i;
+
+	for ( i=0; i<nshared; i++ ) {
+		t = &shared[i];
+		if ( t->kind == in->kind && t->size == in->size && t->contrast == in->contrast &&
+		     (in->kind == INST_GRATING || (t->w == in->rect.w && t->h == in->rect.h)) ) {
+			t->users++;
+			return(t);
+		}
+	}
+	t = &shared[nshared++];
+	t->kind = in->kind;
+	t->size = in->size;
+	t->contrast = in->contrast;
+	t->w = in->rect.w;
+	t->h = in->rect.h;
+	t->users = 1;
+	if ( in->kind == INST_GRATING ) {
+		/* a screen width from any phase */
+		t->row = (Uint8 *)malloc((screen->w + (int)in->size)*pw.bpp);
+		GratingTable(t->row, &pw, screen->w + (int)in->size, in->size, 0,
+			     mean, in->contrast, NULL);
+		return(t);
+	}
+	/* the board and its reverse */
+	for ( i=0; i<2; i++ ) {
+		pixel[i] = pw.map[ModulatedLevel(mean, in->contrast, i ? -1 : 1)];
+		pixel[1-i] = pw.map[ModulatedLevel(mean, in->contrast, i ? 1 : -1)];
+		t->frame[i] = SDL_CreateRGBSurface(SDL_SWSURFACE, t->w, t->h,
+						   screen->format->BitsPerPixel,
+						   screen->format->Rmask, screen->format->Gmask,
+						   screen->format->Bmask, screen->format->Amask);
+		if ( t->frame[i] == NULL ) {
+			fprintf(stderr, "Couldn't create checker frame: %s\n", SDL_GetError());
+			exit(2);
+		}
+		DrawChecker(t->frame[i], &pw, in->size, 0, 0, pixel);
+	}
+	return(t);
+}
+
+
+
+/* an instance from its spec: x,y,w,h, the size, the frequency and
+   optionally the contrast */
+void CreateInstance(Instance *in, const OptionSpec *spec, double frame_ms,
+		    double contrast)
+{
+	const double *v = spec->v;
+	double cycle_ms;
+
+	memset(in, 0, sizeof(*in));
+	in->kind = spec->kind;
+	in->rect.x = (Sint16)v[0];
+	in->rect.y = (Sint16)v[1];
+	in->rect.w = (Uint16)v[2];
+	in->rect.h = (Uint16)v[3];
+	in->size = floor(v[4] + 0.5);
+	in->freq = v[5];
+	in->contrast = CheckContrast(mean, spec->n > 6 ? v[6] : contrast);
+	if ( v[0] < 0 || v[1] < 0 || v[2] < 1 || v[3] < 1 ||
+	     v[0] + v[2] > screen->w || v[1] + v[3] > screen->h ) {
+		fprintf(stderr, "Instance %d,%d %dx%d is not on the %dx%d screen\n",
+			(int)v[0], (int)v[1], (int)v[2], (int)v[3], screen->w, screen->h);
+		exit(1);
+	}
+	if ( in->size < 2 || in->freq < 0 ) {
+		fprintf(stderr, "Instances need a size of 2 pixels or more and a frequency of 0 or more\n");
+		exit(1);
+	}
+
+	/* a grating moves every frame, a checker reverses every half cycle */
+	if ( in->freq > 0 ) {
+		cycle_ms = 1000/in->freq;
+		if ( in->kind == INST_GRATING ) {
+			in->update = 1;
+			in->shift = in->size*frame_ms/cycle_ms;
+		} else {
+			in->update = FramesFor(cycle_ms/2, frame_ms, "checker half cycle");
+			CheckFrequency("checker frequency", in->freq, 1000/(2*in->update*frame_ms));
+		}
+	}
+	in->table = FindTable(in);
+	in->step = -1;
+	in->drawn[0] = in->drawn[1] = -1;
+}
+
+
+static int Overlap(const SDL_Rect *a, const SDL_Rect *b)
+{
+	return( a->x < b->x + b->w && b->x < a->x + a->w &&
+		a->y < b->y + b->h && b->y < a->y + a->h );
+}
+
+
+/* follow the schedule of an instance to frame, late steps are those
+   shown after their first frame */
+void ScheduleInstance(Instance *in, int frame)
+{
+	int step;
+
+	step = in->update ? frame/in->update : 0;
+	in->changed = (step != in->step);
+	if ( !in->changed ) {
+		return;
+	}
+	if ( in->step >= 0 ) {
+		if ( frame > step*in->update ) {
+			in->nlate++;
+		}
+		if ( step > in->step + 1 ) {
+			in->nskipped += step - in->step - 1;
+		}
+	}
+	in->step = step;
+	if ( in->kind == INST_GRATING ) {
+		in->state = (int)floor(fmod(step*in->shift, in->size) + 0.5) % (int)in->size;
+	} else {
+		in->state = step%2;
+	}
+}
+
+
+/* the pool job of drawing instance job[i] into the locked screen */
+void DrawInstance(void *arg, int i)
+{
+	Instance *in = ((Instance **)arg)[i];
+	SharedTable *t = in->table;
+	SDL_Surface *f;
+	Uint8 *dst;
+	int y;
+
+	TRACE_BEGIN("instance");
+	dst = (Uint8 *)screen->pixels + in->rect.y*screen->pitch + in->rect.x*pw.bpp;
+	if ( in->kind == INST_GRATING ) {
+		ReplicateRow(dst, screen->pitch, t->row + in->state*pw.bpp,
+			     in->rect.w*pw.bpp, in->rect.h);
+	} else {
+		f = t->frame[in->state];
+		for ( y=0; y<in->rect.h; y++ ) {
+			memcpy(dst + y*screen->pitch, (Uint8 *)f->pixels + y*f->pitch,
+			       in->rect.w*pw.bpp);
+		}
+	}
+	TRACE_END("instance");
+}
+
+
+int main(int argc, char *argv[])
+{
+	Uint32 videoflags;
+	SDL_TimerID refreshTimerID;
+	SDL_Event event;
+	int width, height, bpp;
+	int done;
+	double rate, frame_ms, start_ms, now_ms;
+	double contrast;
+	int frame, lastframe, page, pages, i, j, njobs, nrects, log, nthreads;
+	Instance *in, *job[MAX_INSTANCES];
+	SDL_Rect rects[MAX_INSTANCES + 1];	/* and a sync patch */
+	ThreadPool pool;
+
+	redrawEvent.type = SDL_USEREVENT;
+	redrawEvent.user.code = 1;
+	redrawEvent.user.data1 = NULL;
+	redrawEvent.user.data2 = NULL;
+
+	/* Initialize SDL */
+	if ( SDL_Init(SDL_INIT_VIDEO|SDL_INIT_TIMER) < 0 ) {
+		fprintf(stderr, "Couldn't initialize SDL: %s\n",SDL_GetError());
+		exit(1);
+	}
+
+	width = 640;
+	height = 480;
+	bpp = 32;
+	rate = 0;
+	mean = MEAN;
+	contrast = CONTRAST;
+	nspec = 0;
+	log = 0;
+	nthreads = -1;
+
+	videoflags =  SDL_DOUBLEBUF|SDL_FULLSCREEN;
+
+	while ( argc > 1 ) {
+	  --argc;
+	  if ( argv[argc-1] && (strcmp(argv[argc-1], "-grating") == 0) ) {
+	    AddSpec(argv[argc-1], argv[argc], INST_GRATING, 6, 7, "x,y,w,h,period,freq[,contrast]");
+	    --argc;
+	  } else if ( argv[argc-1] && (strcmp(argv[argc-1], "-checker") == 0) ) {
+	    AddSpec(argv[argc-1], argv[argc], INST_CHECKER, 6, 7, "x,y,w,h,sqsize,freq[,contrast]");
+	    --argc;
+	  } else if ( argv[argc-1] && (strcmp(argv[argc-1], "-threads") == 0) ) {
+	    nthreads = atoi(argv[argc]);
+	    --argc;
+	  } else if ( argv[argc-1] && (strcmp(argv[argc-1], "-w") == 0) ) {
+	    width = atoi(argv[argc]);
+	    --argc;
+	  } else if ( argv[argc-1] && (strcmp(argv[argc-1], "-h") == 0) ) {
+	    height = atoi(argv[argc]);
+	    --argc;
+	  } else if ( argv[argc-1] && (strcmp(argv[argc-1], "-bpp") == 0) ) {
+	    bpp = atoi(argv[argc]);
+	    --argc;
+	  } else if ( argv[argc-1] && (strcmp(argv[argc-1], "-refresh") == 0) ) {
+	    rate = atof(argv[argc]);
+	    --argc;
+	  } else if ( argv[argc-1] && (strcmp(argv[argc-1], "-mean") == 0) ) {
+	    mean = atof(argv[argc]);
+	    --argc;
+	  } else if ( argv[argc-1] && (strcmp(argv[argc-1], "-contrast") == 0) ) {
+	    contrast = atof(argv[argc]);
+	    --argc;
+	  } else if ( argv[argc-1] && (strcmp(argv[argc-1], "-calib") == 0) ) {
+	    if ( !LoadCalibration(argv[argc]) ) {
+	      exit(1);
+	    }
+	    --argc;
+	  } else if ( argv[argc-1] && (strcmp(argv[argc-1], "-sync") == 0) ) {
+	    OpenSyncPatch(&syncpatch, argv[argc]);
+	    --argc;
+	  } else if ( argv[argc] && (strcmp(argv[argc], "-log") == 0) ) {
+	    log = 1;
+	  } else if ( argv[argc] && (strcmp(argv[argc], "-sw") == 0) ) {
+	    videoflags |= SDL_SWSURFACE;
+	  } else if ( argv[argc] && (strcmp(argv[argc], "-hw") == 0) ) {
+	    videoflags |= SDL_HWSURFACE;
+	  } else if ( argv[argc] && (strcmp(argv[argc], "-hwpalette") == 0) ) {
+	    videoflags |= SDL_HWPALETTE;
+	  } else if ( argv[argc] && (strcmp(argv[argc], "-window") == 0) ) {
+	    videoflags ^= SDL_FULLSCREEN;
+	  } else if ( argv[argc] && (strcmp(argv[argc], "-perf") == 0) ) {
+	    PerfOpen(&perf);
+	  } else
+	    {
+	      fprintf(stderr, "Usage: %s [-window] [-bpp #] [-w #] [-h #] [-grating x,y,w,h,period,freq[,contrast]] [-checker x,y,w,h,sqsize,freq[,contrast]]... [-threads #] [-mean #] [-contrast #] [-calib file] [-refresh #] [-log] [-perf] [-sync luminance|binary]\n"
+		      "Each instance keeps its own schedule, -log prints a line per step of each\n", argv[0]);
+	      exit(1);
+	    }
+	}
+	if ( nspec == 0 ) {
+	  fprintf(stderr, "No instances given with -grating or -checker\n");
+	  exit(1);
+	}
+
+	/* Set video mode */
+	screen = CreateScreen(width, height, bpp, videoflags);
+	if ( screen == NULL ) {
+		exit(2);
+	}
+	frame_ms = FramePeriod(screen, rate);
+
+	/* the instances in the order of the command line, which was
+	   parsed from its end */
+	for ( i=nspec-1; i>=0; i-- ) {
+		CreateInstance(&instance[ninstances], &specs[i], frame_ms, contrast);
+		for ( j=0; j<ninstances; j++ ) {
+			if ( Overlap(&instance[j].rect, &instance[ninstances].rect) ) {
+				fprintf(stderr, "Instances %d and %d overlap\n", j+1, ninstances+1);
+				exit(1);
+			}
+		}
+		ninstances++;
+	}
+	fprintf(stderr, "%d instances share %d tables\n", ninstances, nshared);
+
+	/* one thread per instance, the main thread takes one of them */
+	if ( nthreads < 0 ) {
+		nthreads = ninstances - 1;
+	}
+	if ( !InitPool(&pool, nthreads, &perf) ) {
+		exit(2);
+	}
+
+	/* with page flipping each page keeps the state drawn on it */
+	pages = ((screen->flags & SDL_DOUBLEBUF) && (screen->flags & SDL_HWSURFACE)) ? 2 : 1;
+	for ( page=0; page<pages; page++ ) {
+	  SDL_FillRect(screen, NULL, pw.map[ModulatedLevel(mean, 0, 0)]);
+	  if ( pages == 2 ) {
+	    SDL_Flip(screen);
+	  }
+	}
+	SDL_UpdateRect(screen, 0, 0, 0, 0);
+	page = 0;
+
+	SDL_ShowCursor(SDL_DISABLE);
+	refreshTimerID = SDL_AddTimer(FrameTimerInterval(frame_ms), refreshTimer, (void *)screen);
+	start_ms = GetTimeMs();
+	lastframe = -1;
+
+	/* MAIN LOOP, do screen refresh and wait for keys */
+	done = 0;
+	TRACE_BEGIN("wait");
+	while ( !done && SDL_WaitEvent(&event) ) {
+	  TRACE_END("wait");
+	  switch (event.type) {
+	  case SDL_KEYDOWN:
+	    /* Ignore ALT-TAB for windows */
+	    if ( (event.key.keysym.sym == SDLK_LALT) ||
+		 (event.key.keysym.sym == SDLK_TAB) ) {
+	      break;
+	    }
+	    /* Any key quits the application... */
+	  case SDL_QUIT:
+	    done = 1;
+	    break;
+	  case SDL_USEREVENT:
+	    frame = FrameIndex(start_ms, frame_ms);
+	    if ( frame == lastframe ) {
+	      break;
+	    }
+	    lastframe = frame;
+	    njobs = 0;
+	    nrects = 0;
+	    for ( i=0; i<ninstances; i++ ) {
+	      in = &instance[i];
+	      ScheduleInstance(in, frame);
+	      if ( in->drawn[page] != in->state ) {
+		in->drawn[page] = in->state;
+		job[njobs++] = in;
+		rects[nrects++] = in->rect;
+	      }
+	    }
+	    if ( njobs == 0 && pages == 1 ) {
+	      break;
+	    }
+	    TRACE_BEGIN("lock");
+	    SDL_LockSurface(screen);
+	    TRACE_END("lock");
+	    TRACE_BEGIN("draw");
+	    PerfBegin(&perf);
+	    RunPool(&pool, DrawInstance, job, njobs);
+	    SDL_UnlockSurface(screen);
+	    PerfEnd(&perf);
+	    TRACE_END("draw");
+	    ShowSyncPatch(&syncpatch, screen, &pw);
+	    if ( pages == 2 ) {
+	      TRACE_BEGIN("flip");
+	      SDL_Flip(screen);
+	      TRACE_END("flip");
+	    } else {
+	      TRACE_BEGIN("update");
+	      SDL_UpdateRects(screen, SyncRects(&syncpatch, rects, nrects), rects);
+	      TRACE_END("update");
+	    }
+	    SyncPresented(&syncpatch, frame);
+	    page = (page + 1)%pages;
+
+	    /* the timing log of the instances which started a step */
+	    now_ms = GetTimeMs() - start_ms;
+	    for ( i=0; i<ninstances; i++ ) {
+	      in = &instance[i];
+	      if ( !in->changed ) {
+		continue;
+	      }
+	      if ( in->nsteps > 0 ) {
+		in->interval += now_ms - in->last_ms;
+	      }
+	      in->last_ms = now_ms;
+	      in->nsteps++;
+	      if ( log ) {
+		printf("%d %d %d %.3f\n", i+1, frame, in->step, now_ms);
+	      }
+	    }
+	    break;
+	  default:
+	    break;
+	  }
+	  TRACE_BEGIN("wait");
+	}
+	TRACE_END("wait");
+	SDL_RemoveTimer(refreshTimerID);
+	SDL_ShowCursor(SDL_ENABLE);
+	FreePool(&pool);
+	for ( i=0; i<ninstances; i++ ) {
+	  in = &instance[i];
+	  printf("instance %d, %s %dx%d at %d,%d: %d steps, %d late, %d skipped",
+		 i+1, in->kind == INST_GRATING ? "grating" : "checker",
+		 in->rect.w, in->rect.h, in->rect.x, in->rect.y,
+		 in->nsteps, in->nlate, in->nskipped);
+	  if ( in->nsteps > 1 ) {
+	    printf(", mean interval %.3f ms", in->interval/(in->nsteps - 1));
+	  }
+	  printf("\n");
+	}
+	CloseSyncPatch(&syncpatch);
+	PerfReport(&perf);
+	SDL_Quit();
+	return(0);
+}
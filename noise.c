@@ -0,0 +1,317 @@
+/*********************************************************/
+/*                                                       */
+/* Sparse and white noise for reverse correlation,       */
+/* every frame can be regenerated from seed and index    */
+/*                                                       */
+/* GPL, of course                                        */
+/*                                                       */
+/*********************************************************/
+
+/* The random numbers come from Philox4x32-10 (Salmon et al., SC11),
+   a counter based generator: counter i of frame f is encrypted with
+   the seed as key and gives words 4i..4i+3. Nothing is carried from
+   one word or frame to the next, so the AVX2 kernel computes eight
+   counters at once and still gives the same words as the plain C
+   one, and any frame can be made again offline from the logged seed
+   and frame index. */
+
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+
+#include "SDL.h"
+#include "pixels.h"
+#include "kernels.h"
+#include "calibration.h"
+#include "noise.h"
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__)) && defined(__SSE2__)
+#define HAVE_X86_KERNELS
+#include <immintrin.h>
+#endif
+
+/* Philox4x32 multipliers and key increments */
+#define PHILOX_M0 0xD2511F53
+#define PHILOX_M1 0xCD9E8D57
+#define PHILOX_W0 0x9E3779B9
+#define PHILOX_W1 0xBB67AE85
+#define PHILOX_ROUNDS 10
+
+/* Gaussian levels are looked up from 16 random bits */
+#define GAUSS_BITS 16
+#define GAUSS_SIZE (1<<GAUSS_BITS)
+
+/* words 4*first.. of n counters, n a multiple of 8 for the SIMD one */
+typedef void (*PhiloxFunc)(Uint32 *words, Uint32 first, int n, Uint32 seed, Uint32 frame);
+
+static PhiloxFunc philox_kernel;
+static int type, nbx, nby, nsparse, nwords;
+static Uint32 *words;
+static Uint8 *line;
+static int linesize;
+static Uint8 mean_level, black, white;
+static Uint8 gauss[GAUSS_SIZE];
+/* the eight blocks of each byte of binary noise */
+static Uint8 bits[256][8];
+
+
+static void PhiloxGeneric(Uint32 *words, Uint32 first, int n, Uint32 seed, Uint32 frame)
+{
+	Uint32 c0, c1, c2, c3, k0, k1, t;
+	Uint64 p0, p1;
+	int i, r;
+
+	for ( i=0; i<n; i++ ) {
+		c0 = first + i;
+		c1 = frame;
+		c2 = 0;
+		c3 = 0;
+		k0 = seed;
+		k1 = 0;
+		for ( r=0; r<PHILOX_ROUNDS; r++ ) {
+			p0 = (Uint64)PHILOX_M0*c0;
+			p1 = (Uint64)PHILOX_M1*c2;
+			t = (Uint32)(p1 >> 32) ^ c1 ^ k0;
+			c1 = (Uint32)p1;
+			c2 = (Uint32)(p0 >> 32) ^ c3 ^ k1;
+			c3 = (Uint32)p0;
+			c0 = t;
+			k0 += PHILOX_W0;
+			k1 += PHILOX_W1;
+		}
+		words[4*i] = c0;
+		words[4*i+1] = c1;
+		words[4*i+2] = c2;
+		words[4*i+3] = c3;
+	}
+}
+
+#ifdef HAVE_X86_KERNELS
+
+/* high and low halves of the products of eight 32 bit lanes */
+__attribute__((target("avx2")))
+static inline void MulHiLoAVX2(__m256i a, __m256i m, __m256i *hi, __m256i *lo)
+{
+	__m256i even, odd;
+
+	even = _mm256_mul_epu32(a, m);
+	odd = _mm256_mul_epu32(_mm256_srli_epi64(a, 32), m);
+	*lo = _mm256_blend_epi32(even, _mm256_slli_epi64(odd, 32), 0xAA);
+	*hi = _mm256_blend_epi32(_mm256_srli_epi64(even, 32), odd, 0xAA);
+}
+
+
+__attribute__((target("avx2")))
+static void PhiloxAVX2(Uint32 *words, Uint32 first, int n, Uint32 seed, Uint32 frame)
+{
+	__m256i c0, c1, c2, c3, k0, k1, hi0, lo0, hi1, lo1, m0, m1, a, b, c, d;
+	int i, r;
+
+	m0 = _mm256_set1_epi32(PHILOX_M0);
+	m1 = _mm256_set1_epi32(PHILOX_M1);
+	for ( i=0; i+8<=n; i+=8 ) {
+		/* one counter per lane */
+		c0 = _mm256_add_epi32(_mm256_set1_epi32(first + i),
+				      _mm256_setr_epi32(0, 1, 2, 3, 4, 5, 6, 7));
+		c1 = _mm256_set1_epi32(frame);
+		c2 = _mm256_setzero_si256();
+		c3 = _mm256_setzero_si256();
+		k0 = _mm256_set1_epi32(seed);
+		k1 = _mm256_setzero_si256();
+		for ( r=0; r<PHILOX_ROUNDS; r++ ) {
+			MulHiLoAVX2(c0, m0, &hi0, &lo0);
+			MulHiLoAVX2(c2, m1, &hi1, &lo1);
+			c0 = _mm256_xor_si256(_mm256_xor_si256(hi1, c1), k0);
+			c1 = lo1;
+			c2 = _mm256_xor_si256(_mm256_xor_si256(hi0, c3), k1);
+			c3 = lo0;
+			k0 = _mm256_add_epi32(k0, _mm256_set1_epi32(PHILOX_W0));
+			k1 = _mm256_add_epi32(k1, _mm256_set1_epi32(PHILOX_W1));
+		}
+		/* transpose to the four words of each counter in turn */
+		a = _mm256_unpacklo_epi32(c0, c1);
+		b = _mm256_unpacklo_epi32(c2, c3);
+		c = _mm256_unpackhi_epi32(c0, c1);
+		d = _mm256_unpackhi_epi32(c2, c3);
+		c0 = _mm256_unpacklo_epi64(a, b);	/* counters 0, 4 */
+		c1 = _mm256_unpackhi_epi64(a, b);	/* counters 1, 5 */
+		c2 = _mm256_unpacklo_epi64(c, d);	/* counters 2, 6 */
+		c3 = _mm256_unpackhi_epi64(c, d);	/* counters 3, 7 */
+		_mm256_storeu_si256((__m256i *)(words+4*i),
+				    _mm256_permute2x128_si256(c0, c1, 0x20));
+		_mm256_storeu_si256((__m256i *)(words+4*i+8),
+				    _mm256_permute2x128_si256(c2, c3, 0x20));
+		_mm256_storeu_si256((__m256i *)(words+4*i+16),
+				    _mm256_permute2x128_si256(c0, c1, 0x31));
+		_mm256_storeu_si256((__m256i *)(words+4*i+24),
+				    _mm256_permute2x128_si256(c2, c3, 0x31));
+	}
+	_mm256_zeroupper();
+	PhiloxGeneric(words+4*i, first+i, n-i, seed, frame);
+}
+
+#endif
+
+
+void NoiseWords(Uint32 *words, int n, Uint32 seed, Uint32 frame)
+{
+	Uint32 last[4];
+
+	if ( philox_kernel == NULL ) {
+		philox_kernel = PhiloxGeneric;
+#ifdef HAVE_X86_KERNELS
+		if ( strcmp(KernelName(), "avx2") == 0 ) {
+			philox_kernel = PhiloxAVX2;
+		}
+#endif
+	}
+	philox_kernel(words, 0, n/4, seed, frame);
+	if ( n%4 ) {
+		PhiloxGeneric(last, n/4, 1, seed, frame);
+		memcpy(words + n - n%4, last, (n%4)*sizeof(Uint32));
+	}
+}
+
+
+/* standard normal deviate below which a fraction p lies */
+static double NormalQuantile(double p)
+{
+	double lo, hi, z;
+	int i;
+
+	lo = -10;
+	hi = 10;
+	for ( i=0; i<60; i++ ) {
+		z = (lo + hi)/2;
+		if ( 0.5*erfc(-z/M_SQRT2) < p ) {
+			lo = z;
+		} else {
+			hi = z;
+		}
+	}
+	return((lo + hi)/2);
+}
+
+
+int InitNoise(int t, int w, int h, double mean, double contrast, int n)
+{
+	double m;
+	int i, k;
+
+	if ( w < 1 || h < 1 || (t == NOISE_SPARSE && n < 1) ) {
+		fprintf(stderr, "Noise needs at least one block\n");
+		return(0);
+	}
+	type = t;
+	nbx = w;
+	nby = h;
+	nsparse = n;
+	contrast = CheckContrast(mean, contrast);
+	mean_level = ModulatedLevel(mean, contrast, 0);
+	black = ModulatedLevel(mean, contrast, -1);
+	white = ModulatedLevel(mean, contrast, 1);
+
+	/* random words per frame: two per sparse block, one bit per
+	   binary block, 16 bits per Gaussian block */
+	switch ( type ) {
+	case NOISE_SPARSE:
+		nwords = 2*nsparse;
+		break;
+	case NOISE_BINARY:
+		nwords = (nbx*nby + 31)/32;
+		for ( i=0; i<256; i++ ) {
+			for ( k=0; k<8; k++ ) {
+				bits[i][k] = ((i >> k) & 1) ? white : black;
+			}
+		}
+		break;
+	default:
+		nwords = (nbx*nby + 1)/2;
+		/* clipped beyond the range of the display */
+		for ( i=0; i<GAUSS_SIZE; i++ ) {
+			m = contrast*NormalQuantile((i + 0.5)/GAUSS_SIZE);
+			if ( m > 1 ) {
+				m = 1;
+			} else if ( m < -1 ) {
+				m = -1;
+			}
+			gauss[i] = ModulatedLevel(mean, 1, m);
+		}
+		break;
+	}
+	free(words);
+	words = (Uint32 *)malloc(nwords*sizeof(Uint32));
+	return(1);
+}
+
+
+void NoiseFrame(Uint8 *levels, Uint32 seed, Uint32 frame)
+{
+	Uint8 *byte;
+	int i, n;
+
+	n = nbx*nby;
+	NoiseWords(words, nwords, seed, frame);
+	switch ( type ) {
+	case NOISE_SPARSE:
+		/* later blocks cover earlier ones at the same place */
+		memset(levels, mean_level, n);
+		for ( i=0; i<nsparse; i++ ) {
+			levels[((Uint64)words[2*i]*n) >> 32] = (words[2*i+1] >> 31) ? white : black;
+		}
+		break;
+	case NOISE_BINARY:
+		/* bit i of the stream is block i, the words as little endian */
+		for ( i=0; i+8<=n; i+=8 ) {
+			byte = bits[(words[i >> 5] >> (i & 31)) & 255];
+			memcpy(levels+i, byte, 8);
+		}
+		for ( ; i<n; i++ ) {
+			levels[i] = ((words[i >> 5] >> (i & 31)) & 1) ? white : black;
+		}
+		break;
+	default:
+		/* low half of word i/2 for even blocks, high half for odd */
+		for ( i=0; i+2<=n; i+=2 ) {
+			levels[i] = gauss[words[i >> 1] & (GAUSS_SIZE-1)];
+			levels[i+1] = gauss[words[i >> 1] >> GAUSS_BITS];
+		}
+		if ( i < n ) {
+			levels[i] = gauss[words[i >> 1] & (GAUSS_SIZE-1)];
+		}
+		break;
+	}
+}
+
+
+void RenderNoise(SDL_Surface *surface, const PixelWriter *pw, const Uint8 *levels, int block)
+{
+	Uint8 *dst;
+	int i, x, y, w, h, rows;
+
+	w = surface->w < nbx*block ? surface->w : nbx*block;
+	h = surface->h < nby*block ? surface->h : nby*block;
+	if ( w > linesize ) {
+		free(line);
+		line = (Uint8 *)malloc(w);
+		linesize = w;
+	}
+	dst = (Uint8 *)surface->pixels;
+	for ( y=0, i=0; y<h; y+=block, i++ ) {
+		/* one pixel row per block row, copied down for the others */
+		if ( block == 1 ) {
+			pw->row(dst, levels + i*nbx, w, pw->map);
+			dst += surface->pitch;
+			continue;
+		}
+		for ( x=0; x<w; x++ ) {
+			line[x] = levels[i*nbx + x/block];
+		}
+		pw->row(dst, line, w, pw->map);
+		rows = h - y < block ? h - y : block;
+		ReplicateRow(dst + surface->pitch, surface->pitch, dst, w*pw->bpp, rows-1);
+		dst += rows*surface->pitch;
+	}
+}
@@ -0,0 +1,39 @@
+/*********************************************************/
+/*                                                       */
+/* Sparse and white noise for reverse correlation,       */
+/* every frame can be regenerated from seed and index    */
+/*                                                       */
+/* GPL, of course                                        */
+/*                                                       */
+/*********************************************************/
+
+#ifndef NOISE_H
+#define NOISE_H
+
+#include "SDL.h"
+#include "pixels.h"
+
+/* kinds of noise */
+#define NOISE_SPARSE 0		/* a few black or white blocks on the mean */
+#define NOISE_BINARY 1		/* every block black or white */
+#define NOISE_GAUSS 2		/* every block Gaussian around the mean */
+
+/* n words of the random stream of one frame. Word j depends only on
+   seed, frame and j, so a frame can be made again without the ones
+   before it. */
+void NoiseWords(Uint32 *words, int n, Uint32 seed, Uint32 frame);
+
+/* prepare nbx x nby blocks of noise around the mean luminance (a
+   fraction of the range as in calibration.h). The contrast is the
+   Michelson contrast of binary and sparse noise and the RMS contrast
+   of Gaussian noise, nsparse the number of blocks of sparse noise.
+   Returns 0 on error. */
+int InitNoise(int type, int nbx, int nby, double mean, double contrast, int nsparse);
+
+/* the gray levels of the blocks of one frame, row by row */
+void NoiseFrame(Uint8 *levels, Uint32 seed, Uint32 frame);
+
+/* draw the blocks, each block x block pixels, into a locked surface */
+void RenderNoise(SDL_Surface *surface, const PixelWriter *pw, const Uint8 *levels, int block);
+
+#endif
@@ -0,0 +1,290 @@
+/*********************************************************/
+/*                                                       */
+/* Display sparse or white noise for reverse correlation */
+/* mapping of receptive fields, only the seed and the    */
+/* noise frame numbers are logged                        */
+/*                                                       */
+/* GPL, of course                                        */
+/*                                                       */
+/*********************************************************/
+
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <time.h>
+
+#include "SDL.h"
+#include "refresh.h"
+#include "pixels.h"
+#include "kernels.h"
+#include "calibration.h"
+#include "noise.h"
+#include "trace.h"
+#include "perfcount.h"
+#include "syncpatch.h"
+
+/* default parameters */
+#define BLOCK 16
+#define HOLD 1
+#define NSPARSE 1
+#define MEAN 0.5
+#define CONTRAST 1
+
+/* 8 Bit Graphics */
+#define NUM_COLORS	256
+
+PixelWriter pw;
+PerfCounters perf;
+SyncPatch syncpatch;
+
+SDL_Event redrawEvent;
+
+SDL_Surface *CreateScreen(Uint16 w, Uint16 h, Uint8 bpp, Uint32 flags)
+{
+	SDL_Surface *screen;
+	int i;
+	SDL_Color palette[NUM_COLORS];
+
+	/* Set the video mode */
+	screen = SDL_SetVideoMode(w, h, bpp, flags);
+	if ( screen == NULL ) {
+	  fprintf(stderr, "Couldn't set display mode: %s\n", SDL_GetError());
+	  return(NULL);
+	}
+	fprintf(stderr, "Screen is in %s mode\n", (screen->flags & SDL_FULLSCREEN) ? "fullscreen" : "windowed");
+
+	/* Set a gray colormap */
+	for ( i=0; i<NUM_COLORS; ++i ) {
+		palette[i].r = (NUM_COLORS-1)-i * (256 / NUM_COLORS);
+		palette[i].g = (NUM_COLORS-1)-i * (256 / NUM_COLORS);
+		palette[i].b = (NUM_COLORS-1)-i * (256 / NUM_COLORS);
+	}
+	SDL_SetColors(screen, palette, 0, NUM_COLORS);
+
+	if ( !InitPixelWriter(&pw, screen->format) ) {
+	  return(NULL);
+	}
+	return(screen);
+}
+
+
+/* write one noise frame as a binary PGM with a pixel per block */
+void WritePGM(FILE *f, const Uint8 *levels, int nbx, int nby)
+{
+	fprintf(f, "P5\n%d %d\n255\n", nbx, nby);
+	fwrite(levels, 1, nbx*nby, f);
+}
+
+Uint32 refreshTimer(Uint32 interval, void *params)
+{
+	TRACE_INSTANT("timer");
+        SDL_PushEvent(&redrawEvent);
+	return interval;
+}
+
+
+
+int main(int argc, char *argv[])
+{
+	SDL_Surface *screen;
+	Uint32 videoflags;
+	SDL_TimerID refreshTimerID;
+	SDL_Event event;
+	int width, height, bpp;
+	int done;
+	double rate, frame_ms, start_ms, mean, contrast;
+	int type, block, hold, nsparse, nbx, nby, pgm;
+	int frame, noise, lastnoise;
+	Uint32 seed;
+	Uint8 *levels;
+	const char *names[3] = { "sparse", "binary", "gauss" };
+
+	redrawEvent.type = SDL_USEREVENT;
+	redrawEvent.user.code = 1;
+	redrawEvent.user.data1 = NULL;
+	redrawEvent.user.data2 = NULL;
+
+	width = 640;
+	height = 480;
+	bpp = 32;
+	rate = 0;
+	type = NOISE_SPARSE;
+	block = BLOCK;
+	hold = HOLD;
+	nsparse = NSPARSE;
+	mean = MEAN;
+	contrast = CONTRAST;
+	seed = (Uint32)time(NULL);
+	pgm = -1;
+
+	videoflags =  SDL_DOUBLEBUF|SDL_FULLSCREEN;
+
+	while ( argc > 1 ) {
+	  --argc;
+	  if ( argv[argc-1] && (strcmp(argv[argc-1], "-w") == 0) ) {
+	    width = atoi(argv[argc]);
+	    --argc;
+	  } else if ( argv[argc-1] && (strcmp(argv[argc-1], "-h") == 0) ) {
+	    height = atoi(argv[argc]);
+	    --argc;
+	  } else if ( argv[argc-1] && (strcmp(argv[argc-1], "-block") == 0) ) {
+	    block = atoi(argv[argc]);
+	    --argc;
+	  } else if ( argv[argc-1] && (strcmp(argv[argc-1], "-hold") == 0) ) {
+	    hold = atoi(argv[argc]);
+	    --argc;
+	  } else if ( argv[argc-1] && (strcmp(argv[argc-1], "-nsparse") == 0) ) {
+	    nsparse = atoi(argv[argc]);
+	    --argc;
+	  } else if ( argv[argc-1] && (strcmp(argv[argc-1], "-seed") == 0) ) {
+	    seed = (Uint32)strtoul(argv[argc], NULL, 0);
+	    --argc;
+	  } else if ( argv[argc-1] && (strcmp(argv[argc-1], "-pgm") == 0) ) {
+	    pgm = atoi(argv[argc]);
+	    --argc;
+	  } else if ( argv[argc-1] && (strcmp(argv[argc-1], "-bpp") == 0) ) {
+	    bpp = atoi(argv[argc]);
+	    --argc;
+	  } else if ( argv[argc-1] && (strcmp(argv[argc-1], "-refresh") == 0) ) {
+	    rate = atof(argv[argc]);
+	    --argc;
+	  } else if ( argv[argc-1] && (strcmp(argv[argc-1], "-mean") == 0) ) {
+	    mean = atof(argv[argc]);
+	    --argc;
+	  } else if ( argv[argc-1] && (strcmp(argv[argc-1], "-contrast") == 0) ) {
+	    contrast = atof(argv[argc]);
+	    --argc;
+	  } else if ( argv[argc-1] && (strcmp(argv[argc-1], "-calib") == 0) ) {
+	    if ( !LoadCalibration(argv[argc]) ) {
+	      exit(1);
+	    }
+	    --argc;
+	  } else if ( argv[argc-1] && (strcmp(argv[argc-1], "-sync") == 0) ) {
+	    OpenSyncPatch(&syncpatch, argv[argc]);
+	    --argc;
+	  } else if ( argv[argc] && (strcmp(argv[argc], "-sparse") == 0) ) {
+	    type = NOISE_SPARSE;
+	  } else if ( argv[argc] && (strcmp(argv[argc], "-binary") == 0) ) {
+	    type = NOISE_BINARY;
+	  } else if ( argv[argc] && (strcmp(argv[argc], "-gauss") == 0) ) {
+	    type = NOISE_GAUSS;
+	  } else if ( argv[argc] && (strcmp(argv[argc], "-sw") == 0) ) {
+	    videoflags |= SDL_SWSURFACE;
+	  } else if ( argv[argc] && (strcmp(argv[argc], "-hwpalette") == 0) ) {
+	    videoflags |= SDL_HWPALETTE;
+	  } else if ( argv[argc] && (strcmp(argv[argc], "-window") == 0) ) {
+	    videoflags ^= SDL_FULLSCREEN;
+	  } else if ( argv[argc] && (strcmp(argv[argc], "-perf") == 0) ) {
+	    PerfOpen(&perf);
+	  } else
+	    {
+	      fprintf(stderr, "Usage: %s [-window] [-bpp #] [-w #] [-h #] [-sparse|-binary|-gauss] [-block #] [-nsparse #] [-hold #] [-seed #] [-mean #] [-contrast #] [-calib file] [-refresh #] [-pgm frame] [-perf] [-sync luminance|binary]\n", argv[0]);
+	      exit(1);
+	    }
+	}
+	if ( block < 1 || hold < 1 ) {
+	  fprintf(stderr, "-block and -hold must be at least 1\n");
+	  exit(1);
+	}
+
+	/* the screen size gives the number of blocks, with -pgm it is
+	   taken from -w and -h without opening the display */
+	if ( pgm >= 0 ) {
+	  nbx = (width + block - 1)/block;
+	  nby = (height + block - 1)/block;
+	  if ( !InitNoise(type, nbx, nby, mean, contrast, nsparse) ) {
+	    exit(1);
+	  }
+	  levels = (Uint8 *)malloc(nbx*nby);
+	  NoiseFrame(levels, seed, pgm);
+	  WritePGM(stdout, levels, nbx, nby);
+	  return(0);
+	}
+
+	/* Initialize SDL */
+	if ( SDL_Init(SDL_INIT_VIDEO|SDL_INIT_TIMER) < 0 ) {
+	  fprintf(stderr, "Couldn't initialize SDL: %s\n",SDL_GetError());
+	  exit(1);
+	}
+
+	/* Set video mode */
+	screen = CreateScreen(width, height, bpp, videoflags);
+	if ( screen == NULL ) {
+		exit(2);
+	}
+	nbx = (screen->w + block - 1)/block;
+	nby = (screen->h + block - 1)/block;
+	if ( !InitNoise(type, nbx, nby, mean, contrast, nsparse) ) {
+	  exit(1);
+	}
+	levels = (Uint8 *)malloc(nbx*nby);
+
+	frame_ms = FramePeriod(screen, rate);
+
+	/* everything needed to make the frames again */
+	printf("# noise %s seed %lu blocks %dx%d block %d hold %d nsparse %d mean %g contrast %g\n",
+	       names[type], (unsigned long)seed, nbx, nby, block, hold, nsparse, mean, contrast);
+	printf("# noise frame, time in ms\n");
+
+	SDL_ShowCursor(SDL_DISABLE);
+	refreshTimerID = SDL_AddTimer(FrameTimerInterval(frame_ms), refreshTimer, (void *)screen);
+	start_ms = GetTimeMs();
+	lastnoise = -1;
+
+	done = 0;
+	TRACE_BEGIN("wait");
+	while ( !done && SDL_WaitEvent(&event) ) {
+	  TRACE_END("wait");
+	  switch (event.type) {
+	  case SDL_KEYDOWN:
+	    /* Ignore ALT-TAB */
+	    if ( (event.key.keysym.sym == SDLK_LALT) || (event.key.keysym.sym == SDLK_TAB) ) {
+	      break;
+	    }
+	    /* Any key quits */
+	  case SDL_QUIT:
+	    done = 1;
+	    break;
+	  case SDL_USEREVENT:
+	    /* a new noise frame every hold frames, late frames are
+	       skipped and show up as gaps in the log */
+	    frame = FrameIndex(start_ms, frame_ms);
+	    noise = frame/hold;
+	    if ( noise == lastnoise ) {
+	      break;
+	    }
+	    lastnoise = noise;
+	    TRACE_BEGIN("generate");
+	    NoiseFrame(levels, seed, noise);
+	    TRACE_END("generate");
+	    TRACE_BEGIN("lock");
+	    SDL_LockSurface(screen);
+	    TRACE_END("lock");
+	    TRACE_BEGIN("draw");
+	    PerfBegin(&perf);
+	    RenderNoise(screen, &pw, levels, block);
+	    SDL_UnlockSurface(screen);
+	    PerfEnd(&perf);
+	    TRACE_END("draw");
+	    ShowSyncPatch(&syncpatch, screen, &pw);
+	    TRACE_BEGIN("flip");
+	    SDL_Flip(screen);
+	    TRACE_END("flip");
+	    SyncPresented(&syncpatch, frame);
+	    printf("%d %.3f\n", noise, GetTimeMs() - start_ms);
+	    break;
+	  default:
+	    break;
+	  }
+	  TRACE_BEGIN("wait");
+	}
+	TRACE_END("wait");
+	SDL_RemoveTimer(refreshTimerID);
+	SDL_ShowCursor(SDL_ENABLE);
+	CloseSyncPatch(&syncpatch);
+	PerfReport(&perf);
+	SDL_Quit();
+	return(0);
+}
@@ -0,0 +1,54 @@
+/*********************************************************/
+/*                                                       */
+/* Options given as lists of numbers, as the layers and  */
+/* instances of the compositing programs                 */
+/*                                                       */
+/* GPL, of course                                        */
+/*                                                       */
+/*********************************************************/
+
+
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "options.h"
+
+
+void AddOptionSpec(OptionSpec *specs, int *nspec, int maxspecs, const char *what,
+		   const char *option, const char *s, int kind, int min, int max,
+		   const char *form)
+{
+	OptionSpec *p;
+	char *end;
+	int ok;
+
+	if ( *nspec >= maxspecs ) {
+		fprintf(stderr, "%s: there are at most %d %s\n", option, maxspecs, what);
+		exit(1);
+	}
+	p = &specs[*nspec];
+	p->kind = kind;
+	p->n = 0;
+	ok = 1;
+	for ( ;; ) {
+		if ( p->n == MAX_OPTION_VALUES ) {
+			ok = 0;
+			break;
+		}
+		p->v[p->n] = strtod(s, &end);
+		if ( end == s || (*end != ',' && *end != '\0') ) {
+			ok = 0;
+			break;
+		}
+		p->n++;
+		if ( *end == '\0' ) {
+			break;
+		}
+		s = end + 1;
+	}
+	if ( !ok || (p->n != min && p->n != max) ) {
+		fprintf(stderr, "%s takes %s\n", option, form);
+		exit(1);
+	}
+	(*nspec)++;
+}
@@ -0,0 +1,30 @@
+/*********************************************************/
+/*                                                       */
+/* Options given as lists of numbers, as the layers and  */
+/* instances of the compositing programs                 */
+/*                                                       */
+/* GPL, of course                                        */
+/*                                                       */
+/*********************************************************/
+
+#ifndef OPTIONS_H
+#define OPTIONS_H
+
+/* most numbers after one option */
+#define MAX_OPTION_VALUES 8
+
+typedef struct {
+	int kind;			/* what the option adds, up to the program */
+	int n;				/* numbers given */
+	double v[MAX_OPTION_VALUES];
+} OptionSpec;
+
+/* parse the comma separated numbers s after option into a new entry of
+   kind at specs[*nspec], which has room for maxspecs of what. There
+   must be min or max numbers, as described by form. Exits with a
+   message otherwise or if there is no room left. */
+void AddOptionSpec(OptionSpec *specs, int *nspec, int maxspecs, const char *what,
+		   const char *option, const char *s, int kind, int min, int max,
+		   const char *form);
+
+#endif
@@ -0,0 +1,211 @@
+/*********************************************************/
+/*                                                       */
+/* Hardware performance counters around the render       */
+/* stage, to tell compute from cache and memory bound    */
+/*                                                       */
+/* GPL, of course                                        */
+/*                                                       */
+/*********************************************************/
+
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+
+#ifdef __linux__
+#include <unistd.h>
+#include <sys/syscall.h>
+#include <linux/perf_event.h>
+#endif
+
+#include "SDL.h"
+#include "refresh.h"
+#include "perfcount.h"
+
+static const char *counter_name[PERF_NCOUNTERS] = {
+	"cycles", "instructions", "LLC misses"
+};
+
+
+#ifdef __linux__
+static int OpenCounter(int counter)
+{
+	struct perf_event_attr attr;
+
+	memset(&attr, 0, sizeof(attr));
+	attr.size = sizeof(attr);
+	attr.type = PERF_TYPE_HARDWARE;
+	switch ( counter ) {
+	case PERF_CYCLES:
+		attr.config = PERF_COUNT_HW_CPU_CYCLES;
+		break;
+	case PERF_INSTRUCTIONS:
+		attr.config = PERF_COUNT_HW_INSTRUCTIONS;
+		break;
+	default:
+		attr.config = PERF_COUNT_HW_CACHE_MISSES;
+		break;
+	}
+	/* user space only, allowed up to perf_event_paranoid 2 */
+	attr.exclude_kernel = 1;
+	attr.exclude_hv = 1;
+	return(syscall(__NR_perf_event_open, &attr, 0, -1, -1, 0));
+}
+#endif
+
+
+static Uint64 ReadCounter(int fd)
+{
+	Uint64 value = 0;
+
+#ifdef __linux__
+	if ( read(fd, &value, sizeof(value)) != sizeof(value) ) {
+		value = 0;
+	}
+#endif
+	return(value);
+}
+
+
+void PerfOpen(PerfCounters *pc)
+{
+	int i;
+
+	memset(pc, 0, sizeof(*pc));
+	pc->enabled = 1;
+	for ( i=0; i<PERF_NCOUNTERS; i++ ) {
+#ifdef __linux__
+		pc->fd[i] = OpenCounter(i);
+		if ( pc->fd[i] < 0 ) {
+			fprintf(stderr, "No %s counter: %s\n", counter_name[i], strerror(errno));
+		}
+#else
+		pc->fd[i] = -1;
+		fprintf(stderr, "No %s counter on this system\n", counter_name[i]);
+#endif
+	}
+}
+
+
+void PerfAddThread(PerfCounters *pc)
+{
+	int i, t;
+
+	if ( !pc->enabled || pc->nthreads == PERF_MAX_THREADS ) {
+		return;
+	}
+	t = pc->nthreads++;
+	for ( i=0; i<PERF_NCOUNTERS; i++ ) {
+		pc->tfd[t][i] = -1;
+#ifdef __linux__
+		/* only what the caller counts, the sums would mix otherwise */
+		if ( pc->fd[i] >= 0 ) {
+			pc->tfd[t][i] = OpenCounter(i);
+		}
+#endif
+	}
+}
+
+
+void PerfDropThreads(PerfCounters *pc)
+{
+	int i, t;
+
+	for ( t=0; t<pc->nthreads; t++ ) {
+		for ( i=0; i<PERF_NCOUNTERS; i++ ) {
+#ifdef __linux__
+			if ( pc->tfd[t][i] >= 0 ) {
+				close(pc->tfd[t][i]);
+			}
+#endif
+		}
+	}
+	pc->nthreads = 0;
+}
+
+
+/* the sum of a counter over the caller and the added threads, a
+   thread whose counter failed to open adds nothing */
+static Uint64 ReadAll(const PerfCounters *pc, int i)
+{
+	Uint64 value;
+	int t;
+
+	value = ReadCounter(pc->fd[i]);
+	for ( t=0; t<pc->nthreads; t++ ) {
+		if ( pc->tfd[t][i] >= 0 ) {
+			value += ReadCounter(pc->tfd[t][i]);
+		}
+	}
+	return(value);
+}
+
+
+void PerfBegin(PerfCounters *pc)
+{
+	int i;
+
+	if ( !pc->enabled ) {
+		return;
+	}
+	for ( i=0; i<PERF_NCOUNTERS; i++ ) {
+		if ( pc->fd[i] >= 0 ) {
+			pc->start[i] = ReadAll(pc, i);
+		}
+	}
+	pc->start_ms = GetTimeMs();
+}
+
+
+void PerfEnd(PerfCounters *pc)
+{
+	int i;
+
+	if ( !pc->enabled ) {
+		return;
+	}
+	pc->total_ms += GetTimeMs() - pc->start_ms;
+	for ( i=0; i<PERF_NCOUNTERS; i++ ) {
+		if ( pc->fd[i] >= 0 ) {
+			pc->total[i] += ReadAll(pc, i) - pc->start[i];
+		}
+	}
+	pc->frames++;
+}
+
+
+void PerfReport(const PerfCounters *pc)
+{
+	double n, bytes;
+
+	if ( !pc->enabled || pc->frames == 0 ) {
+		return;
+	}
+	n = pc->frames;
+	printf("render stage: %ld frames, %.3f ms per frame", pc->frames, pc->total_ms/n);
+	if ( pc->nthreads > 0 && (pc->fd[PERF_CYCLES] >= 0 || pc->fd[PERF_INSTRUCTIONS] >= 0
+				  || pc->fd[PERF_LLC_MISSES] >= 0) ) {
+		printf(", counted on %d render threads and the main thread", pc->nthreads);
+	}
+	printf("\n");
+	if ( pc->fd[PERF_CYCLES] >= 0 ) {
+		printf("  cycles per frame: %.0f\n", pc->total[PERF_CYCLES]/n);
+	}
+	if ( pc->fd[PERF_INSTRUCTIONS] >= 0 ) {
+		printf("  instructions per frame: %.0f", pc->total[PERF_INSTRUCTIONS]/n);
+		if ( pc->fd[PERF_CYCLES] >= 0 && pc->total[PERF_CYCLES] > 0 ) {
+			printf(", %.2f per cycle", (double)pc->total[PERF_INSTRUCTIONS]/pc->total[PERF_CYCLES]);
+		}
+		printf("\n");
+	}
+	if ( pc->fd[PERF_LLC_MISSES] >= 0 ) {
+		bytes = (double)pc->total[PERF_LLC_MISSES]*PERF_LINE_BYTES/n;
+		printf("  LLC misses per frame: %.0f, about %.2f MB from memory",
+		       pc->total[PERF_LLC_MISSES]/n, bytes/1.0e6);
+		if ( pc->total_ms > 0 ) {
+			printf(" at %.2f GB/s", bytes*n/(pc->total_ms*1.0e6));
+		}
+		printf("\n");
+	}
+}
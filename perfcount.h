@@ -0,0 +1,57 @@
+/*********************************************************/
+/*                                                       */
+/* Hardware performance counters around the render       */
+/* stage, to tell compute from cache and memory bound    */
+/*                                                       */
+/* GPL, of course                                        */
+/*                                                       */
+/*********************************************************/
+
+#ifndef PERFCOUNT_H
+#define PERFCOUNT_H
+
+#include "SDL.h"
+
+#define PERF_CYCLES       0
+#define PERF_INSTRUCTIONS 1
+#define PERF_LLC_MISSES   2
+#define PERF_NCOUNTERS    3
+
+/* bytes moved from memory per last level cache miss */
+#define PERF_LINE_BYTES 64
+
+/* most render threads counted besides the caller */
+#define PERF_MAX_THREADS 16
+
+typedef struct {
+	int enabled;			/* set by PerfOpen */
+	int fd[PERF_NCOUNTERS];		/* -1 where not available */
+	int nthreads;			/* render threads counted as well */
+	int tfd[PERF_MAX_THREADS][PERF_NCOUNTERS];
+	Uint64 start[PERF_NCOUNTERS], total[PERF_NCOUNTERS];
+	double start_ms, total_ms;
+	long frames;
+} PerfCounters;
+
+/* open the counters of the calling thread, user space only. Counters
+   the kernel or the CPU do not offer are left out with a message,
+   the time of the render stage is measured in any case. */
+void PerfOpen(PerfCounters *pc);
+
+/* count the calling thread as well, for the threads of a pool which
+   render parts of a frame for the thread calling PerfBegin. Call from
+   each such thread, one at a time, before the first PerfBegin. */
+void PerfAddThread(PerfCounters *pc);
+
+/* stop counting the threads added, when their pool is gone */
+void PerfDropThreads(PerfCounters *pc);
+
+/* around the render stage of a frame, summed over the calling and the
+   added threads, nothing unless opened */
+void PerfBegin(PerfCounters *pc);
+void PerfEnd(PerfCounters *pc);
+
+/* print the means per frame to stdout */
+void PerfReport(const PerfCounters *pc);
+
+#endif
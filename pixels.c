@@ -0,0 +1,161 @@
+/*********************************************************/
+/*                                                       */
+/* Pixel writers specialised for 8, 16, 24 and 32 bit    */
+/* surfaces, chosen once when the screen is set up       */
+/*                                                       */
+/* GPL, of course                                        */
+/*                                                       */
+/*********************************************************/
+
+
+#include <stdio.h>
+
+#include "SDL.h"
+#include "pixels.h"
+#include "kernels.h"
+
+/* how one pixel is stored, p points to its first byte */
+#define STORE8(p, v)	(*(Uint8 *)(p) = (Uint8)(v))
+#define STORE16(p, v)	(*(Uint16 *)(p) = (Uint16)(v))
+#define STORE32(p, v)	(*(Uint32 *)(p) = (Uint32)(v))
+#if SDL_BYTEORDER == SDL_LIL_ENDIAN
+#define STORE24(p, v)	((p)[0] = (Uint8)(v), (p)[1] = (Uint8)((v)>>8), (p)[2] = (Uint8)((v)>>16))
+#else
+#define STORE24(p, v)	((p)[0] = (Uint8)((v)>>16), (p)[1] = (Uint8)((v)>>8), (p)[2] = (Uint8)(v))
+#endif
+
+/* one set of writers per pixel size, the size is a constant in the
+   loops so that there is no branching per pixel */
+#define DEFINE_WRITERS(N, STORE) \
+static void Put##N(Uint8 *pixels, int pitch, int x, int y, Uint32 pixel) \
+{ \
+	Uint8 *p = pixels + y*pitch + x*(N/8); \
+	STORE(p, pixel); \
+} \
+\
+static void Row##N(Uint8 *dst, const Uint8 *levels, int n, const Uint32 *map) \
+{ \
+	int i; \
+	for ( i=0; i<n; i++ ) { \
+		STORE(dst + i*(N/8), map[levels[i]]); \
+	} \
+} \
+\
+static void Fill##N(Uint8 *dst, Uint32 pixel, int n) \
+{ \
+	int i; \
+	for ( i=0; i<n; i++ ) { \
+		STORE(dst + i*(N/8), pixel); \
+	} \
+}
+
+/* colour rows put the bits of the three channels together */
+#define DEFINE_COLOUR(N, STORE) \
+static void Colour##N(const PixelWriter *pw, Uint8 *dst, Uint8 *const *levels, int n) \
+{ \
+	int i; \
+	for ( i=0; i<n; i++ ) { \
+		STORE(dst + i*(N/8), pw->chan[RED][levels[RED][i]] | \
+		      pw->chan[GREEN][levels[GREEN][i]] | pw->chan[BLUE][levels[BLUE][i]]); \
+	} \
+}
+
+DEFINE_WRITERS(8, STORE8)
+DEFINE_WRITERS(16, STORE16)
+DEFINE_WRITERS(24, STORE24)
+DEFINE_WRITERS(32, STORE32)
+DEFINE_COLOUR(16, STORE16)
+DEFINE_COLOUR(24, STORE24)
+DEFINE_COLOUR(32, STORE32)
+
+
+/* with a whole byte per channel the levels are the bytes of the
+   pixels, the rows are only interleaved */
+static void ColourPlanes(const PixelWriter *pw, Uint8 *dst, Uint8 *const *levels, int n)
+{
+	const Uint8 *plane[4];
+	int k;
+
+	for ( k=0; k<4; k++ ) {
+		plane[k] = NULL;
+	}
+	for ( k=RED; k<=BLUE; k++ ) {
+		plane[pw->plane[k]] = levels[k];
+	}
+	InterleavePlanes(dst, plane, n);
+}
+
+
+/* byte in memory of a 32 bit pixel holding the bits from shift */
+static int ByteOf(int shift)
+{
+#if SDL_BYTEORDER == SDL_LIL_ENDIAN
+	return(shift/8);
+#else
+	return(3 - shift/8);
+#endif
+}
+
+
+int InitPixelWriter(PixelWriter *pw, SDL_PixelFormat *fmt)
+{
+	int i;
+
+	pw->bpp = fmt->BytesPerPixel;
+	switch ( pw->bpp ) {
+	case 1:
+		pw->put = Put8;
+		pw->row = Row8;
+		pw->fill = Fill8;
+		pw->colour = NULL;
+		break;
+	case 2:
+		pw->put = Put16;
+		pw->row = Row16;
+		pw->fill = Fill16;
+		pw->colour = Colour16;
+		break;
+	case 3:
+		pw->put = Put24;
+		pw->row = Row24;
+		pw->fill = Fill24;
+		pw->colour = Colour24;
+		break;
+	case 4:
+		pw->put = Put32;
+		pw->row = Row32;
+		pw->fill = Fill32;
+		pw->colour = Colour32;
+		break;
+	default:
+		fprintf(stderr, "Unsupported pixel size: %d bytes\n", pw->bpp);
+		return(0);
+	}
+
+	/* on 8 bit surfaces this finds the palette entries */
+	for ( i=0; i<NUM_LEVELS; i++ ) {
+		pw->map[i] = SDL_MapRGB(fmt, i, i, i);
+	}
+
+	/* the channels of true colour surfaces, SDL_MapRGB sets the
+	   alpha bits too */
+	pw->plane[RED] = pw->plane[GREEN] = pw->plane[BLUE] = -1;
+	if ( fmt->palette != NULL ) {
+		pw->colour = NULL;
+		return(1);
+	}
+	for ( i=0; i<NUM_LEVELS; i++ ) {
+		pw->chan[RED][i] = ((Uint32)(i >> fmt->Rloss) << fmt->Rshift) | fmt->Amask;
+		pw->chan[GREEN][i] = (Uint32)(i >> fmt->Gloss) << fmt->Gshift;
+		pw->chan[BLUE][i] = (Uint32)(i >> fmt->Bloss) << fmt->Bshift;
+	}
+	if ( pw->bpp == 4 && fmt->Amask == 0 &&
+	     fmt->Rloss == 0 && fmt->Gloss == 0 && fmt->Bloss == 0 &&
+	     fmt->Rshift%8 == 0 && fmt->Gshift%8 == 0 && fmt->Bshift%8 == 0 ) {
+		pw->plane[RED] = ByteOf(fmt->Rshift);
+		pw->plane[GREEN] = ByteOf(fmt->Gshift);
+		pw->plane[BLUE] = ByteOf(fmt->Bshift);
+		pw->colour = ColourPlanes;
+	}
+	return(1);
+}
@@ -0,0 +1,45 @@
+/*********************************************************/
+/*                                                       */
+/* Pixel writers specialised for 8, 16, 24 and 32 bit    */
+/* surfaces, chosen once when the screen is set up       */
+/*                                                       */
+/* GPL, of course                                        */
+/*                                                       */
+/*********************************************************/
+
+#ifndef PIXELS_H
+#define PIXELS_H
+
+#include "SDL.h"
+
+/* number of gray levels */
+#define NUM_LEVELS 256
+
+/* the colour channels */
+#define RED   0
+#define GREEN 1
+#define BLUE  2
+
+typedef struct PixelWriter {
+	int bpp;			/* bytes per pixel */
+	Uint32 map[NUM_LEVELS];		/* gray level to pixel value */
+	Uint32 chan[3][NUM_LEVELS];	/* level of each channel to its bits of a pixel */
+	int plane[3];			/* byte of a 32 bit pixel holding each channel,
+					   -1 if the channels are not whole bytes */
+
+	/* set one pixel, y counts rows of pitch bytes */
+	void (*put)(Uint8 *pixels, int pitch, int x, int y, Uint32 pixel);
+	/* convert n gray levels into pixels */
+	void (*row)(Uint8 *dst, const Uint8 *levels, int n, const Uint32 *map);
+	/* n pixels of one value */
+	void (*fill)(Uint8 *dst, Uint32 pixel, int n);
+	/* convert n levels of each channel, levels[RED] and so on, into
+	   pixels. Not for 8 bit surfaces, which have a gray palette. */
+	void (*colour)(const struct PixelWriter *pw, Uint8 *dst, Uint8 *const *levels, int n);
+} PixelWriter;
+
+/* pick the writers for a surface format, returns 0 if unsupported.
+   Set the palette of 8 bit surfaces first. */
+int InitPixelWriter(PixelWriter *pw, SDL_PixelFormat *fmt);
+
+#endif
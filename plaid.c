@@ -0,0 +1,319 @@
+/*********************************************************/
+/*                                                       */
+/* Plaids and other sums of drifting sine gratings       */
+/*                                                       */
+/* GPL, of course                                        */
+/*                                                       */
+/*********************************************************/
+
+/* Each component keeps its phase as a 32 bit fixed point fraction of
+   a cycle. Along a row the phase grows by a constant, so a component
+   costs one addition and one table lookup per pixel. The sum is kept
+   in units of MOD_ONE = contrast 1, clamped and turned into a
+   calibrated gray level by a last table.
+
+   Components drifting along x or y are separable: they are summed
+   once per frame into a row and a column table, so a plaid made only
+   of those costs the same as a single grating. */
+
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+
+#include "SDL.h"
+#include "pixels.h"
+#include "kernels.h"
+#include "calibration.h"
+#include "plaid.h"
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__)) && defined(__SSE2__)
+#define HAVE_X86_KERNELS
+#include <immintrin.h>
+#endif
+
+/* entries of the sine tables */
+#define SINE_BITS 12
+#define SINE_SIZE (1<<SINE_BITS)
+
+/* the modulation of contrast 1 */
+#define MOD_ONE 2048
+
+typedef struct {
+	Uint32 dx, dy;		/* phase steps per pixel */
+	double frequency;
+	Sint32 sine[SINE_SIZE];	/* sine scaled by the contrast */
+} Component;
+
+/* add one row of an oblique component starting at phase ph */
+typedef void (*AddFunc)(Sint32 *acc, const Sint32 *sine, Uint32 ph, Uint32 dx, int n);
+/* clamp the sums to +-MOD_ONE */
+typedef void (*ClampFunc)(Sint32 *acc, int n);
+/* clamp and look up 32 bit pixels */
+typedef void (*PixelFunc)(Uint32 *dst, const Sint32 *acc, const Uint32 *pixel, int n);
+
+static Component *comps;
+static int ncomps;
+static int width, height;
+static Sint32 *xsum, *ysum, *acc;
+static Uint8 *levels;
+static Uint8 level[2*MOD_ONE+1];
+static Uint32 pixel[2*MOD_ONE+1];
+static const PixelWriter *pixel_pw;
+static AddFunc add_kernel;
+static ClampFunc clamp_kernel;
+static PixelFunc pixel_kernel;
+
+
+int ParseComponent(const char *arg, GratingComponent *comp)
+{
+	if ( sscanf(arg, "%lf,%lf,%lf,%lf", &comp->angle, &comp->period,
+		    &comp->frequency, &comp->contrast) != 4 || comp->period < 2 ) {
+		return(0);
+	}
+	return(1);
+}
+
+
+/* a fraction of a cycle as a fixed point phase */
+static Uint32 Turns(double turns)
+{
+	turns -= floor(turns);
+	if ( turns >= 1 ) {
+		turns = 0;
+	}
+	return((Uint32)(turns*4294967296.0));
+}
+
+
+static void AddGeneric(Sint32 *acc, const Sint32 *sine, Uint32 ph, Uint32 dx, int n)
+{
+	int x;
+
+	for ( x=0; x<n; x++ ) {
+		acc[x] += sine[ph >> (32-SINE_BITS)];
+		ph += dx;
+	}
+}
+
+
+static void ClampGeneric(Sint32 *acc, int n)
+{
+	int x;
+
+	for ( x=0; x<n; x++ ) {
+		if ( acc[x] > MOD_ONE ) {
+			acc[x] = MOD_ONE;
+		} else if ( acc[x] < -MOD_ONE ) {
+			acc[x] = -MOD_ONE;
+		}
+	}
+}
+
+static void PixelGeneric(Uint32 *dst, const Sint32 *acc, const Uint32 *pixel, int n)
+{
+	int x, a;
+
+	for ( x=0; x<n; x++ ) {
+		a = acc[x];
+		if ( a > MOD_ONE ) {
+			a = MOD_ONE;
+		} else if ( a < -MOD_ONE ) {
+			a = -MOD_ONE;
+		}
+		dst[x] = pixel[a + MOD_ONE];
+	}
+}
+
+#ifdef HAVE_X86_KERNELS
+
+__attribute__((target("avx2")))
+static void AddAVX2(Sint32 *acc, const Sint32 *sine, Uint32 ph, Uint32 dx, int n)
+{
+	__m256i p, step, idx, a;
+	int x;
+
+	p = _mm256_add_epi32(_mm256_set1_epi32(ph),
+			     _mm256_mullo_epi32(_mm256_setr_epi32(0, 1, 2, 3, 4, 5, 6, 7),
+						_mm256_set1_epi32(dx)));
+	step = _mm256_set1_epi32(8*dx);
+	for ( x=0; x+8<=n; x+=8 ) {
+		idx = _mm256_srli_epi32(p, 32-SINE_BITS);
+		a = _mm256_loadu_si256((__m256i *)(acc+x));
+		a = _mm256_add_epi32(a, _mm256_i32gather_epi32((const int *)sine, idx, 4));
+		_mm256_storeu_si256((__m256i *)(acc+x), a);
+		p = _mm256_add_epi32(p, step);
+	}
+	_mm256_zeroupper();
+	AddGeneric(acc+x, sine, ph + (Uint32)x*dx, dx, n-x);
+}
+
+
+__attribute__((target("avx2")))
+static void ClampAVX2(Sint32 *acc, int n)
+{
+	__m256i lo, hi, a;
+	int x;
+
+	lo = _mm256_set1_epi32(-MOD_ONE);
+	hi = _mm256_set1_epi32(MOD_ONE);
+	for ( x=0; x+8<=n; x+=8 ) {
+		a = _mm256_loadu_si256((__m256i *)(acc+x));
+		a = _mm256_min_epi32(_mm256_max_epi32(a, lo), hi);
+		_mm256_storeu_si256((__m256i *)(acc+x), a);
+	}
+	_mm256_zeroupper();
+	ClampGeneric(acc+x, n-x);
+}
+
+
+__attribute__((target("avx2")))
+static void PixelAVX2(Uint32 *dst, const Sint32 *acc, const Uint32 *pixel, int n)
+{
+	__m256i lo, hi, a;
+	int x;
+
+	lo = _mm256_set1_epi32(0);
+	hi = _mm256_set1_epi32(2*MOD_ONE);
+	for ( x=0; x+8<=n; x+=8 ) {
+		a = _mm256_add_epi32(_mm256_loadu_si256((const __m256i *)(acc+x)),
+				     _mm256_set1_epi32(MOD_ONE));
+		a = _mm256_min_epi32(_mm256_max_epi32(a, lo), hi);
+		_mm256_storeu_si256((__m256i *)(dst+x),
+				    _mm256_i32gather_epi32((const int *)pixel, a, 4));
+	}
+	_mm256_zeroupper();
+	PixelGeneric(dst+x, acc+x, pixel, n-x);
+}
+
+#endif
+
+
+int InitPlaid(const GratingComponent *comp, int n, int w, int h, double mean)
+{
+	double a, sum;
+	int i, k;
+
+	if ( n < 1 || n > MAX_COMPONENTS ) {
+		fprintf(stderr, "A plaid has 1 to %d components\n", MAX_COMPONENTS);
+		return(0);
+	}
+	free(comps);
+	free(xsum);
+	free(ysum);
+	free(acc);
+	free(levels);
+	comps = (Component *)malloc(n*sizeof(Component));
+	xsum = (Sint32 *)malloc(w*sizeof(Sint32));
+	ysum = (Sint32 *)malloc(h*sizeof(Sint32));
+	acc = (Sint32 *)malloc(w*sizeof(Sint32));
+	levels = (Uint8 *)malloc(w);
+	ncomps = n;
+	width = w;
+	height = h;
+
+	sum = 0;
+	for ( k=0; k<n; k++ ) {
+		a = comp[k].angle*M_PI/180;
+		comps[k].dx = Turns(cos(a)/comp[k].period);
+		comps[k].dy = Turns(sin(a)/comp[k].period);
+		comps[k].frequency = comp[k].frequency;
+		for ( i=0; i<SINE_SIZE; i++ ) {
+			comps[k].sine[i] = (Sint32)floor(comp[k].contrast*MOD_ONE*
+							 sin(2*M_PI*(i+0.5)/SINE_SIZE) + 0.5);
+		}
+		sum += fabs(comp[k].contrast);
+	}
+	/* the peaks of the sum are clamped, warn if they add up too much */
+	CheckContrast(mean, sum);
+	for ( i=0; i<=2*MOD_ONE; i++ ) {
+		level[i] = ModulatedLevel(mean, 1, (double)(i-MOD_ONE)/MOD_ONE);
+	}
+
+	pixel_pw = NULL;
+
+	add_kernel = AddGeneric;
+	clamp_kernel = ClampGeneric;
+	pixel_kernel = PixelGeneric;
+#ifdef HAVE_X86_KERNELS
+	if ( strcmp(KernelName(), "avx2") == 0 ) {
+		add_kernel = AddAVX2;
+		clamp_kernel = ClampAVX2;
+		pixel_kernel = PixelAVX2;
+	}
+#endif
+	return(1);
+}
+
+
+void RenderPlaid(SDL_Surface *buffer, const PixelWriter *pw, double t)
+{
+	Uint32 base[MAX_COMPONENTS];
+	int oblique[MAX_COMPONENTS];
+	Uint8 *dst;
+	int i, k, x, y, nob;
+
+	/* 32 bit pixels are looked up directly from the sums */
+	if ( pw != pixel_pw ) {
+		for ( i=0; i<=2*MOD_ONE; i++ ) {
+			pixel[i] = pw->map[level[i]];
+		}
+		pixel_pw = pw;
+	}
+
+	/* separable components go into the row and column sums */
+	memset(xsum, 0, width*sizeof(Sint32));
+	memset(ysum, 0, height*sizeof(Sint32));
+	nob = 0;
+	for ( k=0; k<ncomps; k++ ) {
+		base[k] = Turns(-comps[k].frequency*t);
+		if ( comps[k].dy == 0 ) {
+			add_kernel(xsum, comps[k].sine, base[k], comps[k].dx, width);
+		} else if ( comps[k].dx == 0 ) {
+			add_kernel(ysum, comps[k].sine, base[k], comps[k].dy, height);
+		} else {
+			oblique[nob++] = k;
+		}
+	}
+
+	dst = (Uint8 *)buffer->pixels;
+	for ( y=0; y<height; y++, dst += buffer->pitch ) {
+		/* without oblique components equal column sums give equal rows */
+		if ( nob == 0 && y > 0 && ysum[y] == ysum[y-1] ) {
+			memcpy(dst, dst - buffer->pitch, width*pw->bpp);
+			continue;
+		}
+		for ( x=0; x<width; x++ ) {
+			acc[x] = xsum[x] + ysum[y];
+		}
+		for ( k=0; k<nob; k++ ) {
+			add_kernel(acc, comps[oblique[k]].sine,
+				   base[oblique[k]] + (Uint32)y*comps[oblique[k]].dy,
+				   comps[oblique[k]].dx, width);
+		}
+		if ( pw->bpp == 4 ) {
+			pixel_kernel((Uint32 *)dst, acc, pixel, width);
+			continue;
+		}
+		clamp_kernel(acc, width);
+		for ( x=0; x<width; x++ ) {
+			levels[x] = level[acc[x] + MOD_ONE];
+		}
+		pw->row(dst, levels, width, pw->map);
+	}
+}
+
+
+void FreePlaid(void)
+{
+	free(comps);
+	free(xsum);
+	free(ysum);
+	free(acc);
+	free(levels);
+	comps = NULL;
+	xsum = ysum = acc = NULL;
+	levels = NULL;
+	ncomps = 0;
+}
@@ -0,0 +1,38 @@
+/*********************************************************/
+/*                                                       */
+/* Plaids and other sums of drifting sine gratings       */
+/*                                                       */
+/* GPL, of course                                        */
+/*                                                       */
+/*********************************************************/
+
+#ifndef PLAID_H
+#define PLAID_H
+
+#include "SDL.h"
+#include "pixels.h"
+
+/* most components of one plaid */
+#define MAX_COMPONENTS 8
+
+typedef struct {
+	double angle;		/* direction of drift in degrees, 0 is to the right */
+	double period;		/* wavelength in pixels */
+	double frequency;	/* temporal frequency in Hz */
+	double contrast;	/* contrast of this component */
+} GratingComponent;
+
+/* parse "angle,period,frequency,contrast", returns 0 if malformed */
+int ParseComponent(const char *arg, GratingComponent *comp);
+
+/* prepare the tables for a w x h plaid around the mean luminance
+   (a fraction of the range as in calibration.h), returns 0 on error */
+int InitPlaid(const GratingComponent *comp, int n, int w, int h, double mean);
+
+/* draw the plaid at time t in seconds into a locked surface */
+void RenderPlaid(SDL_Surface *buffer, const PixelWriter *pw, double t);
+
+/* release the tables, InitPlaid may be called again after it */
+void FreePlaid(void);
+
+#endif
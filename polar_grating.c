@@ -0,0 +1,409 @@
+/*********************************************************/
+/*                                                       */
+/* Display a rotating windmill or expanding rings        */
+/* to be used as stimulus in conjunction with the physio */
+/* recording software                                    */
+/*                                                       */
+/* GPL, of course                                        */
+/*                                                       */
+/*********************************************************/
+
+/* The phase of the grating at every pixel is computed once into a
+   map. A frame only shifts the phase, so it is drawn through a table
+   of PHASES pixel values rebuilt for each frame, or in palette mode
+   by rotating the 256 palette entries of an indexed screen drawn
+   once. No angle or radius is computed after the start. */
+
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+
+#include "SDL.h"
+#include "refresh.h"
+#include "pixels.h"
+#include "calibration.h"
+#include "trace.h"
+#include "perfcount.h"
+#include "syncpatch.h"
+
+/* default parameters */
+#define SPOKES 8
+#define PERIOD 40
+#define FREQUENCY 1
+#define MEAN 0.5
+#define CONTRAST 1
+
+/* phase steps per cycle in the map, 256 of them in palette mode */
+#define PHASE_BITS 10
+#define PHASES (1<<PHASE_BITS)
+
+/* 8 Bit Graphics */
+#define NUM_COLORS	256
+
+/* some global variables */
+int rings = 0;
+int bar = 0;
+int spokes = SPOKES;
+double period = PERIOD;
+double xc, yc;
+
+/* mean luminance as a fraction of the range and Michelson contrast */
+double mean = MEAN;
+double contrast = CONTRAST;
+
+SDL_Event redrawEvent;
+
+PixelWriter pw;
+PerfCounters perf;
+SyncPatch syncpatch;
+
+/* phase of each pixel and gray level of each phase */
+Uint16 *phase;
+Uint8 level[PHASES];
+
+/* the gray levels of one row, for pixels of other than 4 bytes */
+Uint8 *rowlevels;
+
+SDL_Surface *CreateScreen(Uint16 w, Uint16 h, Uint8 bpp, Uint32 flags)
+{
+	SDL_Surface *screen;
+	int i;
+	SDL_Color palette[NUM_COLORS];
+
+	/* Set the video mode */
+	screen = SDL_SetVideoMode(w, h, bpp, flags);
+	if ( screen == NULL ) {
+	  fprintf(stderr, "Couldn't set display mode: %s\n",
+		  SDL_GetError());
+	  return(NULL);
+	}
+	fprintf(stderr, "Screen is in %s mode\n",
+		(screen->flags & SDL_FULLSCREEN) ? "fullscreen" : "windowed");
+
+	/* Set a gray colormap */
+	for ( i=0; i<NUM_COLORS; ++i ) {
+		palette[i].r = (NUM_COLORS-1)-i * (256 / NUM_COLORS);
+		palette[i].g = (NUM_COLORS-1)-i * (256 / NUM_COLORS);
+		palette[i].b = (NUM_COLORS-1)-i * (256 / NUM_COLORS);
+	}
+	SDL_SetColors(screen, palette, 0, NUM_COLORS);
+
+	if ( !InitPixelWriter(&pw, screen->format) ) {
+	  return(NULL);
+	}
+	return(screen);
+}
+
+
+/* the polar coordinates of every pixel as a phase of the grating,
+   the angle for a windmill and the radius for rings */
+void BuildPhaseMap(int w, int h)
+{
+	double dx, dy, p;
+	int x, y;
+
+	phase = (Uint16 *)malloc(w*h*sizeof(Uint16));
+	rowlevels = (Uint8 *)malloc(w);
+	for ( y=0; y<h; y++ ) {
+	  dy = y + 0.5 - yc;
+	  for ( x=0; x<w; x++ ) {
+	    dx = x + 0.5 - xc;
+	    if ( rings ) {
+	      p = sqrt(dx*dx + dy*dy)/period;
+	    } else {
+	      p = spokes*atan2(dy, dx)/(2*M_PI);
+	    }
+	    p -= floor(p);
+	    phase[y*w+x] = (Uint16)(p*PHASES) & (PHASES-1);
+	  }
+	}
+	for ( x=0; x<PHASES; x++ ) {
+	  if ( bar ) {
+	    level[x] = ModulatedLevel(mean, contrast, x < PHASES/2 ? 1 : -1);
+	  } else {
+	    level[x] = ModulatedLevel(mean, contrast, sin(2*M_PI*(x+0.5)/PHASES));
+	  }
+	}
+}
+
+
+/* draw the pattern shifted by s phase steps into a locked surface */
+void DrawPolar(SDL_Surface *screen, int s)
+{
+	Uint32 pixel[PHASES];
+	Uint8 shifted[PHASES], *dst;
+	const Uint16 *src;
+	int i, x, y;
+
+	for ( i=0; i<PHASES; i++ ) {
+	  shifted[i] = level[(i - s) & (PHASES-1)];
+	  pixel[i] = pw.map[shifted[i]];
+	}
+	for ( y=0; y<screen->h; y++ ) {
+	  src = phase + y*screen->w;
+	  dst = (Uint8 *)screen->pixels + y*screen->pitch;
+	  if ( pw.bpp == 4 ) {
+	    for ( x=0; x<screen->w; x++ ) {
+	      ((Uint32 *)dst)[x] = pixel[src[x]];
+	    }
+	    continue;
+	  }
+	  for ( x=0; x<screen->w; x++ ) {
+	    rowlevels[x] = shifted[src[x]];
+	  }
+	  pw.row(dst, rowlevels, screen->w, pw.map);
+	}
+}
+
+
+/* In palette mode every pixel holds its phase as a colour index, so
+   shifting the pattern by s phase steps only rotates the palette */
+void DrawIndices(SDL_Surface *screen)
+{
+	Uint8 *dst;
+	int x, y;
+
+	SDL_LockSurface(screen);
+	for ( y=0; y<screen->h; y++ ) {
+	  dst = (Uint8 *)screen->pixels + y*screen->pitch;
+	  for ( x=0; x<screen->w; x++ ) {
+	    dst[x] = phase[y*screen->w+x] >> (PHASE_BITS-8);
+	  }
+	}
+	SDL_UnlockSurface(screen);
+}
+
+void RotatePalette(SDL_Surface *screen, int s)
+{
+	SDL_Color colors[NUM_COLORS];
+	int i;
+
+	for ( i=0; i<NUM_COLORS; i++ ) {
+	  colors[i].r = colors[i].g = colors[i].b =
+	    level[((i << (PHASE_BITS-8)) - s) & (PHASES-1)];
+	}
+	SDL_SetPalette(screen, SDL_LOGPAL|SDL_PHYSPAL, colors, 0, NUM_COLORS);
+}
+
+
+Uint32 refreshTimer(Uint32 interval, void *params)
+{
+	TRACE_INSTANT("timer");
+        SDL_PushEvent(&redrawEvent);
+	return interval;
+}
+
+
+int main(int argc, char *argv[])
+{
+	SDL_Surface *screen;
+	Uint32 videoflags;
+	SDL_TimerID refreshTimerID;
+	SDL_Event event;
+	int width, height, bpp;
+	int done;
+	double rate, frame_ms, start_ms, frequency, build_ms;
+	int frame, lastframe, s, usepalette;
+
+	redrawEvent.type = SDL_USEREVENT;
+	redrawEvent.user.code = 1;
+	redrawEvent.user.data1 = NULL;
+	redrawEvent.user.data2 = NULL;
+
+	/* Initialize SDL */
+	if ( SDL_Init(SDL_INIT_VIDEO|SDL_INIT_TIMER) < 0 ) {
+		fprintf(stderr, "Couldn't initialize SDL: %s\n",SDL_GetError());
+		exit(1);
+	}
+
+	width = 640;
+	height = 480;
+	bpp = 32;
+	rate = 0;
+	frequency = FREQUENCY;
+	usepalette = 0;
+	xc = -1;
+	yc = -1;
+
+	videoflags =  SDL_DOUBLEBUF|SDL_FULLSCREEN;
+
+	while ( argc > 1 ) {
+	  --argc;
+	  if ( argv[argc-1] && (strcmp(argv[argc-1], "-w") == 0) ) {
+	    width = atoi(argv[argc]);
+	    --argc;
+	  } else if ( argv[argc-1] && (strcmp(argv[argc-1], "-h") == 0) ) {
+	    height = atoi(argv[argc]);
+	    --argc;
+	  } else if ( argv[argc-1] && (strcmp(argv[argc-1], "-x") == 0) ) {
+	    xc = atof(argv[argc]);
+	    --argc;
+	  } else if ( argv[argc-1] && (strcmp(argv[argc-1], "-y") == 0) ) {
+	    yc = atof(argv[argc]);
+	    --argc;
+	  } else if ( argv[argc-1] && (strcmp(argv[argc-1], "-spokes") == 0) ) {
+	    spokes = atoi(argv[argc]);
+	    --argc;
+	  } else if ( argv[argc-1] && (strcmp(argv[argc-1], "-period") == 0) ) {
+	    period = atof(argv[argc]);
+	    --argc;
+	  } else if ( argv[argc-1] && (strcmp(argv[argc-1], "-freq") == 0) ) {
+	    frequency = atof(argv[argc]);
+	    --argc;
+	  } else if ( argv[argc-1] && (strcmp(argv[argc-1], "-bpp") == 0) ) {
+	    bpp = atoi(argv[argc]);
+	    --argc;
+	  } else if ( argv[argc-1] && (strcmp(argv[argc-1], "-refresh") == 0) ) {
+	    rate = atof(argv[argc]);
+	    --argc;
+	  } else if ( argv[argc-1] && (strcmp(argv[argc-1], "-mean") == 0) ) {
+	    mean = atof(argv[argc]);
+	    --argc;
+	  } else if ( argv[argc-1] && (strcmp(argv[argc-1], "-contrast") == 0) ) {
+	    contrast = atof(argv[argc]);
+	    --argc;
+	  } else if ( argv[argc-1] && (strcmp(argv[argc-1], "-calib") == 0) ) {
+	    if ( !LoadCalibration(argv[argc]) ) {
+	      exit(1);
+	    }
+	    --argc;
+	  } else if ( argv[argc-1] && (strcmp(argv[argc-1], "-sync") == 0) ) {
+	    OpenSyncPatch(&syncpatch, argv[argc]);
+	    --argc;
+	  } else if ( argv[argc] && (strcmp(argv[argc], "-rings") == 0) ) {
+	    rings = 1;
+	  } else if ( argv[argc] && (strcmp(argv[argc], "-bar") == 0) ) {
+	    bar = 1;
+	  } else if ( argv[argc] && (strcmp(argv[argc], "-palette") == 0) ) {
+	    usepalette = 1;
+	  } else if ( argv[argc] && (strcmp(argv[argc], "-sw") == 0) ) {
+	    videoflags |= SDL_SWSURFACE;
+	  } else if ( argv[argc] && (strcmp(argv[argc], "-hw") == 0) ) {
+	    videoflags |= SDL_HWSURFACE;
+	  } else if ( argv[argc] && (strcmp(argv[argc], "-hwpalette") == 0) ) {
+	    videoflags |= SDL_HWPALETTE;
+	  } else if ( argv[argc] && (strcmp(argv[argc], "-window") == 0) ) {
+	    videoflags ^= SDL_FULLSCREEN;
+	  } else if ( argv[argc] && (strcmp(argv[argc], "-perf") == 0) ) {
+	    PerfOpen(&perf);
+	  } else
+	    {
+	      fprintf(stderr, "Usage: %s [-window] [-bpp #] [-w #] [-h #] [-rings] [-spokes #] [-period #] [-x #] [-y #] [-freq #] [-bar] [-mean #] [-contrast #] [-calib file] [-palette] [-refresh #] [-perf] [-sync luminance|binary]\n", argv[0]);
+	      exit(1);
+	    }
+	}
+	if ( spokes < 1 || period < 2 ) {
+	  fprintf(stderr, "A windmill needs at least one spoke and rings a period of at least 2 pixels\n");
+	  exit(1);
+	}
+	if ( syncpatch.code != SYNC_NONE && usepalette ) {
+	  fprintf(stderr, "-sync cannot be combined with -palette\n");
+	  exit(1);
+	}
+	contrast = CheckContrast(mean, contrast);
+
+	/* Set video mode */
+	if ( usepalette ) {
+		screen = CreateScreen(width, height, 8, videoflags|SDL_HWPALETTE);
+		if ( screen != NULL && screen->format->palette == NULL ) {
+			fprintf(stderr, "Couldn't get an 8 bit palette mode\n");
+			exit(2);
+		}
+	} else {
+		screen = CreateScreen(width, height, bpp, videoflags);
+	}
+	if ( screen == NULL ) {
+		exit(2);
+	}
+	if ( xc < 0 || yc < 0 ) {
+	  xc = screen->w/2.0;
+	  yc = screen->h/2.0;
+	}
+
+	build_ms = GetTimeMs();
+	BuildPhaseMap(screen->w, screen->h);
+	if ( usepalette ) {
+		RotatePalette(screen, 0);
+		DrawIndices(screen);
+		if ( screen->flags & SDL_DOUBLEBUF ) {
+			SDL_Flip(screen);
+			DrawIndices(screen);
+		}
+	}
+	fprintf(stderr, "Polar map built in %.1f ms\n", GetTimeMs() - build_ms);
+
+	/* the phase is sampled on every frame, positive frequencies turn
+	   the windmill clockwise and expand the rings */
+	frame_ms = FramePeriod(screen, rate);
+	fprintf(stderr, "frequency=%f, %s\n", frequency,
+		rings ? "rings" : "windmill");
+
+	SDL_ShowCursor(SDL_DISABLE);
+	refreshTimerID = SDL_AddTimer(FrameTimerInterval(frame_ms), refreshTimer, (void *)screen);
+	start_ms = GetTimeMs();
+	lastframe = -1;
+
+	/* MAIN LOOP, do screen refresh and wait for keys */
+	done = 0;
+	TRACE_BEGIN("wait");
+	while ( !done && SDL_WaitEvent(&event) ) {
+	  TRACE_END("wait");
+	  switch (event.type) {
+	  case SDL_KEYDOWN:
+	    /* Ignore ALT-TAB for windows */
+	    if ( (event.key.keysym.sym == SDLK_LALT) ||
+		 (event.key.keysym.sym == SDLK_TAB) ) {
+	      break;
+	    }
+	    /* Any key quits the application... */
+	  case SDL_QUIT:
+	    done = 1;
+	    break;
+	  case SDL_USEREVENT:
+	    frame = FrameIndex(start_ms, frame_ms);
+	    if ( frame == lastframe ) {
+	      break;
+	    }
+	    lastframe = frame;
+	    s = (int)floor(fmod(frequency*frame*frame_ms/1000, 1)*PHASES + 0.5);
+	    if ( usepalette ) {
+	      TRACE_BEGIN("palette");
+	      PerfBegin(&perf);
+	      RotatePalette(screen, s);
+	      PerfEnd(&perf);
+	      TRACE_END("palette");
+	      TRACE_BEGIN("flip");
+	      SDL_Flip(screen);
+	      TRACE_END("flip");
+	      break;
+	    }
+	    TRACE_BEGIN("lock");
+	    SDL_LockSurface(screen);
+	    TRACE_END("lock");
+	    TRACE_BEGIN("draw");
+	    PerfBegin(&perf);
+	    DrawPolar(screen, s);
+	    SDL_UnlockSurface(screen);
+	    PerfEnd(&perf);
+	    TRACE_END("draw");
+	    ShowSyncPatch(&syncpatch, screen, &pw);
+	    TRACE_BEGIN("flip");
+	    SDL_Flip(screen);
+	    TRACE_END("flip");
+	    SyncPresented(&syncpatch, frame);
+	    break;
+	  default:
+	    break;
+	  }
+	  TRACE_BEGIN("wait");
+	}
+	TRACE_END("wait");
+	SDL_RemoveTimer(refreshTimerID);
+	SDL_ShowCursor(SDL_ENABLE);
+	CloseSyncPatch(&syncpatch);
+	PerfReport(&perf);
+	SDL_Quit();
+	return(0);
+}
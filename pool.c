@@ -0,0 +1,135 @@
+/*********************************************************/
+/*                                                       */
+/* A pool of SDL threads which run the jobs of a frame   */
+/* together with the calling thread                      */
+/*                                                       */
+/* GPL, of course                                        */
+/*                                                       */
+/*********************************************************/
+
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "SDL.h"
+#include "perfcount.h"
+#include "pool.h"
+
+
+/* take jobs until none are left, called and returns with the lock */
+static void TakeJobs(ThreadPool *pool)
+{
+	int i;
+
+	while ( pool->next < pool->njobs ) {
+		i = pool->next++;
+		SDL_mutexV(pool->lock);
+		pool->job(pool->arg, i);
+		SDL_mutexP(pool->lock);
+		if ( ++pool->finished == pool->njobs ) {
+			SDL_CondSignal(pool->done);
+		}
+	}
+}
+
+
+static int Worker(void *data)
+{
+	ThreadPool *pool = (ThreadPool *)data;
+
+	SDL_mutexP(pool->lock);
+	if ( pool->perf != NULL ) {
+		PerfAddThread(pool->perf);
+	}
+	pool->started++;
+	SDL_CondSignal(pool->done);
+	while ( !pool->quit ) {
+		if ( pool->next < pool->njobs ) {
+			TakeJobs(pool);
+		} else {
+			SDL_CondWait(pool->work, pool->lock);
+		}
+	}
+	SDL_mutexV(pool->lock);
+	return(0);
+}
+
+
+int InitPool(ThreadPool *pool, int nthreads, PerfCounters *perf)
+{
+	int i;
+
+	memset(pool, 0, sizeof(*pool));
+	pool->perf = perf;
+	if ( nthreads > MAX_POOL_THREADS ) {
+		nthreads = MAX_POOL_THREADS;
+	}
+	pool->lock = SDL_CreateMutex();
+	pool->work = SDL_CreateCond();
+	pool->done = SDL_CreateCond();
+	if ( pool->lock == NULL || pool->work == NULL || pool->done == NULL ) {
+		fprintf(stderr, "Couldn't create the thread pool: %s\n", SDL_GetError());
+		return(0);
+	}
+	for ( i=0; i<nthreads; i++ ) {
+		pool->thread[i] = SDL_CreateThread(Worker, pool);
+		if ( pool->thread[i] == NULL ) {
+			fprintf(stderr, "Couldn't start a render thread: %s\n", SDL_GetError());
+			break;
+		}
+		pool->nthreads++;
+	}
+
+	/* the counters of every worker are open before the first frame */
+	SDL_mutexP(pool->lock);
+	while ( pool->started < pool->nthreads ) {
+		SDL_CondWait(pool->done, pool->lock);
+	}
+	SDL_mutexV(pool->lock);
+	return(1);
+}
+
+
+void RunPool(ThreadPool *pool, void (*job)(void *arg, int i), void *arg, int njobs)
+{
+	int i;
+
+	if ( pool->nthreads == 0 || njobs == 1 ) {
+		for ( i=0; i<njobs; i++ ) {
+			job(arg, i);
+		}
+		return;
+	}
+	SDL_mutexP(pool->lock);
+	pool->job = job;
+	pool->arg = arg;
+	pool->njobs = njobs;
+	pool->next = 0;
+	pool->finished = 0;
+	SDL_CondBroadcast(pool->work);
+	TakeJobs(pool);
+	while ( pool->finished < pool->njobs ) {
+		SDL_CondWait(pool->done, pool->lock);
+	}
+	pool->njobs = 0;
+	pool->next = 0;
+	SDL_mutexV(pool->lock);
+}
+
+
+void FreePool(ThreadPool *pool)
+{
+	int i;
+
+	SDL_mutexP(pool->lock);
+	pool->quit = 1;
+	SDL_CondBroadcast(pool->work);
+	SDL_mutexV(pool->lock);
+	for ( i=0; i<pool->nthreads; i++ ) {
+		SDL_WaitThread(pool->thread[i], NULL);
+	}
+	SDL_DestroyCond(pool->done);
+	SDL_DestroyCond(pool->work);
+	SDL_DestroyMutex(pool->lock);
+}
@@ -0,0 +1,44 @@
+/*********************************************************/
+/*                                                       */
+/* A pool of SDL threads which run the jobs of a frame   */
+/* together with the calling thread                      */
+/*                                                       */
+/* GPL, of course                                        */
+/*                                                       */
+/*********************************************************/
+
+#ifndef POOL_H
+#define POOL_H
+
+#include "SDL.h"
+#include "perfcount.h"
+
+/* most threads besides the caller */
+#define MAX_POOL_THREADS 16
+
+typedef struct {
+	int nthreads;
+	SDL_Thread *thread[MAX_POOL_THREADS];
+	SDL_mutex *lock;
+	SDL_cond *work, *done;
+	void (*job)(void *arg, int i);
+	void *arg;
+	int njobs, next, finished;
+	int started;			/* workers running */
+	PerfCounters *perf;		/* counts the workers too, or NULL */
+	int quit;
+} ThreadPool;
+
+/* start nthreads workers, 0 runs everything in the caller. The
+   workers add themselves to perf unless it is NULL, so that the render
+   stage counts their work. Returns 0 with a message on failure. */
+int InitPool(ThreadPool *pool, int nthreads, PerfCounters *perf);
+
+/* run job(arg, i) for i in 0..njobs-1 on the workers and the calling
+   thread, returns when all are done */
+void RunPool(ThreadPool *pool, void (*job)(void *arg, int i), void *arg, int njobs);
+
+/* stop and wait for the workers */
+void FreePool(ThreadPool *pool);
+
+#endif
@@ -0,0 +1,276 @@
+/*********************************************************/
+/*                                                       */
+/* Display a random dot kinematogram                     */
+/* to be used as stimulus in conjunction with the physio */
+/* recording software                                    */
+/*                                                       */
+/* GPL, of course                                        */
+/*                                                       */
+/*********************************************************/
+
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <time.h>
+
+#include "SDL.h"
+#include "refresh.h"
+#include "pixels.h"
+#include "kernels.h"
+#include "dots.h"
+#include "trace.h"
+#include "perfcount.h"
+#include "syncpatch.h"
+
+/* default parameters */
+#define NDOTS 1000
+#define DOTSIZE 2
+#define SPEED 100 // pixels per second
+#define ANGLE 0
+#define COHERENCE 1
+#define LIFE 0 // frames, 0 lives forever
+
+/* 8 Bit Graphics */
+#define NUM_COLORS	256
+
+SDL_Event redrawEvent;
+
+PixelWriter pw;
+PerfCounters perf;
+SyncPatch syncpatch;
+
+SDL_Surface *CreateScreen(Uint16 w, Uint16 h, Uint8 bpp, Uint32 flags)
+{
+	SDL_Surface *screen;
+	int i;
+	SDL_Color palette[NUM_COLORS];
+
+	/* Set the video mode */
+	screen = SDL_SetVideoMode(w, h, bpp, flags);
+	if ( screen == NULL ) {
+	  fprintf(stderr, "Couldn't set display mode: %s\n",
+		  SDL_GetError());
+	  return(NULL);
+	}
+	fprintf(stderr, "Screen is in %s mode\n",
+		(screen->flags & SDL_FULLSCREEN) ? "fullscreen" : "windowed");
+
+	/* Set a gray colormap */
+	for ( i=0; i<NUM_COLORS; ++i ) {
+		palette[i].r = (NUM_COLORS-1)-i * (256 / NUM_COLORS);
+		palette[i].g = (NUM_COLORS-1)-i * (256 / NUM_COLORS);
+		palette[i].b = (NUM_COLORS-1)-i * (256 / NUM_COLORS);
+	}
+	SDL_SetColors(screen, palette, 0, NUM_COLORS);
+
+	if ( !InitPixelWriter(&pw, screen->format) ) {
+	  return(NULL);
+	}
+	return(screen);
+}
+
+Uint32 refreshTimer(Uint32 interval, void *params)
+{
+	TRACE_INSTANT("timer");
+        SDL_PushEvent(&redrawEvent);
+	return interval;
+}
+
+
+int main(int argc, char *argv[])
+{
+	SDL_Surface *screen;
+	Uint32 videoflags;
+	SDL_TimerID refreshTimerID;
+	SDL_Event event;
+	int width, height, bpp;
+	int done;
+	double rate, frame_ms, start_ms, draw_ms, t0;
+	double speed, angle, coherence;
+	int ndots, dotsize, life, back, fore;
+	int frame, lastframe, page, pages, nframes;
+	Uint32 seed;
+	DotField dots;
+
+	redrawEvent.type = SDL_USEREVENT;
+	redrawEvent.user.code = 1;
+	redrawEvent.user.data1 = NULL;
+	redrawEvent.user.data2 = NULL;
+
+	/* Initialize SDL */
+	if ( SDL_Init(SDL_INIT_VIDEO|SDL_INIT_TIMER) < 0 ) {
+		fprintf(stderr, "Couldn't initialize SDL: %s\n",SDL_GetError());
+		exit(1);
+	}
+
+	width = 640;
+	height = 480;
+	bpp = 32;
+	rate = 0;
+	ndots = NDOTS;
+	dotsize = DOTSIZE;
+	speed = SPEED;
+	angle = ANGLE;
+	coherence = COHERENCE;
+	life = LIFE;
+	back = 0;
+	fore = 255;
+	seed = (Uint32)time(NULL);
+
+	videoflags =  SDL_DOUBLEBUF|SDL_FULLSCREEN;
+
+	while ( argc > 1 ) {
+	  --argc;
+	  if ( argv[argc-1] && (strcmp(argv[argc-1], "-w") == 0) ) {
+	    width = atoi(argv[argc]);
+	    --argc;
+	  } else if ( argv[argc-1] && (strcmp(argv[argc-1], "-h") == 0) ) {
+	    height = atoi(argv[argc]);
+	    --argc;
+	  } else if ( argv[argc-1] && (strcmp(argv[argc-1], "-ndots") == 0) ) {
+	    ndots = atoi(argv[argc]);
+	    --argc;
+	  } else if ( argv[argc-1] && (strcmp(argv[argc-1], "-dotsize") == 0) ) {
+	    dotsize = atoi(argv[argc]);
+	    --argc;
+	  } else if ( argv[argc-1] && (strcmp(argv[argc-1], "-speed") == 0) ) {
+	    speed = atof(argv[argc]);
+	    --argc;
+	  } else if ( argv[argc-1] && (strcmp(argv[argc-1], "-angle") == 0) ) {
+	    angle = atof(argv[argc]);
+	    --argc;
+	  } else if ( argv[argc-1] && (strcmp(argv[argc-1], "-coherence") == 0) ) {
+	    coherence = atof(argv[argc]);
+	    --argc;
+	  } else if ( argv[argc-1] && (strcmp(argv[argc-1], "-life") == 0) ) {
+	    life = atoi(argv[argc]);
+	    --argc;
+	  } else if ( argv[argc-1] && (strcmp(argv[argc-1], "-seed") == 0) ) {
+	    seed = (Uint32)strtoul(argv[argc], NULL, 0);
+	    --argc;
+	  } else if ( argv[argc-1] && (strcmp(argv[argc-1], "-bpp") == 0) ) {
+	    bpp = atoi(argv[argc]);
+	    --argc;
+	  } else if ( argv[argc-1] && (strcmp(argv[argc-1], "-refresh") == 0) ) {
+	    rate = atof(argv[argc]);
+	    --argc;
+	  } else if ( argv[argc-1] && (strcmp(argv[argc-1], "-sync") == 0) ) {
+	    OpenSyncPatch(&syncpatch, argv[argc]);
+	    --argc;
+	  } else if ( argv[argc] && (strcmp(argv[argc], "-i") == 0) ) {
+	    back = 255;
+	    fore = 0;
+	  } else if ( argv[argc] && (strcmp(argv[argc], "-sw") == 0) ) {
+	    videoflags |= SDL_SWSURFACE;
+	  } else if ( argv[argc] && (strcmp(argv[argc], "-hw") == 0) ) {
+	    videoflags |= SDL_HWSURFACE;
+	  } else if ( argv[argc] && (strcmp(argv[argc], "-hwpalette") == 0) ) {
+	    videoflags |= SDL_HWPALETTE;
+	  } else if ( argv[argc] && (strcmp(argv[argc], "-window") == 0) ) {
+	    videoflags ^= SDL_FULLSCREEN;
+	  } else if ( argv[argc] && (strcmp(argv[argc], "-perf") == 0) ) {
+	    PerfOpen(&perf);
+	  } else
+	    {
+	      fprintf(stderr, "Usage: %s [-window] [-bpp #] [-w #] [-h #] [-ndots #] [-dotsize #] [-speed #] [-angle #] [-coherence #] [-life #] [-seed #] [-i] [-refresh #] [-perf] [-sync luminance|binary]\n", argv[0]);
+	      exit(1);
+	    }
+	}
+
+	/* Set video mode */
+	screen = CreateScreen(width, height, bpp, videoflags);
+	if ( screen == NULL ) {
+		exit(2);
+	}
+
+	/* the dots move by whole frames */
+	frame_ms = FramePeriod(screen, rate);
+	if ( !InitDots(&dots, ndots, dotsize, screen->w, screen->h, angle,
+		       speed*frame_ms/1000, coherence, life, seed) ) {
+		exit(1);
+	}
+	fprintf(stderr, "%d dots, %d coherent, %.2f pixels per frame, seed %lu\n",
+		dots.n, dots.nsignal, dots.speed, (unsigned long)seed);
+
+	/* with page flipping each page keeps the dots drawn on it */
+	pages = ((screen->flags & SDL_DOUBLEBUF) && (screen->flags & SDL_HWSURFACE)) ? 2 : 1;
+	for ( page=0; page<pages; page++ ) {
+	  SDL_FillRect(screen, NULL, pw.map[back]);
+	  if ( pages == 2 ) {
+	    SDL_Flip(screen);
+	  }
+	}
+	page = 0;
+
+	SDL_ShowCursor(SDL_DISABLE);
+	refreshTimerID = SDL_AddTimer(FrameTimerInterval(frame_ms), refreshTimer, (void *)screen);
+	start_ms = GetTimeMs();
+	lastframe = -1;
+	draw_ms = 0;
+	nframes = 0;
+
+	/* MAIN LOOP, do screen refresh and wait for keys */
+	done = 0;
+	TRACE_BEGIN("wait");
+	while ( !done && SDL_WaitEvent(&event) ) {
+	  TRACE_END("wait");
+	  switch (event.type) {
+	  case SDL_KEYDOWN:
+	    /* Ignore ALT-TAB for windows */
+	    if ( (event.key.keysym.sym == SDLK_LALT) ||
+		 (event.key.keysym.sym == SDLK_TAB) ) {
+	      break;
+	    }
+	    /* Any key quits the application... */
+	  case SDL_QUIT:
+	    done = 1;
+	    break;
+	  case SDL_USEREVENT:
+	    /* the dots follow the frame count, late frames move them further */
+	    frame = FrameIndex(start_ms, frame_ms);
+	    if ( frame == lastframe ) {
+	      break;
+	    }
+	    t0 = GetTimeMs();
+	    TRACE_BEGIN("move");
+	    if ( lastframe >= 0 ) {
+	      MoveDots(&dots, frame - lastframe, frame);
+	    }
+	    TRACE_END("move");
+	    lastframe = frame;
+	    TRACE_BEGIN("lock");
+	    SDL_LockSurface(screen);
+	    TRACE_END("lock");
+	    TRACE_BEGIN("draw");
+	    PerfBegin(&perf);
+	    DrawDots(screen, &pw, &dots, page, pw.map[fore], pw.map[back]);
+	    SDL_UnlockSurface(screen);
+	    PerfEnd(&perf);
+	    TRACE_END("draw");
+	    draw_ms += GetTimeMs() - t0;
+	    nframes++;
+	    ShowSyncPatch(&syncpatch, screen, &pw);
+	    TRACE_BEGIN("flip");
+	    SDL_Flip(screen);
+	    TRACE_END("flip");
+	    SyncPresented(&syncpatch, frame);
+	    page = (page + 1)%pages;
+	    break;
+	  default:
+	    break;
+	  }
+	  TRACE_BEGIN("wait");
+	}
+	TRACE_END("wait");
+	SDL_RemoveTimer(refreshTimerID);
+	SDL_ShowCursor(SDL_ENABLE);
+	if ( nframes > 0 ) {
+	  printf("mean time to move and draw %d dots: %.3f ms\n", dots.n, draw_ms/nframes);
+	}
+	CloseSyncPatch(&syncpatch);
+	PerfReport(&perf);
+	SDL_Quit();
+	return(0);
+}
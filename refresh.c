@@ -0,0 +1,171 @@
+/*********************************************************/
+/*                                                       */
+/* Display refresh calibration and frame-locked timing   */
+/* shared by the stimulus programs                       */
+/*                                                       */
+/* GPL, of course                                        */
+/*                                                       */
+/*********************************************************/
+
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <math.h>
+#ifndef _WIN32
+#include <time.h>
+#endif
+
+#include "SDL.h"
+#include "refresh.h"
+
+/* flips before the measurement starts */
+#define CALIBRATION_WARMUP 10
+
+/* shorter flips mean SDL_Flip does not wait for the retrace */
+#define MIN_FRAME_MS 2.0
+
+/* intervals further than this fraction from the median are dropped */
+#define OUTLIER_FRACTION 0.2
+
+/* relative error above which a quantised value is reported */
+#define QUANT_TOLERANCE 0.01
+
+
+double GetTimeMs(void)
+{
+#ifdef _WIN32
+	return (double)SDL_GetTicks();
+#else
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec*1000.0 + ts.tv_nsec/1.0e6;
+#endif
+}
+
+
+/* flip or swap, whichever the screen uses */
+static void Present(SDL_Surface *screen)
+{
+	if ( screen->flags & SDL_OPENGL ) {
+		SDL_GL_SwapBuffers();
+	} else {
+		SDL_Flip(screen);
+	}
+}
+
+
+static int CompareDouble(const void *a, const void *b)
+{
+	double x = *(const double *)a;
+	double y = *(const double *)b;
+
+	return (x > y) - (x < y);
+}
+
+
+double CalibrateRefresh(SDL_Surface *screen, int nflips)
+{
+	double *dt;
+	double t0, t1, median, sum;
+	int i, kept;
+
+	if ( !(screen->flags & (SDL_DOUBLEBUF|SDL_OPENGL)) ) {
+		fprintf(stderr, "No double buffered screen, assuming %.1f Hz\n",
+			1000.0/FALLBACK_FRAME_MS);
+		return(FALLBACK_FRAME_MS);
+	}
+
+	dt = (double *)malloc(nflips*sizeof(double));
+	if ( dt == NULL ) {
+		return(FALLBACK_FRAME_MS);
+	}
+
+	for ( i=0; i<CALIBRATION_WARMUP; i++ ) {
+		Present(screen);
+	}
+	t0 = GetTimeMs();
+	for ( i=0; i<nflips; i++ ) {
+		Present(screen);
+		t1 = GetTimeMs();
+		dt[i] = t1 - t0;
+		t0 = t1;
+	}
+
+	qsort(dt, nflips, sizeof(double), CompareDouble);
+	median = dt[nflips/2];
+	if ( median < MIN_FRAME_MS ) {
+		fprintf(stderr, "SDL_Flip is not synced to the display, assuming %.1f Hz\n",
+			1000.0/FALLBACK_FRAME_MS);
+		free(dt);
+		return(FALLBACK_FRAME_MS);
+	}
+
+	/* drop missed retraces and scheduler hiccups */
+	sum = 0;
+	kept = 0;
+	for ( i=0; i<nflips; i++ ) {
+		if ( fabs(dt[i]-median) < OUTLIER_FRACTION*median ) {
+			sum += dt[i];
+			kept++;
+		}
+	}
+	free(dt);
+
+	fprintf(stderr, "Display refresh: %.3f Hz (%.3f ms, %d of %d flips used)\n",
+		1000.0*kept/sum, sum/kept, kept, nflips);
+	return(sum/kept);
+}
+
+
+double FramePeriod(SDL_Surface *screen, double rate)
+{
+	if ( rate > 0 ) {
+		fprintf(stderr, "Display refresh: %.3f Hz (set by -refresh)\n", rate);
+		return(1000.0/rate);
+	}
+	return(CalibrateRefresh(screen, CALIBRATION_FLIPS));
+}
+
+
+int FramesFor(double ms, double frame_ms, const char *what)
+{
+	int n;
+
+	n = (int)floor(ms/frame_ms + 0.5);
+	if ( n < 1 ) {
+		n = 1;
+	}
+	if ( what != NULL && fabs(n*frame_ms - ms) > QUANT_TOLERANCE*ms ) {
+		fprintf(stderr, "Warning: %s of %.2f ms is shown as %d frames (%.2f ms)\n",
+			what, ms, n, n*frame_ms);
+	}
+	return(n);
+}
+
+
+void CheckFrequency(const char *what, double requested, double shown)
+{
+	if ( fabs(shown - requested) > QUANT_TOLERANCE*requested ) {
+		fprintf(stderr, "Warning: %s of %f Hz cannot be shown exactly, using %f Hz\n",
+			what, requested, shown);
+	}
+}
+
+
+Uint32 FrameTimerInterval(double frame_ms)
+{
+	Uint32 interval;
+
+	interval = (Uint32)(frame_ms/2);
+	if ( interval < 1 ) {
+		interval = 1;
+	}
+	return(interval);
+}
+
+
+int FrameIndex(double start_ms, double frame_ms)
+{
+	return((int)((GetTimeMs() - start_ms)/frame_ms));
+}
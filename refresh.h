@@ -0,0 +1,42 @@
+/*********************************************************/
+/*                                                       */
+/* Display refresh calibration and frame-locked timing   */
+/* shared by the stimulus programs                       */
+/*                                                       */
+/* GPL, of course                                        */
+/*                                                       */
+/*********************************************************/
+
+#ifndef REFRESH_H
+#define REFRESH_H
+
+#include "SDL.h"
+
+/* number of flips timed to measure the refresh period */
+#define CALIBRATION_FLIPS 60
+
+/* assumed frame period if the flips are not synced to the display */
+#define FALLBACK_FRAME_MS (1000.0/60.0)
+
+/* high resolution time in ms */
+double GetTimeMs(void);
+
+/* measure the flip period of a double buffered or OpenGL screen in ms */
+double CalibrateRefresh(SDL_Surface *screen, int nflips);
+
+/* frame period from a -refresh rate in Hz or by calibration */
+double FramePeriod(SDL_Surface *screen, double rate);
+
+/* round a duration in ms to whole frames, warns about what if inexact */
+int FramesFor(double ms, double frame_ms, const char *what);
+
+/* warn if a temporal frequency cannot be shown exactly */
+void CheckFrequency(const char *what, double requested, double shown);
+
+/* timer interval which samples every frame at least once */
+Uint32 FrameTimerInterval(double frame_ms);
+
+/* number of whole frames since start_ms */
+int FrameIndex(double start_ms, double frame_ms);
+
+#endif
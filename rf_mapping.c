@@ -16,10 +16,15 @@
 #include <math.h>
 
 #include "SDL.h"
+#include "refresh.h"
+#include "waveform.h"
+#include "pixels.h"
+#include "trace.h"
+#include "perfcount.h"
+#include "syncpatch.h"
 
 /* default parameters */
 #define DIAMETER 20
-#define REFRESHRATE 30
 #define FREQUENCY 0
 
 /* 8 Bit Graphics */
@@ -40,7 +45,10 @@ SDL_PixelFormat *fmt;
 /* back/fore color */
 int back, fore;
 
-SDL_Event redrawEvent;
+SDL_Event redrawEvent, moveEvent;
+PerfCounters perf;
+SyncPatch syncpatch;
+PixelWriter pw;
 
 SDL_Surface *CreateScreen(Uint16 w, Uint16 h, Uint8 bpp, Uint32 flags)
 {
@@ -83,7 +91,7 @@ int FilterEvents(const SDL_Event *event) {
       spot.y = event->motion.y;
       SDL_UnlockSurface(screen);
       /* no update here, emit user event instead */
-      SDL_PushEvent(&redrawEvent);
+      SDL_PushEvent(&moveEvent);
       return(0);  
     }
     return(1);
@@ -91,6 +99,7 @@ int FilterEvents(const SDL_Event *event) {
 
 Uint32 refreshTimer(Uint32 interval, void *params)
 {
+	TRACE_INSTANT("timer");
         SDL_PushEvent(&redrawEvent);
 	return interval;
 }
@@ -102,11 +111,16 @@ int main(int argc, char *argv[])
 	Uint32 videoflags;
 	SDL_TimerID refreshTimerID;
 	SDL_Event event;
-	int width, height, bpp, refresh;
+	int width, height, bpp;
 	int done;
 	Uint8 *buffp;
-	Uint32 startTimer, runTimer;
 	int i, j;
+	double rate, frame_ms, start_ms;
+	int half, state, laststate, frame;
+	Waveform wave;
+	double *m;
+	Uint32 *wavepixel, pixel;
+	int usewave, nwave, l;
 
 	/* Initialize SDL */
 	if ( SDL_Init(SDL_INIT_VIDEO|SDL_INIT_TIMER) < 0 ) {
@@ -121,8 +135,12 @@ int main(int argc, char *argv[])
 	bpp = 32;
 	back = 0;
 	fore = 255;
-	refresh = REFRESHRATE;
 	frequency = FREQUENCY;
+	rate = 0;
+	usewave = 0;
+	wave.duration = WAVE_DURATION;
+	wave.f1 = 0;
+	wave.seed = 1;
 
 	videoflags =  SDL_DOUBLEBUF|SDL_FULLSCREEN;
 
@@ -130,6 +148,8 @@ int main(int argc, char *argv[])
 	redrawEvent.user.code = 1;
 	redrawEvent.user.data1 = NULL;
 	redrawEvent.user.data2 = NULL;
+	moveEvent = redrawEvent;
+	moveEvent.user.code = 2;
 
 	while ( argc > 1 ) {
 	  --argc;
@@ -152,9 +172,28 @@ int main(int argc, char *argv[])
 	  } else if ( argv[argc-1] && (strcmp(argv[argc-1], "-freq") == 0) ) {
 	    frequency = atof(argv[argc]);
 	    --argc;
+	  } else if ( argv[argc-1] && (strcmp(argv[argc-1], "-wave") == 0) ) {
+	    wave.type = ParseWaveform(argv[argc]);
+	    usewave = 1;
+	    --argc;
+	  } else if ( argv[argc-1] && (strcmp(argv[argc-1], "-duration") == 0) ) {
+	    wave.duration = atof(argv[argc]);
+	    --argc;
+	  } else if ( argv[argc-1] && (strcmp(argv[argc-1], "-f1") == 0) ) {
+	    wave.f1 = atof(argv[argc]);
+	    --argc;
+	  } else if ( argv[argc-1] && (strcmp(argv[argc-1], "-seed") == 0) ) {
+	    wave.seed = (Uint32)strtoul(argv[argc], NULL, 0);
+	    --argc;
 	  } else if ( argv[argc-1] && (strcmp(argv[argc-1], "-bpp") == 0) ) {
 	    bpp = atoi(argv[argc]);
 	    --argc;
+	  } else if ( argv[argc-1] && (strcmp(argv[argc-1], "-refresh") == 0) ) {
+	    rate = atof(argv[argc]);
+	    --argc;
+	  } else if ( argv[argc-1] && (strcmp(argv[argc-1], "-sync") == 0) ) {
+	    OpenSyncPatch(&syncpatch, argv[argc]);
+	    --argc;
 	  } else if ( argv[argc] && (strcmp(argv[argc], "-sw") == 0) ) {
 	    videoflags |= SDL_SWSURFACE;
 	  } else if ( argv[argc] && (strcmp(argv[argc], "-i") == 0) ) {
@@ -166,13 +205,23 @@ int main(int argc, char *argv[])
 	    videoflags |= SDL_HWPALETTE;
 	  } else if ( argv[argc] && (strcmp(argv[argc], "-window") == 0) ) {
 	    videoflags ^= SDL_FULLSCREEN;
+	  } else if ( argv[argc] && (strcmp(argv[argc], "-perf") == 0) ) {
+	    PerfOpen(&perf);
 	  } else 
 	    {
-	      fprintf(stderr, "Usage: %s [-window] [-bpp #] [-w #] [-h #] [-diam #] [-sw #] [-sh #] [-i] [-freq #]\n", argv[0]);
+	      fprintf(stderr, "Usage: %s [-window] [-bpp #] [-w #] [-h #] [-diam #] [-sw #] [-sh #] [-i] [-freq #] [-wave square|sine|sawtooth|chirp|noise] [-duration #] [-f1 #] [-seed #] [-refresh #] [-perf] [-sync luminance|binary]\n"
+		      "-freq and -f1 are reversals per second, two per cycle of any -wave\n", argv[0]);
 	      exit(1);
 	    }
 	}
 
+	/* without a frequency a periodic wave would be a steady gray */
+	if ( usewave && wave.type >= 0 && wave.type != WAVE_NOISE && !(frequency > 0) &&
+	     !(wave.type == WAVE_CHIRP && wave.f1 > 0) ) {
+	  fprintf(stderr, "-wave square, sine and sawtooth need -freq above 0, chirp -freq or -f1\n");
+	  exit(1);
+	}
+
 	spot.w = sw;
 	spot.h = sh;
 	
@@ -181,15 +230,45 @@ int main(int argc, char *argv[])
 	if ( screen == NULL ) {
 		exit(2);
 	}
+	if ( syncpatch.code != SYNC_NONE && !InitPixelWriter(&pw, screen->format) ) {
+		exit(2);
+	}
+
+	/* flash on whole frames, frequency 0 is a steady spot */
+	frame_ms = FramePeriod(screen, rate);
+	half = 0;
+	if ( frequency > 0 && !usewave ) {
+	  half = FramesFor(1000/frequency, frame_ms, "reversal period");
+	}
+
+	/* a waveform runs between back and fore, one pixel value per
+	   frame. -freq and -f1 count reversals as in flashing_checker */
+	if ( usewave ) {
+	  wave.frequency = frequency/2;
+	  wave.f1 /= 2;
+	  m = SampleWaveform(&wave, frame_ms, &nwave);
+	  if ( m == NULL ) {
+	    exit(1);
+	  }
+	  wavepixel = (Uint32 *)malloc(nwave*sizeof(Uint32));
+	  for ( i=0; i<nwave; i++ ) {
+	    l = (int)floor(back + (fore - back)*(m[i] + 1)/2 + 0.5);
+	    wavepixel[i] = SDL_MapRGB(fmt, l, l, l);
+	  }
+	  free(m);
+	}
 
 	SDL_SetEventFilter(FilterEvents);
 	SDL_ShowCursor(SDL_DISABLE);
 
-	refreshTimerID = SDL_AddTimer((int)(refresh), refreshTimer, (void *)screen);
-	runTimer = SDL_GetTicks();
+	refreshTimerID = SDL_AddTimer(FrameTimerInterval(frame_ms), refreshTimer, (void *)screen);
+	start_ms = GetTimeMs();
+	laststate = -1;
 
 	done = 0;
+	TRACE_BEGIN("wait");
 	while ( !done && SDL_WaitEvent(&event) ) {
+	  TRACE_END("wait");
 	  switch (event.type) {
 	  case SDL_KEYDOWN:
 	    /* Ignore ALT-TAB */
@@ -201,20 +280,50 @@ int main(int argc, char *argv[])
 	    done = 1;
 	    break;
 	  case SDL_USEREVENT:
-	    runTimer = SDL_GetTicks();
+	    /* redraw when the spot has moved or the flash phase changed,
+	       a waveform changes the spot on every frame */
+	    frame = FrameIndex(start_ms, frame_ms);
+	    state = 0;
+	    if ( usewave ) {
+	      state = frame;
+	    } else if ( half > 0 ) {
+	      state = (frame/half)%2;
+	    }
+	    if ( event.user.code == 1 && state == laststate ) {
+	      break;
+	    }
+	    laststate = state;
+	    if ( usewave ) {
+	      pixel = wavepixel[frame%nwave];
+	    } else if ( state == 0 ) {
+	      pixel = SDL_MapRGB(fmt, fore, fore, fore);
+	    } else {
+	      pixel = SDL_MapRGB(fmt, back, back, back);
+	    }
+	    TRACE_BEGIN("lock");
 	    SDL_LockSurface(screen);
-	    if((int)(runTimer/(500/frequency))%2 == 0) 
-	      SDL_FillRect(screen, &spot,  SDL_MapRGB(fmt, fore, fore, fore));
-	    else
-	      SDL_FillRect(screen, &spot,  SDL_MapRGB(fmt, back, back, back));
+	    TRACE_END("lock");
+	    TRACE_BEGIN("draw");
+	    PerfBegin(&perf);
+	    SDL_FillRect(screen, &spot, pixel);
 	    SDL_UnlockSurface(screen);
+	    PerfEnd(&perf);
+	    TRACE_END("draw");
+	    ShowSyncPatch(&syncpatch, screen, &pw);
+	    TRACE_BEGIN("update");
 	    SDL_UpdateRect(screen, 0, 0, 0, 0);
+	    TRACE_END("update");
+	    SyncPresented(&syncpatch, frame);
 	    break;
 	  default:
 	    break;
 	  }
+	  TRACE_BEGIN("wait");
 	}
+	TRACE_END("wait");
 	SDL_ShowCursor(SDL_ENABLE);
+	CloseSyncPatch(&syncpatch);
+	PerfReport(&perf);
 	SDL_Quit();
 	return(0);	
 }
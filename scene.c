@@ -0,0 +1,242 @@
+/*********************************************************/
+/*                                                       */
+/* A stack of stimulus layers composited only where      */
+/* something changed since a page was last drawn         */
+/*                                                       */
+/* GPL, of course                                        */
+/*                                                       */
+/*********************************************************/
+
+/* Every layer is an opaque rectangle. A layer which changes marks
+   where it was and where it is now as damaged on every page, and a
+   page recomposites just its damaged rectangles, from the topmost
+   layer covering a whole rectangle upwards, since nothing below it
+   can show. Static layers are rendered once into a surface of the
+   screen format and copied row by row, dynamic ones draw themselves
+   into the rectangle. Overlapping damage is merged into its bounding
+   box when that is no larger than the two rectangles, like the old
+   and new place of a moving bar, otherwise the overlap is simply
+   composited twice. */
+
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "SDL.h"
+#include "scene.h"
+
+
+/* the overlap of a and b in c, returns 0 if they do not overlap */
+static int Intersect(const SDL_Rect *a, const SDL_Rect *b, SDL_Rect *c)
+{
+	int x0, y0, x1, y1;
+
+	x0 = a->x > b->x ? a->x : b->x;
+	y0 = a->y > b->y ? a->y : b->y;
+	x1 = a->x + a->w < b->x + b->w ? a->x + a->w : b->x + b->w;
+	y1 = a->y + a->h < b->y + b->h ? a->y + a->h : b->y + b->h;
+	if ( x1 <= x0 || y1 <= y0 ) {
+		return(0);
+	}
+	c->x = x0;
+	c->y = y0;
+	c->w = x1 - x0;
+	c->h = y1 - y0;
+	return(1);
+}
+
+
+/* the bounding box of a and b in a */
+static void Union(SDL_Rect *a, const SDL_Rect *b)
+{
+	int x0, y0, x1, y1;
+
+	x0 = a->x < b->x ? a->x : b->x;
+	y0 = a->y < b->y ? a->y : b->y;
+	x1 = a->x + a->w > b->x + b->w ? a->x + a->w : b->x + b->w;
+	y1 = a->y + a->h > b->y + b->h ? a->y + a->h : b->y + b->h;
+	a->x = x0;
+	a->y = y0;
+	a->w = x1 - x0;
+	a->h = y1 - y0;
+}
+
+
+static int Contains(const SDL_Rect *a, const SDL_Rect *b)
+{
+	return( b->x >= a->x && b->y >= a->y &&
+		b->x + b->w <= a->x + a->w && b->y + b->h <= a->y + a->h );
+}
+
+
+void InitScene(Scene *s, SDL_Surface *screen, int pages)
+{
+	s->nlayers = 0;
+	s->w = screen->w;
+	s->h = screen->h;
+	s->bpp = screen->format->BytesPerPixel;
+	s->pages = pages;
+	s->ndamage[0] = s->ndamage[1] = 0;
+	s->touched = 0;
+}
+
+
+int AddLayer(Scene *s, Layer *l)
+{
+	if ( s->nlayers == MAX_LAYERS ) {
+		fprintf(stderr, "A scene holds at most %d layers\n", MAX_LAYERS);
+		return(0);
+	}
+	l->cache = NULL;
+	s->layer[s->nlayers++] = l;
+	return(1);
+}
+
+
+int CacheLayers(Scene *s, SDL_Surface *screen)
+{
+	SDL_PixelFormat *fmt;
+	SDL_Rect full;
+	Layer *l;
+	int i;
+
+	fmt = screen->format;
+	full.x = full.y = 0;
+	full.w = s->w;
+	full.h = s->h;
+	for ( i=0; i<s->nlayers; i++ ) {
+		l = s->layer[i];
+		if ( l->dynamic ) {
+			continue;
+		}
+		/* static layers do not move, only their visible part is kept */
+		if ( !Intersect(&l->rect, &full, &l->rect) ) {
+			l->rect.w = l->rect.h = 0;
+			continue;
+		}
+		l->cache = SDL_CreateRGBSurface(SDL_SWSURFACE, l->rect.w, l->rect.h,
+						fmt->BitsPerPixel, fmt->Rmask, fmt->Gmask,
+						fmt->Bmask, fmt->Amask);
+		if ( l->cache == NULL ) {
+			fprintf(stderr, "Couldn't create layer cache: %s\n", SDL_GetError());
+			return(0);
+		}
+		SDL_LockSurface(l->cache);
+		l->draw(l, (Uint8 *)l->cache->pixels, l->cache->pitch, &l->rect);
+		SDL_UnlockSurface(l->cache);
+	}
+	DamageScene(s, &full);
+	return(1);
+}
+
+
+/* add r to the damage of a page, merging it with what it overlaps
+   if that does not add pixels */
+static void AddDamage(Scene *s, int page, SDL_Rect r)
+{
+	SDL_Rect *d, c, u;
+	int i;
+
+	d = s->damage[page];
+	i = 0;
+	while ( i < s->ndamage[page] ) {
+		u = r;
+		Union(&u, &d[i]);
+		if ( Intersect(&d[i], &r, &c) &&
+		     (long)u.w*u.h <= (long)r.w*r.h + (long)d[i].w*d[i].h ) {
+			r = u;
+			d[i] = d[--s->ndamage[page]];
+			i = 0;
+		} else {
+			i++;
+		}
+	}
+	if ( s->ndamage[page] == MAX_DAMAGE ) {
+		for ( i=0; i<MAX_DAMAGE; i++ ) {
+			Union(&r, &d[i]);
+		}
+		s->ndamage[page] = 0;
+	}
+	d[s->ndamage[page]++] = r;
+}
+
+
+void DamageScene(Scene *s, const SDL_Rect *r)
+{
+	SDL_Rect full, c;
+	int page;
+
+	full.x = full.y = 0;
+	full.w = s->w;
+	full.h = s->h;
+	if ( !Intersect(r, &full, &c) ) {
+		return;
+	}
+	for ( page=0; page<s->pages; page++ ) {
+		AddDamage(s, page, c);
+	}
+}
+
+
+void UpdateScene(Scene *s, int frame)
+{
+	SDL_Rect old;
+	Layer *l;
+	int i;
+
+	for ( i=0; i<s->nlayers; i++ ) {
+		l = s->layer[i];
+		if ( l->update == NULL ) {
+			continue;
+		}
+		old = l->rect;
+		if ( l->update(l, frame) ) {
+			DamageScene(s, &old);
+			DamageScene(s, &l->rect);
+		}
+	}
+}
+
+
+int DrawScene(Scene *s, SDL_Surface *screen, int page, SDL_Rect *rects)
+{
+	SDL_Rect *d, c;
+	Layer *l;
+	Uint8 *dst, *src;
+	int i, j, y, n;
+
+	s->touched = 0;
+	d = s->damage[page];
+	n = s->ndamage[page];
+	for ( i=0; i<n; i++ ) {
+		/* the topmost layer covering the whole rectangle hides the rest */
+		for ( j=s->nlayers-1; j>0; j-- ) {
+			if ( Contains(&s->layer[j]->rect, &d[i]) ) {
+				break;
+			}
+		}
+		for ( ; j<s->nlayers; j++ ) {
+			l = s->layer[j];
+			if ( !Intersect(&l->rect, &d[i], &c) ) {
+				continue;
+			}
+			dst = (Uint8 *)screen->pixels + c.y*screen->pitch + c.x*s->bpp;
+			if ( l->dynamic ) {
+				l->draw(l, dst, screen->pitch, &c);
+			} else {
+				src = (Uint8 *)l->cache->pixels + (c.y - l->rect.y)*l->cache->pitch +
+					(c.x - l->rect.x)*s->bpp;
+				for ( y=0; y<c.h; y++ ) {
+					memcpy(dst, src, c.w*s->bpp);
+					dst += screen->pitch;
+					src += l->cache->pitch;
+				}
+			}
+			s->touched += (long)c.w*c.h;
+		}
+		rects[i] = d[i];
+	}
+	s->ndamage[page] = 0;
+	return(n);
+}
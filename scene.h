@@ -0,0 +1,65 @@
+/*********************************************************/
+/*                                                       */
+/* A stack of stimulus layers composited only where      */
+/* something changed since a page was last drawn         */
+/*                                                       */
+/* GPL, of course                                        */
+/*                                                       */
+/*********************************************************/
+
+#ifndef SCENE_H
+#define SCENE_H
+
+#include "SDL.h"
+
+#define MAX_LAYERS 16
+
+/* damaged rectangles kept per page before they are merged into one */
+#define MAX_DAMAGE 32
+
+typedef struct Layer Layer;
+
+struct Layer {
+	SDL_Rect rect;		/* what the layer covers, opaque, in screen pixels */
+	int dynamic;		/* drawn whenever composited, else from the cache */
+	/* move or change the layer for a frame, returns 1 if it did */
+	int (*update)(Layer *l, int frame);
+	/* draw the part clip of the layer, dst points at the top left
+	   pixel of clip in rows pitch bytes apart */
+	void (*draw)(Layer *l, Uint8 *dst, int pitch, const SDL_Rect *clip);
+	void *data;		/* of the kind of layer */
+	SDL_Surface *cache;	/* static layers rendered once */
+};
+
+typedef struct {
+	int nlayers;
+	Layer *layer[MAX_LAYERS];	/* bottom first */
+	int w, h, bpp;
+	int pages;
+	int ndamage[2];
+	SDL_Rect damage[2][MAX_DAMAGE];	/* to redraw on each page */
+	long touched;			/* pixels written by the last DrawScene */
+} Scene;
+
+/* an empty scene on screen, pages is 2 with page flipping */
+void InitScene(Scene *s, SDL_Surface *screen, int pages);
+
+/* put a layer on top of the others, returns 0 if there are too many */
+int AddLayer(Scene *s, Layer *l);
+
+/* render the static layers into their caches and mark the whole
+   screen for drawing, returns 0 on error */
+int CacheLayers(Scene *s, SDL_Surface *screen);
+
+/* mark r for redrawing on every page */
+void DamageScene(Scene *s, const SDL_Rect *r);
+
+/* update all layers for a frame, marking where they were and where
+   they are now if they changed */
+void UpdateScene(Scene *s, int frame);
+
+/* recomposite the damage of a page into the locked screen, copies
+   the rectangles drawn to rects and returns their number */
+int DrawScene(Scene *s, SDL_Surface *screen, int page, SDL_Rect *rects);
+
+#endif
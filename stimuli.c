@@ -0,0 +1,179 @@
+/*********************************************************/
+/*                                                       */
+/* The drawing steps of the classic stimuli, shared by   */
+/* the programs and the microbenchmarks                  */
+/*                                                       */
+/* GPL, of course                                        */
+/*                                                       */
+/*********************************************************/
+
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+
+#include "SDL.h"
+#include "pixels.h"
+#include "kernels.h"
+#include "calibration.h"
+#include "stimuli.h"
+
+
+/* modulation of pixel i of the grating table */
+static double GratingModulation(int i, double period, int bar)
+{
+	if ( bar ) {
+		return(((i%((int)period))==0) ? 1 : -1);
+	}
+	return(sin((float)i/period*(2*M_PI)));
+}
+
+
+void GratingTable(Uint8 *c, const PixelWriter *pw, int n, double period, int bar,
+		  double mean, double contrast, float *value)
+{
+	Uint8 *levels;
+	double m;
+	int i;
+
+	levels = (Uint8 *)malloc(n);
+	for ( i=0; i<n; i++ ) {
+		m = GratingModulation(i, period, bar);
+		levels[i] = ModulatedLevel(mean, contrast, m);
+		if ( value != NULL ) {
+			value[i] = ModulatedValue(mean, contrast, m);
+		}
+	}
+	pw->row(c, levels, n, pw->map);
+	free(levels);
+}
+
+
+/* The levels of each channel are worked out once, the interleaving
+   into pixels is the only step more than for gray. */
+void ColourGratingTable(Uint8 *c, const PixelWriter *pw, int n, double period, int bar,
+			double mean, double contrast, const double *rgb, float **value)
+{
+	Uint8 *levels[3];
+	double m;
+	int i, k;
+
+	for ( k=RED; k<=BLUE; k++ ) {
+		levels[k] = (Uint8 *)malloc(n);
+	}
+	for ( i=0; i<n; i++ ) {
+		m = GratingModulation(i, period, bar);
+		for ( k=RED; k<=BLUE; k++ ) {
+			levels[k][i] = ModulatedLevel(mean, contrast*rgb[k], m);
+			if ( value != NULL ) {
+				value[k][i] = ModulatedValue(mean, contrast*rgb[k], m);
+			}
+		}
+	}
+	pw->colour(pw, c, levels, n);
+	for ( k=RED; k<=BLUE; k++ ) {
+		free(levels[k]);
+	}
+}
+
+
+void MachBandTable(Uint8 *c, const PixelWriter *pw, int w, int num,
+		   double mean, double contrast)
+{
+	Uint8 *levels;
+	int i;
+
+	levels = (Uint8 *)malloc(w);
+	for ( i=0; i<w; i++ ) {
+		levels[i] = ModulatedLevel(mean, contrast, 2.0*(i/(w/num))/(num-1) - 1);
+	}
+	pw->row(c, levels, w, pw->map);
+	pw->row(c + w*pw->bpp, levels, w, pw->map);
+	free(levels);
+}
+
+
+/* The board has only two kinds of rows, one the inverse of the
+   other. Both are rendered once and copied to every line, so the
+   cost is that of a memcpy of the screen whatever the square size.
+   Squares cut by the screen edges are drawn partially. */
+void DrawChecker(SDL_Surface *buffer, const PixelWriter *pw, double sqsize,
+		 double xoff, double yoff, const Uint32 *pixel)
+{
+	Uint8 *levels, *type, *rows[2];
+	int x, y, r, w, h;
+
+	w = buffer->w;
+	h = buffer->h;
+
+	levels = (Uint8 *)malloc(w);
+	type = (Uint8 *)malloc(h);
+	rows[0] = (Uint8 *)malloc(2*w*pw->bpp);
+	rows[1] = rows[0] + w*pw->bpp;
+	for ( r=0; r<2; r++ ) {
+	  for ( x=0; x<w; x++ ) {
+	    levels[x] = ((int)floor((x+xoff)/sqsize) + r) & 1;
+	  }
+	  pw->row(rows[r], levels, w, pixel);
+	}
+	for ( y=0; y<h; y++ ) {
+	  type[y] = (int)floor((y+yoff)/sqsize) & 1;
+	}
+
+	SDL_LockSurface(buffer);
+	ReplicateRows((Uint8 *)buffer->pixels, buffer->pitch, rows, type, w*pw->bpp, h);
+	SDL_UnlockSurface(buffer);
+
+	free(rows[0]);
+	free(type);
+	free(levels);
+}
+
+
+/* is coordinate x, shifted by off, inside a square rather than a gap */
+static int InSquare(int x, double off, double sqsize, double gapsize)
+{
+	double cellsize, q;
+
+	cellsize = sqsize + gapsize;
+	q = x + off;
+	q = q - floor(q/cellsize)*cellsize - floor(gapsize/2);
+	return( q >= 0 && q < sqsize );
+}
+
+
+/* The grid has only two kinds of rows, blank ones in the gaps and
+   ones crossing a row of squares. Both are rendered once and copied
+   to every line. Squares cut by the screen edges are drawn partially. */
+void DrawHermanGrid(SDL_Surface *buffer, const PixelWriter *pw, double sqsize,
+		    double gapsize, double xoff, double yoff, const Uint32 *pixel)
+{
+	Uint8 *levels, *type, *rows[2];
+	int x, y, w, h;
+
+	w = buffer->w;
+	h = buffer->h;
+
+	levels = (Uint8 *)malloc(w);
+	type = (Uint8 *)malloc(h);
+	rows[0] = (Uint8 *)malloc(2*w*pw->bpp);
+	rows[1] = rows[0] + w*pw->bpp;
+	memset(levels, 0, w);
+	pw->row(rows[0], levels, w, pixel);
+	for ( x=0; x<w; x++ ) {
+	  levels[x] = InSquare(x, xoff, sqsize, gapsize);
+	}
+	pw->row(rows[1], levels, w, pixel);
+	for ( y=0; y<h; y++ ) {
+	  type[y] = InSquare(y, yoff, sqsize, gapsize);
+	}
+
+	SDL_LockSurface(buffer);
+	ReplicateRows((Uint8 *)buffer->pixels, buffer->pitch, rows, type, w*pw->bpp, h);
+	SDL_UnlockSurface(buffer);
+
+	free(rows[0]);
+	free(type);
+	free(levels);
+}
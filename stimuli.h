@@ -0,0 +1,44 @@
+/*********************************************************/
+/*                                                       */
+/* The drawing steps of the classic stimuli, shared by   */
+/* the programs and the microbenchmarks                  */
+/*                                                       */
+/* GPL, of course                                        */
+/*                                                       */
+/*********************************************************/
+
+#ifndef STIMULI_H
+#define STIMULI_H
+
+#include "SDL.h"
+#include "pixels.h"
+
+/* the row table of moving_grating: n pixels of a sine grating, or of
+   one pixel bars if bar, of period pixels around mean in the format
+   of pw. The fractional levels go to value unless it is NULL. */
+void GratingTable(Uint8 *c, const PixelWriter *pw, int n, double period, int bar,
+		  double mean, double contrast, float *value);
+
+/* the same in colour, each channel modulated with contrast times its
+   entry of rgb, the direction of colour.h. The fractional levels go to
+   value[RED] and so on unless value is NULL. Not for 8 bit surfaces. */
+void ColourGratingTable(Uint8 *c, const PixelWriter *pw, int n, double period, int bar,
+			double mean, double contrast, const double *rgb, float **value);
+
+/* the row table of moving_mach_bands: num equal steps in luminance
+   across w pixels, written twice */
+void MachBandTable(Uint8 *c, const PixelWriter *pw, int w, int num,
+		   double mean, double contrast);
+
+/* a checker board of squares of sqsize shifted by xoff, yoff, the
+   square in the top left corner gets pixel[0], its neighbours
+   pixel[1] */
+void DrawChecker(SDL_Surface *buffer, const PixelWriter *pw, double sqsize,
+		 double xoff, double yoff, const Uint32 *pixel);
+
+/* a herman grid of squares of sqsize with gaps of gapsize shifted by
+   xoff, yoff, the gaps get pixel[0], the squares pixel[1] */
+void DrawHermanGrid(SDL_Surface *buffer, const PixelWriter *pw, double sqsize,
+		    double gapsize, double xoff, double yoff, const Uint32 *pixel);
+
+#endif
@@ -0,0 +1,722 @@
+/*********************************************************/
+/*                                                       */
+/* Matches a photodiode trace of the sync patch with the */
+/* log of presented frames and reports dropped and       */
+/* duplicated frames, or makes such a trace from a log   */
+/*                                                       */
+/* GPL, of course                                        */
+/*                                                       */
+/*********************************************************/
+
+/* The trace has one sample per line, the time in ms followed by one
+   value per photodiode, lines starting with # are comments. The
+   levels of the patch are found by clustering the values of each
+   photodiode, so neither the gamma of the display nor the gain of the
+   diode matter. Every frame of the log is then looked for in the
+   trace: a frame which never shows up was dropped, one shown for more
+   refreshes than the log gives it was duplicated. The clocks of the
+   trace and the log are aligned on the frames themselves, -offset
+   gives the trace time of log time 0 when they are linked, so that
+   the latency of the display can be reported. */
+
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+
+#include "SDL.h"
+#include "syncpatch.h"
+
+/* what became of a logged frame */
+#define SHOWN      0
+#define DROPPED    1
+#define UNRECORDED 2	/* outside the trace */
+
+/* runs of one symbol shorter than this fraction of a frame are edges */
+#define MIN_RUN 0.25
+
+/* the trace is averaged over this fraction of a frame */
+#define SMOOTH 0.125
+
+/* logged frames scored for each alignment, near it and at the ends */
+#define LOCAL_SCORE 64
+
+/* share of the timing error of each frame taken into the alignment */
+#define DRIFT_GAIN 0.25
+
+/* samples used to find the levels of the patch */
+#define MAX_FIT 100000
+
+/* the synthesized photodiode, gamma and time constant in ms */
+#define SYNTH_GAMMA 2.2
+#define SYNTH_TAU 0.5
+
+typedef struct {
+	long n;			/* presented count */
+	int frame;
+	double t;		/* log time, ms */
+	int symbol;
+	int state;
+	int run;		/* the run showing it */
+} Entry;
+
+typedef struct {
+	int symbol;
+	double onset, end;
+} Run;
+
+int code, nchannels, verbose;
+Entry *entry;
+int nentries;
+double *stime;
+float *svalue;
+int nsamples;
+Run *run;
+int nruns;
+double frame_ms;
+
+
+static void *Grow(void *p, int n, int *size, int elem)
+{
+	if ( n < *size ) {
+		return(p);
+	}
+	*size = *size ? 2*(*size) : 1024;
+	p = realloc(p, (size_t)(*size)*elem);
+	if ( p == NULL ) {
+		fprintf(stderr, "Out of memory\n");
+		exit(2);
+	}
+	return(p);
+}
+
+
+static int CompareDouble(const void *a, const void *b)
+{
+	double x = *(const double *)a, y = *(const double *)b;
+
+	return(x < y ? -1 : x > y);
+}
+
+
+static void ReadLog(const char *filename)
+{
+	FILE *f;
+	char line[256], name[64];
+	Entry *e;
+	int size;
+
+	f = fopen(filename, "r");
+	if ( f == NULL ) {
+		fprintf(stderr, "Couldn't read %s\n", filename);
+		exit(2);
+	}
+	code = SYNC_NONE;
+	size = 0;
+	while ( fgets(line, sizeof(line), f) ) {
+		if ( sscanf(line, "# sync %63s", name) == 1 ) {
+			code = strcmp(name, "binary") == 0 ? SYNC_BINARY : SYNC_LUMINANCE;
+			continue;
+		}
+		if ( line[0] == '#' ) {
+			continue;
+		}
+		entry = (Entry *)Grow(entry, nentries, &size, sizeof(Entry));
+		e = &entry[nentries];
+		if ( sscanf(line, "%ld %d %lf", &e->n, &e->frame, &e->t) == 3 ) {
+			nentries++;
+		}
+	}
+	fclose(f);
+	if ( code == SYNC_NONE || nentries < 2 ) {
+		fprintf(stderr, "%s is not a log of the sync patch\n", filename);
+		exit(1);
+	}
+	nchannels = SyncChannels(code);
+}
+
+
+/* the median period of the logged frames */
+static double LogPeriod(void)
+{
+	double *p, m;
+	int i, n;
+
+	p = (double *)malloc(nentries*sizeof(double));
+	n = 0;
+	for ( i=1; i<nentries; i++ ) {
+		if ( entry[i].frame > entry[i-1].frame ) {
+			p[n++] = (entry[i].t - entry[i-1].t)/(entry[i].frame - entry[i-1].frame);
+		}
+	}
+	if ( n == 0 ) {
+		fprintf(stderr, "The log has no frame period\n");
+		exit(1);
+	}
+	qsort(p, n, sizeof(double), CompareDouble);
+	m = p[n/2];
+	free(p);
+	return(m);
+}
+
+
+static void ReadTrace(const char *filename)
+{
+	FILE *f;
+	char line[1024], *s, *end;
+	int i, size, vsize;
+	double v;
+
+	f = fopen(filename, "r");
+	if ( f == NULL ) {
+		fprintf(stderr, "Couldn't read %s\n", filename);
+		exit(2);
+	}
+	size = vsize = 0;
+	while ( fgets(line, sizeof(line), f) ) {
+		if ( line[0] == '#' ) {
+			continue;
+		}
+		stime = (double *)Grow(stime, nsamples, &size, sizeof(double));
+		stime[nsamples] = strtod(line, &end);
+		if ( end == line ) {
+			continue;
+		}
+		for ( i=0; i<nchannels; i++ ) {
+			s = end;
+			v = strtod(s, &end);
+			if ( end == s ) {
+				fprintf(stderr, "%s needs %d photodiode values per sample\n",
+					filename, nchannels);
+				exit(1);
+			}
+			svalue = (float *)Grow(svalue, nsamples*nchannels + i, &vsize, sizeof(float));
+			svalue[nsamples*nchannels + i] = v;
+		}
+		nsamples++;
+	}
+	fclose(f);
+	if ( nsamples < 2 ) {
+		fprintf(stderr, "%s has no samples\n", filename);
+		exit(1);
+	}
+}
+
+
+/* a moving average centred on each sample against the noise of the
+   photodiode */
+static void Smooth(void)
+{
+	float *v;
+	double sum;
+	int i, c, w, n;
+
+	w = (int)(SMOOTH*frame_ms*(nsamples - 1)/(stime[nsamples-1] - stime[0]))/2;
+	if ( w < 1 ) {
+		return;
+	}
+	v = (float *)malloc(nsamples*sizeof(float));
+	for ( c=0; c<nchannels; c++ ) {
+		sum = 0;
+		n = 0;
+		for ( i=-w; i<nsamples; i++ ) {
+			if ( i + w < nsamples ) {
+				sum += svalue[(i + w)*nchannels + c];
+				n++;
+			}
+			if ( i - w - 1 >= 0 ) {
+				sum -= svalue[(i - w - 1)*nchannels + c];
+				n--;
+			}
+			if ( i >= 0 ) {
+				v[i] = sum/n;
+			}
+		}
+		for ( i=0; i<nsamples; i++ ) {
+			svalue[i*nchannels + c] = v[i];
+		}
+	}
+	free(v);
+}
+
+
+/* the levels of one photodiode by k-means from the 5th to the 95th
+   percentile, in increasing order */
+static void FitLevels(int channel, double *level, int k)
+{
+	double *v, *sum;
+	int *count, i, j, c, n, stride, iter;
+
+	stride = nsamples > MAX_FIT ? nsamples/MAX_FIT + 1 : 1;
+	v = (double *)malloc((nsamples/stride + 1)*sizeof(double));
+	n = 0;
+	for ( i=0; i<nsamples; i+=stride ) {
+		v[n++] = svalue[i*nchannels + channel];
+	}
+	qsort(v, n, sizeof(double), CompareDouble);
+	for ( c=0; c<k; c++ ) {
+		level[c] = v[(int)((0.05 + 0.9*c/(k - 1))*(n - 1))];
+	}
+	sum = (double *)malloc(k*sizeof(double));
+	count = (int *)malloc(k*sizeof(int));
+	for ( iter=0; iter<20; iter++ ) {
+		for ( c=0; c<k; c++ ) {
+			sum[c] = 0;
+			count[c] = 0;
+		}
+		/* sorted values fall into the clusters in order */
+		c = 0;
+		for ( j=0; j<n; j++ ) {
+			while ( c < k-1 && v[j] > (level[c] + level[c+1])/2 ) {
+				c++;
+			}
+			sum[c] += v[j];
+			count[c]++;
+		}
+		for ( c=0; c<k; c++ ) {
+			if ( count[c] > 0 ) {
+				level[c] = sum[c]/count[c];
+			}
+		}
+	}
+	free(count);
+	free(sum);
+	free(v);
+}
+
+
+/* split the trace into runs of one symbol, edges between the levels
+   join the run after them */
+static void FindRuns(void)
+{
+	double level[SYNC_BITS][SYNC_LEVELS], v;
+	int i, c, l, k, symbol, size;
+	Run raw;
+
+	k = code == SYNC_BINARY ? 2 : SYNC_LEVELS;
+	for ( c=0; c<nchannels; c++ ) {
+		FitLevels(c, level[c], k);
+	}
+	size = 0;
+	raw.symbol = -1;
+	raw.onset = stime[0];
+	for ( i=0; i<=nsamples; i++ ) {
+		symbol = -1;
+		if ( i < nsamples ) {
+			symbol = 0;
+			for ( c=0; c<nchannels; c++ ) {
+				v = svalue[i*nchannels + c];
+				for ( l=0; l<k-1 && v > (level[c][l] + level[c][l+1])/2; l++ ) {
+				}
+				symbol += code == SYNC_BINARY ? l << c : l;
+			}
+			if ( symbol == raw.symbol ) {
+				continue;
+			}
+		}
+		raw.end = i < nsamples ? stime[i] : stime[nsamples-1];
+		if ( raw.symbol >= 0 && raw.end - raw.onset >= MIN_RUN*frame_ms ) {
+			if ( nruns > 0 && run[nruns-1].symbol == raw.symbol ) {
+				run[nruns-1].end = raw.end;
+			} else {
+				run = (Run *)Grow(run, nruns, &size, sizeof(Run));
+				if ( nruns > 0 ) {
+					raw.onset = run[nruns-1].end;
+				}
+				run[nruns++] = raw;
+			}
+		}
+		if ( i < nsamples ) {
+			raw.symbol = symbol;
+			raw.onset = stime[i];
+		}
+	}
+}
+
+
+/* the first run starting at or after t */
+static int RunAfter(double t)
+{
+	int lo, hi, m;
+
+	lo = 0;
+	hi = nruns;
+	while ( lo < hi ) {
+		m = (lo + hi)/2;
+		if ( run[m].onset < t ) {
+			lo = m + 1;
+		} else {
+			hi = m;
+		}
+	}
+	return(lo);
+}
+
+
+/* the first logged frame at or after log time t */
+static int EntryAfter(double t)
+{
+	int lo, hi, m;
+
+	lo = 0;
+	hi = nentries;
+	while ( lo < hi ) {
+		m = (lo + hi)/2;
+		if ( entry[m].t < t ) {
+			lo = m + 1;
+		} else {
+			hi = m;
+		}
+	}
+	return(lo);
+}
+
+
+/* of the logged frames from first to last inside the trace, those
+   whose symbol starts within half a frame of their log time plus
+   offset less those for which it does not */
+static int Score(double offset, int first, int last)
+{
+	int i, j, n;
+	double t;
+
+	n = 0;
+	if ( first < 0 ) {
+		first = 0;
+	}
+	if ( last > nentries ) {
+		last = nentries;
+	}
+	for ( i=first; i<last; i++ ) {
+		t = entry[i].t + offset;
+		if ( t < stime[0] || t > stime[nsamples-1] ) {
+			continue;
+		}
+		for ( j=RunAfter(t - frame_ms/2); j<nruns && run[j].onset <= t + frame_ms/2; j++ ) {
+			if ( run[j].symbol == entry[i].symbol ) {
+				break;
+			}
+		}
+		n += j < nruns && run[j].onset <= t + frame_ms/2 ? 1 : -1;
+	}
+	return(n);
+}
+
+
+/* the trace time of log time 0. Every early run is tried against the
+   logged frames with its symbol and scored on the frames following
+   it, some spread over the log and those at its ends; as the code
+   repeats, alignments a whole number of code periods apart only
+   differ at the ends. */
+static double Align(int linked, double clock)
+{
+	double *cand, best, o;
+	int size, ncand, i, j, k, s, bests, ties, period, edge, spread;
+
+	period = SyncSymbols(code);
+	cand = NULL;
+	size = ncand = 0;
+	for ( j=0; j<nruns && j<3*period; j++ ) {
+		for ( i=0; i<nentries; i++ ) {
+			o = run[j].onset - entry[i].t;
+			if ( entry[i].symbol != run[j].symbol || (linked && o < clock) ) {
+				continue;
+			}
+			cand = (double *)Grow(cand, ncand, &size, sizeof(double));
+			cand[ncand++] = o;
+		}
+	}
+	if ( ncand == 0 ) {
+		fprintf(stderr, "No frame of the log is in the trace\n");
+		exit(1);
+	}
+	qsort(cand, ncand, sizeof(double), CompareDouble);
+
+	best = cand[0];
+	bests = 0;
+	ties = 0;
+	edge = 2*period;
+	spread = nentries/LOCAL_SCORE + 1;
+	for ( k=0; k<ncand; k=j ) {
+		/* alignments within a quarter frame are the same */
+		for ( j=k+1; j<ncand && cand[j] - cand[k] < MIN_RUN*frame_ms; j++ ) {
+		}
+		o = cand[(k + j - 1)/2];
+		i = EntryAfter(stime[0] - o);
+		s = Score(o, i, i + LOCAL_SCORE);
+		for ( i=spread/2; i<nentries; i+=spread ) {
+			s += Score(o, i, i + 1);
+		}
+		s += Score(o, 0, edge) + Score(o, nentries - edge, nentries);
+		if ( k == 0 || s > bests ) {
+			bests = s;
+			best = o;
+			ties = 0;
+		} else if ( s == bests ) {
+			ties++;
+		}
+	}
+	free(cand);
+	if ( ties > 0 ) {
+		fprintf(stderr, "The trace matches the log at %d alignments, taking the %s\n",
+			ties + 1, linked ? "shortest latency" : "first");
+	}
+	return(best);
+}
+
+
+/* walk the log, following the drift between the clocks */
+static double Match(double offset)
+{
+	int i, j, last, period;
+	double t, tol;
+
+	period = SyncSymbols(code);
+	tol = period/2*frame_ms;
+	last = -1;
+	for ( i=0; i<nentries; i++ ) {
+		t = entry[i].t + offset;
+		entry[i].run = -1;
+		if ( t < stime[0] || t > stime[nsamples-1] ) {
+			entry[i].state = UNRECORDED;
+			continue;
+		}
+		entry[i].state = DROPPED;
+		for ( j=RunAfter(t - tol); j<nruns && run[j].onset <= t + tol; j++ ) {
+			if ( j > last && run[j].symbol == entry[i].symbol ) {
+				entry[i].state = SHOWN;
+				entry[i].run = j;
+				offset += DRIFT_GAIN*(run[j].onset - t);
+				last = j;
+				break;
+			}
+		}
+	}
+	return(offset);
+}
+
+
+static void Report(int linked, double clock)
+{
+	int i, k, shown, dropped, unrecorded, duplicated, n;
+	double d, sum, sum2;
+
+	shown = dropped = unrecorded = duplicated = 0;
+	sum = sum2 = 0;
+	k = -1;
+	for ( i=0; i<nentries; i++ ) {
+		switch ( entry[i].state ) {
+		case UNRECORDED:
+			unrecorded++;
+			k = -1;
+			continue;
+		case DROPPED:
+			dropped++;
+			if ( verbose ) {
+				printf("dropped %ld frame %d\n", entry[i].n, entry[i].frame);
+			}
+			continue;
+		}
+		shown++;
+		d = run[entry[i].run].onset - entry[i].t;
+		sum += d;
+		sum2 += d*d;
+		/* the refreshes since the last frame shown against those
+		   between their presentations in the log */
+		if ( k >= 0 ) {
+			n = (int)floor((run[entry[i].run].onset - run[entry[k].run].onset)/frame_ms + 0.5)
+				- (int)floor((entry[i].t - entry[k].t)/frame_ms + 0.5);
+			if ( n > 0 ) {
+				duplicated += n;
+				if ( verbose ) {
+					printf("duplicated %ld frame %d, %d more refreshes\n",
+					       entry[k].n, entry[k].frame, n);
+				}
+			}
+		}
+		k = i;
+	}
+	printf("%s code, frame period %.3f ms, %d runs in the trace\n",
+	       code == SYNC_BINARY ? "binary" : "luminance", frame_ms, nruns);
+	printf("logged %d, not recorded %d, shown %d, dropped %d, duplicated %d\n",
+	       nentries, unrecorded, shown, dropped, duplicated);
+	if ( shown > 0 ) {
+		sum /= shown;
+		d = shown > 1 ? sqrt((sum2 - shown*sum*sum)/(shown - 1)) : 0;
+		if ( linked ) {
+			printf("latency %.3f ms, sd %.3f ms\n", sum - clock, d);
+		} else {
+			printf("trace minus log time %.3f ms, sd %.3f ms\n", sum, d);
+		}
+	}
+}
+
+
+/* a trace of a photodiode with a gamma and a time constant watching
+   the frames of the log, with frames dropped and frames shown a
+   refresh late at random. A late frame which meets the next one is
+   never seen. */
+static void Synthesize(const char *filename, double rate, double latency,
+		       double noise, double pdrop, double plate)
+{
+	FILE *f;
+	double t, end, y[SYNC_BITS], target, dt, a, u1, u2;
+	double *onset;
+	int i, c, k, ndropped, nlate, nlost, n;
+
+	onset = (double *)malloc(nentries*sizeof(double));
+	ndropped = nlate = nlost = 0;
+	for ( i=0; i<nentries; i++ ) {
+		onset[i] = entry[i].t + latency;
+		if ( rand() < pdrop*RAND_MAX ) {
+			onset[i] = -1;
+			ndropped++;
+		} else if ( i > 0 && rand() < plate*RAND_MAX ) {
+			onset[i] += frame_ms;
+			nlate++;
+		}
+	}
+	for ( i=nentries-2; i>=0; i-- ) {
+		if ( onset[i] >= 0 && onset[i+1] >= 0 && onset[i+1] - onset[i] < frame_ms/2 ) {
+			onset[i] = -1;
+			nlost++;
+		}
+	}
+
+	f = fopen(filename, "w");
+	if ( f == NULL ) {
+		fprintf(stderr, "Couldn't write %s\n", filename);
+		exit(2);
+	}
+	fprintf(f, "# photodiode trace, %d frames dropped, %d late, %d of them never shown\n",
+		ndropped, nlate, nlost);
+	dt = 1000/rate;
+	a = 1 - exp(-dt/SYNTH_TAU);
+	t = entry[0].t + latency - 10*frame_ms;
+	end = entry[nentries-1].t + latency + 11*frame_ms;
+	for ( c=0; c<nchannels; c++ ) {
+		y[c] = 0.5;
+	}
+	i = k = -1;
+	n = 0;
+	for ( ; t<end; t+=dt ) {
+		/* the last frame shown by now */
+		while ( i+1 < nentries && (onset[i+1] < 0 || onset[i+1] <= t) ) {
+			i++;
+			if ( onset[i] >= 0 ) {
+				k = i;
+			}
+		}
+		fprintf(f, "%.3f", t);
+		for ( c=0; c<nchannels; c++ ) {
+			target = k < 0 ? 0.5
+				: pow(SyncLevel(code, SyncSymbol(code, entry[k].n), c)/(NUM_LEVELS - 1.0), SYNTH_GAMMA);
+			y[c] += a*(target - y[c]);
+			u1 = (rand() + 1.0)/(RAND_MAX + 1.0);
+			u2 = rand()/(RAND_MAX + 1.0);
+			fprintf(f, " %.5f", y[c] + noise*sqrt(-2*log(u1))*cos(2*M_PI*u2));
+		}
+		fprintf(f, "\n");
+		n++;
+	}
+	fclose(f);
+	free(onset);
+	printf("synthesized %d samples, %d frames dropped, %d late, %d of them never shown\n",
+	       n, ndropped, nlate, nlost);
+}
+
+
+int main(int argc, char *argv[])
+{
+	const char *logname, *tracename;
+	double rate, latency, noise, pdrop, plate, clock, offset;
+	int synth, linked, i;
+	unsigned seed;
+
+	logname = SYNC_LOG;
+	tracename = NULL;
+	synth = 0;
+	linked = 0;
+	clock = 0;
+	rate = 10000;
+	latency = 20;
+	noise = 0.01;
+	pdrop = 0;
+	plate = 0;
+	seed = 1;
+	verbose = 0;
+	frame_ms = 0;
+
+	while ( argc > 1 ) {
+	  --argc;
+	  if ( argv[argc-1] && (strcmp(argv[argc-1], "-log") == 0) ) {
+	    logname = argv[argc];
+	    --argc;
+	  } else if ( argv[argc-1] && (strcmp(argv[argc-1], "-trace") == 0) ) {
+	    tracename = argv[argc];
+	    --argc;
+	  } else if ( argv[argc-1] && (strcmp(argv[argc-1], "-period") == 0) ) {
+	    frame_ms = atof(argv[argc]);
+	    --argc;
+	  } else if ( argv[argc-1] && (strcmp(argv[argc-1], "-offset") == 0) ) {
+	    clock = atof(argv[argc]);
+	    linked = 1;
+	    --argc;
+	  } else if ( argv[argc-1] && (strcmp(argv[argc-1], "-rate") == 0) ) {
+	    rate = atof(argv[argc]);
+	    --argc;
+	  } else if ( argv[argc-1] && (strcmp(argv[argc-1], "-latency") == 0) ) {
+	    latency = atof(argv[argc]);
+	    --argc;
+	  } else if ( argv[argc-1] && (strcmp(argv[argc-1], "-noise") == 0) ) {
+	    noise = atof(argv[argc]);
+	    --argc;
+	  } else if ( argv[argc-1] && (strcmp(argv[argc-1], "-drop") == 0) ) {
+	    pdrop = atof(argv[argc]);
+	    --argc;
+	  } else if ( argv[argc-1] && (strcmp(argv[argc-1], "-late") == 0) ) {
+	    plate = atof(argv[argc]);
+	    --argc;
+	  } else if ( argv[argc-1] && (strcmp(argv[argc-1], "-seed") == 0) ) {
+	    seed = (unsigned)strtoul(argv[argc], NULL, 0);
+	    --argc;
+	  } else if ( argv[argc] && (strcmp(argv[argc], "-synth") == 0) ) {
+	    synth = 1;
+	  } else if ( argv[argc] && (strcmp(argv[argc], "-v") == 0) ) {
+	    verbose = 1;
+	  } else
+	    {
+	      fprintf(stderr, "Usage: %s -trace file [-log file] [-period #] [-offset #] [-v]\n"
+		      "       %s -synth -trace file [-log file] [-rate #] [-latency #] [-noise #] [-drop #] [-late #] [-seed #]\n",
+		      argv[0], argv[0]);
+	      exit(1);
+	    }
+	}
+	if ( tracename == NULL ) {
+	  fprintf(stderr, "%s needs -trace\n", argv[0]);
+	  exit(1);
+	}
+
+	ReadLog(logname);
+	if ( frame_ms <= 0 ) {
+	  frame_ms = LogPeriod();
+	}
+	for ( i=0; i<nentries; i++ ) {
+	  entry[i].symbol = SyncSymbol(code, entry[i].n);
+	}
+
+	if ( synth ) {
+	  srand(seed);
+	  Synthesize(tracename, rate, latency, noise, pdrop, plate);
+	  return(0);
+	}
+
+	ReadTrace(tracename);
+	Smooth();
+	FindRuns();
+	offset = Align(linked, clock);
+	Match(offset);
+	Report(linked, clock);
+	return(0);
+}
@@ -0,0 +1,139 @@
+/*********************************************************/
+/*                                                       */
+/* A patch in the corner of the screen coding the frames */
+/* for a photodiode, with a log of when each was shown   */
+/*                                                       */
+/* GPL, of course                                        */
+/*                                                       */
+/*********************************************************/
+
+/* The nth presented frame shows the symbol n modulo the number of
+   symbols of the code, either as one of SYNC_LEVELS gray levels of a
+   single patch or as SYNC_BITS patches, one per photodiode, black or
+   white for the bits of the symbol. A run of missing or repeated
+   frames shorter than the number of symbols is told apart by
+   sync_decode, which matches the photodiode trace with the log
+   written here. */
+
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "SDL.h"
+#include "refresh.h"
+#include "pixels.h"
+#include "kernels.h"
+#include "syncpatch.h"
+
+
+void OpenSyncPatch(SyncPatch *sp, const char *code)
+{
+	const char *name;
+
+	memset(sp, 0, sizeof(*sp));
+	if ( strcmp(code, "luminance") == 0 ) {
+		sp->code = SYNC_LUMINANCE;
+	} else if ( strcmp(code, "binary") == 0 ) {
+		sp->code = SYNC_BINARY;
+	} else {
+		fprintf(stderr, "The sync patch codes are luminance and binary\n");
+		exit(1);
+	}
+	sp->npatches = SyncChannels(sp->code);
+	sp->rect.w = sp->npatches*SYNC_SIZE;
+	sp->rect.h = SYNC_SIZE;
+
+	name = getenv("STIM_SYNCLOG");
+	if ( name == NULL ) {
+		name = SYNC_LOG;
+	}
+	sp->log = fopen(name, "w");
+	if ( sp->log == NULL ) {
+		fprintf(stderr, "Couldn't write %s\n", name);
+		exit(2);
+	}
+	fprintf(sp->log, "# sync %s\n", code);
+}
+
+
+int SyncChannels(int code)
+{
+	return(code == SYNC_BINARY ? SYNC_BITS : 1);
+}
+
+
+int SyncSymbols(int code)
+{
+	return(code == SYNC_BINARY ? 1 << SYNC_BITS : SYNC_LEVELS);
+}
+
+
+int SyncSymbol(int code, long n)
+{
+	return(n%SyncSymbols(code));
+}
+
+
+int SyncLevel(int code, int symbol, int i)
+{
+	if ( code == SYNC_BINARY ) {
+		return(symbol & (1 << i) ? NUM_LEVELS-1 : 0);
+	}
+	return(symbol*(NUM_LEVELS-1)/(SYNC_LEVELS-1));
+}
+
+
+void ShowSyncPatch(SyncPatch *sp, SDL_Surface *screen, const PixelWriter *pw)
+{
+	int i, x, w, h, symbol;
+
+	if ( sp->code == SYNC_NONE ) {
+		return;
+	}
+	symbol = SyncSymbol(sp->code, sp->presented);
+	h = SYNC_SIZE < screen->h ? SYNC_SIZE : screen->h;
+	if ( sp->rect.w > screen->w ) {
+		sp->rect.w = screen->w;
+	}
+	sp->rect.h = h;
+	SDL_LockSurface(screen);
+	for ( i=0; i<sp->npatches; i++ ) {
+		x = i*SYNC_SIZE;
+		w = x + SYNC_SIZE < screen->w ? SYNC_SIZE : screen->w - x;
+		if ( w > 0 ) {
+			FillSolid((Uint8 *)screen->pixels + x*pw->bpp, screen->pitch, w*pw->bpp, h,
+				  pw->map[SyncLevel(sp->code, symbol, i)], pw->bpp);
+		}
+	}
+	SDL_UnlockSurface(screen);
+}
+
+
+int SyncRects(const SyncPatch *sp, SDL_Rect *rects, int n)
+{
+	if ( sp->code != SYNC_NONE ) {
+		rects[n++] = sp->rect;
+	}
+	return(n);
+}
+
+
+void SyncPresented(SyncPatch *sp, int frame)
+{
+	if ( sp->code == SYNC_NONE ) {
+		return;
+	}
+	fprintf(sp->log, "%ld %d %.3f\n", sp->presented, frame, GetTimeMs());
+	sp->presented++;
+}
+
+
+void CloseSyncPatch(SyncPatch *sp)
+{
+	if ( sp->code == SYNC_NONE ) {
+		return;
+	}
+	fclose(sp->log);
+	sp->code = SYNC_NONE;
+}
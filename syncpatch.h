@@ -0,0 +1,64 @@
+/*********************************************************/
+/*                                                       */
+/* A patch in the corner of the screen coding the frames */
+/* for a photodiode, with a log of when each was shown   */
+/*                                                       */
+/* GPL, of course                                        */
+/*                                                       */
+/*********************************************************/
+
+#ifndef SYNCPATCH_H
+#define SYNCPATCH_H
+
+#include <stdio.h>
+
+#include "SDL.h"
+#include "pixels.h"
+
+#define SYNC_NONE      0
+#define SYNC_LUMINANCE 1	/* one patch in SYNC_LEVELS gray levels */
+#define SYNC_BINARY    2	/* SYNC_BITS black or white patches */
+
+#define SYNC_LEVELS 4
+#define SYNC_BITS   4
+
+/* side of a patch in pixels, the patches start at the top left */
+#define SYNC_SIZE 32
+
+/* the log of presented frames, the STIM_SYNCLOG variable overrides it */
+#define SYNC_LOG "sync.log"
+
+typedef struct {
+	int code;		/* SYNC_NONE unless opened */
+	int npatches;
+	SDL_Rect rect;		/* all patches */
+	long presented;		/* frames presented so far */
+	FILE *log;
+} SyncPatch;
+
+/* code is luminance or binary, exits with a message on error */
+void OpenSyncPatch(SyncPatch *sp, const char *code);
+
+/* the symbol of the nth presented frame and the gray level of patch
+   i showing it */
+int SyncSymbols(int code);
+int SyncSymbol(int code, long n);
+int SyncLevel(int code, int symbol, int i);
+
+/* number of patches, or photodiodes, of a code */
+int SyncChannels(int code);
+
+/* draw the patches of the next frame into the screen, just before it
+   is presented */
+void ShowSyncPatch(SyncPatch *sp, SDL_Surface *screen, const PixelWriter *pw);
+
+/* add the patches to the n rectangles passed to SDL_UpdateRects,
+   which need room for one more. Returns the new number. */
+int SyncRects(const SyncPatch *sp, SDL_Rect *rects, int n);
+
+/* log the frame just presented */
+void SyncPresented(SyncPatch *sp, int frame);
+
+void CloseSyncPatch(SyncPatch *sp);
+
+#endif
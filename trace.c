@@ -0,0 +1,177 @@
+/*********************************************************/
+/*                                                       */
+/* Spans of the stages of the main loops, written at     */
+/* exit in the Chrome trace format                       */
+/*                                                       */
+/* GPL, of course                                        */
+/*                                                       */
+/*********************************************************/
+
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+#ifndef _WIN32
+#include <unistd.h>
+#endif
+
+#include "SDL.h"
+#include "trace.h"
+
+#ifdef ENABLE_TRACE
+
+typedef struct {
+	const char *name;
+	Uint64 ns;
+	char phase;
+} TraceRecord;
+
+typedef struct TraceChunk {
+	struct TraceChunk *next;
+	volatile int n;
+	TraceRecord record[TRACE_CHUNK];
+} TraceChunk;
+
+/* the events of one thread, only ever appended to by that thread */
+typedef struct TraceBuffer {
+	struct TraceBuffer *next;
+	int tid;
+	TraceChunk *first, *last;
+} TraceBuffer;
+
+static TraceBuffer *volatile threads;
+static volatile int nthreads;
+static volatile int started;
+static Uint64 start_ns;
+
+/* the buffer of the calling thread */
+static __thread TraceBuffer *own;
+
+
+static Uint64 TraceNow(void)
+{
+#ifdef _WIN32
+	return((Uint64)SDL_GetTicks()*1000000);
+#else
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return((Uint64)ts.tv_sec*1000000000 + ts.tv_nsec);
+#endif
+}
+
+
+static TraceChunk *NewChunk(void)
+{
+	TraceChunk *c;
+
+	c = (TraceChunk *)malloc(sizeof(TraceChunk));
+	if ( c == NULL ) {
+		fprintf(stderr, "Out of memory for the trace\n");
+		exit(2);
+	}
+	c->next = NULL;
+	c->n = 0;
+	return(c);
+}
+
+
+/* write the events of all threads, the threads still running may
+   add more meanwhile but only the complete ones are counted */
+static void WriteTrace(void)
+{
+	const char *filename;
+	TraceBuffer *b;
+	TraceChunk *c;
+	TraceRecord *r;
+	FILE *fp;
+	long nevents;
+	int pid, i, n;
+
+	filename = getenv("STIM_TRACE");
+	if ( filename == NULL ) {
+		filename = TRACE_FILE;
+	}
+	fp = fopen(filename, "w");
+	if ( fp == NULL ) {
+		fprintf(stderr, "Couldn't write trace %s\n", filename);
+		return;
+	}
+#ifdef _WIN32
+	pid = 1;
+#else
+	pid = getpid();
+#endif
+	nevents = 0;
+	fprintf(fp, "{\"displayTimeUnit\":\"ns\",\"traceEvents\":[\n");
+	for ( b=threads; b; b=b->next ) {
+		fprintf(fp, "%s{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":%d,\"tid\":%d,"
+			"\"args\":{\"name\":\"thread %d\"}}", nevents ? ",\n" : "",
+			pid, b->tid, b->tid);
+		nevents++;
+		for ( c=b->first; c; c=c->next ) {
+			n = c->n;
+			__sync_synchronize();
+			for ( i=0; i<n; i++ ) {
+				r = &c->record[i];
+				fprintf(fp, ",\n{\"name\":\"%s\",\"ph\":\"%c\",\"ts\":%.3f,\"pid\":%d,\"tid\":%d%s}",
+					r->name, r->phase, (r->ns - start_ns)/1000.0, pid, b->tid,
+					r->phase == 'i' ? ",\"s\":\"t\"" : "");
+				nevents++;
+			}
+		}
+	}
+	fprintf(fp, "\n]}\n");
+	fclose(fp);
+	fprintf(stderr, "Trace of %ld events written to %s\n", nevents, filename);
+}
+
+
+/* the buffer of a thread at its first event, the first event of all
+   also sets the time origin and the export at exit */
+static TraceBuffer *NewBuffer(void)
+{
+	TraceBuffer *b;
+
+	if ( __sync_bool_compare_and_swap(&started, 0, 1) ) {
+		start_ns = TraceNow();
+		atexit(WriteTrace);
+	}
+	b = (TraceBuffer *)malloc(sizeof(TraceBuffer));
+	if ( b == NULL ) {
+		fprintf(stderr, "Out of memory for the trace\n");
+		exit(2);
+	}
+	b->first = b->last = NewChunk();
+	b->tid = __sync_add_and_fetch(&nthreads, 1);
+	do {
+		b->next = threads;
+	} while ( !__sync_bool_compare_and_swap(&threads, b->next, b) );
+	return(b);
+}
+
+
+void TraceEvent(const char *name, char phase)
+{
+	TraceBuffer *b = own;
+	TraceChunk *c;
+	TraceRecord *r;
+
+	if ( b == NULL ) {
+		b = own = NewBuffer();
+	}
+	c = b->last;
+	if ( c->n == TRACE_CHUNK ) {
+		c->next = NewChunk();
+		c = b->last = c->next;
+	}
+	r = &c->record[c->n];
+	r->name = name;
+	r->phase = phase;
+	r->ns = TraceNow();
+	/* the record is complete before it is counted */
+	__sync_synchronize();
+	c->n++;
+}
+
+#endif
@@ -0,0 +1,40 @@
+/*********************************************************/
+/*                                                       */
+/* Spans of the stages of the main loops, written at     */
+/* exit in the Chrome trace format (chrome://tracing,    */
+/* ui.perfetto.dev). Configure with --enable-trace,      */
+/* otherwise the macros compile to nothing.              */
+/*                                                       */
+/* GPL, of course                                        */
+/*                                                       */
+/*********************************************************/
+
+#ifndef TRACE_H
+#define TRACE_H
+
+/* the file written at exit unless STIM_TRACE names another */
+#define TRACE_FILE "trace.json"
+
+/* events recorded per allocation of a thread's buffer */
+#define TRACE_CHUNK 8192
+
+#ifdef ENABLE_TRACE
+
+/* record an event of the calling thread, phase 'B' begins a span,
+   'E' ends the innermost one, 'i' marks an instant. name must be a
+   string constant. */
+void TraceEvent(const char *name, char phase);
+
+#define TRACE_BEGIN(name)	TraceEvent(name, 'B')
+#define TRACE_END(name)		TraceEvent(name, 'E')
+#define TRACE_INSTANT(name)	TraceEvent(name, 'i')
+
+#else
+
+#define TRACE_BEGIN(name)	((void)0)
+#define TRACE_END(name)		((void)0)
+#define TRACE_INSTANT(name)	((void)0)
+
+#endif
+
+#endif
@@ -0,0 +1,96 @@
+/*********************************************************/
+/*                                                       */
+/* Temporal waveforms of flashing stimuli, sampled once  */
+/* per frame for the whole trial                         */
+/*                                                       */
+/* GPL, of course                                        */
+/*                                                       */
+/*********************************************************/
+
+/* All the work is done before the trial starts: the programs turn
+   the samples into gray levels or pixel values, so a frame costs one
+   table lookup whatever the waveform. */
+
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+
+#include "SDL.h"
+#include "waveform.h"
+
+static const char *names[] = { "square", "sine", "sawtooth", "chirp", "noise" };
+
+
+int ParseWaveform(const char *name)
+{
+	int i;
+
+	for ( i=0; i<(int)(sizeof(names)/sizeof(names[0])); i++ ) {
+		if ( strcmp(name, names[i]) == 0 ) {
+			return(i);
+		}
+	}
+	return(-1);
+}
+
+
+/* uniform in 0..1, never 0, from a xorshift generator */
+static double Uniform(Uint32 *state)
+{
+	*state ^= *state << 13;
+	*state ^= *state >> 17;
+	*state ^= *state << 5;
+	return(((*state >> 8) + 0.5)/16777216.0);
+}
+
+
+double *SampleWaveform(const Waveform *wave, double frame_ms, int *nframes)
+{
+	double *m, t, p, T, u1, u2;
+	Uint32 state;
+	int i, n;
+
+	T = wave->duration;
+	n = (int)floor(T*1000/frame_ms + 0.5);
+	if ( n < 1 || wave->type < 0 || wave->type > WAVE_NOISE ) {
+		fprintf(stderr, "A waveform needs a known shape and a trial of at least one frame\n");
+		return(NULL);
+	}
+	m = (double *)malloc(n*sizeof(double));
+	state = wave->seed ? wave->seed : 1;
+	for ( i=0; i<n; i++ ) {
+		t = i*frame_ms/1000;
+		p = wave->frequency*t;
+		switch ( wave->type ) {
+		case WAVE_SQUARE:
+			m[i] = p - floor(p) < 0.5 ? 1 : -1;
+			break;
+		case WAVE_SINE:
+			m[i] = sin(2*M_PI*p);
+			break;
+		case WAVE_SAWTOOTH:
+			m[i] = 2*(p - floor(p)) - 1;
+			break;
+		case WAVE_CHIRP:
+			/* the frequency rises linearly from frequency to f1 */
+			m[i] = sin(2*M_PI*(p + (wave->f1 - wave->frequency)*t*t/(2*T)));
+			break;
+		default:
+			/* Box-Muller, one sample per frame, the draws in a
+			   fixed order so that a seed gives one sequence */
+			u1 = Uniform(&state);
+			u2 = Uniform(&state);
+			m[i] = sqrt(-2*log(u1))*cos(2*M_PI*u2)/3;
+			if ( m[i] > 1 ) {
+				m[i] = 1;
+			} else if ( m[i] < -1 ) {
+				m[i] = -1;
+			}
+			break;
+		}
+	}
+	*nframes = n;
+	return(m);
+}
@@ -0,0 +1,42 @@
+/*********************************************************/
+/*                                                       */
+/* Temporal waveforms of flashing stimuli, sampled once  */
+/* per frame for the whole trial                         */
+/*                                                       */
+/* GPL, of course                                        */
+/*                                                       */
+/*********************************************************/
+
+#ifndef WAVEFORM_H
+#define WAVEFORM_H
+
+#include "SDL.h"
+
+/* shapes of the time course */
+#define WAVE_SQUARE 0
+#define WAVE_SINE 1
+#define WAVE_SAWTOOTH 2
+#define WAVE_CHIRP 3
+#define WAVE_NOISE 4
+
+/* length of a trial in s if not given */
+#define WAVE_DURATION 10
+
+typedef struct {
+	int type;		/* one of WAVE_* */
+	double frequency;	/* in Hz, where a chirp starts */
+	double f1;		/* where a chirp ends */
+	double duration;	/* of the trial in s, the table repeats after it */
+	Uint32 seed;		/* of the noise */
+} Waveform;
+
+/* the WAVE_* of "square", "sine", "sawtooth", "chirp" or "noise",
+   -1 if unknown */
+int ParseWaveform(const char *name);
+
+/* the modulation -1..1 on every frame of the trial, sampled at the
+   frame period. Noise is Gaussian with a standard deviation of 1/3,
+   clipped at +-1. Returns NULL on error, nframes is the length. */
+double *SampleWaveform(const Waveform *wave, double frame_ms, int *nframes);
+
+#endif